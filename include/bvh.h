@@ -0,0 +1,628 @@
+#ifndef BVH_H
+#define BVH_H
+
+// Binary bounding volume hierarchy over axis aligned boxes, built top-down
+// with binned SAH. Nodes are 32 bytes and laid out so they can be uploaded
+// to an std430 SSBO as is (vec3 + uint, vec3 + uint).
+//
+// A node with count > 0 is a leaf covering prims[left_first .. +count),
+// otherwise its children are nodes left_first and left_first + 1.
+//
+// The build is parallel in two ways. Subtrees of at least BVH_TASK_MIN
+// primitives become tasks on a shared stack that all build threads take
+// from, and nodes of at least BVH_PARALLEL_BINS primitives (the top few
+// levels, where there are fewer tasks than threads) are binned by all
+// threads at once. Children are always allocated after their parent.
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "types.h"
+
+#define BVH_BINS            16
+#define BVH_MAX_LEAF        4       // leaves are only forced above this size
+#define BVH_MAX_DEPTH       64
+#define BVH_COST_TRAVERSAL  1.0f
+#define BVH_COST_INTERSECT  1.0f
+#define BVH_TASK_MIN        4096    // smaller subtrees stay on their thread
+#define BVH_PARALLEL_BINS   131072  // larger nodes are binned by all threads
+#define BVH_MAX_THREADS     64
+#define BVH_REBUILD_RATIO   1.3f    // refit trees are rebuilt once their SAH cost grows this much
+
+typedef struct _TAG_bvh_node
+{
+    f32 min[3];
+    u32 left_first;
+    f32 max[3];
+    u32 count;
+} bvh_node_t;
+
+typedef struct _TAG_bvh_aabb
+{
+    f32 min[3];
+    f32 max[3];
+} bvh_aabb_t;
+
+typedef struct _TAG_bvh
+{
+    bvh_node_t  *nodes;
+    u32         num_nodes;
+    u32         *prims;     // primitive index for every leaf slot
+    u32         num_prims;
+} bvh_t;
+
+void        bvh_build(bvh_t *bvh, bvh_aabb_t *boxes, u32 count, u32 num_threads);
+void        bvh_refit(bvh_t *bvh, bvh_aabb_t *boxes);
+f32         bvh_sah_cost(bvh_t *bvh);
+void        bvh_free(bvh_t *bvh);
+
+void        bvh_aabb_empty(bvh_aabb_t *box);
+void        bvh_aabb_grow(bvh_aabb_t *box, f32 *min, f32 *max);
+f32         bvh_aabb_area(f32 *min, f32 *max);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== BVH IMPLEMENTATION =================================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef BVH_IMPL
+
+void
+bvh_aabb_empty(bvh_aabb_t *box)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        box->min[a] = FLT_MAX;
+        box->max[a] = -FLT_MAX;
+    }
+}
+
+void
+bvh_aabb_grow(bvh_aabb_t *box,
+              f32 *min,
+              f32 *max)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        box->min[a] = (min[a] < box->min[a]) ? min[a] : box->min[a];
+        box->max[a] = (max[a] > box->max[a]) ? max[a] : box->max[a];
+    }
+}
+
+f32
+bvh_aabb_area(f32 *min,
+              f32 *max)
+{
+    f32 dx = max[0] - min[0];
+    f32 dy = max[1] - min[1];
+    f32 dz = max[2] - min[2];
+
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+        return 0.0f;
+
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+internal void
+bvh_fit_node(bvh_t *bvh,
+             bvh_node_t *node,
+             bvh_aabb_t *boxes)
+{
+    bvh_aabb_t bounds;
+
+    bvh_aabb_empty(&bounds);
+    for (u32 i = 0; i < node->count; i++)
+    {
+        bvh_aabb_t *box = &boxes[bvh->prims[node->left_first + i]];
+        bvh_aabb_grow(&bounds, box->min, box->max);
+    }
+    memcpy(node->min, bounds.min, sizeof(node->min));
+    memcpy(node->max, bounds.max, sizeof(node->max));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BUILD
+
+typedef struct _TAG_bvh_bins
+{
+    bvh_aabb_t  box[3][BVH_BINS];
+    u32         count[3][BVH_BINS];
+} bvh_bins_t;
+
+typedef struct _TAG_bvh_split
+{
+    u32         axis;
+    u32         bin;            // primitives in lower bins go left
+    f32         cmin[3];
+    f32         scale[3];
+    f32         cost;           // unnormalised, area * count summed over both sides
+    bvh_aabb_t  left;
+    bvh_aabb_t  right;
+} bvh_split_t;
+
+typedef struct _TAG_bvh_builder
+{
+    bvh_t                   *bvh;
+    bvh_aabb_t              *boxes;
+    f32                     *centroids;
+    u32                     num_threads;
+    std::atomic<u32>        num_nodes;
+
+    // Subtree tasks
+    std::mutex              lock;
+    std::condition_variable wake;
+    u32                     *tasks;
+    u32                     num_tasks;
+    u32                     active;
+} bvh_builder_t;
+
+internal u32
+bvh_bin_index(f32 c,
+              f32 cmin,
+              f32 scale)
+{
+    u32 b = (u32)((c - cmin) * scale);
+    return (b > BVH_BINS - 1) ? BVH_BINS - 1 : b;
+}
+
+internal void
+bvh_centroid_bounds(bvh_builder_t *builder,
+                    u32 first,
+                    u32 count,
+                    bvh_aabb_t *out)
+{
+    bvh_aabb_empty(out);
+    for (u32 i = first; i < first + count; i++)
+    {
+        f32 *c = &builder->centroids[builder->bvh->prims[i] * 3];
+        bvh_aabb_grow(out, c, c);
+    }
+}
+
+internal void
+bvh_bin_range(bvh_builder_t *builder,
+              u32 first,
+              u32 count,
+              bvh_split_t *split,
+              bvh_bins_t *bins)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        for (u32 b = 0; b < BVH_BINS; b++)
+        {
+            bvh_aabb_empty(&bins->box[a][b]);
+            bins->count[a][b] = 0;
+        }
+    }
+
+    for (u32 i = first; i < first + count; i++)
+    {
+        u32         prim = builder->bvh->prims[i];
+        bvh_aabb_t  *box = &builder->boxes[prim];
+
+        for (u32 a = 0; a < 3; a++)
+        {
+            u32 b = bvh_bin_index(builder->centroids[prim * 3 + a], split->cmin[a], split->scale[a]);
+            bins->count[a][b]++;
+            bvh_aabb_grow(&bins->box[a][b], box->min, box->max);
+        }
+    }
+}
+
+// Both passes over a node, on one thread or split across all of them
+internal void
+bvh_bin_node(bvh_builder_t *builder,
+             bvh_node_t *node,
+             bvh_split_t *split,
+             bvh_bins_t *bins)
+{
+    u32         num_threads = (node->count >= BVH_PARALLEL_BINS) ? builder->num_threads : 1;
+    bvh_aabb_t  centroids;
+
+
+    if (num_threads == 1)
+    {
+        bvh_centroid_bounds(builder, node->left_first, node->count, &centroids);
+    }
+    else
+    {
+        std::thread threads[BVH_MAX_THREADS];
+        bvh_aabb_t  parts[BVH_MAX_THREADS];
+
+        for (u32 t = 0; t < num_threads; t++)
+        {
+            u32 first = node->left_first + (u32)((u64)node->count * t / num_threads);
+            u32 last = node->left_first + (u32)((u64)node->count * (t + 1) / num_threads);
+
+            if (t)
+                threads[t] = std::thread(bvh_centroid_bounds, builder, first, last - first, &parts[t]);
+            else
+                bvh_centroid_bounds(builder, first, last - first, &parts[t]);
+        }
+        bvh_aabb_empty(&centroids);
+        for (u32 t = 0; t < num_threads; t++)
+        {
+            if (t)
+                threads[t].join();
+            bvh_aabb_grow(&centroids, parts[t].min, parts[t].max);
+        }
+    }
+
+    for (u32 a = 0; a < 3; a++)
+    {
+        f32 extent = centroids.max[a] - centroids.min[a];
+
+        split->cmin[a] = centroids.min[a];
+        split->scale[a] = (extent > 0.0f) ? BVH_BINS / extent : 0.0f;
+    }
+
+    if (num_threads == 1)
+    {
+        bvh_bin_range(builder, node->left_first, node->count, split, bins);
+    }
+    else
+    {
+        std::thread threads[BVH_MAX_THREADS];
+        bvh_bins_t  *parts = (bvh_bins_t *)malloc(num_threads * sizeof(bvh_bins_t));
+
+        for (u32 t = 0; t < num_threads; t++)
+        {
+            u32 first = node->left_first + (u32)((u64)node->count * t / num_threads);
+            u32 last = node->left_first + (u32)((u64)node->count * (t + 1) / num_threads);
+
+            if (t)
+                threads[t] = std::thread(bvh_bin_range, builder, first, last - first, split, &parts[t]);
+            else
+                bvh_bin_range(builder, first, last - first, split, &parts[t]);
+        }
+        for (u32 t = 1; t < num_threads; t++)
+            threads[t].join();
+
+        *bins = parts[0];
+        for (u32 t = 1; t < num_threads; t++)
+        {
+            for (u32 a = 0; a < 3; a++)
+            {
+                for (u32 b = 0; b < BVH_BINS; b++)
+                {
+                    bins->count[a][b] += parts[t].count[a][b];
+                    bvh_aabb_grow(&bins->box[a][b], parts[t].box[a][b].min, parts[t].box[a][b].max);
+                }
+            }
+        }
+        free(parts);
+    }
+}
+
+// Best binned SAH split of a node; FALSE if every centroid coincides. The
+// child bounds come straight from the bins.
+internal b32
+bvh_find_split(bvh_builder_t *builder,
+               bvh_node_t *node,
+               bvh_split_t *split)
+{
+    bvh_bins_t  bins;
+    b32         found = FALSE;
+
+
+    bvh_bin_node(builder, node, split, &bins);
+    split->cost = FLT_MAX;
+
+    for (u32 axis = 0; axis < 3; axis++)
+    {
+        bvh_aabb_t  left_box[BVH_BINS - 1];
+        f32         left_area[BVH_BINS - 1];
+        u32         left_count[BVH_BINS - 1];
+        bvh_aabb_t  acc;
+        u32         acc_count;
+
+
+        if (split->scale[axis] == 0.0f)
+            continue;
+
+        // Sweep from the left, then from the right evaluating each plane
+        bvh_aabb_empty(&acc);
+        acc_count = 0;
+        for (u32 b = 0; b < BVH_BINS - 1; b++)
+        {
+            acc_count += bins.count[axis][b];
+            bvh_aabb_grow(&acc, bins.box[axis][b].min, bins.box[axis][b].max);
+            left_box[b] = acc;
+            left_count[b] = acc_count;
+            left_area[b] = bvh_aabb_area(acc.min, acc.max);
+        }
+
+        bvh_aabb_empty(&acc);
+        acc_count = 0;
+        for (u32 b = BVH_BINS - 1; b > 0; b--)
+        {
+            acc_count += bins.count[axis][b];
+            bvh_aabb_grow(&acc, bins.box[axis][b].min, bins.box[axis][b].max);
+
+            f32 cost = left_count[b - 1] * left_area[b - 1] + acc_count * bvh_aabb_area(acc.min, acc.max);
+            if (left_count[b - 1] && acc_count && cost < split->cost)
+            {
+                split->cost = cost;
+                split->axis = axis;
+                split->bin = b;
+                split->left = left_box[b - 1];
+                split->right = acc;
+                found = TRUE;
+            }
+        }
+    }
+
+    return found;
+}
+
+// Splits a node in two if SAH says so. Returns the index of the left child,
+// or 0 if the node stays a leaf.
+internal u32
+bvh_split_node(bvh_builder_t *builder,
+               u32 index)
+{
+    bvh_t       *bvh = builder->bvh;
+    bvh_node_t  *node = &bvh->nodes[index];
+    bvh_split_t split;
+    f32         split_cost,
+                leaf_cost;
+    u32         i,
+                j,
+                left;
+
+
+    if (node->count <= 1 || !bvh_find_split(builder, node, &split))
+        return 0;
+
+    // Costs relative to this node's area, which scales both sides
+    split_cost = BVH_COST_TRAVERSAL + BVH_COST_INTERSECT * split.cost /
+                 bvh_aabb_area(node->min, node->max);
+    leaf_cost = BVH_COST_INTERSECT * node->count;
+    if (node->count <= BVH_MAX_LEAF && leaf_cost <= split_cost)
+        return 0;
+
+    // Partition in place by the same bin index the split was chosen with
+    i = node->left_first;
+    j = i + node->count - 1;
+    while (i <= j)
+    {
+        f32 c = builder->centroids[bvh->prims[i] * 3 + split.axis];
+
+        if (bvh_bin_index(c, split.cmin[split.axis], split.scale[split.axis]) < split.bin)
+        {
+            i++;
+        }
+        else
+        {
+            u32 temp = bvh->prims[i];
+            bvh->prims[i] = bvh->prims[j];
+            bvh->prims[j] = temp;
+            if (j-- == 0)
+                break;
+        }
+    }
+
+    u32 left_count = i - node->left_first;
+    if (left_count == 0 || left_count == node->count)
+        return 0;
+
+    left = builder->num_nodes.fetch_add(2);
+    bvh->nodes[left].left_first = node->left_first;
+    bvh->nodes[left].count = left_count;
+    memcpy(bvh->nodes[left].min, split.left.min, sizeof(split.left.min));
+    memcpy(bvh->nodes[left].max, split.left.max, sizeof(split.left.max));
+    bvh->nodes[left + 1].left_first = i;
+    bvh->nodes[left + 1].count = node->count - left_count;
+    memcpy(bvh->nodes[left + 1].min, split.right.min, sizeof(split.right.min));
+    memcpy(bvh->nodes[left + 1].max, split.right.max, sizeof(split.right.max));
+    node->left_first = left;
+    node->count = 0;
+
+    return left;
+}
+
+internal void
+bvh_push_task(bvh_builder_t *builder,
+              u32 node)
+{
+    std::lock_guard<std::mutex> guard(builder->lock);
+
+    builder->tasks[builder->num_tasks++] = node;
+    builder->wake.notify_one();
+}
+
+// Depth first below `root`; big children are handed to other threads
+internal void
+bvh_build_subtree(bvh_builder_t *builder,
+                  u32 root)
+{
+    u32 stack[BVH_MAX_DEPTH * 2];
+    u32 stack_size = 0;
+
+    stack[stack_size++] = root;
+    while (stack_size)
+    {
+        u32 left = bvh_split_node(builder, stack[--stack_size]);
+
+        if (!left)
+            continue;
+
+        for (u32 child = left + 2; child-- > left;)
+        {
+            if (builder->num_threads > 1 && builder->bvh->nodes[child].count >= BVH_TASK_MIN)
+                bvh_push_task(builder, child);
+            else if (stack_size < BVH_MAX_DEPTH * 2)
+                stack[stack_size++] = child;
+            // else: pathological input, the child stays a big leaf
+        }
+    }
+}
+
+internal void
+bvh_build_worker(bvh_builder_t *builder)
+{
+    for (;;)
+    {
+        u32 node;
+
+        {
+            std::unique_lock<std::mutex> guard(builder->lock);
+
+            // Done once nothing is queued and nobody can queue more
+            while (!builder->num_tasks && builder->active)
+                builder->wake.wait(guard);
+            if (!builder->num_tasks)
+                break;
+
+            node = builder->tasks[--builder->num_tasks];
+            builder->active++;
+        }
+
+        bvh_build_subtree(builder, node);
+
+        {
+            std::lock_guard<std::mutex> guard(builder->lock);
+
+            if (--builder->active == 0 && !builder->num_tasks)
+                builder->wake.notify_all();
+        }
+    }
+}
+
+// num_threads 0 uses every hardware thread; small inputs always build on
+// the calling thread
+void
+bvh_build(bvh_t *bvh,
+          bvh_aabb_t *boxes,
+          u32 count,
+          u32 num_threads)
+{
+    bvh_builder_t   builder;
+    std::thread     threads[BVH_MAX_THREADS];
+
+
+    memset(bvh, 0, sizeof(*bvh));
+    if (!count)
+        return;
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads || count < BVH_TASK_MIN * 2)
+        num_threads = 1;
+    if (num_threads > BVH_MAX_THREADS)
+        num_threads = BVH_MAX_THREADS;
+
+    bvh->num_prims = count;
+    bvh->prims = (u32 *)malloc(count * sizeof(u32));
+    bvh->nodes = (bvh_node_t *)malloc((2 * count - 1) * sizeof(bvh_node_t));
+
+    builder.bvh = bvh;
+    builder.boxes = boxes;
+    builder.centroids = (f32 *)malloc(count * 3 * sizeof(f32));
+    builder.num_threads = num_threads;
+    builder.num_nodes.store(1);
+    builder.tasks = (u32 *)malloc((count / BVH_TASK_MIN * 2 + 2) * sizeof(u32));
+    builder.num_tasks = 0;
+    builder.active = 0;
+
+    for (u32 i = 0; i < count; i++)
+    {
+        bvh->prims[i] = i;
+        for (u32 a = 0; a < 3; a++)
+            builder.centroids[i * 3 + a] = 0.5f * (boxes[i].min[a] + boxes[i].max[a]);
+    }
+
+    bvh->nodes[0].left_first = 0;
+    bvh->nodes[0].count = count;
+    bvh_fit_node(bvh, &bvh->nodes[0], boxes);
+
+    if (num_threads == 1)
+    {
+        bvh_build_subtree(&builder, 0);
+    }
+    else
+    {
+        builder.tasks[builder.num_tasks++] = 0;
+        for (u32 i = 1; i < num_threads; i++)
+            threads[i] = std::thread(bvh_build_worker, &builder);
+        bvh_build_worker(&builder);
+        for (u32 i = 1; i < num_threads; i++)
+            threads[i].join();
+    }
+
+    bvh->num_nodes = builder.num_nodes.load();
+    free(builder.centroids);
+    free(builder.tasks);
+}
+
+// Recomputes the node bounds for moved primitives, keeping the topology.
+// Children are always allocated after their parent, so one backwards pass
+// sees every child before its parent.
+void
+bvh_refit(bvh_t *bvh,
+          bvh_aabb_t *boxes)
+{
+    for (u32 i = bvh->num_nodes; i-- > 0;)
+    {
+        bvh_node_t *node = &bvh->nodes[i];
+
+        if (node->count)
+        {
+            bvh_fit_node(bvh, node, boxes);
+        }
+        else
+        {
+            bvh_node_t *left = &bvh->nodes[node->left_first];
+            bvh_node_t *right = left + 1;
+
+            for (u32 a = 0; a < 3; a++)
+            {
+                node->min[a] = (left->min[a] < right->min[a]) ? left->min[a] : right->min[a];
+                node->max[a] = (left->max[a] > right->max[a]) ? left->max[a] : right->max[a];
+            }
+        }
+    }
+}
+
+// Expected cost of a random ray through the tree, relative to the root
+f32
+bvh_sah_cost(bvh_t *bvh)
+{
+    f32 root_area;
+    f64 cost = 0.0;   // node order varies with the build threads, keep the sum stable
+
+    if (!bvh->num_nodes)
+        return 0.0f;
+
+    root_area = bvh_aabb_area(bvh->nodes[0].min, bvh->nodes[0].max);
+    if (root_area <= 0.0f)
+        return 0.0f;
+
+    for (u32 i = 0; i < bvh->num_nodes; i++)
+    {
+        bvh_node_t *node = &bvh->nodes[i];
+        f32 area = bvh_aabb_area(node->min, node->max) / root_area;
+
+        if (node->count)
+            cost += BVH_COST_INTERSECT * node->count * area;
+        else
+            cost += BVH_COST_TRAVERSAL * area;
+    }
+
+    return (f32)cost;
+}
+
+void
+bvh_free(bvh_t *bvh)
+{
+    free(bvh->nodes);
+    free(bvh->prims);
+    memset(bvh, 0, sizeof(*bvh));
+}
+
+#endif // BVH_IMPL
+
+#endif // BVH_H
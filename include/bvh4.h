@@ -0,0 +1,347 @@
+#ifndef BVH4_H
+#define BVH4_H
+
+// Compressed 4-wide BVH, collapsed from a binary one. A node is one 64 byte
+// cache line holding up to four children, whose boxes are stored as 8 bit
+// offsets on a grid anchored at the node's min corner. The grid step is a
+// power of two per axis, so decoding is exact and only the quantisation
+// (rounded outwards) makes the boxes looser. Laid out for std430 as is.
+//
+// A child with count > 0 is a leaf covering prims[child .. +count) of the
+// binary BVH, otherwise it is the node at index child. Node 0 is the root;
+// children are always allocated after their parent. Collapsing opens the
+// largest child until a node has four, and turns binary subtrees of up to
+// BVH4_MERGE_LEAF prims into single leaves, which leaves several times
+// fewer nodes than the binary tree has.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "types.h"
+#include "bvh.h"
+
+#define BVH4_WIDTH          4
+#define BVH4_MAX_LEAF       255     // longer leaves are split over extra nodes
+#define BVH4_MERGE_LEAF     4       // binary subtrees this small become one leaf
+#define BVH4_EXPONENT_BIAS  127     // as in an f32
+
+typedef struct _TAG_bvh4_node
+{
+    f32 origin[3];                  // grid origin, the min corner of the node
+    u8  exponent[3];                // grid step is 2^(exponent - BVH4_EXPONENT_BIAS)
+    u8  num_children;
+    u8  qmin[3][BVH4_WIDTH];        // child boxes on the grid, per axis
+    u8  qmax[3][BVH4_WIDTH];
+    u32 child[BVH4_WIDTH];
+    u8  count[BVH4_WIDTH];
+    u32 pad;
+} bvh4_node_t;
+
+typedef struct _TAG_bvh4
+{
+    bvh4_node_t *nodes;
+    u32         num_nodes;
+    u32         capacity;
+} bvh4_t;
+
+void        bvh4_build(bvh4_t *bvh4, bvh_t *bvh);
+void        bvh4_free(bvh4_t *bvh4);
+f32         bvh4_scale(u8 exponent);
+void        bvh4_child_box(bvh4_node_t *node, u32 child, bvh_aabb_t *box);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== BVH4 IMPLEMENTATION ================================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef BVH4_IMPL
+
+// Pending node: either the children of a binary inner node, or a binary
+// leaf too long for one child slot
+typedef struct _TAG_bvh4_task
+{
+    u32         node;               // in the wide BVH
+    u32         source;             // binary node, U32_MAX for a long leaf
+    u32         first;              // ... which covers prims[first .. +count)
+    u32         count;
+    bvh_aabb_t  box;
+} bvh4_task_t;
+
+typedef struct _TAG_bvh4_builder
+{
+    bvh4_t      *bvh4;
+    bvh_t       *bvh;
+    u32         *first;             // prim range of every binary subtree
+    u32         *count;
+    bvh4_task_t *tasks;
+    u32         num_tasks;
+    u32         cap_tasks;
+} bvh4_builder_t;
+
+f32
+bvh4_scale(u8 exponent)
+{
+    u32 bits = (u32)exponent << 23;
+    f32 scale;
+
+    memcpy(&scale, &bits, sizeof(scale));
+
+    return scale;
+}
+
+void
+bvh4_child_box(bvh4_node_t *node,
+               u32 child,
+               bvh_aabb_t *box)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        f32 scale = bvh4_scale(node->exponent[a]);
+
+        box->min[a] = node->origin[a] + node->qmin[a][child] * scale;
+        box->max[a] = node->origin[a] + node->qmax[a][child] * scale;
+    }
+}
+
+internal u32
+bvh4_alloc(bvh4_t *bvh4)
+{
+    if (bvh4->num_nodes == bvh4->capacity)
+    {
+        bvh4->capacity = bvh4->capacity ? bvh4->capacity * 2 : 64;
+        bvh4->nodes = (bvh4_node_t *)realloc(bvh4->nodes, bvh4->capacity * sizeof(bvh4_node_t));
+    }
+    memset(&bvh4->nodes[bvh4->num_nodes], 0, sizeof(bvh4_node_t));
+
+    return bvh4->num_nodes++;
+}
+
+// Grid of a node: the smallest power of two step per axis that spans the
+// node's extent in 255 steps
+internal void
+bvh4_set_grid(bvh4_node_t *node,
+              bvh_aabb_t *bounds)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        f32 extent = (bounds->max[a] - bounds->min[a]) / 255.0f;
+        s32 exponent = -BVH4_EXPONENT_BIAS + 1;
+
+        if (extent > 0.0f)
+        {
+            frexpf(extent, &exponent);
+            while (ldexpf(1.0f, exponent) * 255.0f < bounds->max[a] - bounds->min[a])
+                exponent++;
+        }
+        exponent += BVH4_EXPONENT_BIAS;
+        node->origin[a] = bounds->min[a];
+        node->exponent[a] = (u8)((exponent < 1) ? 1 : (exponent > 254) ? 254 : exponent);
+    }
+}
+
+// Quantises a child box outwards onto the node's grid
+internal void
+bvh4_set_child_box(bvh4_node_t *node,
+                   u32 child,
+                   f32 *min,
+                   f32 *max)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        f32 inv_scale = 1.0f / bvh4_scale(node->exponent[a]);
+        f32 lo = floorf((min[a] - node->origin[a]) * inv_scale);
+        f32 hi = ceilf((max[a] - node->origin[a]) * inv_scale);
+
+        node->qmin[a][child] = (u8)((lo < 0.0f) ? 0.0f : (lo > 255.0f) ? 255.0f : lo);
+        node->qmax[a][child] = (u8)((hi < 0.0f) ? 0.0f : (hi > 255.0f) ? 255.0f : hi);
+    }
+}
+
+// Allocates the wide node for a child and queues it
+internal u32
+bvh4_push_task(bvh4_builder_t *builder,
+               u32 source,
+               u32 first,
+               u32 count,
+               f32 *min,
+               f32 *max)
+{
+    bvh4_task_t *task;
+
+    if (builder->num_tasks == builder->cap_tasks)
+    {
+        builder->cap_tasks = builder->cap_tasks ? builder->cap_tasks * 2 : 64;
+        builder->tasks = (bvh4_task_t *)realloc(builder->tasks, builder->cap_tasks * sizeof(bvh4_task_t));
+    }
+
+    task = &builder->tasks[builder->num_tasks++];
+    task->node = bvh4_alloc(builder->bvh4);
+    task->source = source;
+    task->first = first;
+    task->count = count;
+    memcpy(task->box.min, min, sizeof(task->box.min));
+    memcpy(task->box.max, max, sizeof(task->box.max));
+
+    return task->node;
+}
+
+// A leaf too long for one slot, split into up to four even runs
+internal void
+bvh4_emit_leaf(bvh4_builder_t *builder,
+               bvh4_task_t *task,
+               bvh4_node_t *node)
+{
+    u32 run = (task->count + BVH4_WIDTH - 1) / BVH4_WIDTH;
+
+    for (u32 first = task->first; first < task->first + task->count; first += run)
+    {
+        u32 c = node->num_children++;
+        u32 count = task->first + task->count - first;
+
+        count = (count < run) ? count : run;
+        bvh4_set_child_box(node, c, task->box.min, task->box.max);
+        if (count <= BVH4_MAX_LEAF)
+        {
+            node->child[c] = first;
+            node->count[c] = (u8)count;
+        }
+        else
+        {
+            node->child[c] = bvh4_push_task(builder, U32_MAX, first, count, task->box.min, task->box.max);
+        }
+    }
+}
+
+// Binary leaves and small subtrees end up as leaf children
+internal b32
+bvh4_is_leaf(bvh4_builder_t *builder,
+             u32 source)
+{
+    return builder->bvh->nodes[source].count || builder->count[source] <= BVH4_MERGE_LEAF;
+}
+
+// The children of a binary node: opens the largest inner child until there
+// are four
+internal void
+bvh4_emit_inner(bvh4_builder_t *builder,
+                bvh4_task_t *task,
+                bvh4_node_t *node)
+{
+    bvh_node_t  *nodes = builder->bvh->nodes;
+    u32         kids[BVH4_WIDTH];
+    u32         num_kids = 0;
+
+
+    if (bvh4_is_leaf(builder, task->source))
+    {
+        kids[num_kids++] = task->source;   // a leaf root
+    }
+    else
+    {
+        kids[num_kids++] = nodes[task->source].left_first;
+        kids[num_kids++] = nodes[task->source].left_first + 1;
+    }
+
+    while (num_kids < BVH4_WIDTH)
+    {
+        u32 best = U32_MAX;
+        f32 best_area = -1.0f;
+
+        for (u32 k = 0; k < num_kids; k++)
+        {
+            f32 area = bvh_aabb_area(nodes[kids[k]].min, nodes[kids[k]].max);
+
+            if (!bvh4_is_leaf(builder, kids[k]) && area > best_area)
+            {
+                best = k;
+                best_area = area;
+            }
+        }
+        if (best == U32_MAX)
+            break;
+
+        kids[num_kids++] = nodes[kids[best]].left_first + 1;
+        kids[best] = nodes[kids[best]].left_first;
+    }
+
+    for (u32 k = 0; k < num_kids; k++)
+    {
+        bvh_node_t  *kid = &nodes[kids[k]];
+        b32         leaf = bvh4_is_leaf(builder, kids[k]);
+        u32         first = builder->first[kids[k]];
+        u32         count = builder->count[kids[k]];
+
+
+        bvh4_set_child_box(node, k, kid->min, kid->max);
+        if (leaf && count <= BVH4_MAX_LEAF)
+        {
+            node->child[k] = first;
+            node->count[k] = (u8)count;
+        }
+        else
+        {
+            node->child[k] = bvh4_push_task(builder, leaf ? U32_MAX : kids[k],
+                                            first, count, kid->min, kid->max);
+        }
+    }
+    node->num_children = (u8)num_kids;
+}
+
+void
+bvh4_build(bvh4_t *bvh4,
+           bvh_t *bvh)
+{
+    bvh4_builder_t builder;
+
+    memset(bvh4, 0, sizeof(*bvh4));
+    if (!bvh->num_nodes)
+        return;
+
+    builder.bvh4 = bvh4;
+    builder.bvh = bvh;
+    builder.first = (u32 *)malloc(bvh->num_nodes * sizeof(u32));
+    builder.count = (u32 *)malloc(bvh->num_nodes * sizeof(u32));
+    builder.tasks = NULL;
+    builder.num_tasks = 0;
+    builder.cap_tasks = 0;
+
+    // Subtrees cover contiguous prims, and children come after their parent
+    for (u32 i = bvh->num_nodes; i-- > 0;)
+    {
+        bvh_node_t *node = &bvh->nodes[i];
+
+        builder.first[i] = node->count ? node->left_first : builder.first[node->left_first];
+        builder.count[i] = node->count ? node->count
+                                       : builder.count[node->left_first] + builder.count[node->left_first + 1];
+    }
+    bvh4_push_task(&builder, 0, 0, 0, bvh->nodes[0].min, bvh->nodes[0].max);
+
+    while (builder.num_tasks)
+    {
+        bvh4_task_t task = builder.tasks[--builder.num_tasks];
+        bvh4_node_t node;
+
+        memset(&node, 0, sizeof(node));
+        bvh4_set_grid(&node, &task.box);
+        if (task.source == U32_MAX)
+            bvh4_emit_leaf(&builder, &task, &node);
+        else
+            bvh4_emit_inner(&builder, &task, &node);
+        bvh4->nodes[task.node] = node;
+    }
+
+    free(builder.first);
+    free(builder.count);
+    free(builder.tasks);
+}
+
+void
+bvh4_free(bvh4_t *bvh4)
+{
+    free(bvh4->nodes);
+    memset(bvh4, 0, sizeof(*bvh4));
+}
+
+#endif // BVH4_IMPL
+
+#endif // BVH4_H
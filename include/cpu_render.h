@@ -0,0 +1,1672 @@
+#ifndef CPU_RENDER_H
+#define CPU_RENDER_H
+
+// CPU path tracer for the scenes in scene.h. Follows the compute kernels
+// (same camera, materials, RNG and accumulation) so the two backends can be
+// swapped at runtime.
+//
+// Sphere intersection is SIMD over the structure-of-arrays sphere storage:
+// secondary rays test one ray against CPU_LANES spheres at a time, primary
+// rays are traced as coherent packets of CPU_PACKET_SIZE rays sharing the
+// camera origin, tested against one sphere at a time. The width follows the
+// mmath backend, plus AVX-512 when the compiler targets it. Meshes and
+// mesh instances are traversed one ray at a time through their BVHs; mesh
+// BVHs are the compressed 4-wide ones, whose nodes are tested 4 children
+// at a time.
+//
+// Textured materials are filtered at the level of a ray cone per path: it
+// starts at the angle one pixel subtends and widens by that angle for every
+// segment, which is what the mesh kernel does as well.
+//
+// Scenes with an environment map sample it at every diffuse hit (next event
+// estimation) and weigh that against diffuse bounces that escape to it with
+// the power heuristic, as the outdoor kernels do.
+//
+// Threads take tiles in the renderer's order, a Morton or Hilbert curve by
+// default (curve.h), and trace a tile's packets along the same curve, so a
+// thread's consecutive rays and the threads' concurrent tiles stay close in
+// the image and share cached BVH nodes and texels. The order doesn't change
+// the image: every pixel seeds its own random state.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include "types.h"
+#include "mmath.h"
+#include "scene.h"
+#include "curve.h"
+
+#define CPU_TILE_SIZE       32
+#define CPU_MAX_THREADS     64
+#define CPU_TILE_PACKETS    ((CPU_TILE_SIZE / CPU_PACKET_SIZE) * CPU_TILE_SIZE)
+#define CPU_DEFAULT_ORDER   CURVE_HILBERT
+
+/* ============================ *
+ * =====    SIMD lanes    ===== *
+ * ============================ */
+
+#if !defined(MMATH_NO_SIMD) && defined(__AVX512F__)
+    #define CPU_LANES               16
+    typedef __m512                  cpu_vf;
+    typedef __m512i                 cpu_vi;
+    typedef __mmask16               cpu_vm;
+    #define cpu_vf_set1(x)          _mm512_set1_ps(x)
+    #define cpu_vf_load(p)          _mm512_load_ps(p)
+    #define cpu_vf_store(p, a)      _mm512_store_ps(p, a)
+    #define cpu_vf_add(a, b)        _mm512_add_ps(a, b)
+    #define cpu_vf_sub(a, b)        _mm512_sub_ps(a, b)
+    #define cpu_vf_mul(a, b)        _mm512_mul_ps(a, b)
+    #define cpu_vf_madd(a, b, c)    _mm512_fmadd_ps(a, b, c)
+    #define cpu_vf_sqrt(a)          _mm512_sqrt_ps(a)
+    #define cpu_vf_ge(a, b)         _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ)
+    #define cpu_vf_le(a, b)         _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ)
+    #define cpu_vf_select(m, a, b)  _mm512_mask_blend_ps(m, b, a)
+    #define cpu_vm_and(a, b)        (cpu_vm)((a) & (b))
+    #define cpu_vm_andnot(a, b)     (cpu_vm)((a) & ~(b))
+    #define cpu_vm_or(a, b)         (cpu_vm)((a) | (b))
+    #define cpu_vm_bits(m)          (u32)(m)
+    #define cpu_vi_set1(x)          _mm512_set1_epi32(x)
+    #define cpu_vi_store(p, a)      _mm512_store_si512((void *)(p), a)
+    #define cpu_vi_add(a, b)        _mm512_add_epi32(a, b)
+    #define cpu_vi_select(m, a, b)  _mm512_mask_blend_epi32(m, b, a)
+    #define cpu_vi_lanes()          _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, \
+                                                      8, 9, 10, 11, 12, 13, 14, 15)
+#elif defined(MMATH_AVX2)
+    #define CPU_LANES               8
+    typedef __m256                  cpu_vf;
+    typedef __m256i                 cpu_vi;
+    typedef __m256                  cpu_vm;
+    #define cpu_vf_set1(x)          _mm256_set1_ps(x)
+    #define cpu_vf_load(p)          _mm256_load_ps(p)
+    #define cpu_vf_store(p, a)      _mm256_store_ps(p, a)
+    #define cpu_vf_add(a, b)        _mm256_add_ps(a, b)
+    #define cpu_vf_sub(a, b)        _mm256_sub_ps(a, b)
+    #define cpu_vf_mul(a, b)        _mm256_mul_ps(a, b)
+    #ifdef __FMA__
+        #define cpu_vf_madd(a, b, c)    _mm256_fmadd_ps(a, b, c)
+    #else
+        #define cpu_vf_madd(a, b, c)    _mm256_add_ps(_mm256_mul_ps(a, b), c)
+    #endif
+    #define cpu_vf_sqrt(a)          _mm256_sqrt_ps(a)
+    #define cpu_vf_ge(a, b)         _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+    #define cpu_vf_le(a, b)         _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+    #define cpu_vf_select(m, a, b)  _mm256_blendv_ps(b, a, m)
+    #define cpu_vm_and(a, b)        _mm256_and_ps(a, b)
+    #define cpu_vm_andnot(a, b)     _mm256_andnot_ps(b, a)
+    #define cpu_vm_or(a, b)         _mm256_or_ps(a, b)
+    #define cpu_vm_bits(m)          (u32)_mm256_movemask_ps(m)
+    #define cpu_vi_set1(x)          _mm256_set1_epi32(x)
+    #define cpu_vi_store(p, a)      _mm256_store_si256((__m256i *)(p), a)
+    #define cpu_vi_add(a, b)        _mm256_add_epi32(a, b)
+    #define cpu_vi_select(m, a, b)  _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), \
+                                                                         _mm256_castsi256_ps(a), m))
+    #define cpu_vi_lanes()          _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)
+#elif defined(MMATH_SSE)
+    #define CPU_LANES               4
+    typedef __m128                  cpu_vf;
+    typedef __m128i                 cpu_vi;
+    typedef __m128                  cpu_vm;
+    #define cpu_vf_set1(x)          _mm_set1_ps(x)
+    #define cpu_vf_load(p)          _mm_load_ps(p)
+    #define cpu_vf_store(p, a)      _mm_store_ps(p, a)
+    #define cpu_vf_add(a, b)        _mm_add_ps(a, b)
+    #define cpu_vf_sub(a, b)        _mm_sub_ps(a, b)
+    #define cpu_vf_mul(a, b)        _mm_mul_ps(a, b)
+    #define cpu_vf_madd(a, b, c)    m_madd_ps(a, b, c)
+    #define cpu_vf_sqrt(a)          _mm_sqrt_ps(a)
+    #define cpu_vf_ge(a, b)         _mm_cmpge_ps(a, b)
+    #define cpu_vf_le(a, b)         _mm_cmple_ps(a, b)
+    #define cpu_vf_select(m, a, b)  _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+    #define cpu_vm_and(a, b)        _mm_and_ps(a, b)
+    #define cpu_vm_andnot(a, b)     _mm_andnot_ps(b, a)
+    #define cpu_vm_or(a, b)         _mm_or_ps(a, b)
+    #define cpu_vm_bits(m)          (u32)_mm_movemask_ps(m)
+    #define cpu_vi_set1(x)          _mm_set1_epi32(x)
+    #define cpu_vi_store(p, a)      _mm_store_si128((__m128i *)(p), a)
+    #define cpu_vi_add(a, b)        _mm_add_epi32(a, b)
+    #define cpu_vi_select(m, a, b)  _mm_castps_si128(cpu_vf_select(m, _mm_castsi128_ps(a), \
+                                                                    _mm_castsi128_ps(b)))
+    #define cpu_vi_lanes()          _mm_setr_epi32(0, 1, 2, 3)
+#else
+    #define CPU_LANES               1
+    typedef f32                     cpu_vf;
+    typedef s32                     cpu_vi;
+    typedef b32                     cpu_vm;
+    #define cpu_vf_set1(x)          (x)
+    #define cpu_vf_load(p)          (*(p))
+    #define cpu_vf_store(p, a)      (*(p) = (a))
+    #define cpu_vf_add(a, b)        ((a) + (b))
+    #define cpu_vf_sub(a, b)        ((a) - (b))
+    #define cpu_vf_mul(a, b)        ((a) * (b))
+    #define cpu_vf_madd(a, b, c)    ((a) * (b) + (c))
+    #define cpu_vf_sqrt(a)          sqrtf(a)
+    #define cpu_vf_ge(a, b)         ((a) >= (b))
+    #define cpu_vf_le(a, b)         ((a) <= (b))
+    #define cpu_vf_select(m, a, b)  ((m) ? (a) : (b))
+    #define cpu_vm_and(a, b)        ((a) && (b))
+    #define cpu_vm_andnot(a, b)     ((a) && !(b))
+    #define cpu_vm_or(a, b)         ((a) || (b))
+    #define cpu_vm_bits(m)          (u32)(m)
+    #define cpu_vi_set1(x)          (x)
+    #define cpu_vi_store(p, a)      (*(p) = (a))
+    #define cpu_vi_add(a, b)        ((a) + (b))
+    #define cpu_vi_select(m, a, b)  ((m) ? (a) : (b))
+    #define cpu_vi_lanes()          0
+#endif
+
+// Primary ray packets are at least 8 wide and fill a whole register
+#define CPU_PACKET_SIZE     (CPU_LANES > 8 ? CPU_LANES : 8)
+
+/* ============================ *
+ * =====    Rays          ===== *
+ * ============================ */
+
+typedef struct _TAG_cpu_ray
+{
+    vec3_t origin;
+    vec3_t direction;
+} cpu_ray_t;
+
+typedef struct _TAG_cpu_hit
+{
+    vec3_t  p;
+    vec3_t  normal;
+    f32     t;
+    b32     front_face;
+    u32     material;
+
+    // Only filled in for textured materials
+    f32     u, v;
+    f32     uv_density;     // texture units per world unit at the hit
+    f32     cone_width;     // of the path's ray cone, set by cpu_trace
+} cpu_hit_t;
+
+// Coherent primary rays: one origin, unit length directions per lane
+typedef struct alignas(64) _TAG_cpu_packet
+{
+    f32     dx[CPU_PACKET_SIZE];
+    f32     dy[CPU_PACKET_SIZE];
+    f32     dz[CPU_PACKET_SIZE];
+    f32     t[CPU_PACKET_SIZE];
+    s32     sphere[CPU_PACKET_SIZE];
+    vec3_t  origin;
+} cpu_packet_t;
+
+typedef struct _TAG_cpu_camera
+{
+    mat4_t  inv_view;
+    mat4_t  inv_proj;
+    vec3_t  origin;
+    vec2_t  resolution;
+    f32     spread;         // angle one pixel subtends, the ray cones' spread
+} cpu_camera_t;
+
+/* ============================ *
+ * =====    Renderer      ===== *
+ * ============================ */
+
+typedef struct _TAG_cpu_renderer
+{
+    scene_t             *scene;
+    cpu_camera_t        camera;
+    s32                 width;
+    s32                 height;
+    f32                 *accum;         // linear RGB sums
+    f32                 *pixels;        // RGBA, gamma corrected like the kernels write
+    u32                 num_threads;
+    u32                 order;                          // CURVE_*
+    u32                 *tile_order;                    // tile indices, row major
+    u32                 packet_order[CPU_TILE_PACKETS]; // packets of a tile, row major
+
+    // Current pass
+    u32                 sample_base;
+    u32                 samples;
+    u32                 tiles_x;
+    u32                 num_tiles;
+    std::atomic<u32>    next_tile;
+} cpu_renderer_t;
+
+void        cpu_camera_setup(cpu_camera_t *camera, mat4_t view, mat4_t proj, vec2_t resolution);
+cpu_ray_t   cpu_get_ray(cpu_camera_t *camera, f32 u, f32 v);
+
+s32         cpu_intersect_spheres(scene_t *scene, cpu_ray_t *ray, f32 t_min, f32 t_max, f32 *t_hit);
+s32         cpu_intersect_spheres_scalar(scene_t *scene, cpu_ray_t *ray, f32 t_min, f32 t_max, f32 *t_hit);
+void        cpu_intersect_packet(scene_t *scene, cpu_packet_t *packet, f32 t_min, f32 t_max);
+b32         cpu_scene_hit(scene_t *scene, cpu_ray_t *ray, f32 t_min, f32 t_max, cpu_hit_t *hit);
+
+void        cpu_renderer_init(cpu_renderer_t *renderer, s32 width, s32 height, u32 num_threads);
+void        cpu_renderer_free(cpu_renderer_t *renderer);
+void        cpu_renderer_set_order(cpu_renderer_t *renderer, u32 order);
+void        cpu_render_pass(cpu_renderer_t *renderer, scene_t *scene, mat4_t view, mat4_t proj,
+                            vec2_t resolution, u32 sample_base, u32 samples);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== CPU RENDER IMPLEMENTATION ==========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef CPU_RENDER_IMPL
+
+////////////////////////////////////////////////////////////////////////////////
+// RANDOM (same xorshift as the kernels)
+
+internal u32
+cpu_randi(u32 *state)
+{
+    u32 x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 15;
+    *state = x;
+
+    return x;
+}
+
+internal f32
+cpu_randf(u32 *state)
+{
+    return (cpu_randi(state) & 0xffffff) / 16777216.0f;
+}
+
+internal vec3_t
+cpu_random_unit_vector(u32 *state)
+{
+    f32 z = cpu_randf(state) * 2.0f - 1.0f;
+    f32 t = cpu_randf(state) * 2.0f * 3.1415926f;
+    f32 r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+    vec3_t v = {r * cosf(t), r * sinf(t), z};
+
+    return v;
+}
+
+internal vec3_t
+cpu_random_in_unit_sphere(u32 *state)
+{
+    vec3_t v = cpu_random_unit_vector(state);
+
+    return vec3_scal(v, cbrtf(cpu_randf(state)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// CAMERA
+
+void
+cpu_camera_setup(cpu_camera_t *camera,
+                 mat4_t view,
+                 mat4_t proj,
+                 vec2_t resolution)
+{
+    vec4_t origin;
+
+    camera->inv_view = mat4_inverse(view);
+    camera->inv_proj = mat4_inverse(proj);
+    camera->resolution = resolution;
+    camera->spread = 2.0f / (proj.col2[1] * resolution.y);
+
+    origin = mat4_mult_vec4(camera->inv_view, vec4_make(0.0f, 0.0f, 0.0f, 1.0f));
+    camera->origin = vec3_scal(vec4_to_vec3(origin), 1.0f / origin.w);
+}
+
+cpu_ray_t
+cpu_get_ray(cpu_camera_t *camera,
+            f32 u,
+            f32 v)
+{
+    cpu_ray_t   ray;
+    vec4_t      view_pos;
+    vec4_t      dir;
+
+
+    view_pos = mat4_mult_vec4(camera->inv_proj, vec4_make(u * 2.0f - 1.0f, v * 2.0f - 1.0f, -1.0f, 1.0f));
+    dir = mat4_mult_vec4(camera->inv_view, vec4_make(view_pos.x, view_pos.y, -1.0f, 0.0f));
+
+    // Exact normalisation: the packet kernel relies on unit directions, and
+    // the scalar mmath normalize is only an approximation
+    ray.origin = camera->origin;
+    ray.direction = vec4_to_vec3(dir);
+    ray.direction = vec3_scal(ray.direction, 1.0f / sqrtf(vec3_dot(ray.direction, ray.direction)));
+
+    return ray;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// INTERSECTION
+
+// Straight port of the kernels' scene_hit loop, one sphere at a time. Kept
+// as the reference the SIMD kernels are checked and benchmarked against.
+s32
+cpu_intersect_spheres_scalar(scene_t *scene,
+                             cpu_ray_t *ray,
+                             f32 t_min,
+                             f32 t_max,
+                             f32 *t_hit)
+{
+    s32 closest = -1;
+    f32 a = vec3_dot(ray->direction, ray->direction);
+
+    for (u32 i = 0; i < scene->num_spheres; i++)
+    {
+        vec3_t center = {scene->sphere_x[i], scene->sphere_y[i], scene->sphere_z[i]};
+        vec3_t oc = vec3_sub(ray->origin, center);
+        f32 half_b = vec3_dot(oc, ray->direction);
+        f32 c = vec3_dot(oc, oc) - scene->sphere_r[i] * scene->sphere_r[i];
+        f32 disc = half_b * half_b - a * c;
+
+        if (disc < 0)
+            continue;
+
+        f32 sqrtd = sqrtf(disc);
+        f32 root = (-half_b - sqrtd) / a;
+        if (root < t_min || root > t_max)
+        {
+            root = (-half_b + sqrtd) / a;
+            if (root < t_min || root > t_max)
+                continue;
+        }
+
+        t_max = root;
+        closest = (s32)i;
+    }
+
+    *t_hit = t_max;
+    return closest;
+}
+
+// One ray against CPU_LANES spheres per step. Every lane keeps its own
+// closest hit; the lanes are reduced once at the end.
+s32
+cpu_intersect_spheres(scene_t *scene,
+                      cpu_ray_t *ray,
+                      f32 t_min,
+                      f32 t_max,
+                      f32 *t_hit)
+{
+    alignas(64) f32 lane_t[CPU_LANES];
+    alignas(64) s32 lane_sphere[CPU_LANES];
+    u32             count = scene_padded_spheres(scene);
+    f32             a = vec3_dot(ray->direction, ray->direction);
+    s32             closest = -1;
+
+
+    cpu_vf ox = cpu_vf_set1(ray->origin.x);
+    cpu_vf oy = cpu_vf_set1(ray->origin.y);
+    cpu_vf oz = cpu_vf_set1(ray->origin.z);
+    cpu_vf dx = cpu_vf_set1(ray->direction.x);
+    cpu_vf dy = cpu_vf_set1(ray->direction.y);
+    cpu_vf dz = cpu_vf_set1(ray->direction.z);
+    cpu_vf va = cpu_vf_set1(a);
+    cpu_vf inv_a = cpu_vf_set1(1.0f / a);
+    cpu_vf vmin = cpu_vf_set1(t_min);
+    cpu_vf zero = cpu_vf_set1(0.0f);
+    cpu_vf best_t = cpu_vf_set1(t_max);
+    cpu_vi best_sphere = cpu_vi_set1(-1);
+    cpu_vi index = cpu_vi_lanes();
+    cpu_vi step = cpu_vi_set1(CPU_LANES);
+
+    for (u32 i = 0; i < count; i += CPU_LANES)
+    {
+        cpu_vf ocx = cpu_vf_sub(ox, cpu_vf_load(scene->sphere_x + i));
+        cpu_vf ocy = cpu_vf_sub(oy, cpu_vf_load(scene->sphere_y + i));
+        cpu_vf ocz = cpu_vf_sub(oz, cpu_vf_load(scene->sphere_z + i));
+        cpu_vf r = cpu_vf_load(scene->sphere_r + i);
+        cpu_vf half_b = cpu_vf_madd(ocx, dx, cpu_vf_madd(ocy, dy, cpu_vf_mul(ocz, dz)));
+        cpu_vf c = cpu_vf_sub(cpu_vf_madd(ocx, ocx, cpu_vf_madd(ocy, ocy, cpu_vf_mul(ocz, ocz))),
+                              cpu_vf_mul(r, r));
+        cpu_vf disc = cpu_vf_sub(cpu_vf_mul(half_b, half_b), cpu_vf_mul(va, c));
+        cpu_vm hit = cpu_vf_ge(disc, zero);
+
+        if (cpu_vm_bits(hit))
+        {
+            cpu_vf sqrtd = cpu_vf_sqrt(disc);
+            cpu_vf t0 = cpu_vf_mul(cpu_vf_sub(cpu_vf_sub(zero, half_b), sqrtd), inv_a);
+            cpu_vf t1 = cpu_vf_mul(cpu_vf_sub(sqrtd, half_b), inv_a);
+            cpu_vm near = cpu_vm_and(hit, cpu_vm_and(cpu_vf_ge(t0, vmin), cpu_vf_le(t0, best_t)));
+            cpu_vm far = cpu_vm_andnot(cpu_vm_and(hit, cpu_vm_and(cpu_vf_ge(t1, vmin), cpu_vf_le(t1, best_t))),
+                                       near);
+
+            best_t = cpu_vf_select(near, t0, cpu_vf_select(far, t1, best_t));
+            best_sphere = cpu_vi_select(cpu_vm_or(near, far), index, best_sphere);
+        }
+        index = cpu_vi_add(index, step);
+    }
+
+    cpu_vf_store(lane_t, best_t);
+    cpu_vi_store(lane_sphere, best_sphere);
+    for (u32 i = 0; i < CPU_LANES; i++)
+    {
+        if (lane_sphere[i] >= 0 && lane_t[i] <= t_max)
+        {
+            t_max = lane_t[i];
+            closest = lane_sphere[i];
+        }
+    }
+
+    *t_hit = t_max;
+    return closest;
+}
+
+// A packet of primary rays against one sphere at a time. The rays share
+// their origin, so oc and c are per sphere scalars and each lane only pays
+// for a dot product until the discriminant says it is worth going on.
+void
+cpu_intersect_packet(scene_t *scene,
+                     cpu_packet_t *packet,
+                     f32 t_min,
+                     f32 t_max)
+{
+    cpu_vf vmin = cpu_vf_set1(t_min);
+    cpu_vf zero = cpu_vf_set1(0.0f);
+
+    for (u32 k = 0; k < CPU_PACKET_SIZE; k++)
+    {
+        packet->t[k] = t_max;
+        packet->sphere[k] = -1;
+    }
+
+    for (u32 i = 0; i < scene->num_spheres; i++)
+    {
+        f32 ocx = packet->origin.x - scene->sphere_x[i];
+        f32 ocy = packet->origin.y - scene->sphere_y[i];
+        f32 ocz = packet->origin.z - scene->sphere_z[i];
+        f32 c = ocx * ocx + ocy * ocy + ocz * ocz - scene->sphere_r[i] * scene->sphere_r[i];
+        cpu_vf vocx = cpu_vf_set1(ocx);
+        cpu_vf vocy = cpu_vf_set1(ocy);
+        cpu_vf vocz = cpu_vf_set1(ocz);
+        cpu_vf vc = cpu_vf_set1(c);
+        cpu_vi sphere = cpu_vi_set1((s32)i);
+
+        for (u32 k = 0; k < CPU_PACKET_SIZE; k += CPU_LANES)
+        {
+            cpu_vf half_b = cpu_vf_madd(vocx, cpu_vf_load(packet->dx + k),
+                                        cpu_vf_madd(vocy, cpu_vf_load(packet->dy + k),
+                                                    cpu_vf_mul(vocz, cpu_vf_load(packet->dz + k))));
+            cpu_vf disc = cpu_vf_sub(cpu_vf_mul(half_b, half_b), vc);    // a == 1
+            cpu_vm hit = cpu_vf_ge(disc, zero);
+
+            if (!cpu_vm_bits(hit))
+                continue;
+
+            cpu_vf best_t = cpu_vf_load(packet->t + k);
+            cpu_vf sqrtd = cpu_vf_sqrt(disc);
+            cpu_vf t0 = cpu_vf_sub(cpu_vf_sub(zero, half_b), sqrtd);
+            cpu_vf t1 = cpu_vf_sub(sqrtd, half_b);
+            cpu_vm near = cpu_vm_and(hit, cpu_vm_and(cpu_vf_ge(t0, vmin), cpu_vf_le(t0, best_t)));
+            cpu_vm far = cpu_vm_andnot(cpu_vm_and(hit, cpu_vm_and(cpu_vf_ge(t1, vmin), cpu_vf_le(t1, best_t))),
+                                       near);
+
+            cpu_vf_store(packet->t + k, cpu_vf_select(near, t0, cpu_vf_select(far, t1, best_t)));
+            cpu_vi_store(packet->sphere + k,
+                         cpu_vi_select(cpu_vm_or(near, far), sphere,
+                                       *(cpu_vi *)(packet->sphere + k)));
+        }
+    }
+}
+
+internal void
+cpu_set_face_normal(cpu_ray_t *ray,
+                    vec3_t outward_normal,
+                    cpu_hit_t *hit)
+{
+    hit->front_face = vec3_dot(ray->direction, outward_normal) < 0;
+    hit->normal = hit->front_face ? outward_normal : vec3_scal(outward_normal, -1.0f);
+}
+
+internal void
+cpu_sphere_hit_record(scene_t *scene,
+                      cpu_ray_t *ray,
+                      s32 sphere,
+                      f32 t,
+                      cpu_hit_t *hit)
+{
+    vec3_t  center = {scene->sphere_x[sphere], scene->sphere_y[sphere], scene->sphere_z[sphere]};
+    f32     radius = scene->sphere_r[sphere];
+    vec3_t  outward;
+
+
+    hit->t = t;
+    hit->p = vec3_add(ray->origin, vec3_scal(ray->direction, t));
+    hit->material = scene->sphere_material[sphere];
+    outward = vec3_scal(vec3_sub(hit->p, center), 1.0f / radius);
+    cpu_set_face_normal(ray, outward, hit);
+
+    // Latitude/longitude, seam at -x; a unit of uv covers the whole sphere
+    if (scene->materials[hit->material].texture != TEXTURE_NONE)
+    {
+        hit->u = (atan2f(-outward.z, outward.x) + 3.1415926f) / (2.0f * 3.1415926f);
+        hit->v = acosf(fminf(fmaxf(-outward.y, -1.0f), 1.0f)) / 3.1415926f;
+        hit->uv_density = 1.0f / (2.0f * sqrtf(3.1415926f) * radius);
+    }
+}
+
+// Planes are two sided, as in the plane kernel
+internal b32
+cpu_plane_hit(scene_plane_t *plane,
+              cpu_ray_t *ray,
+              f32 t_min,
+              f32 t_max,
+              cpu_hit_t *hit)
+{
+    vec3_t  normal = plane->normal;
+    f32     denom = vec3_dot(normal, ray->direction);
+    f32     t;
+
+
+    if (denom < 0.0f)
+    {
+        normal = vec3_scal(normal, -1.0f);
+        denom = -denom;
+    }
+    if (denom <= 1e-6f)
+        return FALSE;
+
+    t = vec3_dot(vec3_sub(plane->pos, ray->origin), normal) / denom;
+    if (t < t_min || t > t_max)
+        return FALSE;
+
+    hit->t = t;
+    hit->p = vec3_add(ray->origin, vec3_scal(ray->direction, t));
+    hit->material = plane->material;
+    cpu_set_face_normal(ray, normal, hit);
+
+    return TRUE;
+}
+
+internal b32
+cpu_planes_hit(scene_t *scene,
+               cpu_ray_t *ray,
+               f32 t_min,
+               f32 t_max,
+               cpu_hit_t *hit)
+{
+    b32 hit_anything = FALSE;
+
+    for (u32 i = 0; i < scene->num_planes; i++)
+    {
+        if (cpu_plane_hit(&scene->planes[i], ray, t_min, t_max, hit))
+        {
+            hit_anything = TRUE;
+            t_max = hit->t;
+        }
+    }
+
+    return hit_anything;
+}
+
+// Watertight ray/triangle test (Woop, Benthin & Wald 2013), the same as the
+// mesh kernel's. The per ray shear is set up once per traversal.
+typedef struct _TAG_cpu_tri_ray
+{
+    u32 kx, ky, kz;
+    f32 sx, sy, sz;
+} cpu_tri_ray_t;
+
+internal void
+cpu_tri_ray_setup(cpu_ray_t *ray,
+                  cpu_tri_ray_t *tr)
+{
+    f32 *d = &ray->direction.x;
+    f32 ax = fabsf(d[0]),
+        ay = fabsf(d[1]),
+        az = fabsf(d[2]);
+
+
+    tr->kz = (ax > ay) ? ((ax > az) ? 0 : 2) : ((ay > az) ? 1 : 2);
+    tr->kx = (tr->kz + 1) % 3;
+    tr->ky = (tr->kx + 1) % 3;
+    if (d[tr->kz] < 0.0f)
+    {
+        u32 temp = tr->kx;
+        tr->kx = tr->ky;
+        tr->ky = temp;
+    }
+
+    tr->sx = d[tr->kx] / d[tr->kz];
+    tr->sy = d[tr->ky] / d[tr->kz];
+    tr->sz = 1.0f / d[tr->kz];
+}
+
+internal b32
+cpu_triangle_hit(mesh_t *mesh,
+                 cpu_ray_t *ray,
+                 cpu_tri_ray_t *tr,
+                 u32 tri,
+                 f32 t_min,
+                 f32 *t_max,
+                 f32 *bary)
+{
+    f32 *o = &ray->origin.x;
+    f32 *p0 = &mesh->vertices[mesh->indices[tri * 3 + 0]].px;
+    f32 *p1 = &mesh->vertices[mesh->indices[tri * 3 + 1]].px;
+    f32 *p2 = &mesh->vertices[mesh->indices[tri * 3 + 2]].px;
+    f32 A[3], B[3], C[3];
+
+
+    for (u32 a = 0; a < 3; a++)
+    {
+        A[a] = p0[a] - o[a];
+        B[a] = p1[a] - o[a];
+        C[a] = p2[a] - o[a];
+    }
+
+    f32 ax = A[tr->kx] - tr->sx * A[tr->kz];
+    f32 ay = A[tr->ky] - tr->sy * A[tr->kz];
+    f32 bx = B[tr->kx] - tr->sx * B[tr->kz];
+    f32 by = B[tr->ky] - tr->sy * B[tr->kz];
+    f32 cx = C[tr->kx] - tr->sx * C[tr->kz];
+    f32 cy = C[tr->ky] - tr->sy * C[tr->kz];
+
+    f32 u = cx * by - cy * bx;
+    f32 v = ax * cy - ay * cx;
+    f32 w = bx * ay - by * ax;
+
+    // Exactly on an edge: redo the edge functions in double precision
+    if (u == 0.0f || v == 0.0f || w == 0.0f)
+    {
+        u = (f32)((f64)cx * by - (f64)cy * bx);
+        v = (f32)((f64)ax * cy - (f64)ay * cx);
+        w = (f32)((f64)bx * ay - (f64)by * ax);
+    }
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return FALSE;
+
+    f32 det = u + v + w;
+    if (det == 0.0f)
+        return FALSE;
+
+    f32 t = (u * tr->sz * A[tr->kz] + v * tr->sz * B[tr->kz] + w * tr->sz * C[tr->kz]) / det;
+    if (t < t_min || t > *t_max)
+        return FALSE;
+
+    *t_max = t;
+    bary[0] = u / det;
+    bary[1] = v / det;
+    bary[2] = w / det;
+
+    return TRUE;
+}
+
+// Entry distance into a node's box, negative on a miss
+internal f32
+cpu_node_hit(bvh_node_t *node,
+             f32 *origin,
+             f32 *inv_dir,
+             f32 t_min,
+             f32 t_max)
+{
+    for (u32 a = 0; a < 3; a++)
+    {
+        f32 t0 = (node->min[a] - origin[a]) * inv_dir[a];
+        f32 t1 = (node->max[a] - origin[a]) * inv_dir[a];
+
+        t_min = fmaxf(t_min, fminf(t0, t1));
+        t_max = fminf(t_max, fmaxf(t0, t1));
+    }
+
+    return (t_min <= t_max) ? t_min : -1.0f;
+}
+
+// Entry distances of the ray into the children of a wide node, decoded from
+// the quantised boxes 4 at a time. Returns the mask of children hit.
+internal u32
+cpu_bvh4_node_hit(bvh4_node_t *node,
+                  f32 *origin,
+                  f32 *inv_dir,
+                  f32 t_min,
+                  f32 t_max,
+                  f32 *t_enter)
+{
+#ifdef MMATH_SSE
+    __m128  enter = _mm_set1_ps(t_min),
+            leave = _mm_set1_ps(t_max);
+    __m128i zero = _mm_setzero_si128();
+    s32     bytes;
+
+
+    for (u32 a = 0; a < 3; a++)
+    {
+        __m128  scale = _mm_set1_ps(bvh4_scale(node->exponent[a]) * inv_dir[a]);
+        __m128  base = _mm_set1_ps((node->origin[a] - origin[a]) * inv_dir[a]);
+        __m128  qmin,
+                qmax,
+                t0,
+                t1;
+
+        memcpy(&bytes, node->qmin[a], sizeof(bytes));
+        qmin = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+        memcpy(&bytes, node->qmax[a], sizeof(bytes));
+        qmax = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+
+        // (origin + q * scale - o) / d, with the divisions folded into the
+        // per node constants
+        t0 = _mm_add_ps(base, _mm_mul_ps(qmin, scale));
+        t1 = _mm_add_ps(base, _mm_mul_ps(qmax, scale));
+        enter = _mm_max_ps(_mm_min_ps(t0, t1), enter);
+        leave = _mm_min_ps(_mm_max_ps(t0, t1), leave);
+    }
+    _mm_storeu_ps(t_enter, enter);
+
+    return (u32)_mm_movemask_ps(_mm_cmple_ps(enter, leave)) & ((1u << node->num_children) - 1);
+#else
+    u32 mask = 0;
+
+    for (u32 c = 0; c < node->num_children; c++)
+    {
+        f32 enter = t_min,
+            leave = t_max;
+
+        for (u32 a = 0; a < 3; a++)
+        {
+            f32 scale = bvh4_scale(node->exponent[a]) * inv_dir[a];
+            f32 base = (node->origin[a] - origin[a]) * inv_dir[a];
+            f32 t0 = base + node->qmin[a][c] * scale;
+            f32 t1 = base + node->qmax[a][c] * scale;
+
+            enter = fmaxf(enter, fminf(t0, t1));
+            leave = fminf(leave, fmaxf(t0, t1));
+        }
+        t_enter[c] = enter;
+        mask |= (enter <= leave) << c;
+    }
+
+    return mask;
+#endif
+}
+
+// Closest triangle of one mesh BVH. The leaf children of a node are tested
+// with it, its inner children are visited later, both nearest first. Shrinks
+// t_max to the hit; the ray may be in any (affine) space, t is unaffected.
+// Adds the nodes visited to *steps when given.
+internal b32
+cpu_blas_hit(mesh_t *mesh,
+             cpu_ray_t *ray,
+             f32 t_min,
+             f32 *t_max,
+             u32 *hit_tri,
+             f32 *hit_bary,
+             u32 *steps)
+{
+    bvh4_node_t     *nodes = mesh->bvh4.nodes;
+    cpu_tri_ray_t   tr;
+    u32             stack[BVH_MAX_DEPTH * (BVH4_WIDTH - 1)];
+    u32             stack_size = 0;
+    u32             node = 0;
+    u32             visited = 0;
+    b32             found = FALSE;
+    f32             bary[3];
+    f32             inv_dir[3] = {1.0f / ray->direction.x, 1.0f / ray->direction.y, 1.0f / ray->direction.z};
+    f32             *origin = &ray->origin.x;
+
+
+    if (!mesh->bvh4.num_nodes)
+        return FALSE;
+
+    cpu_tri_ray_setup(ray, &tr);
+    for (;;)
+    {
+        bvh4_node_t *wide = &nodes[node];
+        f32         t_enter[BVH4_WIDTH];
+        u32         order[BVH4_WIDTH];
+        u32         num_hit = 0;
+        u32         mask = cpu_bvh4_node_hit(wide, origin, inv_dir, t_min, *t_max, t_enter);
+
+
+        visited++;
+
+        // Children hit, nearest first
+        for (u32 c = 0; c < BVH4_WIDTH; c++)
+        {
+            if (!(mask & (1u << c)))
+                continue;
+
+            u32 i = num_hit++;
+            for (; i > 0 && t_enter[order[i - 1]] > t_enter[c]; i--)
+                order[i] = order[i - 1];
+            order[i] = c;
+        }
+
+        for (u32 k = 0; k < num_hit; k++)
+        {
+            u32 c = order[k];
+
+            if (!wide->count[c] || t_enter[c] > *t_max)
+                continue;
+            for (u32 i = 0; i < wide->count[c]; i++)
+            {
+                if (cpu_triangle_hit(mesh, ray, &tr, wide->child[c] + i, t_min, t_max, bary))
+                {
+                    found = TRUE;
+                    *hit_tri = wide->child[c] + i;
+                    memcpy(hit_bary, bary, sizeof(bary));
+                }
+            }
+        }
+
+        // Farthest inner child goes on the stack first
+        for (u32 k = num_hit; k-- > 0;)
+        {
+            u32 c = order[k];
+
+            if (!wide->count[c] && t_enter[c] <= *t_max && stack_size < BVH_MAX_DEPTH * (BVH4_WIDTH - 1))
+                stack[stack_size++] = wide->child[c];
+        }
+
+        if (!stack_size)
+            break;
+        node = stack[--stack_size];
+    }
+
+    if (steps)
+        *steps += visited;
+
+    return found;
+}
+
+// cpu_blas_hit() on the binary BVH the compressed one is collapsed from,
+// kept for the bench. Adds the nodes visited to *steps.
+internal b32
+cpu_blas_hit_binary(mesh_t *mesh,
+                    cpu_ray_t *ray,
+                    f32 t_min,
+                    f32 *t_max,
+                    u32 *hit_tri,
+                    f32 *hit_bary,
+                    u32 *steps)
+{
+    bvh_node_t      *nodes = mesh->bvh.nodes;
+    cpu_tri_ray_t   tr;
+    u32             stack[BVH_MAX_DEPTH];
+    u32             stack_size = 0;
+    u32             node = 0;
+    b32             found = FALSE;
+    f32             bary[3];
+    f32             inv_dir[3] = {1.0f / ray->direction.x, 1.0f / ray->direction.y, 1.0f / ray->direction.z};
+    f32             *origin = &ray->origin.x;
+
+
+    if (!mesh->bvh.num_nodes || cpu_node_hit(&nodes[0], origin, inv_dir, t_min, *t_max) < 0.0f)
+        return FALSE;
+
+    cpu_tri_ray_setup(ray, &tr);
+    for (;;)
+    {
+        (*steps)++;
+        if (nodes[node].count)
+        {
+            for (u32 i = 0; i < nodes[node].count; i++)
+            {
+                if (cpu_triangle_hit(mesh, ray, &tr, nodes[node].left_first + i, t_min, t_max, bary))
+                {
+                    found = TRUE;
+                    *hit_tri = nodes[node].left_first + i;
+                    memcpy(hit_bary, bary, sizeof(bary));
+                }
+            }
+        }
+        else
+        {
+            u32 left = nodes[node].left_first;
+            f32 t_left = cpu_node_hit(&nodes[left], origin, inv_dir, t_min, *t_max);
+            f32 t_right = cpu_node_hit(&nodes[left + 1], origin, inv_dir, t_min, *t_max);
+
+            if (t_left >= 0.0f && t_right >= 0.0f)
+            {
+                node = (t_left <= t_right) ? left : left + 1;
+                if (stack_size < BVH_MAX_DEPTH)
+                    stack[stack_size++] = (t_left <= t_right) ? left + 1 : left;
+                continue;
+            }
+            if (t_left >= 0.0f || t_right >= 0.0f)
+            {
+                node = (t_left >= 0.0f) ? left : left + 1;
+                continue;
+            }
+        }
+
+        if (!stack_size)
+            break;
+        node = stack[--stack_size];
+    }
+
+    return found;
+}
+
+// Interpolated vertex normal, or the geometric one for files without
+// normals. Not normalised.
+internal vec3_t
+cpu_triangle_normal(mesh_t *mesh,
+                    u32 tri,
+                    f32 *bary)
+{
+    mesh_vertex_t   *v0 = &mesh->vertices[mesh->indices[tri * 3 + 0]];
+    mesh_vertex_t   *v1 = &mesh->vertices[mesh->indices[tri * 3 + 1]];
+    mesh_vertex_t   *v2 = &mesh->vertices[mesh->indices[tri * 3 + 2]];
+    vec3_t          normal;
+
+
+    normal.x = bary[0] * v0->nx + bary[1] * v1->nx + bary[2] * v2->nx;
+    normal.y = bary[0] * v0->ny + bary[1] * v1->ny + bary[2] * v2->ny;
+    normal.z = bary[0] * v0->nz + bary[1] * v1->nz + bary[2] * v2->nz;
+
+    if (vec3_dot(normal, normal) == 0.0f)
+    {
+        vec3_t e1 = {v1->px - v0->px, v1->py - v0->py, v1->pz - v0->pz};
+        vec3_t e2 = {v2->px - v0->px, v2->py - v0->py, v2->pz - v0->pz};
+        normal = vec3_cross(e1, e2);
+    }
+
+    return normal;
+}
+
+// Interpolated texture coordinates, and how densely they are spread over
+// the triangle
+internal void
+cpu_triangle_uv(mesh_t *mesh,
+                u32 tri,
+                f32 *bary,
+                cpu_hit_t *hit)
+{
+    mesh_vertex_t   *v0 = &mesh->vertices[mesh->indices[tri * 3 + 0]];
+    mesh_vertex_t   *v1 = &mesh->vertices[mesh->indices[tri * 3 + 1]];
+    mesh_vertex_t   *v2 = &mesh->vertices[mesh->indices[tri * 3 + 2]];
+    vec3_t          e1 = {v1->px - v0->px, v1->py - v0->py, v1->pz - v0->pz};
+    vec3_t          e2 = {v2->px - v0->px, v2->py - v0->py, v2->pz - v0->pz};
+    vec3_t          n = vec3_cross(e1, e2);
+    f32             world_area = sqrtf(vec3_dot(n, n));
+    f32             uv_area = fabsf((v1->u - v0->u) * (v2->v - v0->v) - (v2->u - v0->u) * (v1->v - v0->v));
+
+
+    hit->u = bary[0] * v0->u + bary[1] * v1->u + bary[2] * v2->u;
+    hit->v = bary[0] * v0->v + bary[1] * v1->v + bary[2] * v2->v;
+    hit->uv_density = (world_area > 0.0f) ? sqrtf(uv_area / world_area) : 0.0f;
+}
+
+internal b32
+cpu_mesh_hit(scene_t *scene,
+             cpu_ray_t *ray,
+             f32 t_min,
+             f32 t_max,
+             cpu_hit_t *hit)
+{
+    u32     tri;
+    f32     bary[3];
+    vec3_t  normal;
+
+
+    if (!scene->mesh || !cpu_blas_hit(scene->mesh, ray, t_min, &t_max, &tri, bary, NULL))
+        return FALSE;
+
+    normal = cpu_triangle_normal(scene->mesh, tri, bary);
+    hit->t = t_max;
+    hit->p = vec3_add(ray->origin, vec3_scal(ray->direction, t_max));
+    hit->material = scene->mesh_material;
+    cpu_set_face_normal(ray, vec3_scal(normal, 1.0f / sqrtf(vec3_dot(normal, normal))), hit);
+    if (scene->materials[hit->material].texture != TEXTURE_NONE)
+        cpu_triangle_uv(scene->mesh, tri, bary, hit);
+
+    return TRUE;
+}
+
+// Top level traversal; every instance leaf moves the ray into object space
+// and descends its BLAS
+internal b32
+cpu_tlas_hit(scene_t *scene,
+             cpu_ray_t *ray,
+             f32 t_min,
+             f32 t_max,
+             cpu_hit_t *hit)
+{
+    tlas_t          *tlas = scene->tlas;
+    bvh_node_t      *nodes;
+    u32             stack[BVH_MAX_DEPTH];
+    u32             stack_size = 0;
+    u32             node = 0;
+    u32             hit_instance = U32_MAX,
+                    hit_tri = 0;
+    f32             hit_bary[3];
+    f32             inv_dir[3] = {1.0f / ray->direction.x, 1.0f / ray->direction.y, 1.0f / ray->direction.z};
+    f32             *origin = &ray->origin.x;
+
+
+    if (!tlas || !tlas->bvh.num_nodes)
+        return FALSE;
+
+    nodes = tlas->bvh.nodes;
+    if (cpu_node_hit(&nodes[0], origin, inv_dir, t_min, t_max) < 0.0f)
+        return FALSE;
+
+    for (;;)
+    {
+        if (nodes[node].count)
+        {
+            for (u32 i = 0; i < nodes[node].count; i++)
+            {
+                u32                 index = tlas->bvh.prims[nodes[node].left_first + i];
+                tlas_instance_t     *instance = &tlas->instances[index];
+                cpu_ray_t           object_ray;
+
+
+                object_ray.origin = vec4_to_vec3(mat4_mult_vec4(instance->world_to_object,
+                                                                vec4_from_vec3(ray->origin, 1.0f)));
+                object_ray.direction = vec4_to_vec3(mat4_mult_vec4(instance->world_to_object,
+                                                                   vec4_from_vec3(ray->direction, 0.0f)));
+                if (cpu_blas_hit(tlas->blas[instance->blas], &object_ray, t_min, &t_max, &hit_tri, hit_bary, NULL))
+                    hit_instance = index;
+            }
+        }
+        else
+        {
+            u32 left = nodes[node].left_first;
+            f32 t_left = cpu_node_hit(&nodes[left], origin, inv_dir, t_min, t_max);
+            f32 t_right = cpu_node_hit(&nodes[left + 1], origin, inv_dir, t_min, t_max);
+
+            if (t_left >= 0.0f && t_right >= 0.0f)
+            {
+                node = (t_left <= t_right) ? left : left + 1;
+                if (stack_size < BVH_MAX_DEPTH)
+                    stack[stack_size++] = (t_left <= t_right) ? left + 1 : left;
+                continue;
+            }
+            if (t_left >= 0.0f || t_right >= 0.0f)
+            {
+                node = (t_left >= 0.0f) ? left : left + 1;
+                continue;
+            }
+        }
+
+        if (!stack_size)
+            break;
+        node = stack[--stack_size];
+    }
+
+    if (hit_instance == U32_MAX)
+        return FALSE;
+
+    // Normals go back to world space with the transposed inverse
+    tlas_instance_t *instance = &tlas->instances[hit_instance];
+    vec3_t          n = cpu_triangle_normal(tlas->blas[instance->blas], hit_tri, hit_bary);
+    mat4_t          *m = &instance->world_to_object;
+    vec3_t          normal;
+
+
+    normal.x = m->col1[0] * n.x + m->col1[1] * n.y + m->col1[2] * n.z;
+    normal.y = m->col2[0] * n.x + m->col2[1] * n.y + m->col2[2] * n.z;
+    normal.z = m->col3[0] * n.x + m->col3[1] * n.y + m->col3[2] * n.z;
+
+    hit->t = t_max;
+    hit->p = vec3_add(ray->origin, vec3_scal(ray->direction, t_max));
+    hit->material = instance->material;
+    cpu_set_face_normal(ray, vec3_scal(normal, 1.0f / sqrtf(vec3_dot(normal, normal))), hit);
+
+    return TRUE;
+}
+
+// Closest sphere of the cloud through its BVH
+internal b32
+cpu_cloud_hit(scene_t *scene,
+              cpu_ray_t *ray,
+              f32 t_min,
+              f32 t_max,
+              cpu_hit_t *hit)
+{
+    scene_cloud_t   *cloud = scene->cloud;
+    bvh_node_t      *nodes;
+    u32             stack[BVH_MAX_DEPTH];
+    u32             stack_size = 0;
+    u32             node = 0;
+    u32             hit_sphere = U32_MAX;
+    f32             a = vec3_dot(ray->direction, ray->direction);
+    f32             inv_dir[3] = {1.0f / ray->direction.x, 1.0f / ray->direction.y, 1.0f / ray->direction.z};
+    f32             *origin = &ray->origin.x;
+
+
+    if (!cloud || !cloud->bvh.num_nodes)
+        return FALSE;
+
+    nodes = cloud->bvh.nodes;
+    if (cpu_node_hit(&nodes[0], origin, inv_dir, t_min, t_max) < 0.0f)
+        return FALSE;
+
+    for (;;)
+    {
+        if (nodes[node].count)
+        {
+            for (u32 i = 0; i < nodes[node].count; i++)
+            {
+                u32     index = cloud->bvh.prims[nodes[node].left_first + i];
+                f32     *sphere = &cloud->spheres[index * 4];
+                vec3_t  oc = {ray->origin.x - sphere[0], ray->origin.y - sphere[1], ray->origin.z - sphere[2]};
+                f32     half_b = vec3_dot(oc, ray->direction);
+                f32     c = vec3_dot(oc, oc) - sphere[3] * sphere[3];
+                f32     disc = half_b * half_b - a * c;
+
+
+                if (disc < 0)
+                    continue;
+
+                f32 sqrtd = sqrtf(disc);
+                f32 root = (-half_b - sqrtd) / a;
+                if (root < t_min || root > t_max)
+                {
+                    root = (-half_b + sqrtd) / a;
+                    if (root < t_min || root > t_max)
+                        continue;
+                }
+
+                t_max = root;
+                hit_sphere = index;
+            }
+        }
+        else
+        {
+            u32 left = nodes[node].left_first;
+            f32 t_left = cpu_node_hit(&nodes[left], origin, inv_dir, t_min, t_max);
+            f32 t_right = cpu_node_hit(&nodes[left + 1], origin, inv_dir, t_min, t_max);
+
+            if (t_left >= 0.0f && t_right >= 0.0f)
+            {
+                node = (t_left <= t_right) ? left : left + 1;
+                if (stack_size < BVH_MAX_DEPTH)
+                    stack[stack_size++] = (t_left <= t_right) ? left + 1 : left;
+                continue;
+            }
+            if (t_left >= 0.0f || t_right >= 0.0f)
+            {
+                node = (t_left >= 0.0f) ? left : left + 1;
+                continue;
+            }
+        }
+
+        if (!stack_size)
+            break;
+        node = stack[--stack_size];
+    }
+
+    if (hit_sphere == U32_MAX)
+        return FALSE;
+
+    f32     *sphere = &cloud->spheres[hit_sphere * 4];
+    vec3_t  center = {sphere[0], sphere[1], sphere[2]};
+
+    hit->t = t_max;
+    hit->p = vec3_add(ray->origin, vec3_scal(ray->direction, t_max));
+    hit->material = cloud->materials[hit_sphere];
+    cpu_set_face_normal(ray, vec3_scal(vec3_sub(hit->p, center), 1.0f / sphere[3]), hit);
+
+    return TRUE;
+}
+
+b32
+cpu_scene_hit(scene_t *scene,
+              cpu_ray_t *ray,
+              f32 t_min,
+              f32 t_max,
+              cpu_hit_t *hit)
+{
+    f32 t;
+    s32 sphere = cpu_intersect_spheres(scene, ray, t_min, t_max, &t);
+    b32 found = sphere >= 0;
+
+    if (found)
+        cpu_sphere_hit_record(scene, ray, sphere, t, hit);
+    found |= cpu_planes_hit(scene, ray, t_min, t, hit);
+    found |= cpu_mesh_hit(scene, ray, t_min, found ? hit->t : t_max, hit);
+    found |= cpu_tlas_hit(scene, ray, t_min, found ? hit->t : t_max, hit);
+    found |= cpu_cloud_hit(scene, ray, t_min, found ? hit->t : t_max, hit);
+
+    return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SHADING
+
+internal vec3_t
+cpu_reflect(vec3_t v,
+            vec3_t n)
+{
+    return vec3_sub(v, vec3_scal(n, 2.0f * vec3_dot(n, v)));
+}
+
+internal vec3_t
+cpu_refract(vec3_t v,
+            vec3_t n,
+            f32 eta)
+{
+    f32 d = vec3_dot(n, v);
+    f32 k = 1.0f - eta * eta * (1.0f - d * d);
+    vec3_t zero = {0.0f, 0.0f, 0.0f};
+
+    if (k < 0.0f)
+        return zero;
+
+    return vec3_sub(vec3_scal(v, eta), vec3_scal(n, eta * d + sqrtf(k)));
+}
+
+internal f32
+cpu_schlick(f32 cosine,
+            f32 ref_idx)
+{
+    f32 r0 = (1 - ref_idx) / (1 + ref_idx);
+    r0 = r0 * r0;
+
+    return r0 + (1 - r0) * powf(1 - cosine, 5);
+}
+
+// Albedo through the material's texture layer, at the ray cone's level
+internal vec3_t
+cpu_albedo(scene_t *scene,
+           scene_material_t *mat,
+           cpu_ray_t *ray,
+           cpu_hit_t *hit)
+{
+    f32     cosine;
+    f32     lod;
+    vec3_t  texel;
+
+
+    if (mat->texture == TEXTURE_NONE || !scene->textures || mat->texture >= scene->textures->num_layers)
+        return mat->albedo;
+
+    cosine = vec3_dot(ray->direction, hit->normal) / sqrtf(vec3_dot(ray->direction, ray->direction));
+    lod = texture_lod(hit->cone_width, hit->uv_density, cosine);
+    texel = texture_sample(scene->textures, mat->texture, hit->u, hit->v, lod);
+    texel.x *= mat->albedo.x;
+    texel.y *= mat->albedo.y;
+    texel.z *= mat->albedo.z;
+
+    return texel;
+}
+
+internal b32
+cpu_scatter(scene_t *scene,
+            scene_material_t *mat,
+            cpu_ray_t *ray,
+            cpu_hit_t *hit,
+            u32 *state,
+            vec3_t *atten,
+            cpu_ray_t *scattered)
+{
+    scattered->origin = hit->p;
+
+    switch (mat->type)
+    {
+        case MAT_METAL:
+        {
+            vec3_t reflected = cpu_reflect(vec3_normalize(ray->direction), hit->normal);
+            scattered->direction = vec3_add(reflected, vec3_scal(cpu_random_in_unit_sphere(state), mat->fuzz));
+            *atten = cpu_albedo(scene, mat, ray, hit);
+
+            return vec3_dot(scattered->direction, hit->normal) > 0;
+        }
+
+        case MAT_DIELECTRIC:
+        {
+            f32 ratio = hit->front_face ? (1.0f / mat->idx_ref) : mat->idx_ref;
+            vec3_t unit_dir = vec3_normalize(ray->direction);
+            f32 cos_theta = fminf(-vec3_dot(unit_dir, hit->normal), 1.0f);
+            f32 sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+
+            if (ratio * sin_theta > 1.0f || cpu_schlick(cos_theta, ratio) > cpu_randf(state))
+                scattered->direction = cpu_reflect(unit_dir, hit->normal);
+            else
+                scattered->direction = cpu_refract(unit_dir, hit->normal, ratio);
+            atten->x = atten->y = atten->z = 1.0f;
+
+            return TRUE;
+        }
+
+        case MAT_CHECKERED:
+        {
+            f32 sines = sinf(10 * hit->p.x) * sinf(10 * hit->p.y) * sinf(10 * hit->p.z);
+
+            scattered->direction = vec3_add(hit->normal, cpu_random_unit_vector(state));
+            *atten = (sines < 0) ? mat->checker_even : mat->checker_odd;
+
+            return TRUE;
+        }
+
+        default:    // MAT_LAMBERTIAN
+        {
+            scattered->direction = vec3_add(hit->normal, cpu_random_unit_vector(state));
+            *atten = cpu_albedo(scene, mat, ray, hit);
+
+            return TRUE;
+        }
+    }
+}
+
+internal f32
+cpu_power_heuristic(f32 pdf,
+                    f32 other_pdf)
+{
+    return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+}
+
+// Sky along `direction`. An environment hit that next event estimation
+// could have sampled too (bsdf_pdf > 0) only gets its MIS share.
+internal vec3_t
+cpu_sky(scene_t *scene,
+        vec3_t direction,
+        f32 bsdf_pdf)
+{
+    vec3_t  radiance;
+    f32     light_pdf;
+    f32     t;
+
+
+    if (!scene->environment)
+    {
+        t = 0.5f * (vec3_normalize(direction).y + 1.0f);
+        return vec3_add(vec3_scal(scene->sky_horizon, 1.0f - t), vec3_scal(scene->sky_zenith, t));
+    }
+
+    direction = vec3_scal(direction, 1.0f / sqrtf(vec3_dot(direction, direction)));
+    radiance = envmap_lookup(scene->environment, direction, &light_pdf);
+
+    return (bsdf_pdf > 0.0f) ? vec3_scal(radiance, cpu_power_heuristic(bsdf_pdf, light_pdf)) : radiance;
+}
+
+// Next event estimation towards the environment from a diffuse hit: f cos
+// over pdf without the albedo, MIS weighted against the diffuse bounce
+internal vec3_t
+cpu_environment_light(scene_t *scene,
+                      cpu_hit_t *hit,
+                      u32 *state)
+{
+    vec3_t      black = {0.0f, 0.0f, 0.0f};
+    vec3_t      radiance;
+    cpu_ray_t   shadow;
+    cpu_hit_t   blocker;
+    f32         u1 = cpu_randf(state);
+    f32         u2 = cpu_randf(state);
+    f32         light_pdf,
+                bsdf_pdf,
+                cosine;
+
+
+    radiance = envmap_sample(scene->environment, u1, u2, &shadow.direction, &light_pdf);
+    cosine = vec3_dot(hit->normal, shadow.direction);
+    if (cosine <= 0.0f || light_pdf <= 0.0f)
+        return black;
+
+    shadow.origin = hit->p;
+    if (cpu_scene_hit(scene, &shadow, 0.001f, 100000000000.0f, &blocker))
+        return black;
+
+    bsdf_pdf = cosine / 3.1415926f;
+
+    return vec3_scal(radiance, bsdf_pdf / light_pdf * cpu_power_heuristic(light_pdf, bsdf_pdf));
+}
+
+// Continues a path whose first hit (if any) came from a packet. `spread`
+// is the angle of the path's ray cone.
+internal vec3_t
+cpu_trace(scene_t *scene,
+          cpu_ray_t *primary,
+          cpu_hit_t *first,
+          b32 first_found,
+          f32 spread,
+          u32 *state)
+{
+    vec3_t      color = {scene->exposure, scene->exposure, scene->exposure};
+    vec3_t      black = {0.0f, 0.0f, 0.0f};
+    vec3_t      radiance = black;
+    vec3_t      atten;
+    cpu_ray_t   ray = *primary;
+    cpu_ray_t   scattered;
+    cpu_hit_t   hit = *first;
+    b32         found = first_found;
+    f32         cone_width = 0.0f;
+    f32         bsdf_pdf = 0.0f;    // of the last bounce, if the environment was sampled there too
+    u32         i;
+
+
+    if (scene->shade_normals)
+    {
+        vec3_t one = {1.0f, 1.0f, 1.0f};
+        return found ? vec3_scal(vec3_add(hit.normal, one), 0.5f) : cpu_sky(scene, primary->direction, 0.0f);
+    }
+
+    for (i = 0; i < scene->max_depth; i++)
+    {
+        if (i > 0)
+            found = cpu_scene_hit(scene, &ray, 0.001f, 100000000000.0f, &hit);
+
+        if (!found)
+        {
+            vec3_t c = cpu_sky(scene, ray.direction, bsdf_pdf);
+            radiance.x += color.x * c.x;
+            radiance.y += color.y * c.y;
+            radiance.z += color.z * c.z;
+            break;
+        }
+
+        // Directions of scattered rays aren't unit length
+        cone_width += spread * hit.t * sqrtf(vec3_dot(ray.direction, ray.direction));
+        hit.cone_width = cone_width;
+
+        if (!cpu_scatter(scene, &scene->materials[hit.material], &ray, &hit, state, &atten, &scattered))
+        {
+            if (scene->absorb_keeps)
+                radiance = vec3_add(radiance, color);
+            break;
+        }
+
+        bsdf_pdf = 0.0f;
+        if (scene->environment && (scene->materials[hit.material].type == MAT_LAMBERTIAN ||
+                                   scene->materials[hit.material].type == MAT_CHECKERED))
+        {
+            vec3_t light = cpu_environment_light(scene, &hit, state);
+            vec3_t dir = scattered.direction;
+
+            radiance.x += color.x * atten.x * light.x;
+            radiance.y += color.y * atten.y * light.y;
+            radiance.z += color.z * atten.z * light.z;
+            bsdf_pdf = fmaxf(vec3_dot(hit.normal, dir), 0.0f) / (sqrtf(vec3_dot(dir, dir)) * 3.1415926f);
+        }
+
+        color.x *= atten.x;
+        color.y *= atten.y;
+        color.z *= atten.z;
+        ray = scattered;
+    }
+
+    // Paths that run out keep their colour in kernels with a short max
+    // depth; the others test against 50 whatever their max depth
+    if (i == scene->max_depth)
+        return (i < 50) ? color : black;
+
+    return radiance;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// RENDERER
+
+void
+cpu_renderer_init(cpu_renderer_t *renderer,
+                  s32 width,
+                  s32 height,
+                  u32 num_threads)
+{
+    renderer->scene = NULL;
+    renderer->width = width;
+    renderer->height = height;
+    renderer->accum = (f32 *)calloc((usize)width * height * 3, sizeof(f32));
+    renderer->pixels = (f32 *)calloc((usize)width * height * 4, sizeof(f32));
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads)
+        num_threads = 1;
+    if (num_threads > CPU_MAX_THREADS)
+        num_threads = CPU_MAX_THREADS;
+    renderer->num_threads = num_threads;
+
+    renderer->tiles_x = (width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+    renderer->num_tiles = renderer->tiles_x * ((height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE);
+    renderer->tile_order = (u32 *)malloc(renderer->num_tiles * sizeof(u32));
+    cpu_renderer_set_order(renderer, CPU_DEFAULT_ORDER);
+}
+
+void
+cpu_renderer_free(cpu_renderer_t *renderer)
+{
+    free(renderer->accum);
+    free(renderer->pixels);
+    free(renderer->tile_order);
+    renderer->accum = NULL;
+    renderer->pixels = NULL;
+    renderer->tile_order = NULL;
+}
+
+// Order of the tiles and of the packets in a tile, one of the CURVE_*
+void
+cpu_renderer_set_order(cpu_renderer_t *renderer,
+                       u32 order)
+{
+    renderer->order = order;
+    curve_order(order, renderer->tiles_x, renderer->num_tiles / renderer->tiles_x, renderer->tile_order);
+    curve_order(order, CPU_TILE_SIZE / CPU_PACKET_SIZE, CPU_TILE_SIZE, renderer->packet_order);
+}
+
+internal void
+cpu_render_tile(cpu_renderer_t *renderer,
+                u32 tile)
+{
+    scene_t         *scene = renderer->scene;
+    cpu_camera_t    *camera = &renderer->camera;
+    cpu_packet_t    packet;
+    cpu_ray_t       rays[CPU_PACKET_SIZE];
+    cpu_hit_t       hit = {0};
+    u32             state[CPU_PACKET_SIZE];
+    vec3_t          color[CPU_PACKET_SIZE];
+    s32             x0 = (tile % renderer->tiles_x) * CPU_TILE_SIZE;
+    s32             y0 = (tile / renderer->tiles_x) * CPU_TILE_SIZE;
+    s32             x1 = x0 + CPU_TILE_SIZE < renderer->width ? x0 + CPU_TILE_SIZE : renderer->width;
+    s32             y1 = y0 + CPU_TILE_SIZE < renderer->height ? y0 + CPU_TILE_SIZE : renderer->height;
+    f32             t_min = scene->shade_normals ? 0.0f : 0.001f;
+    f32             t_max = scene->shade_normals ? 10000000.0f : 100000000000.0f;
+    u32             total = renderer->sample_base + renderer->samples;
+
+
+    packet.origin = camera->origin;
+
+    for (u32 p = 0; p < CPU_TILE_PACKETS; p++)
+    {
+        s32 x = x0 + (renderer->packet_order[p] % (CPU_TILE_SIZE / CPU_PACKET_SIZE)) * CPU_PACKET_SIZE;
+        s32 y = y0 + renderer->packet_order[p] / (CPU_TILE_SIZE / CPU_PACKET_SIZE);
+
+        // Edge tiles are cut short
+        if (x >= x1 || y >= y1)
+            continue;
+
+        for (u32 k = 0; k < CPU_PACKET_SIZE; k++)
+        {
+            state[k] = (u32)((x + k) * 1973 + y * 9277) + renderer->sample_base * 26699;
+            color[k].x = color[k].y = color[k].z = 0.0f;
+        }
+
+        for (u32 s = 0; s < renderer->samples; s++)
+        {
+            for (u32 k = 0; k < CPU_PACKET_SIZE; k++)
+            {
+                f32 u = x + (f32)k;
+                f32 v = (f32)y;
+
+                if (!scene->shade_normals)
+                {
+                    u += cpu_randf(&state[k]);
+                    v += cpu_randf(&state[k]);
+                }
+                rays[k] = cpu_get_ray(camera, u / camera->resolution.x, v / camera->resolution.y);
+                packet.dx[k] = rays[k].direction.x;
+                packet.dy[k] = rays[k].direction.y;
+                packet.dz[k] = rays[k].direction.z;
+            }
+
+            cpu_intersect_packet(scene, &packet, t_min, t_max);
+
+            for (u32 k = 0; k < CPU_PACKET_SIZE; k++)
+            {
+                b32 found = packet.sphere[k] >= 0;
+
+                if (found)
+                    cpu_sphere_hit_record(scene, &rays[k], packet.sphere[k], packet.t[k], &hit);
+                found |= cpu_planes_hit(scene, &rays[k], t_min, packet.t[k], &hit);
+                found |= cpu_mesh_hit(scene, &rays[k], t_min, found ? hit.t : t_max, &hit);
+                found |= cpu_tlas_hit(scene, &rays[k], t_min, found ? hit.t : t_max, &hit);
+                found |= cpu_cloud_hit(scene, &rays[k], t_min, found ? hit.t : t_max, &hit);
+
+                vec3_t c = cpu_trace(scene, &rays[k], &hit, found, camera->spread, &state[k]);
+                color[k] = vec3_add(color[k], c);
+            }
+        }
+
+        // Accumulate linearly, store gamma corrected like write_color
+        // (chapter 7 writes its colour as is)
+        for (u32 k = 0; k < CPU_PACKET_SIZE && x + (s32)k < x1; k++)
+        {
+            usize i = (usize)y * renderer->width + x + k;
+            f32 *sum = renderer->accum + i * 3;
+            f32 *out = renderer->pixels + i * 4;
+
+            if (renderer->sample_base == 0)
+                sum[0] = sum[1] = sum[2] = 0.0f;
+            sum[0] += color[k].x;
+            sum[1] += color[k].y;
+            sum[2] += color[k].z;
+
+            out[0] = sum[0] / total;
+            out[1] = sum[1] / total;
+            out[2] = sum[2] / total;
+            if (!scene->shade_normals)
+            {
+                out[0] = sqrtf(out[0]);
+                out[1] = sqrtf(out[1]);
+                out[2] = sqrtf(out[2]);
+            }
+            out[3] = 1.0f;
+        }
+    }
+}
+
+internal void
+cpu_render_worker(cpu_renderer_t *renderer)
+{
+    u32 tile;
+
+    while ((tile = renderer->next_tile.fetch_add(1)) < renderer->num_tiles)
+        cpu_render_tile(renderer, renderer->tile_order[tile]);
+}
+
+// Renders `samples` more samples per pixel on top of the `sample_base`
+// already accumulated (0 starts over) and resolves into renderer->pixels
+void
+cpu_render_pass(cpu_renderer_t *renderer,
+                scene_t *scene,
+                mat4_t view,
+                mat4_t proj,
+                vec2_t resolution,
+                u32 sample_base,
+                u32 samples)
+{
+    std::thread threads[CPU_MAX_THREADS];
+
+    renderer->scene = scene;
+    renderer->sample_base = sample_base;
+    renderer->samples = samples;
+    renderer->next_tile.store(0);
+    cpu_camera_setup(&renderer->camera, view, proj, resolution);
+
+    for (u32 i = 1; i < renderer->num_threads; i++)
+        threads[i] = std::thread(cpu_render_worker, renderer);
+    cpu_render_worker(renderer);
+    for (u32 i = 1; i < renderer->num_threads; i++)
+        threads[i].join();
+}
+
+#endif // CPU_RENDER_IMPL
+
+#endif // CPU_RENDER_H
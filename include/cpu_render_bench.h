@@ -0,0 +1,358 @@
+#ifndef CPU_RENDER_BENCH_H
+#define CPU_RENDER_BENCH_H
+
+// Primary ray throughput of the CPU backend on the sphere field scene: the
+// scalar port of scene_hit against the SIMD 1-ray-vs-N-spheres kernel and
+// the coherent packet kernel, single threaded, followed by a full path
+// traced frame on all threads. Then the instance scene: top level build
+// against refit after moving every instance, and primary rays against a
+// finely tessellated torus through its compressed 4-wide BVH and the binary
+// one it was collapsed from. Both frames are rendered once per tile order
+// too, with the cache misses the hardware counters saw where Linux lets us
+// read them. Run with --bench-cpu.
+
+#include <stdio.h>
+#include <chrono>
+#include "cpu_render.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define CPU_BENCH_WIDTH     1600
+#define CPU_BENCH_HEIGHT    900
+#define CPU_BENCH_INSTANCES 128     // per side
+#define CPU_BENCH_RINGS     1024    // fine torus, 1M triangles
+#define CPU_BENCH_SIDES     512
+#define CPU_BENCH_COUNTERS  2       // last level and L1 data cache misses
+
+void        cpu_render_bench(void);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== CPU RENDER BENCH IMPLEMENTATION ====================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef CPU_RENDER_BENCH_IMPL
+
+internal f64
+cpu_bench_now(void)
+{
+    return std::chrono::duration<f64>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Cache miss counters of this process, threads it starts later included;
+// -1 where they can't be opened (not Linux, no PMU in a VM, perf_event
+// paranoia)
+internal void
+cpu_bench_counters_open(s32 *fds)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+
+    for (u32 i = 0; i < CPU_BENCH_COUNTERS; i++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        if (i == 0)
+        {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        else
+        {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[i] = (s32)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#else
+    for (u32 i = 0; i < CPU_BENCH_COUNTERS; i++)
+        fds[i] = -1;
+#endif
+}
+
+internal void
+cpu_bench_counters_close(s32 *fds)
+{
+#ifdef __linux__
+    for (u32 i = 0; i < CPU_BENCH_COUNTERS; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+#endif
+}
+
+internal void
+cpu_bench_counters_start(s32 *fds)
+{
+#ifdef __linux__
+    for (u32 i = 0; i < CPU_BENCH_COUNTERS; i++)
+    {
+        if (fds[i] < 0)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+// Counts since cpu_bench_counters_start(), U64_MAX for the unavailable
+// ones. Threads only add theirs when they exit, so join them first.
+internal void
+cpu_bench_counters_stop(s32 *fds,
+                        u64 *counts)
+{
+    for (u32 i = 0; i < CPU_BENCH_COUNTERS; i++)
+    {
+        counts[i] = U64_MAX;
+#ifdef __linux__
+        if (fds[i] < 0)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[i], &counts[i], sizeof(counts[i])) != sizeof(counts[i]))
+            counts[i] = U64_MAX;
+#endif
+    }
+}
+
+// One 1 spp frame of `scene` per tile order, timed and with its misses
+internal void
+cpu_bench_orders(cpu_renderer_t *renderer,
+                 scene_t *scene,
+                 mat4_t view,
+                 mat4_t proj,
+                 vec2_t resolution)
+{
+    s32 fds[CPU_BENCH_COUNTERS];
+    u32 order = renderer->order;
+
+
+    cpu_bench_counters_open(fds);
+    for (u32 c = 0; c < CURVE_COUNT; c++)
+    {
+        u64 misses[CPU_BENCH_COUNTERS];
+        f64 start;
+        f64 frame_s;
+
+        cpu_renderer_set_order(renderer, c);
+        cpu_bench_counters_start(fds);
+        start = cpu_bench_now();
+        cpu_render_pass(renderer, scene, view, proj, resolution, 0, 1);
+        frame_s = cpu_bench_now() - start;
+        cpu_bench_counters_stop(fds, misses);
+
+        printf("  %-8s %8.1f ms", curve_names[c], frame_s * 1000.0);
+        if (misses[0] != U64_MAX)
+            printf("  %8.2fM LLC misses", misses[0] * 1.0e-6);
+        if (misses[1] != U64_MAX)
+            printf("  %8.2fM L1D misses", misses[1] * 1.0e-6);
+        if (misses[0] == U64_MAX && misses[1] == U64_MAX)
+            printf("  (no cache counters)");
+        printf("\n");
+    }
+    cpu_bench_counters_close(fds);
+    cpu_renderer_set_order(renderer, order);
+}
+
+void
+cpu_render_bench(void)
+{
+    scene_t         scene;
+    cpu_renderer_t  renderer;
+    cpu_camera_t    camera;
+    cpu_packet_t    packet;
+    cpu_ray_t       *rays;
+    s32             *reference;
+    u32             num_rays = CPU_BENCH_WIDTH * CPU_BENCH_HEIGHT;
+    u32             hits = 0,
+                    mismatches;
+    f64             start,
+                    scalar_s,
+                    simd_s,
+                    packet_s,
+                    frame_s;
+    f32             t;
+    vec2_t          resolution = {CPU_BENCH_WIDTH, CPU_BENCH_HEIGHT};
+    vec3_t          eye = {13.0f, 2.0f, 3.0f};
+    vec3_t          center = {0.0f, 0.0f, 0.0f};
+    vec3_t          up = {0.0f, 1.0f, 0.0f};
+    vec3_t          eye_instances = {0.0f, 0.5f, 1.0f};
+    vec3_t          center_instances = {0.0f, 0.0f, -10.0f};
+    mat4_t          view = mat4_lookat(eye, center, up);
+    mat4_t          proj = mat4_perspective(20.0f, resolution.x / resolution.y, 0.1f, 100.0f);
+
+
+    scene_init(&scene);
+    scene_load_sphere_field(&scene, 1);
+    cpu_camera_setup(&camera, view, proj, resolution);
+
+    rays = (cpu_ray_t *)malloc(num_rays * sizeof(cpu_ray_t));
+    reference = (s32 *)malloc(num_rays * sizeof(s32));
+    for (u32 y = 0; y < CPU_BENCH_HEIGHT; y++)
+        for (u32 x = 0; x < CPU_BENCH_WIDTH; x++)
+            rays[y * CPU_BENCH_WIDTH + x] = cpu_get_ray(&camera, (x + 0.5f) / resolution.x,
+                                                        (y + 0.5f) / resolution.y);
+
+    printf("cpu backend: %u lanes, %u ray packets, %u spheres, %ux%u primary rays\n",
+           CPU_LANES, CPU_PACKET_SIZE, scene.num_spheres, CPU_BENCH_WIDTH, CPU_BENCH_HEIGHT);
+
+    // Scalar port
+    start = cpu_bench_now();
+    for (u32 i = 0; i < num_rays; i++)
+        reference[i] = cpu_intersect_spheres_scalar(&scene, &rays[i], 0.001f, 1.0e11f, &t);
+    scalar_s = cpu_bench_now() - start;
+    for (u32 i = 0; i < num_rays; i++)
+        hits += (reference[i] >= 0);
+
+    // One ray against CPU_LANES spheres
+    mismatches = 0;
+    start = cpu_bench_now();
+    for (u32 i = 0; i < num_rays; i++)
+        mismatches += (cpu_intersect_spheres(&scene, &rays[i], 0.001f, 1.0e11f, &t) != reference[i]);
+    simd_s = cpu_bench_now() - start;
+    printf("%-18s %8.2f Mrays/s\n", "scalar", num_rays / scalar_s * 1.0e-6);
+    printf("%-18s %8.2f Mrays/s  %5.2fx  %u mismatches\n", "1 ray x N spheres",
+           num_rays / simd_s * 1.0e-6, scalar_s / simd_s, mismatches);
+
+    // Packets of horizontally adjacent rays (the bench width is a multiple
+    // of the packet size)
+    mismatches = 0;
+    packet.origin = camera.origin;
+    start = cpu_bench_now();
+    for (u32 i = 0; i < num_rays; i += CPU_PACKET_SIZE)
+    {
+        for (u32 k = 0; k < CPU_PACKET_SIZE; k++)
+        {
+            packet.dx[k] = rays[i + k].direction.x;
+            packet.dy[k] = rays[i + k].direction.y;
+            packet.dz[k] = rays[i + k].direction.z;
+        }
+        cpu_intersect_packet(&scene, &packet, 0.001f, 1.0e11f);
+        for (u32 k = 0; k < CPU_PACKET_SIZE; k++)
+            mismatches += (packet.sphere[k] != reference[i + k]);
+    }
+    packet_s = cpu_bench_now() - start;
+    printf("%-18s %8.2f Mrays/s  %5.2fx  %u mismatches\n", "packets",
+           num_rays / packet_s * 1.0e-6, scalar_s / packet_s, mismatches);
+    printf("%u of %u rays hit\n", hits, num_rays);
+
+    // Full frame, all threads
+    cpu_renderer_init(&renderer, CPU_BENCH_WIDTH, CPU_BENCH_HEIGHT, 0);
+    start = cpu_bench_now();
+    cpu_render_pass(&renderer, &scene, view, proj, resolution, 0, 1);
+    frame_s = cpu_bench_now() - start;
+    printf("1 spp path traced frame on %u threads: %.1f ms\n", renderer.num_threads, frame_s * 1000.0);
+    cpu_bench_orders(&renderer, &scene, view, proj, resolution);
+
+    // Instances of a torus and a ball
+    mesh_t  torus,
+            ball;
+    tlas_t  tlas;
+    f64     build_s,
+            refit_s;
+    vec3_t  torus_center = {0.0f, 0.0f, 0.0f};
+
+
+    mesh_make_torus(&torus, 1.0f, 0.35f, 96, 48);
+    mesh_fit(&torus, torus_center, 1.0f);
+    mesh_build_bvh(&torus, 0);
+    mesh_make_sphere(&ball, 0.5f, 24, 48);
+    mesh_build_bvh(&ball, 0);
+    scene_make_instances(&tlas, &torus, &ball, CPU_BENCH_INSTANCES);
+
+    start = cpu_bench_now();
+    tlas_build(&tlas);
+    build_s = cpu_bench_now() - start;
+
+    for (u32 i = 0; i < tlas.num_instances; i++)
+        tlas_set_transform(&tlas, i, mat4_mult(mat4_translate(0.0f, 0.1f, 0.0f), tlas.object_to_world[i]));
+    start = cpu_bench_now();
+    tlas_refit(&tlas);
+    refit_s = cpu_bench_now() - start;
+
+    printf("%u instances of %u triangles: tlas build %.2f ms, refit %.2f ms (SAH %.1f)\n",
+           tlas.num_instances, torus.num_triangles + ball.num_triangles,
+           build_s * 1000.0, refit_s * 1000.0, bvh_sah_cost(&tlas.bvh));
+
+    scene_load_builtin(&scene, 10, NULL, &tlas, NULL, NULL, NULL);
+    view = mat4_lookat(eye_instances, center_instances, up);
+    proj = mat4_perspective(70.0f, resolution.x / resolution.y, 0.1f, 100.0f);
+    start = cpu_bench_now();
+    cpu_render_pass(&renderer, &scene, view, proj, resolution, 0, 1);
+    frame_s = cpu_bench_now() - start;
+    printf("1 spp instance frame on %u threads: %.1f ms\n", renderer.num_threads, frame_s * 1000.0);
+    cpu_bench_orders(&renderer, &scene, view, proj, resolution);
+
+    // Mesh BVH layouts, one thread
+    mesh_t  fine;
+    u32     *binary_tri = (u32 *)malloc(num_rays * sizeof(u32));
+    f32     *binary_t = (f32 *)malloc(num_rays * sizeof(f32));
+    u32     binary_steps = 0,
+            wide_steps = 0;
+    f64     binary_s,
+            wide_s;
+    f32     bary[3];
+    vec3_t  eye_mesh = {0.0f, 0.8f, 1.2f};
+
+
+    mesh_make_torus(&fine, 1.0f, 0.35f, CPU_BENCH_RINGS, CPU_BENCH_SIDES);
+    mesh_fit(&fine, torus_center, 1.0f);
+    mesh_build_bvh(&fine, 0);
+    cpu_camera_setup(&camera, mat4_lookat(eye_mesh, torus_center, up), proj, resolution);
+    for (u32 y = 0; y < CPU_BENCH_HEIGHT; y++)
+        for (u32 x = 0; x < CPU_BENCH_WIDTH; x++)
+            rays[y * CPU_BENCH_WIDTH + x] = cpu_get_ray(&camera, (x + 0.5f) / resolution.x,
+                                                        (y + 0.5f) / resolution.y);
+
+    start = cpu_bench_now();
+    for (u32 i = 0; i < num_rays; i++)
+    {
+        binary_t[i] = 1.0e11f;
+        binary_tri[i] = U32_MAX;
+        cpu_blas_hit_binary(&fine, &rays[i], 0.001f, &binary_t[i], &binary_tri[i], bary, &binary_steps);
+    }
+    binary_s = cpu_bench_now() - start;
+
+    mismatches = 0;
+    start = cpu_bench_now();
+    for (u32 i = 0; i < num_rays; i++)
+    {
+        u32 tri = U32_MAX;
+
+        t = 1.0e11f;
+        cpu_blas_hit(&fine, &rays[i], 0.001f, &t, &tri, bary, &wide_steps);
+        mismatches += ((tri == U32_MAX) != (binary_tri[i] == U32_MAX) || fabsf(t - binary_t[i]) > 1.0e-5f * t);
+    }
+    wide_s = cpu_bench_now() - start;
+
+    printf("%u triangle mesh: binary BVH %.1f MB, BVH4 %.1f MB\n", fine.num_triangles,
+           fine.bvh.num_nodes * sizeof(bvh_node_t) / 1048576.0,
+           fine.bvh4.num_nodes * sizeof(bvh4_node_t) / 1048576.0);
+    printf("%-18s %8.2f Mrays/s  %5.1f nodes/ray\n", "binary BVH",
+           num_rays / binary_s * 1.0e-6, (f64)binary_steps / num_rays);
+    printf("%-18s %8.2f Mrays/s  %5.1f nodes/ray  %5.2fx  %u mismatches\n", "BVH4",
+           num_rays / wide_s * 1.0e-6, (f64)wide_steps / num_rays, binary_s / wide_s, mismatches);
+
+    mesh_free(&fine);
+    free(binary_tri);
+    free(binary_t);
+    tlas_free(&tlas);
+    mesh_free(&torus);
+    mesh_free(&ball);
+    cpu_renderer_free(&renderer);
+    scene_free(&scene);
+    free(rays);
+    free(reference);
+}
+
+#endif // CPU_RENDER_BENCH_IMPL
+
+#endif // CPU_RENDER_BENCH_H
@@ -0,0 +1,138 @@
+#ifndef CURVE_H
+#define CURVE_H
+
+// Orders over grids of tiles and pixels: the order the CPU backend hands
+// out its tiles and traces its packets in, and the one persistent kernels
+// take their tiles in. Along a Morton (Z) or Hilbert curve, work that comes
+// after each other is close in the image, so it keeps meeting the same BVH
+// nodes and texels in cache; Morton jumps at the border of every quadrant,
+// Hilbert never does.
+//
+// Both curves cover a power of two square, curve_side() of the grid; the
+// points off the grid are skipped. src/shaders/lib/curve.glsl has the GLSL
+// version of curve_point().
+
+#include "types.h"
+
+#define CURVE_ROWS      0
+#define CURVE_MORTON    1
+#define CURVE_HILBERT   2
+#define CURVE_COUNT     3
+
+internal const char *curve_names[CURVE_COUNT] = { "rows", "morton", "hilbert" };
+
+u32         curve_side(u32 cols, u32 rows);
+void        curve_point(u32 curve, u32 side, u32 d, u32 *x, u32 *y);
+u32         curve_order(u32 curve, u32 cols, u32 rows, u32 *order);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== CURVE IMPLEMENTATION ===============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef CURVE_IMPL
+
+// Smallest power of two square the grid fits in
+u32
+curve_side(u32 cols,
+           u32 rows)
+{
+    u32 side = 1;
+
+
+    while (side < cols || side < rows)
+        side <<= 1;
+
+    return side;
+}
+
+// Point `d` of the curve over a side x side square (rows: row major)
+void
+curve_point(u32 curve,
+            u32 side,
+            u32 d,
+            u32 *x,
+            u32 *y)
+{
+    u32 px = 0,
+        py = 0;
+
+
+    if (curve == CURVE_MORTON)
+    {
+        for (u32 bit = 0; (1u << bit) < side; bit++)
+        {
+            px |= ((d >> (2 * bit)) & 1) << bit;
+            py |= ((d >> (2 * bit + 1)) & 1) << bit;
+        }
+    }
+    else if (curve == CURVE_HILBERT)
+    {
+        // Quadrant by quadrant from the smallest, rotating what is already
+        // placed into the quadrant's orientation
+        for (u32 s = 1; s < side; s <<= 1)
+        {
+            u32 rx = 1 & (d >> 1);
+            u32 ry = 1 & (d ^ rx);
+
+            if (ry == 0)
+            {
+                u32 swap;
+
+                if (rx == 1)
+                {
+                    px = s - 1 - px;
+                    py = s - 1 - py;
+                }
+                swap = px;
+                px = py;
+                py = swap;
+            }
+            px += s * rx;
+            py += s * ry;
+            d >>= 2;
+        }
+    }
+    else
+    {
+        px = d % side;
+        py = d / side;
+    }
+
+    *x = px;
+    *y = py;
+}
+
+// Row major indices of the cells of a cols x rows grid in the curve's
+// order; returns how many were written, cols * rows
+u32
+curve_order(u32 curve,
+            u32 cols,
+            u32 rows,
+            u32 *order)
+{
+    u32 side = curve_side(cols, rows);
+    u32 count = 0;
+
+
+    if (curve == CURVE_ROWS)
+    {
+        for (u32 i = 0; i < cols * rows; i++)
+            order[count++] = i;
+        return count;
+    }
+
+    for (u32 d = 0; d < side * side; d++)
+    {
+        u32 x, y;
+
+        curve_point(curve, side, d, &x, &y);
+        if (x < cols && y < rows)
+            order[count++] = y * cols + x;
+    }
+
+    return count;
+}
+
+#endif // CURVE_IMPL
+
+#endif // CURVE_H
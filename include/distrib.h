@@ -0,0 +1,789 @@
+#ifndef DISTRIB_H
+#define DISTRIB_H
+
+// Coordinator / worker tile distribution. The coordinator owns the window,
+// splits each frame into tiles (and each tile into sample chunks), hands them
+// out to worker processes over TCP or Unix sockets and merges the returned
+// tiles into an accumulation buffer weighted by their sample count. Workers
+// that drop off or stall have their in-flight tile put back in the queue.
+//
+// Addresses are either "host:port" (TCP) or "unix:/path/to/socket".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #include <windows.h>
+    #pragma comment(lib, "ws2_32.lib")
+    typedef SOCKET          dist_socket_t;
+    #define DIST_BAD_SOCKET INVALID_SOCKET
+    #define dist_closesocket(s) closesocket(s)
+#else
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <sys/un.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <netdb.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/wait.h>
+    typedef s32             dist_socket_t;
+    #define DIST_BAD_SOCKET (-1)
+    #define dist_closesocket(s) close(s)
+#endif
+
+#define DIST_MAGIC          0x5854524D  // 'MRTX'
+#define DIST_MAX_WORKERS    64
+#define DIST_TILE_SIZE      64
+#define DIST_SAMPLE_CHUNK   50
+#define DIST_JOB_TIMEOUT    10.0        // seconds before a silent worker is dropped
+
+/* ============================ *
+ * =====    Protocol      ===== *
+ * ============================ */
+
+// Coordinator -> worker
+typedef struct _TAG_dist_job
+{
+    u32 magic;
+    u32 frame_id;
+    u32 job_id;
+    u32 scene;
+    s32 x, y;
+    s32 w, h;
+    s32 width, height;  // full frame resolution
+    u32 samples;
+    u32 seed;
+    f32 view[16];
+    f32 proj[16];
+} dist_job_t;
+
+// Worker -> coordinator, followed by w * h * 3 floats of linear mean radiance
+typedef struct _TAG_dist_result
+{
+    u32 magic;
+    u32 frame_id;
+    u32 job_id;
+    s32 x, y;
+    s32 w, h;
+    u32 samples;
+} dist_result_t;
+
+/* ============================ *
+ * =====   Coordinator    ===== *
+ * ============================ */
+
+typedef struct _TAG_dist_worker
+{
+    dist_socket_t   sock;
+    b32             busy;
+    dist_job_t      job;
+    f64             job_start;
+    u8              *recv_buf;
+    usize           recv_len;
+} dist_worker_t;
+
+typedef struct _TAG_dist_coordinator
+{
+    dist_socket_t   listener;
+    dist_worker_t   workers[DIST_MAX_WORKERS];
+    u32             num_workers;
+
+    // Pending jobs (ring buffer, rebuilt every frame)
+    dist_job_t      *queue;
+    u32             queue_cap;
+    u32             queue_head;
+    u32             queue_count;
+
+    // Accumulation: sum of (mean * samples) and sample count per pixel
+    f32             *accum;
+    u32             *counts;
+    s32             width;
+    s32             height;
+
+    u32             frame_id;
+    u32             next_job_id;
+    b32             updated;
+
+#ifndef _WIN32
+    // Local workers from dist_spawn_workers(), waited for once they exit
+    pid_t           children[DIST_MAX_WORKERS];
+    u32             num_children;
+#endif
+} dist_coordinator_t;
+
+b32         dist_coordinator_init(dist_coordinator_t *coord, const char *address, s32 width, s32 height);
+void        dist_coordinator_begin_frame(dist_coordinator_t *coord, u32 scene, f32 *view, f32 *proj, u32 samples);
+void        dist_coordinator_poll(dist_coordinator_t *coord, f64 now);
+void        dist_coordinator_resolve(dist_coordinator_t *coord, f32 *rgba);
+void        dist_coordinator_shutdown(dist_coordinator_t *coord);
+b32         dist_spawn_workers(dist_coordinator_t *coord, const char *exe_path, const char *address, u32 count);
+
+/* ============================ *
+ * =====     Worker       ===== *
+ * ============================ */
+
+dist_socket_t   dist_worker_connect(const char *address);
+b32             dist_worker_recv_job(dist_socket_t sock, dist_job_t *job);
+b32             dist_worker_send_result(dist_socket_t sock, dist_job_t *job, f32 *rgb);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== DISTRIB IMPLEMENTATION =============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef DISTRIB_IMPL
+
+////////////////////////////////////////////////////////////////////////////////
+// SOCKET HELPERS
+
+internal b32
+dist_net_startup(void)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+
+    return (WSAStartup(MAKEWORD(2, 2), &wsa) == 0);
+#else
+    signal(SIGPIPE, SIG_IGN);
+
+    return TRUE;
+#endif
+}
+
+internal void
+dist_set_nonblocking(dist_socket_t sock)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+#else
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+internal void
+dist_set_nodelay(dist_socket_t sock)
+{
+    s32 one = 1;
+
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&one, sizeof(one));
+}
+
+// Opens a listening (server == TRUE) or connected socket for the address.
+internal dist_socket_t
+dist_open(const char *address,
+          b32 server)
+{
+    dist_socket_t   sock;
+    char            host[256];
+    const char      *port;
+    struct addrinfo hints,
+                    *info;
+
+
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+#ifdef _WIN32
+        printf("distrib: unix sockets are not supported on this platform\n");
+        return DIST_BAD_SOCKET;
+#else
+        struct sockaddr_un addr = {0};
+
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, address + 5, sizeof(addr.sun_path) - 1);
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock == DIST_BAD_SOCKET)
+            return DIST_BAD_SOCKET;
+
+        if (server)
+        {
+            unlink(addr.sun_path);
+            if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+                listen(sock, DIST_MAX_WORKERS) != 0)
+            {
+                dist_closesocket(sock);
+                return DIST_BAD_SOCKET;
+            }
+        }
+        else if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            dist_closesocket(sock);
+            return DIST_BAD_SOCKET;
+        }
+
+        return sock;
+#endif
+    }
+
+    port = strrchr(address, ':');
+    if (!port || (usize)(port - address) >= sizeof(host))
+    {
+        printf("distrib: bad address '%s' (expected host:port)\n", address);
+        return DIST_BAD_SOCKET;
+    }
+    memcpy(host, address, port - address);
+    host[port - address] = 0;
+    port++;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    if (getaddrinfo(host[0] ? host : NULL, port, &hints, &info) != 0)
+    {
+        printf("distrib: could not resolve '%s'\n", address);
+        return DIST_BAD_SOCKET;
+    }
+
+    sock = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (sock != DIST_BAD_SOCKET)
+    {
+        if (server)
+        {
+            s32 one = 1;
+
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+            if (bind(sock, info->ai_addr, (s32)info->ai_addrlen) != 0 ||
+                listen(sock, DIST_MAX_WORKERS) != 0)
+            {
+                dist_closesocket(sock);
+                sock = DIST_BAD_SOCKET;
+            }
+        }
+        else if (connect(sock, info->ai_addr, (s32)info->ai_addrlen) != 0)
+        {
+            dist_closesocket(sock);
+            sock = DIST_BAD_SOCKET;
+        }
+        else
+        {
+            dist_set_nodelay(sock);
+        }
+    }
+    freeaddrinfo(info);
+
+    return sock;
+}
+
+internal b32
+dist_send_all(dist_socket_t sock,
+              const void *data,
+              usize len)
+{
+    const char *ptr = (const char *)data;
+
+    while (len > 0)
+    {
+        s32 sent = (s32)send(sock, ptr, (s32)len, 0);
+        if (sent <= 0)
+            return FALSE;
+        ptr += sent;
+        len -= sent;
+    }
+
+    return TRUE;
+}
+
+internal b32
+dist_recv_all(dist_socket_t sock,
+              void *data,
+              usize len)
+{
+    char *ptr = (char *)data;
+
+    while (len > 0)
+    {
+        s32 got = (s32)recv(sock, ptr, (s32)len, 0);
+        if (got <= 0)
+            return FALSE;
+        ptr += got;
+        len -= got;
+    }
+
+    return TRUE;
+}
+
+internal b32
+dist_readable(dist_socket_t sock)
+{
+    fd_set          set;
+    struct timeval  tv = {0, 0};
+
+    FD_ZERO(&set);
+    FD_SET(sock, &set);
+
+    return (select((s32)sock + 1, &set, NULL, NULL, &tv) > 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// COORDINATOR IMPLEMENTATION
+
+// FALSE if the queue is full; dist_coordinator_begin_frame() sizes it for
+// every job of the frame, so only a job that was never popped can miss
+internal b32
+dist_queue_push(dist_coordinator_t *coord,
+                dist_job_t *job)
+{
+    if (coord->queue_count == coord->queue_cap)
+        return FALSE;
+
+    coord->queue[(coord->queue_head + coord->queue_count) % coord->queue_cap] = *job;
+    coord->queue_count++;
+
+    return TRUE;
+}
+
+internal b32
+dist_queue_pop(dist_coordinator_t *coord,
+               dist_job_t *job)
+{
+    if (coord->queue_count == 0)
+        return FALSE;
+
+    *job = coord->queue[coord->queue_head];
+    coord->queue_head = (coord->queue_head + 1) % coord->queue_cap;
+    coord->queue_count--;
+
+    return TRUE;
+}
+
+// Collects the spawned workers that have exited; with `all` it stops the
+// others first and waits for them too
+internal void
+dist_reap_workers(dist_coordinator_t *coord,
+                  b32 all)
+{
+#ifndef _WIN32
+    for (u32 i = 0; i < coord->num_children; i++)
+    {
+        if (all)
+            kill(coord->children[i], SIGTERM);
+        if (waitpid(coord->children[i], NULL, all ? 0 : WNOHANG) == 0)
+            continue;
+
+        coord->children[i--] = coord->children[--coord->num_children];
+    }
+#else
+    (void)coord;
+    (void)all;
+#endif
+}
+
+internal void
+dist_drop_worker(dist_coordinator_t *coord,
+                 u32 index)
+{
+    dist_worker_t *worker = &coord->workers[index];
+
+    printf("distrib: lost worker %u\n", index);
+
+    // Hand its tile to someone else, unless it belongs to a stale frame
+    if (worker->busy && worker->job.frame_id == coord->frame_id &&
+        !dist_queue_push(coord, &worker->job))
+        printf("distrib: job queue full, tile %d,%d is lost\n", worker->job.x, worker->job.y);
+
+    dist_closesocket(worker->sock);
+    free(worker->recv_buf);
+
+    coord->workers[index] = coord->workers[coord->num_workers - 1];
+    coord->num_workers--;
+
+    // A local worker exits once its socket is gone
+    dist_reap_workers(coord, FALSE);
+}
+
+internal void
+dist_merge_result(dist_coordinator_t *coord,
+                  dist_worker_t *worker)
+{
+    dist_result_t   *res = (dist_result_t *)worker->recv_buf;
+    f32             *rgb = (f32 *)(worker->recv_buf + sizeof(dist_result_t));
+
+
+    if (res->frame_id != coord->frame_id)
+        return;
+
+    for (s32 y = 0; y < res->h; y++)
+    {
+        for (s32 x = 0; x < res->w; x++)
+        {
+            s32 px = res->x + x;
+            s32 py = res->y + y;
+            if (px < 0 || py < 0 || px >= coord->width || py >= coord->height)
+                continue;
+
+            s32 dst = py * coord->width + px;
+            s32 src = (y * res->w + x) * 3;
+            coord->accum[dst * 3 + 0] += rgb[src + 0] * res->samples;
+            coord->accum[dst * 3 + 1] += rgb[src + 1] * res->samples;
+            coord->accum[dst * 3 + 2] += rgb[src + 2] * res->samples;
+            coord->counts[dst] += res->samples;
+        }
+    }
+    coord->updated = TRUE;
+}
+
+b32
+dist_coordinator_init(dist_coordinator_t *coord,
+                      const char *address,
+                      s32 width,
+                      s32 height)
+{
+    s32     tiles_x,
+            tiles_y;
+
+
+    memset(coord, 0, sizeof(*coord));
+    if (!dist_net_startup())
+        return FALSE;
+
+    coord->listener = dist_open(address, TRUE);
+    if (coord->listener == DIST_BAD_SOCKET)
+    {
+        printf("distrib: failed to listen on '%s'\n", address);
+        return FALSE;
+    }
+    dist_set_nonblocking(coord->listener);
+
+    tiles_x = (width + DIST_TILE_SIZE - 1) / DIST_TILE_SIZE;
+    tiles_y = (height + DIST_TILE_SIZE - 1) / DIST_TILE_SIZE;
+
+    // One chunk per tile to start with; dist_coordinator_begin_frame() grows
+    // it to the frame's sample count
+    coord->queue_cap = tiles_x * tiles_y;
+    coord->queue = (dist_job_t *)malloc(coord->queue_cap * sizeof(dist_job_t));
+    coord->accum = (f32 *)calloc(width * height * 3, sizeof(f32));
+    coord->counts = (u32 *)calloc(width * height, sizeof(u32));
+    coord->width = width;
+    coord->height = height;
+
+    return TRUE;
+}
+
+void
+dist_coordinator_begin_frame(dist_coordinator_t *coord,
+                             u32 scene,
+                             f32 *view,
+                             f32 *proj,
+                             u32 samples)
+{
+    dist_job_t      job;
+    u32             chunk;
+    u32             tiles,
+                    jobs;
+
+
+    coord->frame_id++;
+    coord->queue_head = 0;
+    coord->queue_count = 0;
+
+    tiles = ((coord->width + DIST_TILE_SIZE - 1) / DIST_TILE_SIZE) *
+            ((coord->height + DIST_TILE_SIZE - 1) / DIST_TILE_SIZE);
+    jobs = tiles * ((samples + DIST_SAMPLE_CHUNK - 1) / DIST_SAMPLE_CHUNK);
+    if (jobs > coord->queue_cap)
+    {
+        dist_job_t *grown = (dist_job_t *)realloc(coord->queue, jobs * sizeof(dist_job_t));
+
+        if (grown)
+        {
+            coord->queue = grown;
+            coord->queue_cap = jobs;
+        }
+        else
+            printf("distrib: no memory for %u jobs, the frame gets %u\n", jobs, coord->queue_cap);
+    }
+    memset(coord->accum, 0, coord->width * coord->height * 3 * sizeof(f32));
+    memset(coord->counts, 0, coord->width * coord->height * sizeof(u32));
+
+    memset(&job, 0, sizeof(job));
+    job.magic = DIST_MAGIC;
+    job.frame_id = coord->frame_id;
+    job.scene = scene;
+    job.width = coord->width;
+    job.height = coord->height;
+    memcpy(job.view, view, sizeof(job.view));
+    memcpy(job.proj, proj, sizeof(job.proj));
+
+    // Sample chunks are the outer loop so the whole frame fills in at low
+    // quality first and then refines
+    for (u32 base = 0; base < samples; base += chunk)
+    {
+        chunk = samples - base;
+        if (chunk > DIST_SAMPLE_CHUNK)
+            chunk = DIST_SAMPLE_CHUNK;
+
+        for (s32 y = 0; y < coord->height; y += DIST_TILE_SIZE)
+        {
+            for (s32 x = 0; x < coord->width; x += DIST_TILE_SIZE)
+            {
+                job.job_id = coord->next_job_id++;
+                job.x = x;
+                job.y = y;
+                job.w = (x + DIST_TILE_SIZE > coord->width) ? coord->width - x : DIST_TILE_SIZE;
+                job.h = (y + DIST_TILE_SIZE > coord->height) ? coord->height - y : DIST_TILE_SIZE;
+                job.samples = chunk;
+                job.seed = base;
+                if (!dist_queue_push(coord, &job))
+                    return;
+            }
+        }
+    }
+}
+
+void
+dist_coordinator_poll(dist_coordinator_t *coord,
+                      f64 now)
+{
+    dist_socket_t   sock;
+
+
+    // New workers
+    while (coord->num_workers < DIST_MAX_WORKERS &&
+           (sock = accept(coord->listener, NULL, NULL)) != DIST_BAD_SOCKET)
+    {
+        dist_worker_t *worker = &coord->workers[coord->num_workers++];
+
+        memset(worker, 0, sizeof(*worker));
+        worker->sock = sock;
+        worker->recv_buf = (u8 *)malloc(sizeof(dist_result_t) +
+                                        DIST_TILE_SIZE * DIST_TILE_SIZE * 3 * sizeof(f32));
+        dist_set_nodelay(sock);
+        printf("distrib: worker %u connected\n", coord->num_workers - 1);
+    }
+
+    for (u32 i = 0; i < coord->num_workers; i++)
+    {
+        dist_worker_t *worker = &coord->workers[i];
+
+        if (worker->busy)
+        {
+            // Pull in whatever part of the result has arrived
+            while (dist_readable(worker->sock))
+            {
+                usize   need = sizeof(dist_result_t);
+                s32     got;
+
+                if (worker->recv_len >= need)
+                {
+                    dist_result_t *res = (dist_result_t *)worker->recv_buf;
+                    need += (usize)(res->w * res->h * 3) * sizeof(f32);
+                }
+
+                got = (s32)recv(worker->sock, (char *)worker->recv_buf + worker->recv_len,
+                                (s32)(need - worker->recv_len), 0);
+                if (got <= 0)
+                {
+                    dist_drop_worker(coord, i--);
+                    goto next_worker;
+                }
+                worker->recv_len += got;
+
+                if (worker->recv_len == sizeof(dist_result_t))
+                {
+                    dist_result_t *res = (dist_result_t *)worker->recv_buf;
+
+                    // Only the tile and samples that were asked for
+                    if (res->magic != DIST_MAGIC || res->job_id != worker->job.job_id ||
+                        res->x != worker->job.x || res->y != worker->job.y ||
+                        res->w != worker->job.w || res->h != worker->job.h ||
+                        res->samples != worker->job.samples)
+                    {
+                        dist_drop_worker(coord, i--);
+                        goto next_worker;
+                    }
+                }
+                else if (worker->recv_len == need && need > sizeof(dist_result_t))
+                {
+                    dist_merge_result(coord, worker);
+                    worker->recv_len = 0;
+                    worker->busy = FALSE;
+                    break;
+                }
+            }
+
+            if (worker->busy && now - worker->job_start > DIST_JOB_TIMEOUT)
+            {
+                dist_drop_worker(coord, i--);
+                goto next_worker;
+            }
+        }
+
+        if (!worker->busy && dist_queue_pop(coord, &worker->job))
+        {
+            if (!dist_send_all(worker->sock, &worker->job, sizeof(dist_job_t)))
+            {
+                worker->busy = TRUE;
+                dist_drop_worker(coord, i--);
+                goto next_worker;
+            }
+            worker->busy = TRUE;
+            worker->job_start = now;
+        }
+
+    next_worker:;
+    }
+}
+
+void
+dist_coordinator_resolve(dist_coordinator_t *coord,
+                         f32 *rgba)
+{
+    s32 num_pixels = coord->width * coord->height;
+
+    // Pixels no worker has reported on yet keep whatever was there before, so
+    // the previous frame stays on screen until its tiles are replaced
+    for (s32 i = 0; i < num_pixels; i++)
+    {
+        if (!coord->counts[i])
+            continue;
+
+        f32 scale = 1.0f / coord->counts[i];
+
+        // Gamma correction, same as write_color() in the kernels
+        rgba[i * 4 + 0] = sqrtf(coord->accum[i * 3 + 0] * scale);
+        rgba[i * 4 + 1] = sqrtf(coord->accum[i * 3 + 1] * scale);
+        rgba[i * 4 + 2] = sqrtf(coord->accum[i * 3 + 2] * scale);
+        rgba[i * 4 + 3] = 1.0f;
+    }
+    coord->updated = FALSE;
+}
+
+void
+dist_coordinator_shutdown(dist_coordinator_t *coord)
+{
+    while (coord->num_workers)
+    {
+        dist_closesocket(coord->workers[coord->num_workers - 1].sock);
+        free(coord->workers[coord->num_workers - 1].recv_buf);
+        coord->num_workers--;
+    }
+    dist_reap_workers(coord, TRUE);
+    dist_closesocket(coord->listener);
+    free(coord->queue);
+    free(coord->accum);
+    free(coord->counts);
+}
+
+b32
+dist_spawn_workers(dist_coordinator_t *coord,
+                   const char *exe_path,
+                   const char *address,
+                   u32 count)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+#ifdef _WIN32
+        STARTUPINFOA        si = {0};
+        PROCESS_INFORMATION pi = {0};
+        char                cmd[1024];
+
+        si.cb = sizeof(si);
+        snprintf(cmd, sizeof(cmd), "\"%s\" --worker %s", exe_path, address);
+        if (!CreateProcessA(NULL, cmd, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+        {
+            printf("distrib: failed to spawn worker %u\n", i);
+            return FALSE;
+        }
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+#else
+        pid_t pid;
+
+        if (coord->num_children == DIST_MAX_WORKERS)
+        {
+            printf("distrib: no more than %u local workers\n", DIST_MAX_WORKERS);
+            return FALSE;
+        }
+
+        pid = fork();
+        if (pid == 0)
+        {
+            execl(exe_path, exe_path, "--worker", address, (char *)NULL);
+            _exit(1);
+        }
+        else if (pid < 0)
+        {
+            printf("distrib: failed to spawn worker %u\n", i);
+            return FALSE;
+        }
+        coord->children[coord->num_children++] = pid;
+#endif
+    }
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// WORKER IMPLEMENTATION
+
+dist_socket_t
+dist_worker_connect(const char *address)
+{
+    dist_socket_t sock;
+
+    if (!dist_net_startup())
+        return DIST_BAD_SOCKET;
+
+    // The coordinator may still be starting up when local workers launch
+    for (u32 attempt = 0; attempt < 50; attempt++)
+    {
+        sock = dist_open(address, FALSE);
+        if (sock != DIST_BAD_SOCKET)
+            return sock;
+#ifdef _WIN32
+        Sleep(100);
+#else
+        usleep(100 * 1000);
+#endif
+    }
+    printf("distrib: could not connect to '%s'\n", address);
+
+    return DIST_BAD_SOCKET;
+}
+
+b32
+dist_worker_recv_job(dist_socket_t sock,
+                     dist_job_t *job)
+{
+    if (!dist_recv_all(sock, job, sizeof(dist_job_t)))
+        return FALSE;
+
+    return (job->magic == DIST_MAGIC &&
+            job->w > 0 && job->w <= DIST_TILE_SIZE &&
+            job->h > 0 && job->h <= DIST_TILE_SIZE);
+}
+
+b32
+dist_worker_send_result(dist_socket_t sock,
+                        dist_job_t *job,
+                        f32 *rgb)
+{
+    dist_result_t res;
+
+    res.magic = DIST_MAGIC;
+    res.frame_id = job->frame_id;
+    res.job_id = job->job_id;
+    res.x = job->x;
+    res.y = job->y;
+    res.w = job->w;
+    res.h = job->h;
+    res.samples = job->samples;
+
+    return (dist_send_all(sock, &res, sizeof(res)) &&
+            dist_send_all(sock, rgb, (usize)(job->w * job->h * 3) * sizeof(f32)));
+}
+
+#endif // DISTRIB_IMPL
+
+#endif // DISTRIB_H
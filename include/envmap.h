@@ -0,0 +1,402 @@
+#ifndef ENVMAP_H
+#define ENVMAP_H
+
+// Equirectangular HDR environment maps lighting the outdoor scenes. Row 0
+// looks straight up (+y) and u runs around the horizon with its seam at -x.
+// Radiance is constant over a texel (nearest lookup), which keeps the
+// sampling pdf exact.
+//
+// Importance sampling follows PBRT's Distribution2D: every texel is weighted
+// by its luminance times sin(theta), its share of the sphere; a marginal CDF
+// picks the row and that row's conditional CDF the texel. Each texel stores
+// its pdf over the uv square next to its radiance, so looking up a
+// direction gives both. The kernels read the texels at
+// ENVMAP_BINDING_TEXELS and the CDFs at ENVMAP_BINDING_CDF, laid out as here.
+//
+// Maps are Radiance .hdr files (RGBE, flat or RLE scanlines). One that fails
+// to load is replaced by a procedural sky: the kernels' gradient plus a sun.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+#include "mmath.h"
+
+#define ENVMAP_BINDING_TEXELS   17
+#define ENVMAP_BINDING_CDF      18
+#define ENVMAP_SKY_WIDTH        512
+#define ENVMAP_SKY_HEIGHT       256
+#define ENVMAP_SUN_RADIUS       0.035f      // radians, about twice the real sun
+#define ENVMAP_SUN_RADIANCE     1000.0f
+
+typedef struct _TAG_envmap
+{
+    f32     *texels;        // r, g, b, pdf over the uv square
+    f32     *cdf;           // marginal (height + 1), then conditional (width + 1) per row
+    u32     width;
+    u32     height;
+} envmap_t;
+
+b32         envmap_load_hdr(envmap_t *env, const char *path);
+void        envmap_make_sky(envmap_t *env, u32 width, u32 height);
+void        envmap_free(envmap_t *env);
+usize       envmap_cdf_size(envmap_t *env);
+vec3_t      envmap_lookup(envmap_t *env, vec3_t direction, f32 *pdf);
+vec3_t      envmap_sample(envmap_t *env, f32 u1, f32 u2, vec3_t *direction, f32 *pdf);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== ENVMAP IMPLEMENTATION ==============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef ENVMAP_IMPL
+
+#define ENVMAP_PI   3.1415926f
+
+internal vec3_t
+envmap_direction(f32 u,
+                 f32 v)
+{
+    f32     theta = v * ENVMAP_PI;
+    f32     phi = u * 2.0f * ENVMAP_PI;
+    vec3_t  d = {-sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)};
+
+    return d;
+}
+
+// Per texel weights, the CDFs and the texels' pdfs
+internal void
+envmap_build_cdf(envmap_t *env)
+{
+    u32     w = env->width;
+    u32     h = env->height;
+    f32     *marginal = env->cdf;
+    f64     total = 0.0;
+    b32     uniform = FALSE;
+
+
+    for (;;)
+    {
+        total = 0.0;
+        for (u32 y = 0; y < h; y++)
+        {
+            f32     *cond = env->cdf + (h + 1) + (usize)y * (w + 1);
+            f32     sin_theta = sinf(ENVMAP_PI * (y + 0.5f) / h);
+            f64     row = 0.0;
+
+
+            cond[0] = 0.0f;
+            for (u32 x = 0; x < w; x++)
+            {
+                f32 *t = env->texels + ((usize)y * w + x) * 4;
+                f32 lum = uniform ? 1.0f : 0.2126f * t[0] + 0.7152f * t[1] + 0.0722f * t[2];
+
+                t[3] = (lum > 0.0f ? lum : 0.0f) * sin_theta;
+                row += t[3];
+                cond[x + 1] = (f32)row;
+            }
+            for (u32 x = 1; x <= w; x++)
+                cond[x] = (row > 0.0) ? (f32)(cond[x] / row) : (f32)x / w;
+            cond[w] = 1.0f;
+
+            marginal[y] = (f32)total;
+            total += row;
+        }
+
+        // An all black map is sampled uniformly over the sphere instead
+        if (total > 0.0 || uniform)
+            break;
+        uniform = TRUE;
+    }
+
+    for (u32 y = 0; y < h; y++)
+        marginal[y] = (f32)(marginal[y] / total);
+    marginal[h] = 1.0f;
+
+    for (usize i = 0; i < (usize)w * h; i++)
+        env->texels[i * 4 + 3] = (f32)(env->texels[i * 4 + 3] * w * h / total);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LOADING
+
+internal b32
+envmap_read_line(FILE *file,
+                 char *line,
+                 u32 size)
+{
+    if (!fgets(line, (s32)size, file))
+        return FALSE;
+    line[strcspn(line, "\r\n")] = 0;
+
+    return TRUE;
+}
+
+// One scanline of RGBE pixels, new style RLE or flat
+internal b32
+envmap_read_scanline(FILE *file,
+                     u8 *rgbe,
+                     u32 width)
+{
+    u8 head[4];
+
+    if (fread(head, 1, 4, file) != 4)
+        return FALSE;
+
+    if (width < 8 || width > 0x7fff || head[0] != 2 || head[1] != 2 || (head[2] & 0x80) ||
+        ((u32)head[2] << 8 | head[3]) != width)
+    {
+        memcpy(rgbe, head, 4);
+        return fread(rgbe + 4, 4, width - 1, file) == width - 1;
+    }
+
+    // Each channel separately: runs (count > 128) or literal bytes
+    for (u32 c = 0; c < 4; c++)
+    {
+        u32 x = 0;
+
+        while (x < width)
+        {
+            s32 count = fgetc(file);
+            s32 value;
+
+            if (count == EOF)
+                return FALSE;
+            if (count > 128)
+            {
+                count -= 128;
+                value = fgetc(file);
+                if (value == EOF || x + count > width)
+                    return FALSE;
+                for (s32 i = 0; i < count; i++)
+                    rgbe[(x++) * 4 + c] = (u8)value;
+            }
+            else
+            {
+                if (count == 0 || x + count > width)
+                    return FALSE;
+                for (s32 i = 0; i < count; i++)
+                {
+                    if ((value = fgetc(file)) == EOF)
+                        return FALSE;
+                    rgbe[(x++) * 4 + c] = (u8)value;
+                }
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+b32
+envmap_load_hdr(envmap_t *env,
+                const char *path)
+{
+    FILE    *file;
+    char    line[256];
+    u8      *rgbe;
+    b32     ok = TRUE;
+
+
+    memset(env, 0, sizeof(*env));
+
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("failed to open environment %s\n", path);
+        return FALSE;
+    }
+
+    if (!envmap_read_line(file, line, sizeof(line)) || strncmp(line, "#?", 2))
+        ok = FALSE;
+    while (ok && envmap_read_line(file, line, sizeof(line)) && line[0])
+    {
+        if (!strncmp(line, "FORMAT=", 7) && strcmp(line + 7, "32-bit_rle_rgbe"))
+            ok = FALSE;
+    }
+    if (!ok || !envmap_read_line(file, line, sizeof(line)) ||
+        sscanf(line, "-Y %u +X %u", &env->height, &env->width) != 2 || !env->width || !env->height)
+    {
+        printf("unsupported environment %s (Radiance RGBE, -Y +X)\n", path);
+        fclose(file);
+        memset(env, 0, sizeof(*env));
+        return FALSE;
+    }
+
+    env->texels = (f32 *)malloc((usize)env->width * env->height * 4 * sizeof(f32));
+    env->cdf = (f32 *)malloc(envmap_cdf_size(env) * sizeof(f32));
+    rgbe = (u8 *)malloc((usize)env->width * 4);
+
+    for (u32 y = 0; y < env->height && ok; y++)
+    {
+        ok = envmap_read_scanline(file, rgbe, env->width);
+        for (u32 x = 0; x < env->width && ok; x++)
+        {
+            u8  *p = rgbe + x * 4;
+            f32 *t = env->texels + ((usize)y * env->width + x) * 4;
+            f32 scale = p[3] ? ldexpf(1.0f, (s32)p[3] - (128 + 8)) : 0.0f;
+
+            t[0] = p[0] * scale;
+            t[1] = p[1] * scale;
+            t[2] = p[2] * scale;
+        }
+    }
+    free(rgbe);
+    fclose(file);
+
+    if (!ok)
+    {
+        printf("failed to read environment %s\n", path);
+        envmap_free(env);
+        return FALSE;
+    }
+
+    envmap_build_cdf(env);
+    printf("environment %s: %ux%u\n", path, env->width, env->height);
+
+    return TRUE;
+}
+
+// The kernels' sky gradient, with a small, very bright sun that uniform
+// sampling would hardly ever find
+void
+envmap_make_sky(envmap_t *env,
+                u32 width,
+                u32 height)
+{
+    vec3_t  sun = {0.45f, 0.6f, 0.66f};
+    f32     sun_cos = cosf(ENVMAP_SUN_RADIUS);
+
+
+    sun = vec3_scal(sun, 1.0f / sqrtf(vec3_dot(sun, sun)));
+
+    env->width = width;
+    env->height = height;
+    env->texels = (f32 *)malloc((usize)width * height * 4 * sizeof(f32));
+    env->cdf = (f32 *)malloc(envmap_cdf_size(env) * sizeof(f32));
+
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+        {
+            vec3_t  d = envmap_direction((x + 0.5f) / width, (y + 0.5f) / height);
+            f32     t = 0.5f * (d.y + 1.0f);
+            f32     *out = env->texels + ((usize)y * width + x) * 4;
+
+
+            out[0] = (1.0f - t) + t * 0.5f;
+            out[1] = (1.0f - t) + t * 0.7f;
+            out[2] = 1.0f;
+            if (vec3_dot(d, sun) > sun_cos)
+            {
+                out[0] = ENVMAP_SUN_RADIANCE;
+                out[1] = ENVMAP_SUN_RADIANCE * 0.9f;
+                out[2] = ENVMAP_SUN_RADIANCE * 0.75f;
+            }
+        }
+    }
+
+    envmap_build_cdf(env);
+}
+
+void
+envmap_free(envmap_t *env)
+{
+    free(env->texels);
+    free(env->cdf);
+    memset(env, 0, sizeof(*env));
+}
+
+usize
+envmap_cdf_size(envmap_t *env)
+{
+    return (usize)env->height + 1 + (usize)env->height * (env->width + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SAMPLING
+
+// Radiance towards `direction` (unit length), and the pdf of sampling it
+// per solid angle
+vec3_t
+envmap_lookup(envmap_t *env,
+              vec3_t direction,
+              f32 *pdf)
+{
+    f32     u = (atan2f(-direction.z, direction.x) + ENVMAP_PI) / (2.0f * ENVMAP_PI);
+    f32     v = acosf(fminf(fmaxf(direction.y, -1.0f), 1.0f)) / ENVMAP_PI;
+    u32     x = (u32)(u * env->width);
+    u32     y = (u32)(v * env->height);
+    f32     sin_theta = sqrtf(fmaxf(0.0f, 1.0f - direction.y * direction.y));
+    f32     *t;
+    vec3_t  radiance;
+
+
+    x = (x < env->width) ? x : env->width - 1;
+    y = (y < env->height) ? y : env->height - 1;
+    t = env->texels + ((usize)y * env->width + x) * 4;
+
+    *pdf = (sin_theta > 0.0f) ? t[3] / (2.0f * ENVMAP_PI * ENVMAP_PI * sin_theta) : 0.0f;
+    radiance.x = t[0];
+    radiance.y = t[1];
+    radiance.z = t[2];
+
+    return radiance;
+}
+
+// Last entry of cdf[0 .. count] not above u
+internal u32
+envmap_find(f32 *cdf,
+            u32 count,
+            f32 u)
+{
+    u32 lo = 0;
+    u32 hi = count;
+
+    while (lo + 1 < hi)
+    {
+        u32 mid = (lo + hi) / 2;
+
+        if (cdf[mid] <= u)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// Direction picked in proportion to the radiance, its pdf per solid angle
+// and the radiance that way
+vec3_t
+envmap_sample(envmap_t *env,
+              f32 u1,
+              f32 u2,
+              vec3_t *direction,
+              f32 *pdf)
+{
+    f32     *marginal = env->cdf;
+    u32     y = envmap_find(marginal, env->height, u2);
+    f32     *cond = env->cdf + (env->height + 1) + (usize)y * (env->width + 1);
+    u32     x = envmap_find(cond, env->width, u1);
+    f32     dv = (u2 - marginal[y]) / (marginal[y + 1] - marginal[y]);
+    f32     du = (u1 - cond[x]) / (cond[x + 1] - cond[x]);
+    f32     *t = env->texels + ((usize)y * env->width + x) * 4;
+    f32     sin_theta;
+    vec3_t  radiance;
+
+
+    *direction = envmap_direction((x + du) / env->width, (y + dv) / env->height);
+    sin_theta = sqrtf(fmaxf(0.0f, 1.0f - direction->y * direction->y));
+
+    *pdf = (sin_theta > 0.0f) ? t[3] / (2.0f * ENVMAP_PI * ENVMAP_PI * sin_theta) : 0.0f;
+    radiance.x = t[0];
+    radiance.y = t[1];
+    radiance.z = t[2];
+
+    return radiance;
+}
+
+#endif // ENVMAP_IMPL
+
+#endif // ENVMAP_H
@@ -3,102 +3,727 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <types.h>
 
+// Shader sources go through a small preprocessor before GL sees them:
+//
+//     #include "file"
+//
+// pastes `file`, found relative to the including file, in place of the line.
+// Every file is pasted once per shader, at its first #include (GLSL's own
+// #if around it doesn't matter, the includes are resolved first), so shared
+// files need no guards and may include each other. Files are read from disk
+// once into a cache that lives until free_source_cache().
+//
+// GL only knows the pasted text, and drivers disagree on what #line's source
+// number does (Mesa drops it), so the loader keeps the line map itself:
+// compile errors are printed with the file and line they come from in front.
+//
+// Linked programs are kept between runs in a binary cache file
+// (load_program_cache() / save_program_cache()), keyed by the driver and the
+// preprocessed text, so a launch with unchanged sources doesn't compile GLSL
+// at all. A binary the driver turns down is compiled again. shader_errors
+// counts every failure to read, compile or link.
+
+#define SHADER_MAX_FILES			64		// distinct files in the cache
+#define SHADER_MAX_INCLUDE_DEPTH	16
+#define SHADER_PATH_SIZE			260
+#define SHADER_DEFINES				U32_MAX	// file of the injected defines
+#define SHADER_MAX_STAGES			2
+#define PROGRAM_CACHE_MAGIC			0x31484350	// "PCH1"
+#define PROGRAM_CACHE_MAX			64
+
+typedef struct _TAG_shader_file			// entry of the source cache
+{
+	char	path[SHADER_PATH_SIZE];		// normalised, '/' separated
+	char	*text;
+} shader_file_t;
+
+typedef struct _TAG_shader_span			// output lines from `output_line` on
+{										// are `file`'s from `line` on
+	u32		output_line;
+	u32		file;
+	u32		line;
+} shader_span_t;
+
+typedef struct _TAG_shader_source		// one shader with its includes pasted in
+{
+	char			*text;
+	u32				size;
+	u32				capacity;
+	u32				num_lines;
+	shader_span_t	*spans;
+	u32				num_spans;
+	u32				max_spans;
+	b32				included[SHADER_MAX_FILES];
+} shader_source_t;
+
+typedef struct _TAG_program_binary		// entry of the program cache
+{
+	u64		key;						// driver and preprocessed sources
+	u32		format;
+	u32		size;
+	u8		*data;
+} program_binary_t;
+
 u32		load_shader(const char *vs_path, const char *fs_path);
 u32		load_shader(const char *cs_path);
+u32		load_compute_shader(const char *cs_path, const char *defines);
 char	*load_source(const char *path);
+void	free_source_cache(void);
+void	load_program_cache(const char *path);
+void	save_program_cache(void);
 void 	check_compile_errors(u32 data, b32 is_program, const char* filename);
 
 // Define everything here since this file is only being used once in the whole
 // program (main.cpp)
 
+u32						shader_errors;
+
+internal shader_file_t		shader_files[SHADER_MAX_FILES];
+internal u32				num_shader_files;
+internal program_binary_t	program_binaries[PROGRAM_CACHE_MAX];
+internal u32				num_program_binaries;
+internal char				*program_cache_path;	// NULL without a cache
+internal b32				program_cache_dirty;
+
+internal void		shader_normalize_path(char *path);
+internal b32		shader_load_source(shader_source_t *src, const char *path, const char *defines);
+internal b32		shader_preprocess(shader_source_t *src, const char *path, const char *defines, u32 depth);
+internal u32		shader_compile(u32 type, const shader_source_t *src, const char *path);
+internal u32		shader_program(const u32 *types, const char **paths, u32 num_stages, const char *defines);
+
 u32
 load_shader(const char *vs_path,
 			const char *fs_path)
 {
-	u32			vertex,
-				fragment,
-				program;
-	char		*shader_src;
-
-
-	// Vertex
-	shader_src = load_source(vs_path);
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &shader_src, NULL);
-	glCompileShader(vertex);
-	check_compile_errors(vertex, 0, vs_path);
-	free(shader_src);
-
-	// Fragment
-	shader_src = load_source(fs_path);
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &shader_src, NULL);
-	glCompileShader(fragment);
-	check_compile_errors(fragment, 0, vs_path);
-	free(shader_src);
-
-	// Program
-	program = glCreateProgram();
-	glAttachShader(program, vertex);
-	glAttachShader(program, fragment);
-	glLinkProgram(program);
-	check_compile_errors(program, 1, NULL);
-
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	u32			types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+	const char	*paths[2] = {vs_path, fs_path};
 
-	return program;
+
+	return shader_program(types, paths, 2, NULL);
 }
 
 u32
 load_shader(const char *cs_path)
 {
-	u32			compute,
-				program;
-	char		*shader_src;
-
-
-	shader_src = load_source(cs_path);
-	compute = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(compute, 1, &shader_src, NULL);
-    glCompileShader(compute);
-    check_compile_errors(compute, 0, cs_path);
-    free(shader_src);
+	return load_compute_shader(cs_path, NULL);
+}
 
-    program = glCreateProgram();
-    glAttachShader(program, compute);
-    glLinkProgram(program);
-    check_compile_errors(program, 1, NULL);
+// Compute shader compiled behind `defines`, which go right after its
+// #version line
+u32
+load_compute_shader(const char *cs_path,
+					const char *defines)
+{
+	u32			type = GL_COMPUTE_SHADER;
 
-	glDeleteShader(compute);
 
-	return program;
+	return shader_program(&type, &cs_path, 1, defines);
 }
 
+// Source of `path` with its includes pasted in, NULL if a file is missing
 char *
 load_source(const char *path)
+{
+	shader_source_t		src;
+
+
+	if (!shader_load_source(&src, path, NULL))
+	{
+		free(src.text);
+		src.text = NULL;
+	}
+	free(src.spans);
+
+	return src.text;
+}
+
+void
+free_source_cache(void)
+{
+	for (u32 i = 0; i < num_shader_files; i++)
+		free(shader_files[i].text);
+	num_shader_files = 0;
+}
+
+// Reads the binaries `path` holds, if any, and saves the programs linked
+// from now on to it in save_program_cache(). A missing or stale file only
+// means compiling.
+void
+load_program_cache(const char *path)
+{
+	FILE		*fptr;
+	s32			num_formats = 0;
+	u32			header[2];
+
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (num_formats == 0)
+	{
+		printf("the driver can't hand out program binaries, compiling every launch\n");
+		return;
+	}
+
+	program_cache_path = (char *)malloc(strlen(path) + 1);
+	strcpy(program_cache_path, path);
+	fptr = fopen(path, "rb");
+	if (!fptr)
+		return;
+
+	// Magic and count, then key, format, size and the binary per program.
+	// Reading stops at the first entry that doesn't add up.
+	if (fread(header, sizeof(header), 1, fptr) == 1 && header[0] == PROGRAM_CACHE_MAGIC)
+	{
+		for (u32 i = 0; i < header[1] && num_program_binaries < PROGRAM_CACHE_MAX; i++)
+		{
+			program_binary_t	*binary = &program_binaries[num_program_binaries];
+
+
+			if (fread(&binary->key, sizeof(u64), 1, fptr) != 1 ||
+				fread(&binary->format, sizeof(u32), 1, fptr) != 1 ||
+				fread(&binary->size, sizeof(u32), 1, fptr) != 1 ||
+				binary->size > (64u << 20))
+				break;
+			binary->data = (u8 *)malloc(binary->size);
+			if (fread(binary->data, 1, binary->size, fptr) != binary->size)
+			{
+				free(binary->data);
+				break;
+			}
+			num_program_binaries++;
+		}
+	}
+	fclose(fptr);
+}
+
+// Writes the cache back if programs were added and frees it
+void
+save_program_cache(void)
+{
+	FILE		*fptr;
+	u32			header[2] = {PROGRAM_CACHE_MAGIC, num_program_binaries};
+
+
+	if (program_cache_path && program_cache_dirty)
+	{
+		fptr = fopen(program_cache_path, "wb");
+		if (fptr)
+		{
+			fwrite(header, sizeof(header), 1, fptr);
+			for (u32 i = 0; i < num_program_binaries; i++)
+			{
+				program_binary_t	*binary = &program_binaries[i];
+
+
+				fwrite(&binary->key, sizeof(u64), 1, fptr);
+				fwrite(&binary->format, sizeof(u32), 1, fptr);
+				fwrite(&binary->size, sizeof(u32), 1, fptr);
+				fwrite(binary->data, 1, binary->size, fptr);
+			}
+			fclose(fptr);
+		}
+		else
+			printf("couldn't write the program cache %s\n", program_cache_path);
+	}
+
+	for (u32 i = 0; i < num_program_binaries; i++)
+		free(program_binaries[i].data);
+	num_program_binaries = 0;
+	free(program_cache_path);
+	program_cache_path = NULL;
+	program_cache_dirty = FALSE;
+}
+
+// '/' separated, without "." and "dir/.." segments, so that the cache finds
+// a file under one name however it was reached
+internal void
+shader_normalize_path(char *path)
+{
+	char		copy[SHADER_PATH_SIZE];
+	char		*segments[SHADER_PATH_SIZE / 2];
+	u32			num_segments = 0;
+	b32			absolute;
+	char		*out;
+
+
+	for (char *c = path; *c; c++)
+		*c = (*c == '\\') ? '/' : *c;
+	absolute = path[0] == '/';
+
+	strcpy(copy, path);
+	for (char *s = strtok(copy, "/"); s; s = strtok(NULL, "/"))
+	{
+		if (!strcmp(s, "."))
+			continue;
+		if (!strcmp(s, "..") && num_segments > 0 && strcmp(segments[num_segments - 1], ".."))
+			num_segments--;
+		else
+			segments[num_segments++] = s;
+	}
+
+	out = path;
+	if (absolute)
+		*out++ = '/';
+	for (u32 i = 0; i < num_segments; i++)
+	{
+		if (i > 0)
+			*out++ = '/';
+		strcpy(out, segments[i]);
+		out += strlen(segments[i]);
+	}
+	*out = 0;
+}
+
+// Index of the (normalised) file in the cache, read on first use; U32_MAX
+// if it can't be read
+internal u32
+shader_cache_file(const char *path)
 {
 	FILE		*fptr;
 	s32			file_len;
-	char		*src;
+	char		*text;
+
+
+	for (u32 i = 0; i < num_shader_files; i++)
+	{
+		if (!strcmp(shader_files[i].path, path))
+			return i;
+	}
 
+	if (num_shader_files == SHADER_MAX_FILES)
+	{
+		printf("more than %u shader sources\n", SHADER_MAX_FILES);
+		return U32_MAX;
+	}
 
 	fptr = fopen(path, "rb");
+	if (!fptr)
+	{
+		printf("couldn't open shader source %s\n", path);
+		return U32_MAX;
+	}
 	fseek(fptr, 0, SEEK_END);
 	file_len = ftell(fptr);
 	fseek(fptr, 0, SEEK_SET);
-	src = (char *)malloc(file_len + 1);
-	fread(src, 1, file_len, fptr);
-	src[file_len] = 0;
+	text = (char *)malloc(file_len + 1);
+	fread(text, 1, file_len, fptr);
+	text[file_len] = 0;
 	fclose(fptr);
 
-	return src;
+	strcpy(shader_files[num_shader_files].path, path);
+	shader_files[num_shader_files].text = text;
+
+	return num_shader_files++;
+}
+
+internal void
+shader_append(shader_source_t *src,
+			  const char *text,
+			  u32 len)
+{
+	if (src->size + len + 1 > src->capacity)
+	{
+		src->capacity = (src->capacity * 2 > src->size + len + 1) ? src->capacity * 2 : src->size + len + 4096;
+		src->text = (char *)realloc(src->text, src->capacity);
+	}
+
+	memcpy(src->text + src->size, text, len);
+	src->size += len;
+	src->text[src->size] = 0;
+	for (u32 i = 0; i < len; i++)
+		src->num_lines += text[i] == '\n';
+}
+
+// The next output line is `file`'s `line`
+internal void
+shader_map_lines(shader_source_t *src,
+				 u32 file,
+				 u32 line)
+{
+	if (src->num_spans == src->max_spans)
+	{
+		src->max_spans = src->max_spans ? src->max_spans * 2 : 32;
+		src->spans = (shader_span_t *)realloc(src->spans, src->max_spans * sizeof(shader_span_t));
+	}
+
+	src->spans[src->num_spans].output_line = src->num_lines + 1;
+	src->spans[src->num_spans].file = file;
+	src->spans[src->num_spans].line = line;
+	src->num_spans++;
+}
+
+internal void
+shader_append_defines(shader_source_t *src,
+					  const char *defines)
+{
+	u32			len = (u32)strlen(defines);
+
+
+	shader_map_lines(src, SHADER_DEFINES, 1);
+	shader_append(src, defines, len);
+	if (len > 0 && defines[len - 1] != '\n')
+		shader_append(src, "\n", 1);
+}
+
+// The rest of `line` after "#<name>", NULL if it's another line
+internal const char *
+shader_directive(const char *line,
+				 const char *name)
+{
+	u32			len = (u32)strlen(name);
+
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line++ != '#')
+		return NULL;
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (strncmp(line, name, len))
+		return NULL;
+	line += len;
+
+	return (*line == ' ' || *line == '\t' || *line == '"') ? line : NULL;
+}
+
+// Appends `path` to `src` with its includes resolved, unless it is already
+// in. `defines` (for the root file) follow its #version line.
+internal b32
+shader_preprocess(shader_source_t *src,
+				  const char *path,
+				  const char *defines,
+				  u32 depth)
+{
+	char		include_path[SHADER_PATH_SIZE];
+	const char	*dir,
+				*version = NULL,
+				*line,
+				*end,
+				*name,
+				*name_end;
+	u32			id,
+				line_num,
+				dir_len;
+
+
+	if (depth > SHADER_MAX_INCLUDE_DEPTH)
+	{
+		printf("shader includes nested deeper than %u at %s\n", SHADER_MAX_INCLUDE_DEPTH, path);
+		return FALSE;
+	}
+
+	id = shader_cache_file(path);
+	if (id == U32_MAX)
+		return FALSE;
+	if (src->included[id])
+		return TRUE;
+	src->included[id] = TRUE;
+
+	dir = shader_files[id].path;
+	dir_len = strrchr(dir, '/') ? (u32)(strrchr(dir, '/') - dir) + 1 : 0;
+
+	// Without a #version line the defines go first
+	if (defines)
+	{
+		line = shader_files[id].text;
+		while (line && !version)
+		{
+			version = shader_directive(line, "version") ? line : NULL;
+			line = strchr(line, '\n');
+			line = line ? line + 1 : NULL;
+		}
+		if (!version)
+			shader_append_defines(src, defines);
+	}
+	shader_map_lines(src, id, 1);
+
+	for (line = shader_files[id].text, line_num = 1; *line; line = end, line_num++)
+	{
+		end = strchr(line, '\n');
+		end = end ? end + 1 : line + strlen(line);
+
+		name = shader_directive(line, "include");
+		if (!name)
+		{
+			shader_append(src, line, (u32)(end - line));
+			if (line == version)
+			{
+				if (end[-1] != '\n')
+					shader_append(src, "\n", 1);
+				shader_append_defines(src, defines);
+				shader_map_lines(src, id, line_num + 1);
+			}
+			continue;
+		}
+
+		while (*name == ' ' || *name == '\t')
+			name++;
+		name_end = (*name == '"') ? strchr(name + 1, '"') : NULL;
+		if (!name_end || name_end > end)
+		{
+			printf("%s:%u: expected #include \"file\"\n", path, line_num);
+			return FALSE;
+		}
+		if (dir_len + (name_end - name) > SHADER_PATH_SIZE)
+		{
+			printf("%s:%u: include path too long\n", path, line_num);
+			return FALSE;
+		}
+
+		memcpy(include_path, dir, dir_len);
+		memcpy(include_path + dir_len, name + 1, name_end - name - 1);
+		include_path[dir_len + (name_end - name - 1)] = 0;
+		shader_normalize_path(include_path);
+		if (!shader_preprocess(src, include_path, NULL, depth + 1))
+		{
+			printf("    included from %s:%u\n", path, line_num);
+			return FALSE;
+		}
+
+		if (src->size > 0 && src->text[src->size - 1] != '\n')
+			shader_append(src, "\n", 1);
+		shader_map_lines(src, id, line_num + 1);
+	}
+
+	return TRUE;
+}
+
+// Prints the compile log with the file and line each message comes from;
+// messages start "0:<line>", "0(<line>)" or "ERROR: 0:<line>" depending on
+// the driver
+internal void
+shader_print_log(u32 shader,
+				 const shader_source_t *src,
+				 const char *path)
+{
+	char		info_log[4096];
+	char		*line,
+				*end,
+				*p;
+
+
+	glGetShaderInfoLog(shader, sizeof(info_log), NULL, info_log);
+	printf("SHADER COMPILATION ERROR OF TYPE: %s\n", path);
+
+	for (line = info_log; *line; line = end)
+	{
+		u32		output_line = 0;
+
+
+		end = strchr(line, '\n');
+		end = end ? end + 1 : line + strlen(line);
+
+		p = line;
+		if (!strncmp(p, "ERROR: ", 7) || !strncmp(p, "WARNING: ", 9))
+			p = strchr(p, ' ') + 1;
+		if (*p >= '0' && *p <= '9')
+		{
+			strtoul(p, &p, 10);
+			if (*p == ':' || *p == '(')
+				output_line = (u32)strtoul(p + 1, NULL, 10);
+		}
+
+		for (u32 i = src->num_spans; output_line > 0 && i-- > 0;)
+		{
+			const shader_span_t	*span = &src->spans[i];
+
+
+			if (span->output_line > output_line)
+				continue;
+			printf("%s:%u: ",
+				   (span->file == SHADER_DEFINES) ? "(defines)" : shader_files[span->file].path,
+				   span->line + (output_line - span->output_line));
+			break;
+		}
+		printf("%.*s", (s32)(end - line), line);
+	}
+	printf("\n");
+}
+
+// Preprocessed `path`; on failure `src` holds what was read so far
+internal b32
+shader_load_source(shader_source_t *src,
+				   const char *path,
+				   const char *defines)
+{
+	char				root[SHADER_PATH_SIZE];
+
+
+	memset(src, 0, sizeof(*src));
+	if (strlen(path) >= SHADER_PATH_SIZE)
+	{
+		printf("shader path too long: %s\n", path);
+		return FALSE;
+	}
+	strcpy(root, path);
+	shader_normalize_path(root);
+
+	return shader_preprocess(src, root, defines, 0);
 }
 
-void 
-check_compile_errors(u32 data, 
+internal u32
+shader_compile(u32 type,
+			   const shader_source_t *src,
+			   const char *path)
+{
+	u32					shader;
+	s32					success;
+
+
+	shader = glCreateShader(type);
+	glShaderSource(shader, 1, &src->text, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		shader_print_log(shader, src, path);
+		shader_errors++;
+	}
+
+	return shader;
+}
+
+// FNV-1a over the driver's name and version and every stage's text
+internal u64
+program_cache_key(const u32 *types,
+				  const shader_source_t *srcs,
+				  u32 num_stages)
+{
+	const char	*driver[3] =
+	{
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION)
+	};
+	u64			key = 14695981039346656037ull;
+
+
+	for (u32 i = 0; i < 3; i++)
+	{
+		for (const char *c = driver[i]; c && *c; c++)
+			key = (key ^ (u8)*c) * 1099511628211ull;
+	}
+	for (u32 i = 0; i < num_stages; i++)
+	{
+		key = (key ^ types[i]) * 1099511628211ull;
+		for (u32 k = 0; k < srcs[i].size; k++)
+			key = (key ^ (u8)srcs[i].text[k]) * 1099511628211ull;
+	}
+
+	return key;
+}
+
+// Program from the cached binary under `key`, 0 if there is none or the
+// driver won't take it
+internal u32
+program_cache_load(u64 key)
+{
+	u32			program;
+	s32			linked;
+
+
+	for (u32 i = 0; i < num_program_binaries; i++)
+	{
+		if (program_binaries[i].key != key)
+			continue;
+
+		program = glCreateProgram();
+		glProgramBinary(program, program_binaries[i].format, program_binaries[i].data, program_binaries[i].size);
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (linked)
+			return program;
+		glDeleteProgram(program);
+		break;
+	}
+
+	return 0;
+}
+
+internal void
+program_cache_store(u64 key,
+					u32 program)
+{
+	program_binary_t	*binary = NULL;
+	s32					size = 0;
+
+
+	for (u32 i = 0; i < num_program_binaries && !binary; i++)
+		binary = (program_binaries[i].key == key) ? &program_binaries[i] : NULL;
+	if (!binary)
+	{
+		if (num_program_binaries == PROGRAM_CACHE_MAX)
+			return;
+		binary = &program_binaries[num_program_binaries++];
+		binary->data = NULL;
+	}
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	binary->key = key;
+	binary->size = (u32)size;
+	binary->data = (u8 *)realloc(binary->data, size);
+	glGetProgramBinary(program, size, NULL, &binary->format, binary->data);
+	program_cache_dirty = TRUE;
+}
+
+// Program linked from one shader per stage; 0 if a source couldn't be read
+internal u32
+shader_program(const u32 *types,
+			   const char **paths,
+			   u32 num_stages,
+			   const char *defines)
+{
+	shader_source_t		srcs[SHADER_MAX_STAGES];
+	u32					shaders[SHADER_MAX_STAGES];
+	u32					program = 0;
+	u64					key = 0;
+	b32					loaded = TRUE;
+	s32					linked;
+
+
+	for (u32 i = 0; i < num_stages; i++)
+		loaded = shader_load_source(&srcs[i], paths[i], defines) && loaded;
+	if (!loaded)
+		shader_errors++;
+
+	if (loaded && program_cache_path)
+	{
+		key = program_cache_key(types, srcs, num_stages);
+		program = program_cache_load(key);
+	}
+
+	if (loaded && !program)
+	{
+		program = glCreateProgram();
+		for (u32 i = 0; i < num_stages; i++)
+		{
+			shaders[i] = shader_compile(types[i], &srcs[i], paths[i]);
+			glAttachShader(program, shaders[i]);
+		}
+		if (program_cache_path)
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(program);
+		check_compile_errors(program, 1, NULL);
+		for (u32 i = 0; i < num_stages; i++)
+			glDeleteShader(shaders[i]);
+
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (linked && program_cache_path)
+			program_cache_store(key, program);
+	}
+
+	for (u32 i = 0; i < num_stages; i++)
+	{
+		free(srcs[i].spans);
+		free(srcs[i].text);
+	}
+
+	return program;
+}
+
+void
+check_compile_errors(u32 data,
                      b32 is_program,
                      const char* filename)
 {
@@ -113,6 +738,7 @@ check_compile_errors(u32 data,
         {
             glGetProgramInfoLog(data, 1024, NULL, info_log);
             printf("PROGRAM LINKING ERROR OF TYPE:\n %s\n\n", info_log);
+            shader_errors++;
         }
     }
     else
@@ -127,4 +753,3 @@ check_compile_errors(u32 data,
 }
 
 #endif GL_LOADSHADER_H
-
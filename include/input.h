@@ -0,0 +1,156 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+// Timestamped key events for camera motion. Polling the key state once per
+// frame moves the camera by whole frames: at a few frames per second the
+// motion jumps, and a key pressed and released between two frames is never
+// seen. The key callbacks push press/release events stamped with the time
+// they arrived instead, and input_held() turns them into how long each key
+// was down since its last call, so the distance moved is the speed times
+// the time held, whatever the frame rate.
+//
+// GLFW delivers events on the main thread only, from glfwPollEvents() and
+// friends, so the stamps are as fine as the loop pumps events; the frame
+// pacer and lazy redraw pump them while they wait. A key that was pressed
+// and released before it was ever integrated counts as held for at least
+// INPUT_MIN_HOLD seconds, so a quick tap always moves.
+
+#include <string.h>
+#include "types.h"
+
+#define INPUT_FORWARD       0
+#define INPUT_BACK          1
+#define INPUT_LEFT          2
+#define INPUT_RIGHT         3
+#define INPUT_KEY_COUNT     4
+
+#define INPUT_QUEUE_SIZE    256
+#define INPUT_MIN_HOLD      (1.0 / 60.0)
+
+typedef struct _TAG_input_event
+{
+    f64 time;       // seconds, same clock as input_held()'s `now`
+    u32 key;        // INPUT_*
+    b32 down;
+} input_event_t;
+
+typedef struct _TAG_input_queue
+{
+    input_event_t   events[INPUT_QUEUE_SIZE];
+    u32             head;
+    u32             count;
+
+    b32             down[INPUT_KEY_COUNT];
+    f64             pressed[INPUT_KEY_COUNT];   // when the key went down
+    f64             since[INPUT_KEY_COUNT];     // held time is counted up to here
+    f64             held[INPUT_KEY_COUNT];      // not handed out yet
+} input_queue_t;
+
+void        input_init(input_queue_t *queue);
+void        input_push(input_queue_t *queue, u32 key, b32 down, f64 time);
+b32         input_held(input_queue_t *queue, f64 now, f64 *held);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== INPUT IMPLEMENTATION ===============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef INPUT_IMPL
+
+void
+input_init(input_queue_t *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+}
+
+internal void
+input_apply(input_queue_t *queue,
+            input_event_t *event)
+{
+    u32 key = event->key;
+
+
+    if (event->down && !queue->down[key])
+    {
+        queue->down[key] = TRUE;
+        queue->pressed[key] = event->time;
+        queue->since[key] = event->time;
+    }
+    else if (!event->down && queue->down[key])
+    {
+        f64 total = event->time - queue->pressed[key];
+
+
+        queue->down[key] = FALSE;
+        if (event->time > queue->since[key])
+            queue->held[key] += event->time - queue->since[key];
+        if (total < INPUT_MIN_HOLD)
+            queue->held[key] += INPUT_MIN_HOLD - (total > 0.0 ? total : 0.0);
+    }
+}
+
+// Key repeats aren't events here, only the first press and the release. A
+// full queue folds its oldest event into the held times, nothing is lost.
+void
+input_push(input_queue_t *queue,
+           u32 key,
+           b32 down,
+           f64 time)
+{
+    input_event_t *event;
+
+
+    if (key >= INPUT_KEY_COUNT)
+        return;
+
+    if (queue->count == INPUT_QUEUE_SIZE)
+    {
+        input_apply(queue, &queue->events[queue->head]);
+        queue->head = (queue->head + 1) % INPUT_QUEUE_SIZE;
+        queue->count--;
+    }
+
+    event = &queue->events[(queue->head + queue->count) % INPUT_QUEUE_SIZE];
+    event->time = time;
+    event->key = key;
+    event->down = down;
+    queue->count++;
+}
+
+// Seconds each INPUT_* key was held since the last call, into `held`;
+// returns TRUE if any was
+b32
+input_held(input_queue_t *queue,
+           f64 now,
+           f64 *held)
+{
+    b32 any = FALSE;
+
+
+    while (queue->count)
+    {
+        input_apply(queue, &queue->events[queue->head]);
+        queue->head = (queue->head + 1) % INPUT_QUEUE_SIZE;
+        queue->count--;
+    }
+
+    for (u32 key = 0; key < INPUT_KEY_COUNT; key++)
+    {
+        if (queue->down[key])
+        {
+            if (now > queue->since[key])
+                queue->held[key] += now - queue->since[key];
+            queue->since[key] = now;
+        }
+
+        held[key] = queue->held[key];
+        queue->held[key] = 0.0;
+        if (held[key] > 0.0 || queue->down[key])
+            any = TRUE;
+    }
+
+    return any;
+}
+
+#endif // INPUT_IMPL
+
+#endif // INPUT_H
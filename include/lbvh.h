@@ -0,0 +1,329 @@
+#ifndef LBVH_H
+#define LBVH_H
+
+// Linear BVH over spheres, built entirely on the GPU for scenes that change
+// every frame (Karras 2012). A build is a handful of compute dispatches:
+//
+//   bounds      centroid bounds, reduced with atomics
+//   morton      30 bit Morton code per sphere
+//   radix sort  count / scan / scatter per 4 bit digit, 8 digits
+//   emit        one internal node per thread straight from the sorted codes
+//   fit         leaf to root bounds, the second thread at a node continues
+//
+// The nodes come out as bvh_node_t with adjacent children, so the kernels
+// traverse them like the CPU built ones; leaves hold a single sphere and
+// index it directly.
+//
+// For moving spheres lbvh_update() runs the fit pass alone on the existing
+// topology, and rebuilds once that made the tree too slow. The SAH cost is
+// measured on the GPU after every build or refit and read back a frame or
+// more later, once its fence has signalled, so the check never stalls.
+//
+// The sphere buffer holds one vec4 (center, radius) per sphere and has to
+// stay bound at LBVH_BINDING_SPHERES. The nodes are at LBVH_BINDING_NODES;
+// the build uses bindings 8 .. 15 for itself.
+//
+// Needs the GL function pointers (glad) to be included before this file.
+
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "bvh.h"
+
+#define LBVH_GROUP_SIZE     256
+#define LBVH_SORT_BLOCK     (LBVH_GROUP_SIZE * 16)  // keys per radix sort workgroup
+#define LBVH_RADIX          16
+#define LBVH_RADIX_PASSES   8           // 4 bits each, covers the 30 bit codes
+#define LBVH_SCAN_GROUP     1024
+
+#define LBVH_BINDING_SPHERES    5
+#define LBVH_BINDING_NODES      7
+
+// Passes, in the order of the programs handed to lbvh_init()
+#define LBVH_PASS_BOUNDS    0
+#define LBVH_PASS_MORTON    1
+#define LBVH_PASS_COUNT     2
+#define LBVH_PASS_SCAN      3
+#define LBVH_PASS_SCATTER   4
+#define LBVH_PASS_EMIT      5
+#define LBVH_PASS_FIT       6
+#define LBVH_PASS_SAH       7
+#define LBVH_NUM_PASSES     8
+
+#define LBVH_BUFFER_KEYS        0       // ping-pong pairs, 0/1 and 2/3
+#define LBVH_BUFFER_VALUES      1
+#define LBVH_BUFFER_KEYS_TEMP   2
+#define LBVH_BUFFER_VALUES_TEMP 3
+#define LBVH_BUFFER_COUNTS      4
+#define LBVH_BUFFER_SLOTS       5
+#define LBVH_BUFFER_ARRIVALS    6
+#define LBVH_BUFFER_BOUNDS      7
+#define LBVH_BUFFER_NODES       8
+#define LBVH_BUFFER_COST        9
+#define LBVH_NUM_BUFFERS        10
+
+typedef struct _TAG_lbvh
+{
+    u32     programs[LBVH_NUM_PASSES];
+    u32     buffers[LBVH_NUM_BUFFERS];
+    u32     capacity;
+    u32     num_spheres;    // of the last build
+
+    // Rebuild heuristic
+    GLsync  cost_fence;     // SAH pass in flight
+    b32     cost_of_build;  // ... measuring a fresh build
+    f32     build_cost;     // 0 until the first measurement is back
+    f32     cost;
+} lbvh_t;
+
+b32         lbvh_init(lbvh_t *lbvh, u32 *programs, u32 capacity);
+void        lbvh_free(lbvh_t *lbvh);
+void        lbvh_build(lbvh_t *lbvh, u32 spheres, u32 num_spheres);
+void        lbvh_refit(lbvh_t *lbvh, u32 spheres);
+b32         lbvh_update(lbvh_t *lbvh, u32 spheres);
+u32         lbvh_nodes(lbvh_t *lbvh);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== LBVH IMPLEMENTATION ================================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef LBVH_IMPL
+
+// Takes ownership of the programs. Fails if any of them didn't link.
+b32
+lbvh_init(lbvh_t *lbvh,
+          u32 *programs,
+          u32 capacity)
+{
+    u32 num_blocks = (capacity + LBVH_SORT_BLOCK - 1) / LBVH_SORT_BLOCK;
+    s32 linked;
+
+
+    memset(lbvh, 0, sizeof(*lbvh));
+    memcpy(lbvh->programs, programs, sizeof(lbvh->programs));
+    for (u32 i = 0; i < LBVH_NUM_PASSES; i++)
+    {
+        glGetProgramiv(programs[i], GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            printf("lbvh: pass %u failed to link\n", i);
+            return FALSE;
+        }
+    }
+
+    lbvh->capacity = capacity;
+    glCreateBuffers(LBVH_NUM_BUFFERS, lbvh->buffers);
+    for (u32 i = LBVH_BUFFER_KEYS; i <= LBVH_BUFFER_VALUES_TEMP; i++)
+        glNamedBufferStorage(lbvh->buffers[i], capacity * sizeof(u32), NULL, 0);
+    glNamedBufferStorage(lbvh->buffers[LBVH_BUFFER_COUNTS], num_blocks * LBVH_RADIX * sizeof(u32), NULL, 0);
+    glNamedBufferStorage(lbvh->buffers[LBVH_BUFFER_SLOTS], (2 * capacity - 1) * sizeof(u32), NULL, 0);
+    glNamedBufferStorage(lbvh->buffers[LBVH_BUFFER_ARRIVALS], capacity * sizeof(u32), NULL, 0);
+    glNamedBufferStorage(lbvh->buffers[LBVH_BUFFER_BOUNDS], 6 * sizeof(u32), NULL, 0);
+    glNamedBufferStorage(lbvh->buffers[LBVH_BUFFER_NODES], (2 * capacity - 1) * sizeof(bvh_node_t), NULL, 0);
+    glNamedBufferStorage(lbvh->buffers[LBVH_BUFFER_COST], sizeof(u32), NULL, 0);
+
+    return TRUE;
+}
+
+void
+lbvh_free(lbvh_t *lbvh)
+{
+    if (lbvh->cost_fence)
+        glDeleteSync(lbvh->cost_fence);
+    glDeleteBuffers(LBVH_NUM_BUFFERS, lbvh->buffers);
+    for (u32 i = 0; i < LBVH_NUM_PASSES; i++)
+        glDeleteProgram(lbvh->programs[i]);
+    memset(lbvh, 0, sizeof(*lbvh));
+}
+
+internal void
+lbvh_bind(lbvh_t *lbvh,
+          u32 binding,
+          u32 buffer)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, lbvh->buffers[buffer]);
+}
+
+internal void
+lbvh_dispatch(lbvh_t *lbvh,
+              u32 pass,
+              u32 num_groups)
+{
+    u32 program = lbvh->programs[pass];
+
+    glUseProgram(program);
+    glUniform1ui(glGetUniformLocation(program, "num_spheres"), lbvh->num_spheres);
+    glDispatchCompute(num_groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Fit pass; the topology in the nodes and slots must be current
+internal void
+lbvh_fit(lbvh_t *lbvh)
+{
+    u32 zero = 0;
+
+    glClearNamedBufferSubData(lbvh->buffers[LBVH_BUFFER_ARRIVALS], GL_R32UI, 0,
+                              lbvh->num_spheres * sizeof(u32), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    lbvh_bind(lbvh, LBVH_BINDING_NODES, LBVH_BUFFER_NODES);
+    lbvh_bind(lbvh, 13, LBVH_BUFFER_SLOTS);
+    lbvh_bind(lbvh, 14, LBVH_BUFFER_ARRIVALS);
+    lbvh_dispatch(lbvh, LBVH_PASS_FIT, (lbvh->num_spheres + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE);
+}
+
+// Queues the SAH pass over the current tree, unless one is still in flight
+internal void
+lbvh_measure(lbvh_t *lbvh,
+             b32 of_build)
+{
+    u32 zero = 0;
+
+    if (lbvh->cost_fence)
+        return;
+
+    glClearNamedBufferData(lbvh->buffers[LBVH_BUFFER_COST], GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    lbvh_bind(lbvh, LBVH_BINDING_NODES, LBVH_BUFFER_NODES);
+    lbvh_bind(lbvh, 15, LBVH_BUFFER_COST);
+    lbvh_dispatch(lbvh, LBVH_PASS_SAH, (2 * lbvh->num_spheres - 1 + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);      // read back with glGetNamedBufferSubData()
+
+    lbvh->cost_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    lbvh->cost_of_build = of_build;
+}
+
+// Picks up a finished SAH measurement, if there is one
+internal void
+lbvh_poll_cost(lbvh_t *lbvh)
+{
+    u32 fixed;
+
+    if (!lbvh->cost_fence || glClientWaitSync(lbvh->cost_fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        return;
+
+    glDeleteSync(lbvh->cost_fence);
+    lbvh->cost_fence = NULL;
+    glGetNamedBufferSubData(lbvh->buffers[LBVH_BUFFER_COST], 0, sizeof(u32), &fixed);
+    lbvh->cost = fixed / 65536.0f;
+    if (lbvh->cost_of_build)
+        lbvh->build_cost = lbvh->cost;
+}
+
+// Full rebuild from the spheres in `spheres` (at most the capacity)
+void
+lbvh_build(lbvh_t *lbvh,
+           u32 spheres,
+           u32 num_spheres)
+{
+    u32 num_groups = (num_spheres + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE;
+    u32 num_blocks = (num_spheres + LBVH_SORT_BLOCK - 1) / LBVH_SORT_BLOCK;
+    u32 bounds_init[6] = {U32_MAX, U32_MAX, U32_MAX, 0, 0, 0};
+
+
+    if (!num_spheres || num_spheres > lbvh->capacity)
+        return;
+    lbvh->num_spheres = num_spheres;
+
+    glNamedBufferSubData(lbvh->buffers[LBVH_BUFFER_BOUNDS], 0, sizeof(bounds_init), bounds_init);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LBVH_BINDING_SPHERES, spheres);
+    lbvh_bind(lbvh, 8, LBVH_BUFFER_KEYS);
+    lbvh_bind(lbvh, 9, LBVH_BUFFER_VALUES);
+    lbvh_bind(lbvh, 15, LBVH_BUFFER_BOUNDS);
+    lbvh_dispatch(lbvh, LBVH_PASS_BOUNDS, num_groups);
+    lbvh_dispatch(lbvh, LBVH_PASS_MORTON, num_groups);
+
+    // Radix sort, ping-ponging between the two key/value pairs. An even
+    // number of passes leaves the result in the first pair.
+    lbvh_bind(lbvh, 12, LBVH_BUFFER_COUNTS);
+    for (u32 pass = 0; pass < LBVH_RADIX_PASSES; pass++)
+    {
+        u32 in = (pass & 1) ? LBVH_BUFFER_KEYS_TEMP : LBVH_BUFFER_KEYS;
+        u32 out = (pass & 1) ? LBVH_BUFFER_KEYS : LBVH_BUFFER_KEYS_TEMP;
+        u32 shift = pass * 4;
+
+        lbvh_bind(lbvh, 8, in);
+        lbvh_bind(lbvh, 9, in + 1);
+        lbvh_bind(lbvh, 10, out);
+        lbvh_bind(lbvh, 11, out + 1);
+
+        glProgramUniform1ui(lbvh->programs[LBVH_PASS_COUNT],
+                            glGetUniformLocation(lbvh->programs[LBVH_PASS_COUNT], "num_blocks"), num_blocks);
+        glProgramUniform1ui(lbvh->programs[LBVH_PASS_COUNT],
+                            glGetUniformLocation(lbvh->programs[LBVH_PASS_COUNT], "shift"), shift);
+        lbvh_dispatch(lbvh, LBVH_PASS_COUNT, num_blocks);
+
+        glProgramUniform1ui(lbvh->programs[LBVH_PASS_SCAN],
+                            glGetUniformLocation(lbvh->programs[LBVH_PASS_SCAN], "num_entries"),
+                            num_blocks * LBVH_RADIX);
+        lbvh_dispatch(lbvh, LBVH_PASS_SCAN, 1);
+
+        glProgramUniform1ui(lbvh->programs[LBVH_PASS_SCATTER],
+                            glGetUniformLocation(lbvh->programs[LBVH_PASS_SCATTER], "num_blocks"), num_blocks);
+        glProgramUniform1ui(lbvh->programs[LBVH_PASS_SCATTER],
+                            glGetUniformLocation(lbvh->programs[LBVH_PASS_SCATTER], "shift"), shift);
+        lbvh_dispatch(lbvh, LBVH_PASS_SCATTER, num_blocks);
+    }
+
+    lbvh_bind(lbvh, 8, LBVH_BUFFER_KEYS);
+    lbvh_bind(lbvh, 9, LBVH_BUFFER_VALUES);
+    lbvh_bind(lbvh, LBVH_BINDING_NODES, LBVH_BUFFER_NODES);
+    lbvh_bind(lbvh, 13, LBVH_BUFFER_SLOTS);
+    lbvh_dispatch(lbvh, LBVH_PASS_EMIT, (num_spheres > 1) ? (num_spheres - 1 + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE : 1);
+
+    lbvh_fit(lbvh);
+
+    // A measurement of the old tree is stale now
+    if (lbvh->cost_fence)
+    {
+        glDeleteSync(lbvh->cost_fence);
+        lbvh->cost_fence = NULL;
+    }
+    lbvh->build_cost = 0.0f;
+    lbvh_measure(lbvh, TRUE);
+}
+
+// New bounds for the same spheres, which may have moved, on the topology of
+// the last build
+void
+lbvh_refit(lbvh_t *lbvh,
+           u32 spheres)
+{
+    if (!lbvh->num_spheres)
+        return;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LBVH_BINDING_SPHERES, spheres);
+    lbvh_fit(lbvh);
+}
+
+// Refit, or rebuild once the last measured cost is past BVH_REBUILD_RATIO
+// times the cost after the last build. Returns TRUE when it rebuilt.
+b32
+lbvh_update(lbvh_t *lbvh,
+            u32 spheres)
+{
+    lbvh_poll_cost(lbvh);
+
+    if (lbvh->build_cost > 0.0f && lbvh->cost > lbvh->build_cost * BVH_REBUILD_RATIO)
+    {
+        printf("lbvh: rebuilt at SAH cost %.1f, %.1f after the last build\n",
+               lbvh->cost, lbvh->build_cost);
+        lbvh_build(lbvh, spheres, lbvh->num_spheres);
+        return TRUE;
+    }
+
+    lbvh_refit(lbvh, spheres);
+    lbvh_measure(lbvh, FALSE);
+
+    return FALSE;
+}
+
+u32
+lbvh_nodes(lbvh_t *lbvh)
+{
+    return lbvh->buffers[LBVH_BUFFER_NODES];
+}
+
+#endif // LBVH_IMPL
+
+#endif // LBVH_H
@@ -0,0 +1,80 @@
+#ifndef LBVH_BENCH_H
+#define LBVH_BENCH_H
+
+// Time of full LBVH rebuilds for growing prefixes of the sphere cloud, and
+// the SAH cost of the largest tree next to the CPU binned SAH builder. The
+// builds are timed on the CPU between glFinish() calls, so submission is
+// included, as it would be for a rebuild every frame. Run with --bench-lbvh.
+//
+// Needs the GL function pointers (glad) to be included before this file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "lbvh.h"
+#include "scene.h"
+
+#define LBVH_BENCH_RUNS     10
+
+void        lbvh_bench(lbvh_t *lbvh, u32 spheres, scene_cloud_t *cloud);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== LBVH BENCH IMPLEMENTATION ==========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef LBVH_BENCH_IMPL
+
+internal f64
+lbvh_bench_now(void)
+{
+    return std::chrono::duration<f64>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// `spheres` holds the cloud as uploaded; `cloud` is only read for its BVH
+void
+lbvh_bench(lbvh_t *lbvh,
+           u32 spheres,
+           scene_cloud_t *cloud)
+{
+    bvh_t       gpu_bvh;
+    u32         num_spheres;
+    f64         start,
+                ms;
+
+
+    for (num_spheres = 1 << 14; ; num_spheres <<= 2)
+    {
+        if (num_spheres > cloud->num_spheres)
+            num_spheres = cloud->num_spheres;
+
+        lbvh_build(lbvh, spheres, num_spheres);   // warm up
+        glFinish();
+
+        start = lbvh_bench_now();
+        for (u32 i = 0; i < LBVH_BENCH_RUNS; i++)
+            lbvh_build(lbvh, spheres, num_spheres);
+        glFinish();
+        ms = (lbvh_bench_now() - start) * 1000.0 / LBVH_BENCH_RUNS;
+
+        printf("%8u spheres: %7.3f ms per build, %7.1f Mspheres/s\n",
+               num_spheres, ms, num_spheres / ms * 1e-3);
+
+        if (num_spheres == cloud->num_spheres)
+            break;
+    }
+
+    // Tree quality of the last (full) build
+    memset(&gpu_bvh, 0, sizeof(gpu_bvh));
+    gpu_bvh.num_nodes = 2 * num_spheres - 1;
+    gpu_bvh.nodes = (bvh_node_t *)malloc(gpu_bvh.num_nodes * sizeof(bvh_node_t));
+    glGetNamedBufferSubData(lbvh_nodes(lbvh), 0, gpu_bvh.num_nodes * sizeof(bvh_node_t), gpu_bvh.nodes);
+    printf("SAH cost: LBVH %.1f, CPU binned SAH %.1f\n",
+           bvh_sah_cost(&gpu_bvh), bvh_sah_cost(&cloud->bvh));
+
+    free(gpu_bvh.nodes);
+}
+
+#endif // LBVH_BENCH_IMPL
+
+#endif // LBVH_BENCH_H
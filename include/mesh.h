@@ -0,0 +1,742 @@
+#ifndef MESH_H
+#define MESH_H
+
+// Indexed triangle meshes: OBJ loading, a procedural fallback mesh and the
+// per-mesh BVH. Vertices are packed as two vec4s (position + u, normal + v)
+// so the vertex buffer uploads to an std430 SSBO unchanged; after
+// mesh_build_bvh() the triangles are stored in BVH leaf order, and the
+// binary BVH is also collapsed into the compressed 4-wide one the renderers
+// traverse.
+//
+// OBJ files are parsed in parallel. The file is split into one chunk per
+// thread at line boundaries; a quick counting pass gives each chunk its
+// global v/vt/vn offsets, so every thread can parse its lines, resolve
+// (relative) indices and deduplicate its face corners on its own.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <thread>
+#include <chrono>
+#include "types.h"
+#include "mmath.h"
+#include "bvh.h"
+#include "bvh4.h"
+
+#define MESH_MAX_THREADS    64
+#define MESH_MAX_FACE_VERTS 64
+
+typedef struct _TAG_mesh_vertex
+{
+    f32 px, py, pz;
+    f32 u;
+    f32 nx, ny, nz;     // zero when the file has no normals
+    f32 v;
+} mesh_vertex_t;
+
+typedef struct _TAG_mesh
+{
+    mesh_vertex_t   *vertices;
+    u32             num_vertices;
+    u32             *indices;       // 3 per triangle
+    u32             num_triangles;
+    bvh_t           bvh;
+    bvh4_t          bvh4;           // same tree, what gets traversed
+} mesh_t;
+
+b32         mesh_load_obj(mesh_t *mesh, const char *path, u32 num_threads);
+void        mesh_make_torus(mesh_t *mesh, f32 major, f32 minor, u32 rings, u32 sides);
+void        mesh_make_sphere(mesh_t *mesh, f32 radius, u32 rings, u32 sides);
+void        mesh_fit(mesh_t *mesh, vec3_t center, f32 size);
+void        mesh_build_bvh(mesh_t *mesh, u32 num_threads);
+void        mesh_free(mesh_t *mesh);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== MESH IMPLEMENTATION ================================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef MESH_IMPL
+
+////////////////////////////////////////////////////////////////////////////////
+// OBJ PARSING
+
+typedef struct _TAG_mesh_corner
+{
+    u32 v, vt, vn;      // resolved, 0 based; U32_MAX when absent
+} mesh_corner_t;
+
+typedef struct _TAG_mesh_obj_chunk
+{
+    const char      *begin;
+    const char      *end;
+
+    // Counting pass
+    u32             num_v, num_vt, num_vn;
+    u32             base_v, base_vt, base_vn;
+
+    // Parsing pass
+    mesh_corner_t   *unique;        // deduplicated corners of this chunk
+    u32             num_unique;
+    u32             *tris;          // indices into unique
+    u32             num_tris;
+    u32             cap_tris;
+    u32             *table;         // open addressing, stores unique index + 1
+    u32             table_size;
+    u32             base_vertex;
+    u32             base_tri;
+    b32             bad_index;
+} mesh_obj_chunk_t;
+
+typedef struct _TAG_mesh_obj
+{
+    f32             *v;
+    f32             *vt;
+    f32             *vn;
+    u32             num_v, num_vt, num_vn;
+} mesh_obj_t;
+
+internal const char *
+mesh_skip_space(const char *p,
+                const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+internal const char *
+mesh_next_line(const char *p,
+               const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+// Plain decimal float parser, a good deal faster than strtof and precise
+// enough for vertex data
+internal const char *
+mesh_parse_float(const char *p,
+                 const char *end,
+                 f32 *out)
+{
+    f64 value = 0.0,
+        scale = 1.0;
+    b32 negative = FALSE;
+
+
+    p = mesh_skip_space(p, end);
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10.0 + (*p++ - '0');
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            scale *= 0.1;
+            value += (*p++ - '0') * scale;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        s32 exponent = 0;
+        b32 exp_negative = FALSE;
+
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+            exp_negative = (*p++ == '-');
+        while (p < end && *p >= '0' && *p <= '9')
+            exponent = exponent * 10 + (*p++ - '0');
+        value *= pow(10.0, exp_negative ? -exponent : exponent);
+    }
+
+    *out = (f32)(negative ? -value : value);
+    return p;
+}
+
+internal const char *
+mesh_parse_int(const char *p,
+               const char *end,
+               s64 *out)
+{
+    s64 value = 0;
+    b32 negative = FALSE;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+
+    *out = negative ? -value : value;
+    return p;
+}
+
+// 1 based, negative relative to `count`; U32_MAX if absent or out of range
+internal u32
+mesh_resolve_index(s64 raw,
+                   u32 count,
+                   b32 *bad)
+{
+    s64 index = (raw < 0) ? (s64)count + raw : raw - 1;
+
+    if (raw == 0)
+        return U32_MAX;
+    if (index < 0 || index >= count)
+    {
+        *bad = TRUE;
+        return U32_MAX;
+    }
+
+    return (u32)index;
+}
+
+internal u32
+mesh_hash_corner(mesh_corner_t *c)
+{
+    u32 h = c->v * 0x9E3779B1u;
+    h ^= (c->vt + 0x7F4A7C15u) * 0x85EBCA77u;
+    h ^= (c->vn + 0x165667B1u) * 0xC2B2AE3Du;
+    return h ^ (h >> 15);
+}
+
+internal void
+mesh_chunk_rehash(mesh_obj_chunk_t *chunk)
+{
+    u32 size = chunk->table_size ? chunk->table_size * 2 : 1024;
+
+    free(chunk->table);
+    chunk->table = (u32 *)calloc(size, sizeof(u32));
+    chunk->table_size = size;
+    chunk->unique = (mesh_corner_t *)realloc(chunk->unique, (size / 2) * sizeof(mesh_corner_t));
+
+    for (u32 i = 0; i < chunk->num_unique; i++)
+    {
+        u32 slot = mesh_hash_corner(&chunk->unique[i]) & (size - 1);
+        while (chunk->table[slot])
+            slot = (slot + 1) & (size - 1);
+        chunk->table[slot] = i + 1;
+    }
+}
+
+internal u32
+mesh_chunk_corner(mesh_obj_chunk_t *chunk,
+                  mesh_corner_t *corner)
+{
+    u32 slot;
+
+    // Keep the table at most half full
+    if ((chunk->num_unique + 1) * 2 > chunk->table_size)
+        mesh_chunk_rehash(chunk);
+
+    slot = mesh_hash_corner(corner) & (chunk->table_size - 1);
+    while (chunk->table[slot])
+    {
+        mesh_corner_t *other = &chunk->unique[chunk->table[slot] - 1];
+        if (other->v == corner->v && other->vt == corner->vt && other->vn == corner->vn)
+            return chunk->table[slot] - 1;
+        slot = (slot + 1) & (chunk->table_size - 1);
+    }
+
+    chunk->unique[chunk->num_unique] = *corner;
+    chunk->table[slot] = ++chunk->num_unique;
+
+    return chunk->num_unique - 1;
+}
+
+internal void
+mesh_obj_count(mesh_obj_chunk_t *chunk)
+{
+    const char *p = chunk->begin;
+
+    while (p < chunk->end)
+    {
+        const char *line = mesh_skip_space(p, chunk->end);
+
+        if (line + 1 < chunk->end && line[0] == 'v')
+        {
+            if (line[1] == ' ' || line[1] == '\t')
+                chunk->num_v++;
+            else if (line[1] == 't')
+                chunk->num_vt++;
+            else if (line[1] == 'n')
+                chunk->num_vn++;
+        }
+        p = mesh_next_line(line, chunk->end);
+    }
+}
+
+internal void
+mesh_obj_parse(mesh_obj_chunk_t *chunk,
+               mesh_obj_t *obj)
+{
+    const char  *p = chunk->begin;
+    const char  *end = chunk->end;
+    u32         nv = chunk->base_v,
+                nvt = chunk->base_vt,
+                nvn = chunk->base_vn;
+
+
+    while (p < end)
+    {
+        const char *line = mesh_skip_space(p, end);
+        const char *next = mesh_next_line(line, end);
+
+        if (line + 1 < end && line[0] == 'v' && (line[1] == ' ' || line[1] == '\t'))
+        {
+            const char *q = line + 1;
+            for (u32 a = 0; a < 3; a++)
+                q = mesh_parse_float(q, next, &obj->v[nv * 3 + a]);
+            nv++;
+        }
+        else if (line + 2 < end && line[0] == 'v' && line[1] == 't')
+        {
+            const char *q = line + 2;
+            q = mesh_parse_float(q, next, &obj->vt[nvt * 2 + 0]);
+            q = mesh_parse_float(q, next, &obj->vt[nvt * 2 + 1]);
+            nvt++;
+        }
+        else if (line + 2 < end && line[0] == 'v' && line[1] == 'n')
+        {
+            const char *q = line + 2;
+            for (u32 a = 0; a < 3; a++)
+                q = mesh_parse_float(q, next, &obj->vn[nvn * 3 + a]);
+            nvn++;
+        }
+        else if (line + 1 < end && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t'))
+        {
+            u32         corners[MESH_MAX_FACE_VERTS];
+            u32         count = 0;
+            const char  *q = line + 1;
+
+
+            for (;;)
+            {
+                mesh_corner_t   corner;
+                s64             raw;
+
+
+                q = mesh_skip_space(q, next);
+                if (q >= next || !((*q >= '0' && *q <= '9') || *q == '-'))
+                    break;
+
+                q = mesh_parse_int(q, next, &raw);
+                corner.v = mesh_resolve_index(raw, nv, &chunk->bad_index);
+                corner.vt = U32_MAX;
+                corner.vn = U32_MAX;
+                if (q < next && *q == '/')
+                {
+                    q++;
+                    if (q < next && *q != '/')
+                    {
+                        q = mesh_parse_int(q, next, &raw);
+                        corner.vt = mesh_resolve_index(raw, nvt, &chunk->bad_index);
+                    }
+                    if (q < next && *q == '/')
+                    {
+                        q = mesh_parse_int(q + 1, next, &raw);
+                        corner.vn = mesh_resolve_index(raw, nvn, &chunk->bad_index);
+                    }
+                }
+                while (q < next && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n')
+                    q++;
+
+                if (corner.v == U32_MAX)
+                {
+                    chunk->bad_index = TRUE;
+                    continue;
+                }
+                if (count < MESH_MAX_FACE_VERTS)
+                    corners[count++] = mesh_chunk_corner(chunk, &corner);
+            }
+
+            // Fan triangulation
+            for (u32 i = 2; i < count; i++)
+            {
+                if (chunk->num_tris == chunk->cap_tris)
+                {
+                    chunk->cap_tris = chunk->cap_tris ? chunk->cap_tris * 2 : 4096;
+                    chunk->tris = (u32 *)realloc(chunk->tris, chunk->cap_tris * 3 * sizeof(u32));
+                }
+                chunk->tris[chunk->num_tris * 3 + 0] = corners[0];
+                chunk->tris[chunk->num_tris * 3 + 1] = corners[i - 1];
+                chunk->tris[chunk->num_tris * 3 + 2] = corners[i];
+                chunk->num_tris++;
+            }
+        }
+
+        p = next;
+    }
+}
+
+internal void
+mesh_obj_emit(mesh_obj_chunk_t *chunk,
+              mesh_obj_t *obj,
+              mesh_t *mesh)
+{
+    for (u32 i = 0; i < chunk->num_unique; i++)
+    {
+        mesh_corner_t *c = &chunk->unique[i];
+        mesh_vertex_t *out = &mesh->vertices[chunk->base_vertex + i];
+
+        memset(out, 0, sizeof(*out));
+        out->px = obj->v[c->v * 3 + 0];
+        out->py = obj->v[c->v * 3 + 1];
+        out->pz = obj->v[c->v * 3 + 2];
+        if (c->vt != U32_MAX)
+        {
+            out->u = obj->vt[c->vt * 2 + 0];
+            out->v = obj->vt[c->vt * 2 + 1];
+        }
+        if (c->vn != U32_MAX)
+        {
+            out->nx = obj->vn[c->vn * 3 + 0];
+            out->ny = obj->vn[c->vn * 3 + 1];
+            out->nz = obj->vn[c->vn * 3 + 2];
+        }
+    }
+
+    for (u32 i = 0; i < chunk->num_tris * 3; i++)
+        mesh->indices[chunk->base_tri * 3 + i] = chunk->base_vertex + chunk->tris[i];
+}
+
+internal f64
+mesh_now(void)
+{
+    return std::chrono::duration<f64>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+b32
+mesh_load_obj(mesh_t *mesh,
+              const char *path,
+              u32 num_threads)
+{
+    FILE                *file;
+    char                *data;
+    usize               size;
+    mesh_obj_chunk_t    chunks[MESH_MAX_THREADS];
+    std::thread         threads[MESH_MAX_THREADS];
+    mesh_obj_t          obj;
+    b32                 bad_index = FALSE;
+    f64                 start = mesh_now();
+
+
+    memset(mesh, 0, sizeof(*mesh));
+
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("failed to open mesh %s\n", path);
+        return FALSE;
+    }
+    fseek(file, 0, SEEK_END);
+    size = (usize)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = (char *)malloc(size + 1);
+    if (fread(data, 1, size, file) != size)
+    {
+        printf("failed to read mesh %s\n", path);
+        fclose(file);
+        free(data);
+        return FALSE;
+    }
+    fclose(file);
+    data[size] = '\n';
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads)
+        num_threads = 1;
+    if (num_threads > MESH_MAX_THREADS)
+        num_threads = MESH_MAX_THREADS;
+    if ((usize)num_threads > size / 65536 + 1)
+        num_threads = (u32)(size / 65536 + 1);
+
+    // Split at line boundaries
+    memset(chunks, 0, sizeof(chunks));
+    for (u32 i = 0; i < num_threads; i++)
+    {
+        const char *begin = (i == 0) ? data : chunks[i - 1].end;
+        const char *end = data + size * (i + 1) / num_threads;
+
+        if (end < begin)
+            end = begin;
+        if (i == num_threads - 1)
+            end = data + size;
+        else
+            end = mesh_next_line(end, data + size);
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+    }
+
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i] = std::thread(mesh_obj_count, &chunks[i]);
+    mesh_obj_count(&chunks[0]);
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i].join();
+
+    memset(&obj, 0, sizeof(obj));
+    for (u32 i = 0; i < num_threads; i++)
+    {
+        chunks[i].base_v = obj.num_v;
+        chunks[i].base_vt = obj.num_vt;
+        chunks[i].base_vn = obj.num_vn;
+        obj.num_v += chunks[i].num_v;
+        obj.num_vt += chunks[i].num_vt;
+        obj.num_vn += chunks[i].num_vn;
+    }
+    obj.v = (f32 *)malloc(((usize)obj.num_v * 3 + 1) * sizeof(f32));
+    obj.vt = (f32 *)malloc(((usize)obj.num_vt * 2 + 1) * sizeof(f32));
+    obj.vn = (f32 *)malloc(((usize)obj.num_vn * 3 + 1) * sizeof(f32));
+
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i] = std::thread(mesh_obj_parse, &chunks[i], &obj);
+    mesh_obj_parse(&chunks[0], &obj);
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i].join();
+
+    for (u32 i = 0; i < num_threads; i++)
+    {
+        chunks[i].base_vertex = mesh->num_vertices;
+        chunks[i].base_tri = mesh->num_triangles;
+        mesh->num_vertices += chunks[i].num_unique;
+        mesh->num_triangles += chunks[i].num_tris;
+        bad_index |= chunks[i].bad_index;
+    }
+    mesh->vertices = (mesh_vertex_t *)malloc(((usize)mesh->num_vertices + 1) * sizeof(mesh_vertex_t));
+    mesh->indices = (u32 *)malloc(((usize)mesh->num_triangles * 3 + 1) * sizeof(u32));
+
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i] = std::thread(mesh_obj_emit, &chunks[i], &obj, mesh);
+    mesh_obj_emit(&chunks[0], &obj, mesh);
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i].join();
+
+    for (u32 i = 0; i < num_threads; i++)
+    {
+        free(chunks[i].unique);
+        free(chunks[i].tris);
+        free(chunks[i].table);
+    }
+    free(obj.v);
+    free(obj.vt);
+    free(obj.vn);
+    free(data);
+
+    if (bad_index)
+        printf("mesh %s: skipped out of range face indices\n", path);
+    if (!mesh->num_triangles)
+    {
+        printf("mesh %s: no triangles\n", path);
+        mesh_free(mesh);
+        return FALSE;
+    }
+
+    printf("mesh %s: %u triangles, %u vertices, parsed in %.2fs on %u threads\n",
+           path, mesh->num_triangles, mesh->num_vertices, mesh_now() - start, num_threads);
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PROCEDURAL
+
+// Fallback when no OBJ is given: a torus around the z axis, so it faces the
+// default camera
+void
+mesh_make_torus(mesh_t *mesh,
+                f32 major,
+                f32 minor,
+                u32 rings,
+                u32 sides)
+{
+    memset(mesh, 0, sizeof(*mesh));
+    mesh->num_vertices = (rings + 1) * (sides + 1);
+    mesh->num_triangles = rings * sides * 2;
+    mesh->vertices = (mesh_vertex_t *)malloc(mesh->num_vertices * sizeof(mesh_vertex_t));
+    mesh->indices = (u32 *)malloc(mesh->num_triangles * 3 * sizeof(u32));
+
+    for (u32 r = 0; r <= rings; r++)
+    {
+        f32 theta = 2.0f * 3.1415926f * r / rings;
+
+        for (u32 s = 0; s <= sides; s++)
+        {
+            f32 phi = 2.0f * 3.1415926f * s / sides;
+            mesh_vertex_t *vert = &mesh->vertices[r * (sides + 1) + s];
+
+            vert->nx = cosf(phi) * cosf(theta);
+            vert->ny = cosf(phi) * sinf(theta);
+            vert->nz = sinf(phi);
+            vert->px = major * cosf(theta) + minor * vert->nx;
+            vert->py = major * sinf(theta) + minor * vert->ny;
+            vert->pz = minor * vert->nz;
+            vert->u = (f32)r / rings;
+            vert->v = (f32)s / sides;
+        }
+    }
+
+    u32 *index = mesh->indices;
+    for (u32 r = 0; r < rings; r++)
+    {
+        for (u32 s = 0; s < sides; s++)
+        {
+            u32 a = r * (sides + 1) + s;
+            u32 b = a + sides + 1;
+
+            *index++ = a; *index++ = a + 1; *index++ = b;
+            *index++ = b; *index++ = a + 1; *index++ = b + 1;
+        }
+    }
+}
+
+// UV sphere around the origin, poles on the y axis
+void
+mesh_make_sphere(mesh_t *mesh,
+                 f32 radius,
+                 u32 rings,
+                 u32 sides)
+{
+    memset(mesh, 0, sizeof(*mesh));
+    mesh->num_vertices = (rings + 1) * (sides + 1);
+    mesh->num_triangles = rings * sides * 2;
+    mesh->vertices = (mesh_vertex_t *)malloc(mesh->num_vertices * sizeof(mesh_vertex_t));
+    mesh->indices = (u32 *)malloc(mesh->num_triangles * 3 * sizeof(u32));
+
+    for (u32 r = 0; r <= rings; r++)
+    {
+        f32 theta = 3.1415926f * r / rings;
+
+        for (u32 s = 0; s <= sides; s++)
+        {
+            f32 phi = 2.0f * 3.1415926f * s / sides;
+            mesh_vertex_t *vert = &mesh->vertices[r * (sides + 1) + s];
+
+            vert->nx = sinf(theta) * cosf(phi);
+            vert->ny = cosf(theta);
+            vert->nz = sinf(theta) * sinf(phi);
+            vert->px = radius * vert->nx;
+            vert->py = radius * vert->ny;
+            vert->pz = radius * vert->nz;
+            vert->u = (f32)s / sides;
+            vert->v = (f32)r / rings;
+        }
+    }
+
+    u32 *index = mesh->indices;
+    for (u32 r = 0; r < rings; r++)
+    {
+        for (u32 s = 0; s < sides; s++)
+        {
+            u32 a = r * (sides + 1) + s;
+            u32 b = a + sides + 1;
+
+            *index++ = a; *index++ = a + 1; *index++ = b;
+            *index++ = b; *index++ = a + 1; *index++ = b + 1;
+        }
+    }
+}
+
+// Uniformly scale and move the mesh so its largest extent is `size` and its
+// bounding box is centred on `center`
+void
+mesh_fit(mesh_t *mesh,
+         vec3_t center,
+         f32 size)
+{
+    f32 min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    f32 max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    f32 extent = 0.0f,
+        scale;
+
+
+    for (u32 i = 0; i < mesh->num_vertices; i++)
+    {
+        f32 *p = &mesh->vertices[i].px;
+        for (u32 a = 0; a < 3; a++)
+        {
+            min[a] = fminf(min[a], p[a]);
+            max[a] = fmaxf(max[a], p[a]);
+        }
+    }
+    for (u32 a = 0; a < 3; a++)
+        extent = fmaxf(extent, max[a] - min[a]);
+    if (extent <= 0.0f)
+        return;
+
+    scale = size / extent;
+    for (u32 i = 0; i < mesh->num_vertices; i++)
+    {
+        mesh_vertex_t *vert = &mesh->vertices[i];
+        vert->px = (vert->px - 0.5f * (min[0] + max[0])) * scale + center.x;
+        vert->py = (vert->py - 0.5f * (min[1] + max[1])) * scale + center.y;
+        vert->pz = (vert->pz - 0.5f * (min[2] + max[2])) * scale + center.z;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// BVH
+
+void
+mesh_build_bvh(mesh_t *mesh,
+               u32 num_threads)
+{
+    bvh_aabb_t  *boxes;
+    u32         *sorted;
+    f64         start = mesh_now(),
+                elapsed;
+
+
+    boxes = (bvh_aabb_t *)malloc(mesh->num_triangles * sizeof(bvh_aabb_t));
+    for (u32 t = 0; t < mesh->num_triangles; t++)
+    {
+        bvh_aabb_empty(&boxes[t]);
+        for (u32 k = 0; k < 3; k++)
+        {
+            f32 *p = &mesh->vertices[mesh->indices[t * 3 + k]].px;
+            bvh_aabb_grow(&boxes[t], p, p);
+        }
+    }
+
+    bvh_free(&mesh->bvh);
+    bvh_build(&mesh->bvh, boxes, mesh->num_triangles, num_threads);
+
+    // Store the triangles in leaf order so leaves index them directly
+    sorted = (u32 *)malloc(mesh->num_triangles * 3 * sizeof(u32));
+    for (u32 i = 0; i < mesh->num_triangles; i++)
+        memcpy(&sorted[i * 3], &mesh->indices[mesh->bvh.prims[i] * 3], 3 * sizeof(u32));
+    free(mesh->indices);
+    mesh->indices = sorted;
+    for (u32 i = 0; i < mesh->num_triangles; i++)
+        mesh->bvh.prims[i] = i;
+
+    bvh4_free(&mesh->bvh4);
+    bvh4_build(&mesh->bvh4, &mesh->bvh);
+
+    free(boxes);
+    elapsed = mesh_now() - start;
+    printf("mesh bvh: %u nodes, SAH cost %.1f, built in %.2fs (%.1f Mtris/s)\n",
+           mesh->bvh.num_nodes, bvh_sah_cost(&mesh->bvh), elapsed,
+           mesh->num_triangles / elapsed * 1e-6);
+    printf("mesh bvh4: %u nodes, %.2f MB instead of %.2f MB\n",
+           mesh->bvh4.num_nodes, mesh->bvh4.num_nodes * sizeof(bvh4_node_t) / 1048576.0,
+           mesh->bvh.num_nodes * sizeof(bvh_node_t) / 1048576.0);
+}
+
+void
+mesh_free(mesh_t *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->indices);
+    bvh_free(&mesh->bvh);
+    bvh4_free(&mesh->bvh4);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+#endif // MESH_IMPL
+
+#endif // MESH_H
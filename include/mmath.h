@@ -5,6 +5,26 @@
 #include <math.h>
 #include "types.h"
 
+// SIMD backend, picked at compile time: AVX2 (+FMA when available), SSE2 or
+// plain scalar. Define MMATH_NO_SIMD to force the scalar path.
+#if !defined(MMATH_NO_SIMD) && defined(__AVX2__)
+    #define MMATH_AVX2
+    #define MMATH_SSE
+#elif !defined(MMATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || \
+                                  (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define MMATH_SSE
+#endif
+
+#ifdef MMATH_SSE
+    #include <immintrin.h>
+    #ifdef __FMA__
+        #define m_madd_ps(a, b, c)  _mm_fmadd_ps(a, b, c)
+    #else
+        #define m_madd_ps(a, b, c)  _mm_add_ps(_mm_mul_ps(a, b), c)
+    #endif
+    #define m_splat_ps(v, i)    _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i))
+#endif
+
 #define m_sin(n)    sinf(n)
 #define m_cos(n)    cosf(n)
 #define m_tan(n)    tanf(n)
@@ -49,6 +69,32 @@ vec3_t      vec3_cross(vec3_t v1, vec3_t v2);
 f32         vec3_mag(vec3_t vec);
 vec3_t      vec3_normalize(vec3_t vec);
 
+/* ============================ *
+ * =====    Vector4D      ===== *
+ * ============================ */
+
+// 16 byte aligned so it maps straight onto an SSE register
+typedef struct alignas(16) _TAG_vec4
+{
+    f32 x;
+    f32 y;
+    f32 z;
+    f32 w;
+} vec4_t;
+
+vec4_t      vec4_make(f32 x, f32 y, f32 z, f32 w);
+vec4_t      vec4_from_vec3(vec3_t vec, f32 w);
+vec3_t      vec4_to_vec3(vec4_t vec);
+vec4_t      vec4_add(vec4_t v1, vec4_t v2);
+vec4_t      vec4_sub(vec4_t v1, vec4_t v2);
+vec4_t      vec4_mul(vec4_t v1, vec4_t v2);
+vec4_t      vec4_scal(vec4_t vec, f32 scalar);
+vec4_t      vec4_min(vec4_t v1, vec4_t v2);
+vec4_t      vec4_max(vec4_t v1, vec4_t v2);
+f32         vec4_dot(vec4_t v1, vec4_t v2);
+f32         vec4_mag(vec4_t vec);
+vec4_t      vec4_normalize(vec4_t vec);
+
 /* ============================ *
  * =====    MATRIX4       ===== *
  * ============================ */
@@ -72,6 +118,8 @@ mat4_t      mat4_perspective(f32 fov, f32 aspect_ratio, f32 near, f32 far);
 mat4_t      mat4_lookat(vec3_t eye, vec3_t center, vec3_t up);
 mat4_t      mat4_scale(f32 scale_value);
 mat4_t      mat4_mult(mat4_t m1, mat4_t m2);
+vec4_t      mat4_mult_vec4(mat4_t matrix, vec4_t vec);
+mat4_t      mat4_inverse(mat4_t matrix);
 
 /* ============================ *
  * =====      MISC		  ===== *
@@ -82,6 +130,13 @@ f32			m_randf(u32 index);
 f32			m_sqrt(f32 number);
 f32			m_isqrt(f32 number);
 
+// Scalar reference versions. These back the scalar build and are what the
+// SIMD paths get benchmarked against.
+mat4_t      mat4_mult_scalar(mat4_t m1, mat4_t m2);
+mat4_t      mat4_inverse_scalar(mat4_t matrix);
+f32			m_sqrt_scalar(f32 number);
+f32			m_isqrt_scalar(f32 number);
+
 ////////////////////////////////////////////////////////////////////////////////
 // ====== MMATH IMPLEMENTATION ================================================/
 ////////////////////////////////////////////////////////////////////////////////
@@ -233,6 +288,184 @@ vec3_normalize(vec3_t vec)
     return vec;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// VECTOR4D IMPLEMENTATION
+
+vec4_t
+vec4_make(f32 x,
+          f32 y,
+          f32 z,
+          f32 w)
+{
+    vec4_t vec;
+
+    vec.x = x;
+    vec.y = y;
+    vec.z = z;
+    vec.w = w;
+
+    return vec;
+}
+
+vec4_t
+vec4_from_vec3(vec3_t vec,
+               f32 w)
+{
+    return vec4_make(vec.x, vec.y, vec.z, w);
+}
+
+vec3_t
+vec4_to_vec3(vec4_t vec)
+{
+    vec3_t res = {vec.x, vec.y, vec.z};
+
+    return res;
+}
+
+vec4_t
+vec4_add(vec4_t v1,
+         vec4_t v2)
+{
+#ifdef MMATH_SSE
+    _mm_store_ps(&v1.x, _mm_add_ps(_mm_load_ps(&v1.x), _mm_load_ps(&v2.x)));
+#else
+    v1.x += v2.x;
+    v1.y += v2.y;
+    v1.z += v2.z;
+    v1.w += v2.w;
+#endif
+
+    return v1;
+}
+
+vec4_t
+vec4_sub(vec4_t v1,
+         vec4_t v2)
+{
+#ifdef MMATH_SSE
+    _mm_store_ps(&v1.x, _mm_sub_ps(_mm_load_ps(&v1.x), _mm_load_ps(&v2.x)));
+#else
+    v1.x -= v2.x;
+    v1.y -= v2.y;
+    v1.z -= v2.z;
+    v1.w -= v2.w;
+#endif
+
+    return v1;
+}
+
+vec4_t
+vec4_mul(vec4_t v1,
+         vec4_t v2)
+{
+#ifdef MMATH_SSE
+    _mm_store_ps(&v1.x, _mm_mul_ps(_mm_load_ps(&v1.x), _mm_load_ps(&v2.x)));
+#else
+    v1.x *= v2.x;
+    v1.y *= v2.y;
+    v1.z *= v2.z;
+    v1.w *= v2.w;
+#endif
+
+    return v1;
+}
+
+vec4_t
+vec4_scal(vec4_t vec,
+          f32 scalar)
+{
+#ifdef MMATH_SSE
+    _mm_store_ps(&vec.x, _mm_mul_ps(_mm_load_ps(&vec.x), _mm_set1_ps(scalar)));
+#else
+    vec.x *= scalar;
+    vec.y *= scalar;
+    vec.z *= scalar;
+    vec.w *= scalar;
+#endif
+
+    return vec;
+}
+
+vec4_t
+vec4_min(vec4_t v1,
+         vec4_t v2)
+{
+#ifdef MMATH_SSE
+    _mm_store_ps(&v1.x, _mm_min_ps(_mm_load_ps(&v1.x), _mm_load_ps(&v2.x)));
+#else
+    v1.x = v1.x < v2.x ? v1.x : v2.x;
+    v1.y = v1.y < v2.y ? v1.y : v2.y;
+    v1.z = v1.z < v2.z ? v1.z : v2.z;
+    v1.w = v1.w < v2.w ? v1.w : v2.w;
+#endif
+
+    return v1;
+}
+
+vec4_t
+vec4_max(vec4_t v1,
+         vec4_t v2)
+{
+#ifdef MMATH_SSE
+    _mm_store_ps(&v1.x, _mm_max_ps(_mm_load_ps(&v1.x), _mm_load_ps(&v2.x)));
+#else
+    v1.x = v1.x > v2.x ? v1.x : v2.x;
+    v1.y = v1.y > v2.y ? v1.y : v2.y;
+    v1.z = v1.z > v2.z ? v1.z : v2.z;
+    v1.w = v1.w > v2.w ? v1.w : v2.w;
+#endif
+
+    return v1;
+}
+
+#ifdef MMATH_SSE
+// Sum of all four lanes, broadcast to every lane
+internal inline __m128
+m_hsum_ps(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    return v;
+}
+#endif
+
+f32
+vec4_dot(vec4_t v1,
+         vec4_t v2)
+{
+#ifdef MMATH_SSE
+    return _mm_cvtss_f32(m_hsum_ps(_mm_mul_ps(_mm_load_ps(&v1.x), _mm_load_ps(&v2.x))));
+#else
+    return ((v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z) + (v1.w * v2.w));
+#endif
+}
+
+f32
+vec4_mag(vec4_t vec)
+{
+    return m_sqrt(vec4_dot(vec, vec));
+}
+
+vec4_t
+vec4_normalize(vec4_t vec)
+{
+#ifdef MMATH_SSE
+    __m128 v = _mm_load_ps(&vec.x);
+    __m128 d = m_hsum_ps(_mm_mul_ps(v, v));
+    __m128 y = _mm_rsqrt_ps(d);
+
+    // One Newton step on the hardware estimate, y *= 1.5 - 0.5 * d * y * y
+    y = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f),
+                                 _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), d), _mm_mul_ps(y, y))));
+    _mm_store_ps(&vec.x, _mm_mul_ps(v, y));
+
+    return vec;
+#else
+    return vec4_scal(vec, m_isqrt(vec4_dot(vec, vec)));
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // MATRIX4 IMPLEMENTATION
 
@@ -440,6 +673,185 @@ mat4_scale(f32 scale_value)
 mat4_t
 mat4_mult(mat4_t m1,
           mat4_t m2)
+{
+#if defined(MMATH_AVX2)
+    // Two result columns per iteration: each half of b holds one column of m2
+    mat4_t res;
+    f32 *p1 = m_cast(m1);
+    f32 *p2 = m_cast(m2);
+    f32 *pres = m_cast(res);
+    __m128 c0 = _mm_loadu_ps(p1 + 0);
+    __m128 c1 = _mm_loadu_ps(p1 + 4);
+    __m128 c2 = _mm_loadu_ps(p1 + 8);
+    __m128 c3 = _mm_loadu_ps(p1 + 12);
+    __m256 a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+    __m256 a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+    __m256 a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+    __m256 a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+
+    for (u8 y = 0; y < 4; y += 2)
+    {
+        __m256 b = _mm256_loadu_ps(p2 + y * 4);
+        __m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(b, b, 0x00));
+    #ifdef __FMA__
+        r = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b, b, 0x55), r);
+        r = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b, b, 0xAA), r);
+        r = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b, b, 0xFF), r);
+    #else
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(b, b, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(b, b, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(b, b, 0xFF)));
+    #endif
+        _mm256_storeu_ps(pres + y * 4, r);
+    }
+
+    return res;
+#elif defined(MMATH_SSE)
+    mat4_t res;
+    f32 *p1 = m_cast(m1);
+    f32 *p2 = m_cast(m2);
+    f32 *pres = m_cast(res);
+    __m128 a0 = _mm_loadu_ps(p1 + 0);
+    __m128 a1 = _mm_loadu_ps(p1 + 4);
+    __m128 a2 = _mm_loadu_ps(p1 + 8);
+    __m128 a3 = _mm_loadu_ps(p1 + 12);
+
+    for (u8 y = 0; y < 4; y++)
+    {
+        __m128 b = _mm_loadu_ps(p2 + y * 4);
+        __m128 r = _mm_mul_ps(a0, m_splat_ps(b, 0));
+        r = m_madd_ps(a1, m_splat_ps(b, 1), r);
+        r = m_madd_ps(a2, m_splat_ps(b, 2), r);
+        r = m_madd_ps(a3, m_splat_ps(b, 3), r);
+        _mm_storeu_ps(pres + y * 4, r);
+    }
+
+    return res;
+#else
+    return mat4_mult_scalar(m1, m2);
+#endif
+}
+
+vec4_t
+mat4_mult_vec4(mat4_t matrix,
+               vec4_t vec)
+{
+#ifdef MMATH_SSE
+    f32 *p = m_cast(matrix);
+    __m128 v = _mm_load_ps(&vec.x);
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(p + 0), m_splat_ps(v, 0));
+    r = m_madd_ps(_mm_loadu_ps(p + 4), m_splat_ps(v, 1), r);
+    r = m_madd_ps(_mm_loadu_ps(p + 8), m_splat_ps(v, 2), r);
+    r = m_madd_ps(_mm_loadu_ps(p + 12), m_splat_ps(v, 3), r);
+    _mm_store_ps(&vec.x, r);
+
+    return vec;
+#else
+    vec4_t res;
+
+    res.x = matrix.col1[0] * vec.x + matrix.col2[0] * vec.y + matrix.col3[0] * vec.z + matrix.col4[0] * vec.w;
+    res.y = matrix.col1[1] * vec.x + matrix.col2[1] * vec.y + matrix.col3[1] * vec.z + matrix.col4[1] * vec.w;
+    res.z = matrix.col1[2] * vec.x + matrix.col2[2] * vec.y + matrix.col3[2] * vec.z + matrix.col4[2] * vec.w;
+    res.w = matrix.col1[3] * vec.x + matrix.col2[3] * vec.y + matrix.col3[3] * vec.z + matrix.col4[3] * vec.w;
+
+    return res;
+#endif
+}
+
+#ifdef MMATH_SSE
+// 2x2 helpers for the block inverse, matrices packed as (m00, m01, m10, m11)
+#define m_swizzle_ps(v, x, y, z, w)     _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+#define m_shuffle_ps(a, b, x, y, z, w)  _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+// A * B
+internal inline __m128
+m_mat2_mul(__m128 a,
+           __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, m_swizzle_ps(b, 0, 3, 0, 3)),
+                      _mm_mul_ps(m_swizzle_ps(a, 1, 0, 3, 2), m_swizzle_ps(b, 2, 1, 2, 1)));
+}
+
+// adj(A) * B
+internal inline __m128
+m_mat2_adj_mul(__m128 a,
+               __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(m_swizzle_ps(a, 3, 3, 0, 0), b),
+                      _mm_mul_ps(m_swizzle_ps(a, 1, 1, 2, 2), m_swizzle_ps(b, 2, 3, 0, 1)));
+}
+
+// A * adj(B)
+internal inline __m128
+m_mat2_mul_adj(__m128 a,
+               __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, m_swizzle_ps(b, 3, 0, 3, 0)),
+                      _mm_mul_ps(m_swizzle_ps(a, 1, 0, 3, 2), m_swizzle_ps(b, 2, 1, 2, 1)));
+}
+#endif
+
+mat4_t
+mat4_inverse(mat4_t matrix)
+{
+#ifdef MMATH_SSE
+    // Block inverse over 2x2 sub-matrices, see "Fast 4x4 Matrix Inverse with
+    // SSE SIMD, Explained" (Eric Zhang). Works on columns just as well as on
+    // rows since inverse(transpose(M)) == transpose(inverse(M)).
+    mat4_t res;
+    f32 *p = m_cast(matrix);
+    f32 *pres = m_cast(res);
+    __m128 c0 = _mm_loadu_ps(p + 0);
+    __m128 c1 = _mm_loadu_ps(p + 4);
+    __m128 c2 = _mm_loadu_ps(p + 8);
+    __m128 c3 = _mm_loadu_ps(p + 12);
+
+    __m128 a = _mm_movelh_ps(c0, c1);
+    __m128 b = _mm_movehl_ps(c1, c0);
+    __m128 c = _mm_movelh_ps(c2, c3);
+    __m128 d = _mm_movehl_ps(c3, c2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 det_sub = _mm_sub_ps(_mm_mul_ps(m_shuffle_ps(c0, c2, 0, 2, 0, 2), m_shuffle_ps(c1, c3, 1, 3, 1, 3)),
+                                _mm_mul_ps(m_shuffle_ps(c0, c2, 1, 3, 1, 3), m_shuffle_ps(c1, c3, 0, 2, 0, 2)));
+    __m128 det_a = m_splat_ps(det_sub, 0);
+    __m128 det_b = m_splat_ps(det_sub, 1);
+    __m128 det_c = m_splat_ps(det_sub, 2);
+    __m128 det_d = m_splat_ps(det_sub, 3);
+
+    __m128 d_c = m_mat2_adj_mul(d, c);
+    __m128 a_b = m_mat2_adj_mul(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), m_mat2_mul(b, d_c));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), m_mat2_mul(c, a_b));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), m_mat2_mul_adj(d, a_b));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), m_mat2_mul_adj(a, d_c));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    __m128 det_m = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+    __m128 tr = m_hsum_ps(_mm_mul_ps(a_b, m_swizzle_ps(d_c, 0, 2, 1, 3)));
+    det_m = _mm_sub_ps(det_m, tr);
+
+    __m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_m);
+    x = _mm_mul_ps(x, rdet);
+    y = _mm_mul_ps(y, rdet);
+    z = _mm_mul_ps(z, rdet);
+    w = _mm_mul_ps(w, rdet);
+
+    // Undo the adjugate and repack the blocks into columns in one shuffle
+    _mm_storeu_ps(pres + 0, m_shuffle_ps(x, y, 3, 1, 3, 1));
+    _mm_storeu_ps(pres + 4, m_shuffle_ps(x, y, 2, 0, 2, 0));
+    _mm_storeu_ps(pres + 8, m_shuffle_ps(z, w, 3, 1, 3, 1));
+    _mm_storeu_ps(pres + 12, m_shuffle_ps(z, w, 2, 0, 2, 0));
+
+    return res;
+#else
+    return mat4_inverse_scalar(matrix);
+#endif
+}
+
+mat4_t
+mat4_mult_scalar(mat4_t m1,
+                 mat4_t m2)
 {
     mat4_t res;
     f32 *p1 = m_cast(m1);
@@ -462,6 +874,56 @@ mat4_mult(mat4_t m1,
     return res;
 }
 
+mat4_t
+mat4_inverse_scalar(mat4_t matrix)
+{
+    mat4_t res;
+    f32 *m = m_cast(matrix);
+    f32 *inv = m_cast(res);
+    f32 det;
+
+    // Cofactor expansion
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] +
+             m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] -
+             m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] +
+             m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] -
+              m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] -
+             m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] +
+             m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] -
+             m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] +
+              m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] +
+             m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] -
+             m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] +
+              m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] -
+              m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] -
+             m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] +
+             m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] -
+              m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] +
+              m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    det = 1.0f / det;
+    for (u8 i = 0; i < 16; i++)
+        inv[i] *= det;
+
+    return res;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // MISC IMPLEMENTATION
 
@@ -481,6 +943,33 @@ m_randf(u32 index)
 
 f32
 m_sqrt(f32 number)
+{
+#ifdef MMATH_SSE
+	return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(number)));
+#else
+	return m_sqrt_scalar(number);
+#endif
+}
+
+f32
+m_isqrt(f32 number)
+{
+#ifdef MMATH_SSE
+	__m128	n = _mm_set_ss(number);
+	__m128	y = _mm_rsqrt_ss(n);
+
+	// rsqrtss is good to ~12 bits, one Newton step brings it to ~23
+	y = _mm_mul_ss(y, _mm_sub_ss(_mm_set_ss(1.5f),
+								 _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), n), _mm_mul_ss(y, y))));
+
+	return _mm_cvtss_f32(y);
+#else
+	return m_isqrt_scalar(number);
+#endif
+}
+
+f32
+m_sqrt_scalar(f32 number)
 {
 	s32		i;
 	f32		x2, y;
@@ -497,7 +986,7 @@ m_sqrt(f32 number)
 }
 
 f32
-m_isqrt(f32 number)
+m_isqrt_scalar(f32 number)
 {
 	s32		i;
 	f32		x2, y;
@@ -0,0 +1,173 @@
+#ifndef MMATH_BENCH_H
+#define MMATH_BENCH_H
+
+// Microbenchmarks for mmath: the compiled-in SIMD backend against the scalar
+// reference functions. Run with --bench-math.
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "mmath.h"
+
+#define MMATH_BENCH_ITERS   (1 << 22)
+#define MMATH_BENCH_SET     256
+
+void        mmath_bench(void);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== MMATH BENCH IMPLEMENTATION =========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef MMATH_BENCH_IMPL
+
+internal f64
+mmath_bench_now(void)
+{
+    return std::chrono::duration<f64, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal void
+mmath_bench_report(const char *name,
+                   f64 ref_ns,
+                   f64 simd_ns,
+                   f32 max_err)
+{
+    printf("%-22s %8.2f ns  %8.2f ns  %6.2fx   %g\n",
+           name, ref_ns / MMATH_BENCH_ITERS, simd_ns / MMATH_BENCH_ITERS,
+           ref_ns / simd_ns, max_err);
+}
+
+void
+mmath_bench(void)
+{
+    mat4_t          mats[MMATH_BENCH_SET];
+    vec3_t          vec3s[MMATH_BENCH_SET];
+    vec4_t          vec4s[MMATH_BENCH_SET];
+    f32             nums[MMATH_BENCH_SET];
+    volatile f32    sink = 0.0f;
+    f64             start,
+                    ref_ns,
+                    simd_ns;
+    f32             max_err;
+
+
+#if defined(MMATH_AVX2)
+    printf("mmath backend: AVX2%s\n",
+    #ifdef __FMA__
+           " + FMA"
+    #else
+           ""
+    #endif
+           );
+#elif defined(MMATH_SSE)
+    printf("mmath backend: SSE2\n");
+#else
+    printf("mmath backend: scalar (every row compares scalar against itself)\n");
+#endif
+    printf("%-22s %11s  %11s  %7s   %s\n", "", "scalar", "simd", "speedup", "max error");
+
+    // Well conditioned inputs: rotation * translation * scale
+    for (u32 i = 0; i < MMATH_BENCH_SET; i++)
+    {
+        f32 a = m_randf(i * 4 + 0) * 360.0f;
+        vec3_t axis = {m_randf(i * 4 + 1) + 0.1f, m_randf(i * 4 + 2), m_randf(i * 4 + 3)};
+        vec3_t pos = {m_randf(i * 7 + 1) * 10.0f, m_randf(i * 7 + 2) * 10.0f, m_randf(i * 7 + 3) * 10.0f};
+
+        mats[i] = mat4_mult_scalar(mat4_mult_scalar(mat4_translate_v(pos), mat4_rotate_v(a, axis)),
+                                   mat4_scale(0.5f + m_randf(i)));
+        vec3s[i] = pos;
+        vec4s[i] = vec4_from_vec3(pos, m_randf(i * 3));
+        nums[i] = 0.001f + m_randf(i * 11) * 1000.0f;
+    }
+
+    // mat4_mult
+    max_err = 0.0f;
+    for (u32 i = 0; i < MMATH_BENCH_SET; i++)
+    {
+        mat4_t r1 = mat4_mult_scalar(mats[i], mats[(i + 1) % MMATH_BENCH_SET]);
+        mat4_t r2 = mat4_mult(mats[i], mats[(i + 1) % MMATH_BENCH_SET]);
+        for (u32 e = 0; e < 16; e++)
+            max_err = fmaxf(max_err, fabsf((m_cast(r1))[e] - (m_cast(r2))[e]));
+    }
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += mat4_mult_scalar(mats[i % MMATH_BENCH_SET], mats[(i + 1) % MMATH_BENCH_SET]).col4[1];
+    ref_ns = mmath_bench_now() - start;
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += mat4_mult(mats[i % MMATH_BENCH_SET], mats[(i + 1) % MMATH_BENCH_SET]).col4[1];
+    simd_ns = mmath_bench_now() - start;
+    mmath_bench_report("mat4_mult", ref_ns, simd_ns, max_err);
+
+    // mat4_inverse, error measured as |M * inverse(M) - I|
+    max_err = 0.0f;
+    for (u32 i = 0; i < MMATH_BENCH_SET; i++)
+    {
+        mat4_t id = mat4_mult_scalar(mats[i], mat4_inverse(mats[i]));
+        for (u32 e = 0; e < 16; e++)
+            max_err = fmaxf(max_err, fabsf((m_cast(id))[e] - ((e % 5 == 0) ? 1.0f : 0.0f)));
+    }
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += mat4_inverse_scalar(mats[i % MMATH_BENCH_SET]).col4[1];
+    ref_ns = mmath_bench_now() - start;
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += mat4_inverse(mats[i % MMATH_BENCH_SET]).col4[1];
+    simd_ns = mmath_bench_now() - start;
+    mmath_bench_report("mat4_inverse", ref_ns, simd_ns, max_err);
+
+    // m_sqrt, relative error against libm
+    max_err = 0.0f;
+    for (u32 i = 0; i < MMATH_BENCH_SET; i++)
+        max_err = fmaxf(max_err, fabsf(m_sqrt(nums[i]) - sqrtf(nums[i])) / sqrtf(nums[i]));
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += m_sqrt_scalar(nums[i % MMATH_BENCH_SET]);
+    ref_ns = mmath_bench_now() - start;
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += m_sqrt(nums[i % MMATH_BENCH_SET]);
+    simd_ns = mmath_bench_now() - start;
+    mmath_bench_report("m_sqrt", ref_ns, simd_ns, max_err);
+
+    // m_isqrt, relative error against libm
+    max_err = 0.0f;
+    for (u32 i = 0; i < MMATH_BENCH_SET; i++)
+        max_err = fmaxf(max_err, fabsf(m_isqrt(nums[i]) * sqrtf(nums[i]) - 1.0f));
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += m_isqrt_scalar(nums[i % MMATH_BENCH_SET]);
+    ref_ns = mmath_bench_now() - start;
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+        sink += m_isqrt(nums[i % MMATH_BENCH_SET]);
+    simd_ns = mmath_bench_now() - start;
+    mmath_bench_report("m_isqrt", ref_ns, simd_ns, max_err);
+
+    // The same add / scale / dot / normalize chain on vec3 and vec4
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+    {
+        vec3_t v = vec3_add(vec3s[i % MMATH_BENCH_SET], vec3s[(i + 1) % MMATH_BENCH_SET]);
+        v = vec3_normalize(vec3_scal(v, 0.5f));
+        sink += vec3_dot(v, vec3s[i % MMATH_BENCH_SET]);
+    }
+    ref_ns = mmath_bench_now() - start;
+    start = mmath_bench_now();
+    for (u32 i = 0; i < MMATH_BENCH_ITERS; i++)
+    {
+        vec4_t v = vec4_add(vec4s[i % MMATH_BENCH_SET], vec4s[(i + 1) % MMATH_BENCH_SET]);
+        v = vec4_normalize(vec4_scal(v, 0.5f));
+        sink += vec4_dot(v, vec4s[i % MMATH_BENCH_SET]);
+    }
+    simd_ns = mmath_bench_now() - start;
+    mmath_bench_report("vec3 vs vec4 chain", ref_ns, simd_ns, 0.0f);
+
+    (void)sink;
+}
+
+#endif // MMATH_BENCH_IMPL
+
+#endif // MMATH_BENCH_H
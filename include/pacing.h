@@ -0,0 +1,147 @@
+#ifndef PACING_H
+#define PACING_H
+
+// How often the UI thread presents. Frames are rendered by the render thread
+// on their own schedule, so a present the UI thread doesn't make is GPU time
+// the render thread's slices get instead:
+//
+//   uncapped   swap interval 0, one present per pass of the loop
+//   vsync      swap interval 1
+//   capped     swap interval 0, the loop sleeps to a fixed frame rate
+//   display    swap interval 1, and the render thread's slices last a share
+//              of the display's refresh period instead of the GPU ms budget,
+//              so the time between presents goes into accumulation samples
+//
+// OS sleeps are only good to about a millisecond, so the capped wait sleeps
+// until PACE_SPIN_MS before the deadline and spins the rest. The caller can
+// pass its own sleep, one that handles window events while it waits.
+
+#include <thread>
+#include <chrono>
+#include "types.h"
+
+#define PACE_UNCAPPED       0
+#define PACE_VSYNC          1
+#define PACE_CAPPED         2
+#define PACE_DISPLAY        3
+#define PACE_COUNT          4
+
+#define PACE_DEFAULT_FPS    60
+#define PACE_MIN_FPS        10
+#define PACE_MAX_FPS        500
+#define PACE_DEFAULT_HZ     60.0    // when the display doesn't say
+#define PACE_DISPLAY_SHARE  0.8f    // of the refresh period, the rest is the UI's
+#define PACE_SPIN_MS        1.0
+
+internal const char *pace_names[PACE_COUNT] = { "uncapped", "vsync", "capped", "display" };
+
+typedef struct _TAG_frame_pacer
+{
+    u32 mode;
+    u32 fps;            // of PACE_CAPPED
+    f64 refresh_hz;     // of the display, 0 if unknown
+    f64 deadline;       // of the next capped frame, in pace_now() seconds
+} frame_pacer_t;
+
+f64         pace_now(void);
+void        pace_init(frame_pacer_t *pacer, u32 mode, u32 fps, f64 refresh_hz);
+void        pace_set_mode(frame_pacer_t *pacer, u32 mode);
+s32         pace_swap_interval(frame_pacer_t *pacer);
+f32         pace_budget_ms(frame_pacer_t *pacer, f32 budget_ms);
+void        pace_wait(frame_pacer_t *pacer, void (*sleep)(f64 seconds));
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== PACING IMPLEMENTATION ==============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef PACING_IMPL
+
+f64
+pace_now(void)
+{
+    return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+pace_init(frame_pacer_t *pacer,
+          u32 mode,
+          u32 fps,
+          f64 refresh_hz)
+{
+    pacer->mode = mode < PACE_COUNT ? mode : PACE_UNCAPPED;
+    pacer->fps = fps ? fps : PACE_DEFAULT_FPS;
+    pacer->refresh_hz = refresh_hz;
+    pacer->deadline = pace_now();
+}
+
+// The caller sets the swap interval to pace_swap_interval() afterwards
+void
+pace_set_mode(frame_pacer_t *pacer,
+              u32 mode)
+{
+    pacer->mode = mode < PACE_COUNT ? mode : PACE_UNCAPPED;
+    pacer->deadline = pace_now();
+}
+
+s32
+pace_swap_interval(frame_pacer_t *pacer)
+{
+    return (pacer->mode == PACE_VSYNC || pacer->mode == PACE_DISPLAY) ? 1 : 0;
+}
+
+// GPU time of one render thread slice; `budget_ms` is the user's
+f32
+pace_budget_ms(frame_pacer_t *pacer,
+               f32 budget_ms)
+{
+    f64 hz = pacer->refresh_hz > 0.0 ? pacer->refresh_hz : PACE_DEFAULT_HZ;
+
+
+    if (pacer->mode != PACE_DISPLAY)
+        return budget_ms;
+
+    return (f32)(1000.0 / hz) * PACE_DISPLAY_SHARE;
+}
+
+// Called once per frame after the present; only PACE_CAPPED waits. `sleep`
+// may return early, it is called again for what is left; NULL sleeps the
+// thread.
+void
+pace_wait(frame_pacer_t *pacer,
+          void (*sleep)(f64 seconds))
+{
+    f64 period,
+        now;
+
+
+    if (pacer->mode != PACE_CAPPED || !pacer->fps)
+        return;
+
+    period = 1.0 / pacer->fps;
+    now = pace_now();
+
+    // More than a frame behind (a hitch, a dragged window): start over from
+    // now instead of rushing out the frames that were missed
+    if (now - pacer->deadline > period)
+        pacer->deadline = now;
+
+    while (pacer->deadline - now > PACE_SPIN_MS * 0.001)
+    {
+        f64 left = pacer->deadline - now - PACE_SPIN_MS * 0.001;
+
+
+        if (sleep)
+            sleep(left);
+        else
+            std::this_thread::sleep_for(std::chrono::duration<f64>(left));
+        now = pace_now();
+    }
+    while (pace_now() < pacer->deadline)
+        std::this_thread::yield();
+
+    pacer->deadline += period;
+}
+
+#endif // PACING_IMPL
+
+#endif // PACING_H
@@ -0,0 +1,259 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+// Compact encodings for rays and hits that sit in memory between passes,
+// such as the sphere kernel's material bins. Unit vectors become 32 bit
+// octahedral maps (two snorm16s, laid out like GLSL's packSnorm2x16),
+// colours and throughput half floats (like packHalf2x16) and the material
+// id shares a word with the hit flags. Positions and distances stay full
+// floats: secondary rays start from them, and 16 bits there would put the
+// origins on the wrong side of the surface.
+//
+// src/shaders/lib/packed.glsl has the GLSL versions of these functions;
+// --bench-packed checks the round trip errors and that both sides produce
+// the same bits.
+
+#include <string.h>
+#include <math.h>
+#include "types.h"
+#include "mmath.h"
+
+#define PACKED_MATERIAL     0x0000ffffu     // hit info: material id ...
+#define PACKED_SCATTERED    0x40000000u     // ... and flags
+#define PACKED_FRONT_FACE   0x80000000u
+
+typedef struct _TAG_packed_ray      // 16 bytes instead of 24
+{
+    f32     origin[3];
+    u32     direction;              // octahedral, unit length once decoded
+} packed_ray_t;
+
+typedef struct _TAG_packed_hit      // 24 bytes instead of 36
+{
+    f32     p[3];
+    f32     t;
+    u32     normal;                 // octahedral
+    u32     info;                   // material id and PACKED_* flags
+} packed_hit_t;
+
+u32         packed_oct_encode(vec3_t v);
+vec3_t      packed_oct_decode(u32 bits);
+u16         packed_half(f32 x);
+f32         packed_half_to_f32(u16 h);
+void        packed_color_encode(vec3_t color, u32 *bits);
+vec3_t      packed_color_decode(const u32 *bits);
+void        packed_ray_encode(packed_ray_t *ray, vec3_t origin, vec3_t direction);
+void        packed_ray_decode(packed_ray_t *ray, vec3_t *origin, vec3_t *direction);
+void        packed_hit_encode(packed_hit_t *hit, vec3_t p, vec3_t normal, f32 t, u32 material, b32 front_face);
+void        packed_hit_decode(packed_hit_t *hit, vec3_t *p, vec3_t *normal, f32 *t, u32 *material, b32 *front_face);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== PACKED IMPLEMENTATION ==============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef PACKED_IMPL
+
+// packSnorm2x16 of one component
+internal u32
+packed_snorm16(f32 x)
+{
+    x = (x < -1.0f) ? -1.0f : (x > 1.0f) ? 1.0f : x;
+
+    return (u32)(u16)(s16)roundf(x * 32767.0f);
+}
+
+internal f32
+packed_snorm16_to_f32(u32 bits)
+{
+    f32 x = (s16)(u16)bits / 32767.0f;
+
+    return (x < -1.0f) ? -1.0f : x;
+}
+
+// Projects onto the octahedron |x| + |y| + |z| = 1 and folds the lower half
+// over the upper one. Zero vectors come back as +z.
+u32
+packed_oct_encode(vec3_t v)
+{
+    f32 l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+    f32 x,
+        y;
+
+
+    if (l1 == 0.0f)
+        return 0;
+
+    x = v.x / l1;
+    y = v.y / l1;
+    if (v.z < 0.0f)
+    {
+        f32 fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        f32 fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+
+        x = fx;
+        y = fy;
+    }
+
+    return packed_snorm16(x) | packed_snorm16(y) << 16;
+}
+
+vec3_t
+packed_oct_decode(u32 bits)
+{
+    vec3_t  v;
+    f32     fold;
+
+
+    v.x = packed_snorm16_to_f32(bits & 0xffff);
+    v.y = packed_snorm16_to_f32(bits >> 16);
+    v.z = 1.0f - fabsf(v.x) - fabsf(v.y);
+    fold = (v.z < 0.0f) ? -v.z : 0.0f;
+    v.x += (v.x >= 0.0f) ? -fold : fold;
+    v.y += (v.y >= 0.0f) ? -fold : fold;
+
+    return vec3_scal(v, 1.0f / sqrtf(vec3_dot(v, v)));
+}
+
+// Round to nearest even, like the F16C conversions; overflow goes to
+// infinity, tiny values to half denormals or zero
+u16
+packed_half(f32 x)
+{
+    u32 bits;
+    u32 sign;
+    u32 mantissa;
+    s32 exponent;
+
+
+    memcpy(&bits, &x, sizeof(bits));
+    sign = (bits >> 16) & 0x8000u;
+    exponent = (s32)((bits >> 23) & 0xff) - 127 + 15;
+    mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xff) == 0xff)                  // inf, NaN
+        return (u16)(sign | 0x7c00u | (mantissa ? 0x200u : 0));
+    if (exponent >= 31)
+        return (u16)(sign | 0x7c00u);
+    if (exponent <= 0)
+    {
+        u32 shift;
+        u32 half;
+
+        if (exponent < -10)
+            return (u16)sign;
+        mantissa |= 0x800000u;
+        shift = (u32)(14 - exponent);
+        half = mantissa >> shift;
+        if ((mantissa >> (shift - 1) & 1) && ((mantissa & ((1u << (shift - 1)) - 1)) || (half & 1)))
+            half++;
+
+        return (u16)(sign | half);
+    }
+
+    // Rounding can carry into the exponent, up to infinity, which is right
+    bits = ((u32)exponent << 10 | mantissa >> 13);
+    if ((mantissa & 0x1000u) && ((mantissa & 0x2fffu) != 0))
+        bits++;
+
+    return (u16)(sign | bits);
+}
+
+f32
+packed_half_to_f32(u16 h)
+{
+    u32 sign = (u32)(h & 0x8000u) << 16;
+    u32 exponent = (h >> 10) & 0x1f;
+    u32 mantissa = h & 0x3ffu;
+    u32 bits;
+    f32 x;
+
+
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000u | mantissa << 13;
+    }
+    else if (exponent == 0)
+    {
+        x = mantissa / 16777216.0f;                     // 2^-24 per step
+        return sign ? -x : x;
+    }
+    else
+    {
+        bits = sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+    }
+    memcpy(&x, &bits, sizeof(x));
+
+    return x;
+}
+
+// Two words, r and g in the first and b in the low half of the second
+void
+packed_color_encode(vec3_t color,
+                    u32 *bits)
+{
+    bits[0] = packed_half(color.x) | (u32)packed_half(color.y) << 16;
+    bits[1] = packed_half(color.z);
+}
+
+vec3_t
+packed_color_decode(const u32 *bits)
+{
+    vec3_t color;
+
+    color.x = packed_half_to_f32((u16)(bits[0] & 0xffff));
+    color.y = packed_half_to_f32((u16)(bits[0] >> 16));
+    color.z = packed_half_to_f32((u16)(bits[1] & 0xffff));
+
+    return color;
+}
+
+void
+packed_ray_encode(packed_ray_t *ray,
+                  vec3_t origin,
+                  vec3_t direction)
+{
+    memcpy(ray->origin, m_cast(origin), sizeof(ray->origin));
+    ray->direction = packed_oct_encode(direction);
+}
+
+void
+packed_ray_decode(packed_ray_t *ray,
+                  vec3_t *origin,
+                  vec3_t *direction)
+{
+    memcpy(m_cast(*origin), ray->origin, sizeof(ray->origin));
+    *direction = packed_oct_decode(ray->direction);
+}
+
+void
+packed_hit_encode(packed_hit_t *hit,
+                  vec3_t p,
+                  vec3_t normal,
+                  f32 t,
+                  u32 material,
+                  b32 front_face)
+{
+    memcpy(hit->p, m_cast(p), sizeof(hit->p));
+    hit->t = t;
+    hit->normal = packed_oct_encode(normal);
+    hit->info = (material & PACKED_MATERIAL) | (front_face ? PACKED_FRONT_FACE : 0);
+}
+
+void
+packed_hit_decode(packed_hit_t *hit,
+                  vec3_t *p,
+                  vec3_t *normal,
+                  f32 *t,
+                  u32 *material,
+                  b32 *front_face)
+{
+    memcpy(m_cast(*p), hit->p, sizeof(hit->p));
+    *t = hit->t;
+    *normal = packed_oct_decode(hit->normal);
+    *material = hit->info & PACKED_MATERIAL;
+    *front_face = (hit->info & PACKED_FRONT_FACE) != 0;
+}
+
+#endif // PACKED_IMPL
+
+#endif // PACKED_H
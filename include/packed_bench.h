@@ -0,0 +1,225 @@
+#ifndef PACKED_BENCH_H
+#define PACKED_BENCH_H
+
+// Round trip errors and cost of the packed.h encodings, and a check that the
+// GLSL versions (packed_check.comp, through the kernels' lib/packed.glsl)
+// produce the same bits. Octahedral directions are held to their angular
+// error, halves exhaustively to their own bits and over random colours to
+// their relative error. GPU and CPU may round ties apart, so bits within one
+// step per 16 bit field count as agreeing, but are reported. Run with
+// --bench-packed.
+//
+// Needs the GL function pointers (glad) to be included before this file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "packed.h"
+#include "cpu_render.h"
+
+#define PACKED_BENCH_COUNT      (1 << 20)
+#define PACKED_BENCH_MAX_COLOR  16.0f
+
+void        packed_bench(u32 program);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== PACKED BENCH IMPLEMENTATION ========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef PACKED_BENCH_IMPL
+
+typedef struct _TAG_packed_bench_result    // packed_check.comp's output
+{
+    u32 bits[4];
+    f32 decoded[4];
+} packed_bench_result_t;
+
+internal f64
+packed_bench_now(void)
+{
+    return std::chrono::duration<f64>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// In doubles and from the cross product, acos of an f32 dot product can't
+// resolve angles this small
+internal f64
+packed_bench_angle(vec3_t a,
+                   vec3_t b)
+{
+    f64 cx = (f64)a.y * b.z - (f64)a.z * b.y;
+    f64 cy = (f64)a.z * b.x - (f64)a.x * b.z;
+    f64 cz = (f64)a.x * b.y - (f64)a.y * b.x;
+    f64 dot = (f64)a.x * b.x + (f64)a.y * b.y + (f64)a.z * b.z;
+
+    return atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) * 180.0 / 3.14159265358979;
+}
+
+// Difference of the two 16 bit fields, the larger one
+internal u32
+packed_bench_steps(u32 a,
+                   u32 b)
+{
+    s32 lo = (s32)(a & 0xffff) - (s32)(b & 0xffff);
+    s32 hi = (s32)(a >> 16) - (s32)(b >> 16);
+
+    lo = (lo < 0) ? -lo : lo;
+    hi = (hi < 0) ? -hi : hi;
+
+    return (u32)((lo > hi) ? lo : hi);
+}
+
+// `program` is packed_check.comp; uses SSBO bindings 8 and 9
+void
+packed_bench(u32 program)
+{
+    f32                     *values = (f32 *)malloc(PACKED_BENCH_COUNT * 4 * sizeof(f32));
+    u32                     *oct = (u32 *)malloc(PACKED_BENCH_COUNT * sizeof(u32));
+    packed_bench_result_t   *results = (packed_bench_result_t *)malloc(PACKED_BENCH_COUNT * sizeof(packed_bench_result_t));
+    u32                     buffers[2];
+    u32                     state = 1;
+    u32                     unstable = 0,
+                            half_mismatches = 0,
+                            gpu_exact = 0,
+                            gpu_near = 0,
+                            gpu_far = 0;
+    f64                     max_angle = 0.0,
+                            sum_angle = 0.0,
+                            max_rel = 0.0,
+                            max_gpu_angle = 0.0,
+                            start,
+                            ms;
+    vec3_t                  sink = {0.0f, 0.0f, 0.0f};
+
+
+    // Random directions, the axes and the fold's edges first
+    for (u32 i = 0; i < PACKED_BENCH_COUNT; i++)
+    {
+        static const vec3_t edges[12] =
+        {
+            { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+            { 0.5f, 0.5f, 0 }, { -0.5f, 0.5f, 0 }, { 0.5f, -0.5f, 0 }, { -0.5f, -0.5f, 0 },
+            { 0.5f, 0.5f, -1e-7f }, { -0.5f, -0.5f, -1e-7f }
+        };
+        vec3_t v = (i < 12) ? edges[i] : cpu_random_unit_vector(&state);
+
+        v = vec3_normalize(v);
+        values[i * 4 + 0] = v.x;
+        values[i * 4 + 1] = v.y;
+        values[i * 4 + 2] = v.z;
+        values[i * 4 + 3] = cpu_randf(&state) * PACKED_BENCH_MAX_COLOR;
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+    // CPU ROUND TRIPS
+
+    for (u32 i = 0; i < PACKED_BENCH_COUNT; i++)
+    {
+        vec3_t  v = {values[i * 4], values[i * 4 + 1], values[i * 4 + 2]};
+        vec3_t  decoded;
+        f64     angle;
+
+
+        oct[i] = packed_oct_encode(v);
+        decoded = packed_oct_decode(oct[i]);
+        angle = packed_bench_angle(v, decoded);
+        max_angle = (angle > max_angle) ? angle : max_angle;
+        sum_angle += angle;
+        unstable += packed_oct_encode(decoded) != oct[i];
+    }
+    printf("octahedral: max error %.5f deg, mean %.5f deg, %u of %u change when re-encoded\n",
+           max_angle, sum_angle / PACKED_BENCH_COUNT, unstable, PACKED_BENCH_COUNT);
+
+    for (u32 h = 0; h < 0x10000; h++)
+    {
+        b32 nan = (h & 0x7c00) == 0x7c00 && (h & 0x3ff);
+
+        half_mismatches += !nan && packed_half(packed_half_to_f32((u16)h)) != h;
+    }
+    for (u32 i = 0; i < PACKED_BENCH_COUNT; i++)
+    {
+        f32 x = values[i * 4 + 3];
+        f64 rel;
+
+        if (x < 6.1035156e-5f)                          // below the normal halves
+            continue;
+        rel = fabs(packed_half_to_f32(packed_half(x)) - x) / x;
+        max_rel = (rel > max_rel) ? rel : max_rel;
+    }
+    printf("half: %u of 65536 change on the way through f32, max relative error %.2e (2^-11 is %.2e)\n",
+           half_mismatches, max_rel, 1.0 / 2048.0);
+
+    start = packed_bench_now();
+    for (u32 i = 0; i < PACKED_BENCH_COUNT; i++)
+    {
+        vec3_t v = {values[i * 4], values[i * 4 + 1], values[i * 4 + 2]};
+
+        sink = vec3_add(sink, packed_oct_decode(packed_oct_encode(v)));
+    }
+    ms = (packed_bench_now() - start) * 1000.0;
+    printf("octahedral encode + decode: %.2f ns each (%.1f)\n",
+           ms * 1e6 / PACKED_BENCH_COUNT, sink.x);
+
+    start = packed_bench_now();
+    for (u32 i = 0; i < PACKED_BENCH_COUNT; i++)
+        sink.x += packed_half_to_f32(packed_half(values[i * 4 + 3]));
+    ms = (packed_bench_now() - start) * 1000.0;
+    printf("half encode + decode: %.2f ns each (%.1f)\n",
+           ms * 1e6 / PACKED_BENCH_COUNT, sink.x);
+
+    /////////////////////////////////////////////////////////////////////////
+    // GPU AGAINST CPU
+
+    glCreateBuffers(2, buffers);
+    glNamedBufferStorage(buffers[0], PACKED_BENCH_COUNT * 4 * sizeof(f32), values, 0);
+    glNamedBufferStorage(buffers[1], PACKED_BENCH_COUNT * sizeof(packed_bench_result_t), NULL, GL_CLIENT_STORAGE_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, buffers[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, buffers[1]);
+    glUseProgram(program);
+    glUniform1ui(glGetUniformLocation(program, "count"), PACKED_BENCH_COUNT);
+    glDispatchCompute((PACKED_BENCH_COUNT + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(buffers[1], 0, PACKED_BENCH_COUNT * sizeof(packed_bench_result_t), results);
+
+    for (u32 i = 0; i < PACKED_BENCH_COUNT; i++)
+    {
+        packed_bench_result_t   *r = &results[i];
+        u32                     expected[3];
+        u32                     steps = 0;
+        vec3_t                  decoded = {r->decoded[0], r->decoded[1], r->decoded[2]};
+        f64                     angle;
+
+
+        expected[0] = oct[i];
+        expected[1] = packed_half(values[i * 4]) | (u32)packed_half(values[i * 4 + 1]) << 16;
+        expected[2] = packed_half(values[i * 4 + 2]) | (u32)packed_half(values[i * 4 + 3]) << 16;
+        for (u32 k = 0; k < 3; k++)
+        {
+            u32 s = packed_bench_steps(r->bits[k], expected[k]);
+
+            steps = (s > steps) ? s : steps;
+        }
+        gpu_exact += steps == 0;
+        gpu_near += steps == 1;
+        gpu_far += steps > 1;
+
+        angle = packed_bench_angle(decoded, packed_oct_decode(r->bits[0]));
+        max_gpu_angle = (angle > max_gpu_angle) ? angle : max_gpu_angle;
+    }
+    printf("GPU: %u identical, %u one step apart, %u further; decode differs by up to %.5f deg\n",
+           gpu_exact, gpu_near, gpu_far, max_gpu_angle);
+    printf("sizes: ray %u -> %u bytes, hit %u -> %u bytes, throughput %u -> %u bytes\n",
+           (u32)(6 * sizeof(f32)), (u32)sizeof(packed_ray_t),
+           (u32)(9 * sizeof(f32)), (u32)sizeof(packed_hit_t),
+           (u32)(3 * sizeof(f32)), (u32)(2 * sizeof(u32)));
+
+    glDeleteBuffers(2, buffers);
+    free(results);
+    free(oct);
+    free(values);
+}
+
+#endif // PACKED_BENCH_IMPL
+
+#endif // PACKED_BENCH_H
@@ -0,0 +1,274 @@
+#ifndef RAY_STATS_H
+#define RAY_STATS_H
+
+// Ray statistics of the path tracing kernels: rays by depth, shadow rays,
+// sphere, plane and triangle tests, BVH node visits and how the paths end.
+// With --ray-stats the kernels are compiled with RAY_STATS_DEFINE, which
+// src/shaders/lib/stats.glsl reads; they add their counts to the buffer at
+// RAY_STATS_BINDING. Reading them never stalls: ray_stats_collect() copies
+// the counters into one of a few readback buffers and clears them,
+// ray_stats_poll() adds up the copies whose fence has passed.
+//
+// The kernels have no Russian roulette; a path ends by escaping to the
+// sky, by being absorbed (a scatter that fails) or at the maximum depth.
+//
+// Needs the GL function pointers (glad) to be included before this file.
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "types.h"
+
+#define STAT_RAYS           0   // by depth, STATS_DEPTHS of them; depth 0 is the primary rays
+#define STATS_DEPTHS        8   // the last one counts every deeper ray too
+#define STAT_SHADOW_RAYS    8
+#define STAT_SPHERE_TESTS   9
+#define STAT_PLANE_TESTS    10
+#define STAT_TRIANGLE_TESTS 11
+#define STAT_NODE_VISITS    12
+#define STAT_ESCAPED        13
+#define STAT_ABSORBED       14
+#define STAT_MAX_DEPTH      15
+#define STAT_COUNT          16
+
+#define RAY_STATS_BINDING   20
+#define RAY_STATS_READBACKS 4
+#define RAY_STATS_WINDOW    0.5     // seconds the ray rate is averaged over
+#define RAY_STATS_DEFINE    "#define RAY_STATS 1\n"
+
+typedef struct _TAG_ray_stats
+{
+    u32     counters;                           // STAT_COUNT u64s, written by the kernels
+    u32     readbacks[RAY_STATS_READBACKS];
+    u64     *mapped[RAY_STATS_READBACKS];
+    GLsync  fences[RAY_STATS_READBACKS];
+    u32     generations[RAY_STATS_READBACKS];   // of the counts each copy holds
+    u32     generation;                         // bumped by ray_stats_reset()
+    u32     next;
+
+    u64     totals[STAT_COUNT];                 // since the last ray_stats_reset()
+
+    // Rays per second over the last RAY_STATS_WINDOW with work in it
+    f64     window_start;
+    f64     window_last;
+    u64     window_rays;
+    f64     rays_per_second;
+} ray_stats_t;
+
+void        ray_stats_init(ray_stats_t *stats);
+void        ray_stats_bind(ray_stats_t *stats);
+void        ray_stats_reset(ray_stats_t *stats);
+void        ray_stats_collect(ray_stats_t *stats);
+b32         ray_stats_poll(ray_stats_t *stats);
+void        ray_stats_read(ray_stats_t *stats, u64 *counts);
+void        ray_stats_free(ray_stats_t *stats);
+u64         ray_stats_rays(const u64 *counts);
+void        ray_stats_print(const u64 *counts);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== RAY STATS IMPLEMENTATION ===========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef RAY_STATS_IMPL
+
+internal f64
+ray_stats_now(void)
+{
+    return std::chrono::duration<f64>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Binds the counters too; other contexts call ray_stats_bind()
+void
+ray_stats_init(ray_stats_t *stats)
+{
+    u32 size = STAT_COUNT * sizeof(u64);
+
+
+    memset(stats, 0, sizeof(*stats));
+
+    glCreateBuffers(1, &stats->counters);
+    glNamedBufferStorage(stats->counters, size, NULL, 0);
+    glClearNamedBufferData(stats->counters, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    glCreateBuffers(RAY_STATS_READBACKS, stats->readbacks);
+    for (u32 i = 0; i < RAY_STATS_READBACKS; i++)
+    {
+        glNamedBufferStorage(stats->readbacks[i], size, NULL,
+                             GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        stats->mapped[i] = (u64 *)glMapNamedBufferRange(stats->readbacks[i], 0, size,
+                                                        GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+                                                        GL_MAP_COHERENT_BIT);
+    }
+
+    stats->window_start = ray_stats_now();
+    stats->window_last = stats->window_start;
+    ray_stats_bind(stats);
+}
+
+void
+ray_stats_bind(ray_stats_t *stats)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RAY_STATS_BINDING, stats->counters);
+}
+
+// New totals, for a new frame; copies still in flight are dropped when
+// they land. The ray rate carries on.
+void
+ray_stats_reset(ray_stats_t *stats)
+{
+    memset(stats->totals, 0, sizeof(stats->totals));
+    stats->generation++;
+}
+
+// After a batch of dispatches. With every readback still in flight the
+// counts stay on the GPU and go with the next copy.
+void
+ray_stats_collect(ray_stats_t *stats)
+{
+    u32 slot = stats->next;
+
+
+    if (stats->fences[slot])
+        return;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(stats->counters, stats->readbacks[slot], 0, 0, STAT_COUNT * sizeof(u64));
+    glClearNamedBufferData(stats->counters, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+    stats->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stats->generations[slot] = stats->generation;
+    stats->next = (slot + 1) % RAY_STATS_READBACKS;
+}
+
+// Adds up the copies that have landed, oldest first; TRUE if any did
+b32
+ray_stats_poll(ray_stats_t *stats)
+{
+    b32 landed = FALSE;
+    f64 now = ray_stats_now();
+
+
+    for (u32 i = 0; i < RAY_STATS_READBACKS; i++)
+    {
+        u32 slot = (stats->next + i) % RAY_STATS_READBACKS;
+        const u64 *counts = stats->mapped[slot];
+        s32 status;
+
+        if (!stats->fences[slot])
+            continue;
+        glGetSynciv(stats->fences[slot], GL_SYNC_STATUS, sizeof(status), NULL, &status);
+        if (status != GL_SIGNALED)
+            break;
+        glDeleteSync(stats->fences[slot]);
+        stats->fences[slot] = NULL;
+
+        // After a pause the rate starts over instead of averaging the idle
+        // time in
+        if (now - stats->window_last > RAY_STATS_WINDOW)
+        {
+            stats->window_start = now;
+            stats->window_rays = 0;
+        }
+        stats->window_rays += ray_stats_rays(counts);
+        stats->window_last = now;
+
+        if (stats->generations[slot] == stats->generation)
+        {
+            for (u32 s = 0; s < STAT_COUNT; s++)
+                stats->totals[s] += counts[s];
+        }
+        landed = TRUE;
+    }
+
+    if (now - stats->window_start >= RAY_STATS_WINDOW)
+    {
+        stats->rays_per_second = stats->window_rays / (now - stats->window_start);
+        stats->window_start = now;
+        stats->window_rays = 0;
+    }
+
+    return landed;
+}
+
+// Waits for everything dispatched so far and adds it to the totals, for
+// benchmarks
+void
+ray_stats_read(ray_stats_t *stats,
+               u64 *counts)
+{
+    u64 gpu[STAT_COUNT];
+
+
+    for (u32 i = 0; i < RAY_STATS_READBACKS; i++)
+    {
+        if (stats->fences[i])
+            glClientWaitSync(stats->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    ray_stats_poll(stats);
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(stats->counters, 0, sizeof(gpu), gpu);
+    glClearNamedBufferData(stats->counters, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    for (u32 s = 0; s < STAT_COUNT; s++)
+        stats->totals[s] += gpu[s];
+
+    memcpy(counts, stats->totals, sizeof(stats->totals));
+}
+
+void
+ray_stats_free(ray_stats_t *stats)
+{
+    for (u32 i = 0; i < RAY_STATS_READBACKS; i++)
+    {
+        if (stats->fences[i])
+            glDeleteSync(stats->fences[i]);
+        glUnmapNamedBuffer(stats->readbacks[i]);
+    }
+    glDeleteBuffers(RAY_STATS_READBACKS, stats->readbacks);
+    glDeleteBuffers(1, &stats->counters);
+    memset(stats, 0, sizeof(*stats));
+}
+
+// Every ray traced: primary, secondary and shadow
+u64
+ray_stats_rays(const u64 *counts)
+{
+    u64 rays = counts[STAT_SHADOW_RAYS];
+
+
+    for (u32 d = 0; d < STATS_DEPTHS; d++)
+        rays += counts[STAT_RAYS + d];
+
+    return rays;
+}
+
+void
+ray_stats_print(const u64 *counts)
+{
+    u64 rays = ray_stats_rays(counts);
+    u64 primary = counts[STAT_RAYS];
+    u64 paths = counts[STAT_ESCAPED] + counts[STAT_ABSORBED] + counts[STAT_MAX_DEPTH];
+
+
+    if (!primary || !rays)
+        return;
+
+    printf("    rays %llu (%.2f per primary), shadow %.2f per primary\n",
+           (unsigned long long)rays, (f64)rays / primary, (f64)counts[STAT_SHADOW_RAYS] / primary);
+    printf("    by depth:");
+    for (u32 d = 0; d < STATS_DEPTHS; d++)
+        printf(" %.3f", (f64)counts[STAT_RAYS + d] / primary);
+    printf("\n");
+    printf("    per ray: %.2f sphere, %.2f plane, %.2f triangle tests, %.2f nodes\n",
+           (f64)counts[STAT_SPHERE_TESTS] / rays, (f64)counts[STAT_PLANE_TESTS] / rays,
+           (f64)counts[STAT_TRIANGLE_TESTS] / rays, (f64)counts[STAT_NODE_VISITS] / rays);
+    if (paths)
+        printf("    paths: %.1f%% escaped, %.1f%% absorbed, %.1f%% at max depth\n",
+               100.0 * counts[STAT_ESCAPED] / paths, 100.0 * counts[STAT_ABSORBED] / paths,
+               100.0 * counts[STAT_MAX_DEPTH] / paths);
+}
+
+#endif // RAY_STATS_IMPL
+
+#endif // RAY_STATS_H
@@ -0,0 +1,142 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+// Lock-free hand-off between the UI thread and the render thread.
+//
+// snapshot_queue_t: single-producer / single-consumer ring of immutable
+// camera + scene snapshots going UI -> render.
+//
+// frame_mailbox_t: triple buffer of finished frames going render -> UI. The
+// render thread always owns the back slot, the UI thread the front slot, and
+// the middle slot holds the most recent completed frame.
+
+#include <atomic>
+#include <string.h>
+#include "types.h"
+#include "mmath.h"
+
+#define SNAPSHOT_QUEUE_SIZE     8
+#define MAILBOX_SLOTS           3
+#define MAILBOX_FRESH           0x4
+
+#define RENDER_BACKEND_GPU      0
+#define RENDER_BACKEND_CPU      1
+
+typedef struct _TAG_render_snapshot
+{
+    mat4_t  view;
+    mat4_t  proj;
+    vec2_t  resolution;
+    u32     program;
+    u32     groups;     // of a persistent kernel, 0 for a grid dispatch
+    u32     scene;
+    u32     backend;
+    u32     samples;
+    f32     time;       // of the cloud animation
+} render_snapshot_t;
+
+typedef struct _TAG_snapshot_queue
+{
+    render_snapshot_t   items[SNAPSHOT_QUEUE_SIZE];
+    std::atomic<u32>    head;   // written by the consumer
+    std::atomic<u32>    tail;   // written by the producer
+} snapshot_queue_t;
+
+typedef struct _TAG_frame_mailbox
+{
+    std::atomic<u32>    middle; // slot index | MAILBOX_FRESH
+    u32                 front;  // UI thread only
+    u32                 back;   // render thread only
+} frame_mailbox_t;
+
+void        snapshot_queue_init(snapshot_queue_t *queue);
+b32         snapshot_queue_push(snapshot_queue_t *queue, render_snapshot_t *snap);
+b32         snapshot_queue_pop(snapshot_queue_t *queue, render_snapshot_t *snap);
+
+void        frame_mailbox_init(frame_mailbox_t *mailbox);
+void        frame_mailbox_publish(frame_mailbox_t *mailbox);
+b32         frame_mailbox_acquire(frame_mailbox_t *mailbox);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== RENDER QUEUE IMPLEMENTATION ========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef RENDER_QUEUE_IMPL
+
+////////////////////////////////////////////////////////////////////////////////
+// SNAPSHOT QUEUE
+
+void
+snapshot_queue_init(snapshot_queue_t *queue)
+{
+    queue->head.store(0);
+    queue->tail.store(0);
+}
+
+b32
+snapshot_queue_push(snapshot_queue_t *queue,
+                    render_snapshot_t *snap)
+{
+    u32 tail = queue->tail.load(std::memory_order_relaxed);
+
+    if (tail - queue->head.load(std::memory_order_acquire) == SNAPSHOT_QUEUE_SIZE)
+        return FALSE;
+
+    queue->items[tail % SNAPSHOT_QUEUE_SIZE] = *snap;
+    queue->tail.store(tail + 1, std::memory_order_release);
+
+    return TRUE;
+}
+
+b32
+snapshot_queue_pop(snapshot_queue_t *queue,
+                   render_snapshot_t *snap)
+{
+    u32 head = queue->head.load(std::memory_order_relaxed);
+
+    if (head == queue->tail.load(std::memory_order_acquire))
+        return FALSE;
+
+    *snap = queue->items[head % SNAPSHOT_QUEUE_SIZE];
+    queue->head.store(head + 1, std::memory_order_release);
+
+    return TRUE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// FRAME MAILBOX
+
+void
+frame_mailbox_init(frame_mailbox_t *mailbox)
+{
+    mailbox->front = 0;
+    mailbox->middle.store(1);
+    mailbox->back = 2;
+}
+
+// Render thread: the back slot holds a finished frame, make it the newest
+void
+frame_mailbox_publish(frame_mailbox_t *mailbox)
+{
+    u32 old = mailbox->middle.exchange(mailbox->back | MAILBOX_FRESH,
+                                       std::memory_order_acq_rel);
+
+    mailbox->back = old & ~MAILBOX_FRESH;
+}
+
+// UI thread: swap in the newest frame if there is one we haven't shown yet
+b32
+frame_mailbox_acquire(frame_mailbox_t *mailbox)
+{
+    if (!(mailbox->middle.load(std::memory_order_acquire) & MAILBOX_FRESH))
+        return FALSE;
+
+    u32 old = mailbox->middle.exchange(mailbox->front, std::memory_order_acq_rel);
+    mailbox->front = old & ~MAILBOX_FRESH;
+
+    return TRUE;
+}
+
+#endif // RENDER_QUEUE_IMPL
+
+#endif // RENDER_QUEUE_H
@@ -0,0 +1,881 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+// Scene description for the CPU backend, and the source of the GPU's sphere
+// scenes: builtin scenes 0 .. SCENE_NUM_SPECIALIZED - 1 share one kernel
+// (src/shaders/spheres.comp), compiled once per scene behind the text
+// scene_specialize() writes, which bakes the spheres and planes in as
+// constants and leaves out the material types and quirks the scene doesn't
+// use. The mesh, instance and cloud kernels keep their scenes inline.
+//
+// Spheres are stored as a structure of arrays (one aligned array per field)
+// so the intersection kernels can load 8 or 16 of them at once.
+// A scene can also reference one triangle mesh, a two level structure of
+// mesh instances or a sphere cloud (none of them owned by the scene).
+//
+// Sphere clouds are too big for the brute force sphere kernel. They are
+// kept as one float4 (center, radius) per sphere, the layout the GPU builds
+// its LBVH from, and get their own BVH on the CPU. Every cloud sphere has a
+// procedural animation channel (see scene_cloud_animate()); animated clouds
+// refit their BVH and only rebuild it once refitting made it too slow.
+//
+// The kernels read their materials from one table holding the materials of
+// all builtin scenes (scene_material_table()), bound at
+// SCENE_MATERIAL_BINDING. A kernel finds its own at the `material_base`
+// uniform, so material ids are the same on both backends.
+//
+// Lambertian and metal materials can take their albedo from a layer of the
+// texture set (texture.h) instead; the mesh scene textures its mesh and a
+// ball next to it. The outdoor scenes (mesh, instances, cloud) can be lit
+// by an environment map (envmap.h) instead of the sky gradient.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+#include "mmath.h"
+#include "mesh.h"
+#include "tlas.h"
+#include "texture.h"
+#include "envmap.h"
+
+#ifdef _WIN32
+    #include <malloc.h>
+    #define scene_aligned_alloc(size)   _aligned_malloc(size, SCENE_ALIGN)
+    #define scene_aligned_free(ptr)     _aligned_free(ptr)
+#else
+    #define scene_aligned_alloc(size)   aligned_alloc(SCENE_ALIGN, size)
+    #define scene_aligned_free(ptr)     free(ptr)
+#endif
+
+#define MAT_LAMBERTIAN      0
+#define MAT_METAL           1
+#define MAT_DIELECTRIC      2
+#define MAT_CHECKERED       3
+
+#define SCENE_ALIGN         64      // one cache line, enough for an AVX-512 load
+#define SCENE_SPHERE_PAD    16      // sphere arrays are padded to a multiple of this
+#define SCENE_NUM_BUILTIN   12      // same order as the compute kernels
+#define SCENE_NUM_SPECIALIZED 9     // the sphere scenes, chapter7 .. plane
+#define SCENE_SPECIALIZE_SIZE 8192  // enough for any of them
+#define SCENE_INSTANCE_MATERIALS 6  // palette shared by instances and clouds
+#define SCENE_CLOUD_SPACING 0.06f
+#define SCENE_MATERIAL_BINDING 16   // past the LBVH scratch bindings
+#define SCENE_BALL_TEXTURE  0       // texture layers of the mesh scene
+#define SCENE_MESH_TEXTURE  1
+
+typedef struct _TAG_scene_material
+{
+    u32     type;
+    vec3_t  albedo;
+    f32     fuzz;
+    f32     idx_ref;
+    vec3_t  checker_even;
+    vec3_t  checker_odd;
+    u32     texture;        // layer multiplying the albedo, or TEXTURE_NONE
+} scene_material_t;
+
+// A material as the kernels see it, laid out for std430
+typedef struct _TAG_scene_gpu_material
+{
+    f32     albedo[3];
+    u32     type;
+    f32     checker_even[3];
+    f32     fuzz;
+    f32     checker_odd[3];
+    f32     idx_ref;
+    u32     texture;
+    u32     pad[3];
+} scene_gpu_material_t;
+
+typedef struct _TAG_scene_plane
+{
+    vec3_t  pos;
+    vec3_t  normal;
+    u32     material;
+} scene_plane_t;
+
+typedef struct _TAG_scene_cloud
+{
+    f32         *spheres;       // x, y, z, radius
+    u32         *materials;     // 1 .. SCENE_INSTANCE_MATERIALS
+    u32         num_spheres;
+
+    // Animation
+    f32         *rest;          // spheres at time 0
+    f32         *anim;          // bounce height, speed, orbit radius, phase
+    f32         time;
+
+    // CPU only, the GPU builds its own
+    bvh_t       bvh;
+    bvh_aabb_t  *boxes;
+    f32         build_cost;     // SAH cost right after the last rebuild
+    f32         cost;
+} scene_cloud_t;
+
+typedef struct _TAG_scene
+{
+    // Spheres. Unused slots up to the padded size hold NaN spheres, which
+    // fail every comparison, so the kernels never need a tail loop.
+    f32                 *sphere_x;
+    f32                 *sphere_y;
+    f32                 *sphere_z;
+    f32                 *sphere_r;
+    u32                 *sphere_material;
+    u32                 num_spheres;
+    u32                 sphere_capacity;
+
+    scene_plane_t       *planes;
+    u32                 num_planes;
+
+    scene_material_t    *materials;
+    u32                 num_materials;
+
+    mesh_t              *mesh;
+    u32                 mesh_material;
+    tlas_t              *tlas;          // instances carry their own material
+    scene_cloud_t       *cloud;         // so do cloud spheres
+    texture_set_t       *textures;      // may be NULL, textured materials fall back to their albedo
+    envmap_t            *environment;   // NULL for the sky gradient
+
+    // Per scene quirks of the kernels
+    u32                 max_depth;
+    vec3_t              sky_horizon;
+    vec3_t              sky_zenith;
+    f32                 exposure;       // initial path throughput
+    b32                 absorb_keeps;   // absorbed paths keep their colour (plane)
+    b32                 shade_normals;  // chapter 7: colour by normal, no gamma
+    b32                 bin_materials;  // GPU only: shade hits binned by material type
+} scene_t;
+
+void        scene_init(scene_t *scene);
+void        scene_free(scene_t *scene);
+u32         scene_add_material(scene_t *scene, scene_material_t *material);
+u32         scene_add_sphere(scene_t *scene, vec3_t center, f32 radius, u32 material);
+u32         scene_add_plane(scene_t *scene, vec3_t pos, vec3_t normal, u32 material);
+u32         scene_padded_spheres(scene_t *scene);
+void        scene_load_builtin(scene_t *scene, u32 index, mesh_t *mesh, tlas_t *tlas,
+                               scene_cloud_t *cloud, texture_set_t *textures,
+                               envmap_t *environment);
+u32         scene_material_table(scene_gpu_material_t **table, u32 *bases);
+u32         scene_specialize(scene_t *scene, char *text, u32 capacity);
+void        scene_make_instances(tlas_t *tlas, mesh_t *mesh, mesh_t *ball, u32 per_side);
+void        scene_make_cloud(scene_cloud_t *cloud, u32 per_side);
+void        scene_cloud_build_bvh(scene_cloud_t *cloud, u32 num_threads);
+void        scene_cloud_animate(scene_cloud_t *cloud, f32 time);
+b32         scene_cloud_update(scene_cloud_t *cloud, f32 time);
+void        scene_cloud_free(scene_cloud_t *cloud);
+void        scene_load_sphere_field(scene_t *scene, u32 seed);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== SCENE IMPLEMENTATION ===============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef SCENE_IMPL
+
+internal vec3_t
+scene_vec3(f32 x,
+           f32 y,
+           f32 z)
+{
+    vec3_t v = {x, y, z};
+    return v;
+}
+
+internal scene_material_t
+scene_material(u32 type,
+               vec3_t albedo,
+               f32 fuzz,
+               f32 idx_ref)
+{
+    scene_material_t mat;
+
+    memset(&mat, 0, sizeof(mat));
+    mat.type = type;
+    mat.albedo = albedo;
+    mat.fuzz = fuzz;
+    mat.idx_ref = idx_ref;
+    mat.texture = TEXTURE_NONE;
+
+    return mat;
+}
+
+void
+scene_init(scene_t *scene)
+{
+    memset(scene, 0, sizeof(*scene));
+    scene->max_depth = 50;
+    scene->sky_horizon = scene_vec3(1.0f, 1.0f, 1.0f);
+    scene->sky_zenith = scene_vec3(0.5f, 0.7f, 1.0f);
+    scene->exposure = 1.0f;
+}
+
+void
+scene_free(scene_t *scene)
+{
+    scene_aligned_free(scene->sphere_x);
+    scene_aligned_free(scene->sphere_y);
+    scene_aligned_free(scene->sphere_z);
+    scene_aligned_free(scene->sphere_r);
+    scene_aligned_free(scene->sphere_material);
+    free(scene->planes);
+    free(scene->materials);
+    scene_init(scene);
+}
+
+u32
+scene_add_material(scene_t *scene,
+                   scene_material_t *material)
+{
+    scene->materials = (scene_material_t *)realloc(scene->materials,
+        (scene->num_materials + 1) * sizeof(scene_material_t));
+    scene->materials[scene->num_materials] = *material;
+
+    return scene->num_materials++;
+}
+
+internal void
+scene_grow_array(void **array,
+                 u32 old_count,
+                 u32 new_count,
+                 f32 fill)
+{
+    f32 *grown = (f32 *)scene_aligned_alloc(new_count * sizeof(f32));
+
+    if (*array)
+        memcpy(grown, *array, old_count * sizeof(f32));
+    for (u32 i = old_count; i < new_count; i++)
+        grown[i] = fill;
+
+    scene_aligned_free(*array);
+    *array = grown;
+}
+
+u32
+scene_add_sphere(scene_t *scene,
+                 vec3_t center,
+                 f32 radius,
+                 u32 material)
+{
+    u32 i = scene->num_spheres;
+
+    if (i == scene->sphere_capacity)
+    {
+        u32 old = scene->sphere_capacity;
+        u32 grown = old ? old * 2 : SCENE_SPHERE_PAD;
+
+        scene_grow_array((void **)&scene->sphere_x, old, grown, NAN);
+        scene_grow_array((void **)&scene->sphere_y, old, grown, NAN);
+        scene_grow_array((void **)&scene->sphere_z, old, grown, NAN);
+        scene_grow_array((void **)&scene->sphere_r, old, grown, NAN);
+        scene_grow_array((void **)&scene->sphere_material, old, grown, 0.0f);
+        scene->sphere_capacity = grown;
+    }
+
+    scene->sphere_x[i] = center.x;
+    scene->sphere_y[i] = center.y;
+    scene->sphere_z[i] = center.z;
+    scene->sphere_r[i] = radius;
+    scene->sphere_material[i] = material;
+
+    return scene->num_spheres++;
+}
+
+u32
+scene_add_plane(scene_t *scene,
+                vec3_t pos,
+                vec3_t normal,
+                u32 material)
+{
+    scene->planes = (scene_plane_t *)realloc(scene->planes,
+        (scene->num_planes + 1) * sizeof(scene_plane_t));
+    scene->planes[scene->num_planes].pos = pos;
+    scene->planes[scene->num_planes].normal = normal;
+    scene->planes[scene->num_planes].material = material;
+
+    return scene->num_planes++;
+}
+
+// Number of sphere slots the SIMD kernels walk, always a multiple of
+// SCENE_SPHERE_PAD
+u32
+scene_padded_spheres(scene_t *scene)
+{
+    return (scene->num_spheres + SCENE_SPHERE_PAD - 1) & ~(SCENE_SPHERE_PAD - 1);
+}
+
+// Materials 1 .. SCENE_INSTANCE_MATERIALS of the instance and cloud scenes,
+// after the ground
+static const struct { u32 type; vec3_t albedo; f32 fuzz; } scene_palette[SCENE_INSTANCE_MATERIALS] =
+{
+    {MAT_LAMBERTIAN, {0.7f, 0.3f, 0.3f}, 0.0f},
+    {MAT_LAMBERTIAN, {0.2f, 0.4f, 0.7f}, 0.0f},
+    {MAT_LAMBERTIAN, {0.8f, 0.7f, 0.2f}, 0.0f},
+    {MAT_LAMBERTIAN, {0.3f, 0.6f, 0.3f}, 0.0f},
+    {MAT_METAL,      {0.8f, 0.8f, 0.8f}, 0.05f},
+    {MAT_METAL,      {0.8f, 0.6f, 0.2f}, 0.3f},
+};
+
+// The scenes of the compute kernels, in the order main.cpp loads them. The
+// mesh, instance and cloud scenes reference `mesh`, `tlas` and `cloud`, the
+// mesh scene `textures` and all three `environment` (NULL for the sky
+// gradient), which have to outlive the scene.
+void
+scene_load_builtin(scene_t *scene,
+                   u32 index,
+                   mesh_t *mesh,
+                   tlas_t *tlas,
+                   scene_cloud_t *cloud,
+                   texture_set_t *textures,
+                   envmap_t *environment)
+{
+    scene_material_t    mat;
+    u32                 m;
+
+
+    scene_free(scene);
+
+    switch (index)
+    {
+        case 0: // chapter7
+        case 1: // chapter8
+        {
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.5f, 0.5f, 0.5f), 0.0f, 0.0f);
+            m = scene_add_material(scene, &mat);
+            scene_add_sphere(scene, scene_vec3(0, 0, -1), 0.5f, m);
+            scene_add_sphere(scene, scene_vec3(0, -100.5f, -1), 100.0f, m);
+            scene->shade_normals = (index == 0);
+        } break;
+
+        case 2: // chapter9
+        case 3: // chapter10
+        case 4: // chapter11
+        case 5: // hollow glass ball
+        {
+            static const vec3_t ground[4] = {{0.8f, 0.8f, 0.0f}, {0.8f, 0.8f, 0.0f},
+                                             {0.8f, 0.8f, 0.0f}, {0.4f, 0.4f, 0.4f}};
+            static const vec3_t center[4] = {{0.7f, 0.3f, 0.3f}, {0.1f, 0.2f, 0.5f},
+                                             {0.0f, 1.0f, 0.0f}, {0.1f, 0.2f, 0.5f}};
+            static const f32 right_fuzz[4] = {1.0f, 0.0f, 0.0f, 0.2f};
+            u32 k = index - 2;
+
+            mat = scene_material(MAT_LAMBERTIAN, ground[k], 0.0f, 0.0f);
+            scene_add_sphere(scene, scene_vec3(0, -100.5f, -1), 100.0f, scene_add_material(scene, &mat));
+            mat = scene_material(MAT_LAMBERTIAN, center[k], 0.0f, 0.0f);
+            scene_add_sphere(scene, scene_vec3(0, 0, -1), 0.5f, scene_add_material(scene, &mat));
+
+            if (index == 2)
+                mat = scene_material(MAT_METAL, scene_vec3(0.8f, 0.8f, 0.8f), 0.3f, 0.0f);
+            else
+                mat = scene_material(MAT_DIELECTRIC, scene_vec3(0.8f, 0.8f, 0.8f), 0.0f, 1.5f);
+            m = scene_add_material(scene, &mat);
+            scene_add_sphere(scene, scene_vec3(-1, 0, -1), 0.5f, m);
+            if (index == 5)
+                scene_add_sphere(scene, scene_vec3(-1, 0, -1), -0.495f, m);
+
+            mat = scene_material(MAT_METAL, scene_vec3(0.8f, 0.6f, 0.2f), right_fuzz[k], 0.0f);
+            scene_add_sphere(scene, scene_vec3(1, 0, -1), 0.5f, scene_add_material(scene, &mat));
+        } break;
+
+        case 6: // checkered texture
+        {
+            static const struct { f32 x, y, z, r; u32 type; vec3_t albedo; f32 fuzz; } spheres[] =
+            {
+                {   0, 1, 0,      1.0f,   MAT_DIELECTRIC, {0.0f, 0.0f, 0.0f}, 0.0f},
+                {  -4, 1, 0,      1.0f,   MAT_LAMBERTIAN, {0.4f, 0.2f, 0.1f}, 0.0f},
+                {   4, 1, 0,      1.0f,   MAT_METAL,      {0.7f, 0.6f, 0.5f}, 0.0f},
+                {  -3, 0.2f, 1,   0.2f,   MAT_METAL,      {0.1f, 0.4f, 0.2f}, 0.3f},
+                {   1, 0.2f, -1,  0.2f,   MAT_METAL,      {0.3f, 0.2f, 0.8f}, 0.0f},
+                {1.5f, 0.2f, 1.6f, 0.2f,  MAT_METAL,      {0.5f, 0.7f, 1.0f}, 0.8f},
+                {   2, 0.2f, -3,  0.2f,   MAT_LAMBERTIAN, {0.4f, 0.2f, 0.7f}, 0.0f},
+                {-3.1f, 0.2f, 1.54f, 0.2f, MAT_LAMBERTIAN, {0.9f, 0.7f, 0.2f}, 0.0f},
+                {   1, 0.2f, -1,  0.2f,   MAT_LAMBERTIAN, {0.3f, 0.2f, 0.8f}, 0.0f},
+                {  -1, 0.2f, 2,   0.2f,   MAT_LAMBERTIAN, {1.0f, 1.0f, 1.0f}, 0.0f},
+                {   2, 0.2f, 0.8f, 0.2f,  MAT_LAMBERTIAN, {1.0f, 0.0f, 1.0f}, 0.0f},
+                {  -2, 0.2f, 0.7f, 0.2f,  MAT_LAMBERTIAN, {1.0f, 0.0f, 0.0f}, 0.0f},
+                {-1.5f, 0.2f, -1.2f, 0.2f, MAT_LAMBERTIAN, {1.0f, 0.3f, 0.2f}, 0.0f},
+                {2.4f, 0.2f, 1.5f, 0.2f,  MAT_LAMBERTIAN, {0.0f, 0.0f, 1.0f}, 0.0f},
+                {0.4f, 0.2f, 2.6f, 0.2f,  MAT_LAMBERTIAN, {0.3f, 0.7f, 0.8f}, 0.0f},
+                {-0.3f, 0.2f, 0.8f, 0.2f, MAT_DIELECTRIC, {0.0f, 0.0f, 0.0f}, 0.0f},
+                {-2.3f, 0.2f, 1.9f, 0.2f, MAT_DIELECTRIC, {0.0f, 0.0f, 0.0f}, 0.0f},
+                {-2.3f, 0.2f, 1.9f, -0.195f, MAT_DIELECTRIC, {0.0f, 0.0f, 0.0f}, 0.0f},
+            };
+
+            // Four material types over 19 spheres diverge badly per warp
+            scene->bin_materials = TRUE;
+
+            mat = scene_material(MAT_CHECKERED, scene_vec3(0.5f, 0.5f, 0.5f), 0.0f, 0.0f);
+            mat.checker_even = scene_vec3(0.2f, 0.3f, 0.1f);
+            mat.checker_odd = scene_vec3(0.9f, 0.9f, 0.9f);
+            scene_add_sphere(scene, scene_vec3(0, -1000, 0), 1000.0f, scene_add_material(scene, &mat));
+
+            for (u32 i = 0; i < sizeof(spheres) / sizeof(spheres[0]); i++)
+            {
+                mat = scene_material(spheres[i].type, spheres[i].albedo, spheres[i].fuzz, 1.5f);
+                scene_add_sphere(scene, scene_vec3(spheres[i].x, spheres[i].y, spheres[i].z),
+                                 spheres[i].r, scene_add_material(scene, &mat));
+            }
+        } break;
+
+        case 7: // lamp
+        {
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.8f, 0.8f, 0.8f), 0.0f, 0.0f);
+            scene_add_sphere(scene, scene_vec3(0, -100.5f, -1), 100.0f, scene_add_material(scene, &mat));
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.1f, 0.2f, 0.5f), 0.0f, 0.0f);
+            scene_add_sphere(scene, scene_vec3(0, 0.5f, -1), 1.0f, scene_add_material(scene, &mat));
+
+            // The lamps are lambertian with an albedo far above one
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(15.0f, 15.0f, 15.0f), 0.0f, 0.0f);
+            m = scene_add_material(scene, &mat);
+            scene_add_sphere(scene, scene_vec3(4, 4.25f, -2), 2.0f, m);
+            scene_add_sphere(scene, scene_vec3(-4, 4.25f, -2), 2.0f, m);
+            scene_add_sphere(scene, scene_vec3(0, 4.25f, 4), 2.0f, m);
+            scene->sky_horizon = scene_vec3(0.01f, 0.01f, 0.01f);
+            scene->sky_zenith = scene_vec3(0.0f, 0.0f, 0.0f);
+        } break;
+
+        case 8: // plane
+        {
+            u32 red, green, blue;
+
+            mat = scene_material(MAT_METAL, scene_vec3(0.7f, 0.3f, 0.3f), 0.0f, 0.0f);
+            red = scene_add_material(scene, &mat);
+            mat = scene_material(MAT_METAL, scene_vec3(0.3f, 0.7f, 0.3f), 0.0f, 0.0f);
+            green = scene_add_material(scene, &mat);
+            mat = scene_material(MAT_METAL, scene_vec3(0.3f, 0.3f, 0.7f), 0.0f, 0.0f);
+            blue = scene_add_material(scene, &mat);
+
+            scene_add_sphere(scene, scene_vec3(-1, 0.5f, -2.5f), 1.0f, red);
+            scene_add_sphere(scene, scene_vec3(1, -1.25f, 1.5f), 1.0f, blue);
+            scene_add_sphere(scene, scene_vec3(0, -2, -3), 0.5f, blue);
+            scene_add_sphere(scene, scene_vec3(1.75f, 4, -2.5f), 1.0f, blue);
+            scene_add_sphere(scene, scene_vec3(2.75f, 2.5f, -3.5f), 0.75f, red);
+            scene_add_sphere(scene, scene_vec3(4.5f, 3.5f, -3), 0.75f, red);
+
+            scene_add_plane(scene, scene_vec3(5, 0, 0), scene_vec3(-1, 0, 0), red);
+            scene_add_plane(scene, scene_vec3(0, 5, 0), scene_vec3(0, -1, 0), green);
+            scene_add_plane(scene, scene_vec3(0, 0, 5), scene_vec3(0, 0, -1), blue);
+            scene_add_plane(scene, scene_vec3(-5, 0, 0), scene_vec3(1, 0, 0), red);
+            scene_add_plane(scene, scene_vec3(0, -5, 0), scene_vec3(0, 1, 0), green);
+            scene_add_plane(scene, scene_vec3(0, 0, -5), scene_vec3(0, 0, 1), blue);
+            scene->max_depth = 10;
+            scene->exposure = 500.0f;
+            scene->absorb_keeps = TRUE;
+        } break;
+
+        case 9: // mesh
+        {
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.5f, 0.5f, 0.5f), 0.0f, 0.0f);
+            scene_add_sphere(scene, scene_vec3(0, -100.5f, -1), 100.0f, scene_add_material(scene, &mat));
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.9f, 0.9f, 0.9f), 0.0f, 0.0f);
+            mat.texture = SCENE_MESH_TEXTURE;
+            scene->mesh_material = scene_add_material(scene, &mat);
+            mat.texture = SCENE_BALL_TEXTURE;
+            scene_add_sphere(scene, scene_vec3(-1.2f, -0.15f, -1.5f), 0.35f, scene_add_material(scene, &mat));
+            scene->mesh = mesh;
+            scene->textures = textures;
+            scene->environment = environment;
+        } break;
+
+        case 10: // instances
+        case 11: // sphere cloud
+        {
+            mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.5f, 0.5f, 0.5f), 0.0f, 0.0f);
+            scene_add_sphere(scene, scene_vec3(0, -1000.5f, 0), 1000.0f, scene_add_material(scene, &mat));
+            for (u32 i = 0; i < SCENE_INSTANCE_MATERIALS; i++)
+            {
+                mat = scene_material(scene_palette[i].type, scene_palette[i].albedo, scene_palette[i].fuzz, 0.0f);
+                scene_add_material(scene, &mat);
+            }
+            if (index == 10)
+                scene->tlas = tlas;
+            else
+                scene->cloud = cloud;
+            scene->environment = environment;
+        } break;
+    }
+}
+
+// Packs the materials of every builtin scene into one table (malloc'd, the
+// caller frees it) and returns its size. Material m of scene i is entry
+// bases[i] + m.
+u32
+scene_material_table(scene_gpu_material_t **table,
+                     u32 *bases)
+{
+    scene_t     scene;
+    u32         count = 0;
+
+
+    *table = NULL;
+    scene_init(&scene);
+    for (u32 i = 0; i < SCENE_NUM_BUILTIN; i++)
+    {
+        scene_load_builtin(&scene, i, NULL, NULL, NULL, NULL, NULL);
+        bases[i] = count;
+        *table = (scene_gpu_material_t *)realloc(*table,
+            (count + scene.num_materials) * sizeof(scene_gpu_material_t));
+
+        for (u32 m = 0; m < scene.num_materials; m++)
+        {
+            scene_material_t        *mat = &scene.materials[m];
+            scene_gpu_material_t    *out = &(*table)[count++];
+
+
+            memcpy(out->albedo, m_cast(mat->albedo), sizeof(out->albedo));
+            out->type = mat->type;
+            memcpy(out->checker_even, m_cast(mat->checker_even), sizeof(out->checker_even));
+            out->fuzz = mat->fuzz;
+            memcpy(out->checker_odd, m_cast(mat->checker_odd), sizeof(out->checker_odd));
+            out->idx_ref = mat->idx_ref;
+            out->texture = mat->texture;
+        }
+    }
+    scene_free(&scene);
+
+    return count;
+}
+
+// Appends to the specialisation text, FALSE once it no longer fits
+internal b32
+scene_append(char *text,
+             u32 capacity,
+             u32 *length,
+             const char *format,
+             ...)
+{
+    va_list args;
+    s32     written;
+
+
+    va_start(args, format);
+    written = vsnprintf(text + *length, capacity - *length, format, args);
+    va_end(args);
+    if (written < 0 || (u32)written >= capacity - *length)
+        return FALSE;
+    *length += (u32)written;
+
+    return TRUE;
+}
+
+// A float literal GLSL reads back exactly, always with a point or exponent
+internal void
+scene_glsl_float(char *out,
+                 f32 x)
+{
+    snprintf(out, 32, "%.9g", x);
+    if (!strpbrk(out, ".e"))
+        strcat(out, ".0");
+}
+
+internal void
+scene_glsl_vec3(char *out,
+                vec3_t v)
+{
+    char x[32], y[32], z[32];
+
+    scene_glsl_float(x, v.x);
+    scene_glsl_float(y, v.y);
+    scene_glsl_float(z, v.z);
+    snprintf(out, 112, "vec3(%s, %s, %s)", x, y, z);
+}
+
+// Writes the defines the sphere scene kernel is compiled with: SCENE_SPHERES
+// and SCENE_PLANES as constructor lists, SCENE_MATERIAL_TYPES as a mask of
+// (1 << type), and the quirks. Returns the length of the text, 0 if it
+// didn't fit in `capacity` (SCENE_SPECIALIZE_SIZE is enough for the builtin
+// scenes).
+u32
+scene_specialize(scene_t *scene,
+                 char *text,
+                 u32 capacity)
+{
+    char        a[112],
+                b[112],
+                f[32];
+    u32         types = 0;
+    u32         length = 0;
+    b32         ok;
+
+
+    for (u32 i = 0; i < scene->num_materials; i++)
+        types |= 1u << scene->materials[i].type;
+
+    ok = scene_append(text, capacity, &length, "#define SCENE_NUM_SPHERES %u\n#define SCENE_SPHERES ",
+                      scene->num_spheres);
+    for (u32 i = 0; ok && i < scene->num_spheres; i++)
+    {
+        vec3_t center = {scene->sphere_x[i], scene->sphere_y[i], scene->sphere_z[i]};
+
+        scene_glsl_vec3(a, center);
+        scene_glsl_float(f, scene->sphere_r[i]);
+        ok = scene_append(text, capacity, &length, "%ssphere_t(%s, %s, %u)",
+                          i ? ", " : "", a, f, scene->sphere_material[i]);
+    }
+
+    ok = ok && scene_append(text, capacity, &length, "\n#define SCENE_NUM_PLANES %u\n#define SCENE_PLANES ",
+                            scene->num_planes);
+    for (u32 i = 0; ok && i < scene->num_planes; i++)
+    {
+        scene_glsl_vec3(a, scene->planes[i].pos);
+        scene_glsl_vec3(b, scene->planes[i].normal);
+        ok = scene_append(text, capacity, &length, "%splane_t(%s, %s, %u)",
+                          i ? ", " : "", a, b, scene->planes[i].material);
+    }
+
+    scene_glsl_vec3(a, scene->sky_horizon);
+    scene_glsl_vec3(b, scene->sky_zenith);
+    scene_glsl_float(f, scene->exposure);
+    ok = ok && scene_append(text, capacity, &length,
+                            "\n#define SCENE_MATERIAL_TYPES 0x%x\n"
+                            "#define SCENE_MAX_DEPTH %uu\n"
+                            "#define SCENE_SKY_HORIZON %s\n"
+                            "#define SCENE_SKY_ZENITH %s\n"
+                            "#define SCENE_EXPOSURE %s\n"
+                            "#define SCENE_ABSORB_KEEPS %d\n"
+                            "#define SCENE_SHADE_NORMALS %d\n"
+                            "#define SCENE_BIN_MATERIALS %d\n",
+                            types, scene->max_depth, a, b, f,
+                            scene->absorb_keeps ? 1 : 0,
+                            scene->shade_normals ? 1 : 0,
+                            scene->bin_materials ? 1 : 0);
+
+    return ok ? length : 0;
+}
+
+// Fills `tlas` with a per_side x per_side field of randomly turned, scaled
+// and coloured copies of `mesh` and `ball`, standing on the ground sphere of
+// the instance scene. Both meshes need their BVH; each copy is normalised
+// by its BLAS bounds so any model fits.
+void
+scene_make_instances(tlas_t *tlas,
+                     mesh_t *mesh,
+                     mesh_t *ball,
+                     u32 per_side)
+{
+    mesh_t  *blas[2] = {mesh, ball};
+    vec3_t  center[2];
+    f32     extent[2];
+
+
+    tlas_init(tlas);
+    for (u32 b = 0; b < 2; b++)
+    {
+        bvh_node_t *root = &blas[b]->bvh.nodes[0];
+
+        center[b] = scene_vec3(0.5f * (root->min[0] + root->max[0]),
+                               0.5f * (root->min[1] + root->max[1]),
+                               0.5f * (root->min[2] + root->max[2]));
+        extent[b] = fmaxf(root->max[0] - root->min[0],
+                          fmaxf(root->max[1] - root->min[1], root->max[2] - root->min[2]));
+        tlas_add_blas(tlas, blas[b]);
+    }
+
+    for (u32 i = 0; i < per_side; i++)
+    {
+        for (u32 j = 0; j < per_side; j++)
+        {
+            u32     r = (i * per_side + j) * 8;
+            u32     b = m_randf(r) < 0.5f ? 0 : 1;
+            f32     size = 0.3f + 0.3f * m_randf(r + 1);
+            f32     x = (j - 0.5f * per_side) * 0.8f + 0.3f * m_randf(r + 2);
+            f32     z = -2.0f - i * 0.8f + 0.3f * m_randf(r + 3);
+            f32     ground = -1000.5f + sqrtf(1000.0f * 1000.0f - x * x - z * z);
+            mat4_t  transform;
+
+
+            transform = mat4_translate(-center[b].x, -center[b].y, -center[b].z);
+            transform = mat4_mult(mat4_scale(size / extent[b]), transform);
+            transform = mat4_mult(mat4_rotate(360.0f * m_randf(r + 4), 0.0f, 1.0f, 0.0f), transform);
+            transform = mat4_mult(mat4_translate(x, ground + 0.5f * size, z), transform);
+
+            tlas_add_instance(tlas, b, transform,
+                              1 + (u32)(m_randf(r + 5) * SCENE_INSTANCE_MATERIALS) % SCENE_INSTANCE_MATERIALS);
+        }
+    }
+
+    tlas_build(tlas);
+}
+
+// A per_side x per_side carpet of small balls resting on the ground sphere
+// of the cloud scene, from the camera out to the horizon. They bounce, and
+// every fifth one also circles around its rest position.
+void
+scene_make_cloud(scene_cloud_t *cloud,
+                 u32 per_side)
+{
+    memset(cloud, 0, sizeof(*cloud));
+    cloud->num_spheres = per_side * per_side;
+    cloud->spheres = (f32 *)malloc((usize)cloud->num_spheres * 4 * sizeof(f32));
+    cloud->materials = (u32 *)malloc((usize)cloud->num_spheres * sizeof(u32));
+    cloud->rest = (f32 *)malloc((usize)cloud->num_spheres * 4 * sizeof(f32));
+    cloud->anim = (f32 *)malloc((usize)cloud->num_spheres * 4 * sizeof(f32));
+    cloud->boxes = (bvh_aabb_t *)malloc((usize)cloud->num_spheres * sizeof(bvh_aabb_t));
+
+    for (u32 i = 0; i < per_side; i++)
+    {
+        for (u32 j = 0; j < per_side; j++)
+        {
+            u32 s = i * per_side + j;
+            u32 r = 0x40000000u + s * 16;
+            f32 radius = 0.015f + 0.01f * m_randf(r);
+            f32 x = (j - 0.5f * per_side) * SCENE_CLOUD_SPACING + 0.02f * m_randf(r + 1);
+            f32 z = 0.5f - i * SCENE_CLOUD_SPACING + 0.02f * m_randf(r + 2);
+            f32 ground = -1000.5f + sqrtf(1000.0f * 1000.0f - x * x - z * z);
+
+            cloud->spheres[s * 4 + 0] = x;
+            cloud->spheres[s * 4 + 1] = ground + radius;
+            cloud->spheres[s * 4 + 2] = z;
+            cloud->spheres[s * 4 + 3] = radius;
+            cloud->materials[s] = 1 + (u32)(m_randf(r + 3) * SCENE_INSTANCE_MATERIALS) % SCENE_INSTANCE_MATERIALS;
+
+            cloud->anim[s * 4 + 0] = 0.05f + 0.25f * m_randf(r + 4);
+            cloud->anim[s * 4 + 1] = 2.0f + 4.0f * m_randf(r + 5);
+            cloud->anim[s * 4 + 2] = (m_randf(r + 6) < 0.2f) ? 0.5f * m_randf(r + 7) : 0.0f;
+            cloud->anim[s * 4 + 3] = 6.2831853f * m_randf(r + 8);
+        }
+    }
+    memcpy(cloud->rest, cloud->spheres, (usize)cloud->num_spheres * 4 * sizeof(f32));
+}
+
+internal void
+scene_cloud_boxes(scene_cloud_t *cloud)
+{
+    for (u32 i = 0; i < cloud->num_spheres; i++)
+    {
+        f32 *s = &cloud->spheres[i * 4];
+
+        for (u32 a = 0; a < 3; a++)
+        {
+            cloud->boxes[i].min[a] = s[a] - s[3];
+            cloud->boxes[i].max[a] = s[a] + s[3];
+        }
+    }
+}
+
+void
+scene_cloud_build_bvh(scene_cloud_t *cloud,
+                      u32 num_threads)
+{
+    scene_cloud_boxes(cloud);
+    bvh_free(&cloud->bvh);
+    bvh_build(&cloud->bvh, cloud->boxes, cloud->num_spheres, num_threads);
+    cloud->build_cost = cloud->cost = bvh_sah_cost(&cloud->bvh);
+}
+
+// Moves every sphere to where its channel puts it at `time`; time 0 is the
+// rest pose. cloud_animate.comp does the same on the GPU.
+void
+scene_cloud_animate(scene_cloud_t *cloud,
+                    f32 time)
+{
+    for (u32 i = 0; i < cloud->num_spheres; i++)
+    {
+        f32 *rest = &cloud->rest[i * 4];
+        f32 *anim = &cloud->anim[i * 4];
+        f32 *s = &cloud->spheres[i * 4];
+        f32 orbit = 0.5f * anim[1] * time + anim[3];
+
+        s[0] = rest[0] + anim[2] * (cosf(orbit) - cosf(anim[3]));
+        s[1] = rest[1] + anim[0] * fabsf(sinf(anim[1] * time));
+        s[2] = rest[2] + anim[2] * (sinf(orbit) - sinf(anim[3]));
+    }
+    cloud->time = time;
+}
+
+// Animates and refits the BVH, or rebuilds it once the refits pushed its
+// SAH cost past BVH_REBUILD_RATIO times what it was after the last build.
+// Returns TRUE when it rebuilt.
+b32
+scene_cloud_update(scene_cloud_t *cloud,
+                   f32 time)
+{
+    scene_cloud_animate(cloud, time);
+    scene_cloud_boxes(cloud);
+    bvh_refit(&cloud->bvh, cloud->boxes);
+    cloud->cost = bvh_sah_cost(&cloud->bvh);
+
+    if (cloud->cost <= cloud->build_cost * BVH_REBUILD_RATIO)
+        return FALSE;
+
+    bvh_free(&cloud->bvh);
+    bvh_build(&cloud->bvh, cloud->boxes, cloud->num_spheres, 0);
+    cloud->build_cost = bvh_sah_cost(&cloud->bvh);
+    printf("cloud bvh: rebuilt at SAH cost %.1f, now %.1f\n", cloud->cost, cloud->build_cost);
+    cloud->cost = cloud->build_cost;
+
+    return TRUE;
+}
+
+void
+scene_cloud_free(scene_cloud_t *cloud)
+{
+    free(cloud->spheres);
+    free(cloud->materials);
+    free(cloud->rest);
+    free(cloud->anim);
+    free(cloud->boxes);
+    bvh_free(&cloud->bvh);
+    memset(cloud, 0, sizeof(*cloud));
+}
+
+// The "final scene" of Ray Tracing in One Weekend: a big ground sphere, three
+// large spheres and a 22x22 grid of small random ones (~490 spheres). Used to
+// benchmark the intersection kernels on more than a handful of spheres.
+void
+scene_load_sphere_field(scene_t *scene,
+                        u32 seed)
+{
+    scene_material_t    mat;
+
+
+    scene_free(scene);
+
+    mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.5f, 0.5f, 0.5f), 0.0f, 0.0f);
+    scene_add_sphere(scene, scene_vec3(0, -1000, 0), 1000.0f, scene_add_material(scene, &mat));
+
+    for (s32 a = -11; a < 11; a++)
+    {
+        for (s32 b = -11; b < 11; b++)
+        {
+            // Fixed offsets into the hash per cell, so the scene only depends
+            // on the seed
+            u32 r = (seed * 484 + (u32)((a + 11) * 22 + (b + 11))) * 16;
+            f32 choose = m_randf(r);
+            vec3_t center = scene_vec3(a + 0.9f * m_randf(r + 1), 0.2f, b + 0.9f * m_randf(r + 2));
+
+            if (choose < 0.8f)
+            {
+                vec3_t albedo = scene_vec3(m_randf(r + 3) * m_randf(r + 4),
+                                           m_randf(r + 5) * m_randf(r + 6),
+                                           m_randf(r + 7) * m_randf(r + 8));
+                mat = scene_material(MAT_LAMBERTIAN, albedo, 0.0f, 0.0f);
+            }
+            else if (choose < 0.95f)
+            {
+                vec3_t albedo = scene_vec3(0.5f + 0.5f * m_randf(r + 3),
+                                           0.5f + 0.5f * m_randf(r + 4),
+                                           0.5f + 0.5f * m_randf(r + 5));
+                mat = scene_material(MAT_METAL, albedo, 0.5f * m_randf(r + 6), 0.0f);
+            }
+            else
+            {
+                mat = scene_material(MAT_DIELECTRIC, scene_vec3(1, 1, 1), 0.0f, 1.5f);
+            }
+            scene_add_sphere(scene, center, 0.2f, scene_add_material(scene, &mat));
+        }
+    }
+
+    mat = scene_material(MAT_DIELECTRIC, scene_vec3(1, 1, 1), 0.0f, 1.5f);
+    scene_add_sphere(scene, scene_vec3(0, 1, 0), 1.0f, scene_add_material(scene, &mat));
+    mat = scene_material(MAT_LAMBERTIAN, scene_vec3(0.4f, 0.2f, 0.1f), 0.0f, 0.0f);
+    scene_add_sphere(scene, scene_vec3(-4, 1, 0), 1.0f, scene_add_material(scene, &mat));
+    mat = scene_material(MAT_METAL, scene_vec3(0.7f, 0.6f, 0.5f), 0.0f, 0.0f);
+    scene_add_sphere(scene, scene_vec3(4, 1, 0), 1.0f, scene_add_material(scene, &mat));
+}
+
+#endif // SCENE_IMPL
+
+#endif // SCENE_H
@@ -0,0 +1,336 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Time-sliced tile scheduler for progressive renders. The image is split into
+// tiles kept in a priority queue (fewest samples first, then centre-out) and
+// each frame only as much tile work is handed out as fits in a GPU time
+// budget. The cost of a pixel-sample is measured with GL timer queries and
+// fed back into the estimate, so heavy scenes get fewer samples per slice.
+//
+// Needs the GL function pointers (glad) to be included before this file.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+
+#define SCHED_TILE_SIZE     128
+#define SCHED_QUERY_COUNT   4
+#define SCHED_MAX_CHUNK     64
+
+typedef struct _TAG_sched_tile
+{
+    s32 x, y;
+    s32 w, h;
+    u32 samples_done;
+    f32 dist;           // distance from the image centre, in tiles
+} sched_tile_t;
+
+// One dispatch worth of work handed out by sched_next()
+typedef struct _TAG_sched_work
+{
+    s32 x, y;
+    s32 w, h;
+    u32 sample_base;
+    u32 samples;
+} sched_work_t;
+
+typedef struct _TAG_sched
+{
+    sched_tile_t    *tiles;
+    u32             num_tiles;
+    u32             *heap;
+    u32             heap_count;
+
+    u32             target_samples;
+    u64             pixel_samples_left;
+
+    // GPU budget
+    f32             budget_ms;
+    f32             used_ms;
+    f64             ms_per_pixel_sample;
+    u64             frame_pixel_samples;
+
+    // Timer queries, in flight for a few frames so reading them never stalls
+    u32             queries[SCHED_QUERY_COUNT];
+    u64             query_pixel_samples[SCHED_QUERY_COUNT];
+    b32             query_pending[SCHED_QUERY_COUNT];
+    u32             query_next;
+    b32             query_active;
+} sched_t;
+
+void        sched_init(sched_t *sched, s32 width, s32 height, f32 budget_ms);
+void        sched_begin(sched_t *sched, u32 target_samples);
+void        sched_reset(sched_t *sched);
+void        sched_free(sched_t *sched);
+b32         sched_done(sched_t *sched);
+f32         sched_progress(sched_t *sched);
+void        sched_frame_begin(sched_t *sched);
+b32         sched_next(sched_t *sched, sched_work_t *work);
+void        sched_frame_end(sched_t *sched);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== SCHEDULER IMPLEMENTATION ===========================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef SCHED_IMPL
+
+////////////////////////////////////////////////////////////////////////////////
+// PRIORITY QUEUE
+
+internal b32
+sched_before(sched_t *sched,
+             u32 a,
+             u32 b)
+{
+    sched_tile_t *ta = &sched->tiles[a];
+    sched_tile_t *tb = &sched->tiles[b];
+
+    if (ta->samples_done != tb->samples_done)
+        return ta->samples_done < tb->samples_done;
+
+    return ta->dist < tb->dist;
+}
+
+internal void
+sched_heap_push(sched_t *sched,
+                u32 tile)
+{
+    u32 i = sched->heap_count++;
+
+    sched->heap[i] = tile;
+    while (i > 0)
+    {
+        u32 parent = (i - 1) / 2;
+        if (!sched_before(sched, sched->heap[i], sched->heap[parent]))
+            break;
+
+        u32 temp = sched->heap[i];
+        sched->heap[i] = sched->heap[parent];
+        sched->heap[parent] = temp;
+        i = parent;
+    }
+}
+
+internal u32
+sched_heap_pop(sched_t *sched)
+{
+    u32 top = sched->heap[0];
+    u32 i = 0;
+
+    sched->heap[0] = sched->heap[--sched->heap_count];
+    for (;;)
+    {
+        u32 left = i * 2 + 1;
+        u32 right = left + 1;
+        u32 best = i;
+
+        if (left < sched->heap_count && sched_before(sched, sched->heap[left], sched->heap[best]))
+            best = left;
+        if (right < sched->heap_count && sched_before(sched, sched->heap[right], sched->heap[best]))
+            best = right;
+        if (best == i)
+            break;
+
+        u32 temp = sched->heap[i];
+        sched->heap[i] = sched->heap[best];
+        sched->heap[best] = temp;
+        i = best;
+    }
+
+    return top;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SCHEDULER
+
+void
+sched_init(sched_t *sched,
+           s32 width,
+           s32 height,
+           f32 budget_ms)
+{
+    s32     tiles_x,
+            tiles_y;
+    f32     cx,
+            cy;
+
+
+    memset(sched, 0, sizeof(*sched));
+
+    tiles_x = (width + SCHED_TILE_SIZE - 1) / SCHED_TILE_SIZE;
+    tiles_y = (height + SCHED_TILE_SIZE - 1) / SCHED_TILE_SIZE;
+    cx = (tiles_x - 1) * 0.5f;
+    cy = (tiles_y - 1) * 0.5f;
+
+    sched->num_tiles = tiles_x * tiles_y;
+    sched->tiles = (sched_tile_t *)calloc(sched->num_tiles, sizeof(sched_tile_t));
+    sched->heap = (u32 *)malloc(sched->num_tiles * sizeof(u32));
+
+    for (s32 y = 0; y < tiles_y; y++)
+    {
+        for (s32 x = 0; x < tiles_x; x++)
+        {
+            sched_tile_t *tile = &sched->tiles[y * tiles_x + x];
+
+            tile->x = x * SCHED_TILE_SIZE;
+            tile->y = y * SCHED_TILE_SIZE;
+            tile->w = (tile->x + SCHED_TILE_SIZE > width) ? width - tile->x : SCHED_TILE_SIZE;
+            tile->h = (tile->y + SCHED_TILE_SIZE > height) ? height - tile->y : SCHED_TILE_SIZE;
+            tile->dist = sqrtf((x - cx) * (x - cx) + (y - cy) * (y - cy));
+        }
+    }
+
+    sched->budget_ms = budget_ms;
+    sched->ms_per_pixel_sample = 1.0e-5;   // ~15ms for a 1600x900 frame at 1spp, refined by timing
+    glCreateQueries(GL_TIME_ELAPSED, SCHED_QUERY_COUNT, sched->queries);
+}
+
+void
+sched_begin(sched_t *sched,
+            u32 target_samples)
+{
+    sched->heap_count = 0;
+    sched->target_samples = target_samples;
+    sched->pixel_samples_left = 0;
+
+    for (u32 i = 0; i < sched->num_tiles; i++)
+    {
+        sched->tiles[i].samples_done = 0;
+        sched->pixel_samples_left += (u64)(sched->tiles[i].w * sched->tiles[i].h) * target_samples;
+        sched_heap_push(sched, i);
+    }
+}
+
+void
+sched_reset(sched_t *sched)
+{
+    sched->heap_count = 0;
+    sched->pixel_samples_left = 0;
+}
+
+// Needs the context sched_init() was called in
+void
+sched_free(sched_t *sched)
+{
+    glDeleteQueries(SCHED_QUERY_COUNT, sched->queries);
+    free(sched->tiles);
+    free(sched->heap);
+    memset(sched, 0, sizeof(*sched));
+}
+
+b32
+sched_done(sched_t *sched)
+{
+    return (sched->heap_count == 0);
+}
+
+f32
+sched_progress(sched_t *sched)
+{
+    u64 total = 0;
+
+    for (u32 i = 0; i < sched->num_tiles; i++)
+        total += (u64)(sched->tiles[i].w * sched->tiles[i].h) * sched->target_samples;
+
+    return total ? 1.0f - (f32)sched->pixel_samples_left / (f32)total : 1.0f;
+}
+
+void
+sched_frame_begin(sched_t *sched)
+{
+    // Fold finished timings into the cost estimate
+    for (u32 i = 0; i < SCHED_QUERY_COUNT; i++)
+    {
+        s32 available = 0;
+        u64 elapsed_ns;
+
+        if (!sched->query_pending[i])
+            continue;
+
+        glGetQueryObjectiv(sched->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        glGetQueryObjectui64v(sched->queries[i], GL_QUERY_RESULT, &elapsed_ns);
+        sched->query_pending[i] = FALSE;
+        if (sched->query_pixel_samples[i])
+        {
+            f64 measured = (elapsed_ns / 1.0e6) / (f64)sched->query_pixel_samples[i];
+            sched->ms_per_pixel_sample += 0.25 * (measured - sched->ms_per_pixel_sample);
+        }
+    }
+
+    sched->used_ms = 0.0f;
+    sched->frame_pixel_samples = 0;
+    sched->query_active = FALSE;
+    if (!sched_done(sched) && !sched->query_pending[sched->query_next])
+    {
+        glBeginQuery(GL_TIME_ELAPSED, sched->queries[sched->query_next]);
+        sched->query_active = TRUE;
+    }
+}
+
+b32
+sched_next(sched_t *sched,
+           sched_work_t *work)
+{
+    sched_tile_t    *tile;
+    u32             index,
+                    remaining,
+                    samples;
+    f64             tile_cost;
+
+
+    // Always hand out at least one slice so progress never stalls
+    if (sched_done(sched) || (sched->used_ms >= sched->budget_ms && sched->frame_pixel_samples))
+        return FALSE;
+
+    index = sched_heap_pop(sched);
+    tile = &sched->tiles[index];
+    remaining = sched->target_samples - tile->samples_done;
+
+    // Fit as many samples of this tile as the rest of the budget allows
+    tile_cost = (tile->w * tile->h) * sched->ms_per_pixel_sample;
+    samples = (u32)((sched->budget_ms - sched->used_ms) / tile_cost);
+    if (samples < 1)
+        samples = 1;
+    if (samples > SCHED_MAX_CHUNK)
+        samples = SCHED_MAX_CHUNK;
+    if (samples > remaining)
+        samples = remaining;
+
+    work->x = tile->x;
+    work->y = tile->y;
+    work->w = tile->w;
+    work->h = tile->h;
+    work->sample_base = tile->samples_done;
+    work->samples = samples;
+
+    tile->samples_done += samples;
+    if (tile->samples_done < sched->target_samples)
+        sched_heap_push(sched, index);
+
+    sched->used_ms += (f32)(tile_cost * samples);
+    sched->frame_pixel_samples += (u64)(tile->w * tile->h) * samples;
+    sched->pixel_samples_left -= (u64)(tile->w * tile->h) * samples;
+
+    return TRUE;
+}
+
+void
+sched_frame_end(sched_t *sched)
+{
+    if (!sched->query_active)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    sched->query_pixel_samples[sched->query_next] = sched->frame_pixel_samples;
+    sched->query_pending[sched->query_next] = TRUE;
+    sched->query_next = (sched->query_next + 1) % SCHED_QUERY_COUNT;
+    sched->query_active = FALSE;
+}
+
+#endif // SCHED_IMPL
+
+#endif // SCHEDULER_H
@@ -0,0 +1,587 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+// Albedo textures. Images (binary PPM or TGA) are decoded on worker threads,
+// resampled to TEXTURE_SIZE squared and given a full mip chain, so the whole
+// set uploads as one GL_TEXTURE_2D_ARRAY with a layer per image. Texels are
+// sRGB RGBA8 with row 0 at v = 0; mips are box filtered in linear space.
+//
+// Both renderers pick the mip level from a ray cone: the cone's width at
+// the hit, times the texels per world unit there, over the cosine at which
+// the ray meets the surface. texture_sample() filters the same levels the
+// GL sampler does (trilinear, repeating), decoding sRGB before filtering.
+//
+// A layer without an image (no path, or one that fails to load) gets a
+// procedural pattern instead: a latitude/longitude grid on even layers,
+// bricks on odd ones.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "types.h"
+#include "mmath.h"
+
+#define TEXTURE_SIZE        1024
+#define TEXTURE_LEVELS      11      // TEXTURE_SIZE down to 1x1
+#define TEXTURE_MAX_LAYERS  16
+#define TEXTURE_MAX_THREADS 16
+#define TEXTURE_NONE        0xffffffffu
+#define TEXTURE_MIN_COSINE  0.05f   // grazing hits stop widening the footprint here
+
+typedef struct _TAG_texture_set
+{
+    u32     *texels[TEXTURE_MAX_LAYERS];    // RGBA8, every level back to back
+    u32     num_layers;
+} texture_set_t;
+
+b32         texture_decode(const char *path, u32 **pixels, u32 *width, u32 *height);
+void        texture_set_load(texture_set_t *set, const char **paths, u32 num_layers, u32 num_threads);
+void        texture_set_free(texture_set_t *set);
+usize       texture_level_offset(u32 level);
+f32         texture_lod(f32 cone_width, f32 uv_density, f32 cosine);
+vec3_t      texture_sample(texture_set_t *set, u32 layer, f32 u, f32 v, f32 lod);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== TEXTURE IMPLEMENTATION =============================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef TEXTURE_IMPL
+
+internal f32    texture_srgb_table[256];
+
+typedef struct _TAG_texture_job
+{
+    texture_set_t       *set;
+    const char          **paths;
+    u32                 num_layers;
+    std::atomic<u32>    next;               // first layer nobody has taken
+} texture_job_t;
+
+internal f64
+texture_now(void)
+{
+    return std::chrono::duration<f64>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal u32
+texture_pack(f32 r,
+             f32 g,
+             f32 b)
+{
+    f32 c[3] = {r, g, b};
+    u32 texel = 0xff000000u;
+
+    for (u32 k = 0; k < 3; k++)
+    {
+        f32 x = (c[k] < 0.0f) ? 0.0f : (c[k] > 1.0f) ? 1.0f : c[k];
+
+        x = (x <= 0.0031308f) ? x * 12.92f : 1.055f * powf(x, 1.0f / 2.4f) - 0.055f;
+        texel |= (u32)(x * 255.0f + 0.5f) << (k * 8);
+    }
+
+    return texel;
+}
+
+internal void
+texture_unpack(u32 texel,
+               f32 *c)
+{
+    c[0] = texture_srgb_table[texel & 0xff];
+    c[1] = texture_srgb_table[(texel >> 8) & 0xff];
+    c[2] = texture_srgb_table[(texel >> 16) & 0xff];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// DECODING
+
+// Next header field of a PPM, skipping whitespace and comments
+internal b32
+texture_ppm_field(const u8 **cursor,
+                  const u8 *end,
+                  u32 *value)
+{
+    const u8 *p = *cursor;
+
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#'))
+    {
+        if (*p == '#')
+            while (p < end && *p != '\n')
+                p++;
+        else
+            p++;
+    }
+    if (p == end || *p < '0' || *p > '9')
+        return FALSE;
+
+    *value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        *value = *value * 10 + (*p++ - '0');
+    *cursor = p;
+
+    return TRUE;
+}
+
+internal b32
+texture_decode_ppm(const u8 *data,
+                   usize size,
+                   u32 **pixels,
+                   u32 *width,
+                   u32 *height)
+{
+    const u8    *p = data + 2;
+    const u8    *end = data + size;
+    u32         max_value;
+
+
+    if (!texture_ppm_field(&p, end, width) || !texture_ppm_field(&p, end, height) ||
+        !texture_ppm_field(&p, end, &max_value) || max_value == 0 || max_value > 255)
+        return FALSE;
+    p++;    // the single whitespace before the raster
+    if (!*width || !*height || (usize)(end - p) < (usize)*width * *height * 3)
+        return FALSE;
+
+    // Rows are stored top down
+    *pixels = (u32 *)malloc((usize)*width * *height * sizeof(u32));
+    for (u32 y = 0; y < *height; y++)
+    {
+        u32 *row = *pixels + (usize)(*height - 1 - y) * *width;
+
+        for (u32 x = 0; x < *width; x++, p += 3)
+            row[x] = 0xff000000u | (u32)(p[0] * 255 / max_value)
+                   | (u32)(p[1] * 255 / max_value) << 8 | (u32)(p[2] * 255 / max_value) << 16;
+    }
+
+    return TRUE;
+}
+
+// Uncompressed or RLE true colour / greyscale
+internal b32
+texture_decode_tga(const u8 *data,
+                   usize size,
+                   u32 **pixels,
+                   u32 *width,
+                   u32 *height)
+{
+    const u8    *p = data + 18 + data[0];
+    const u8    *end = data + size;
+    u32         type = data[2] & ~8u;
+    b32         rle = (data[2] & 8) != 0;
+    u32         bytes = data[16] / 8;
+    b32         top_down = (data[17] & 0x20) != 0;
+    usize       count;
+    usize       i = 0;
+
+
+    *width = data[12] | (u32)data[13] << 8;
+    *height = data[14] | (u32)data[15] << 8;
+    if (18 + (usize)data[0] > size || data[1] != 0 || !*width || !*height ||
+        !((type == 2 && (bytes == 3 || bytes == 4)) || (type == 3 && bytes == 1)))
+        return FALSE;
+
+    count = (usize)*width * *height;
+    *pixels = (u32 *)malloc(count * sizeof(u32));
+    while (i < count)
+    {
+        usize   run = 1;
+        b32     repeat = FALSE;
+        u32     texel = 0;
+
+        if (rle)
+        {
+            if (p >= end)
+                break;
+            run = (*p & 0x7f) + 1;
+            repeat = (*p++ & 0x80) != 0;
+            if (run > count - i)
+                run = count - i;
+        }
+        for (usize k = 0; k < run; k++, i++)
+        {
+            if (k == 0 || !repeat)
+            {
+                if ((usize)(end - p) < bytes)
+                    break;
+                if (bytes == 1)
+                    texel = 0xff000000u | p[0] * 0x010101u;
+                else
+                    texel = (bytes == 4 ? (u32)p[3] << 24 : 0xff000000u) | p[2] | (u32)p[1] << 8 | (u32)p[0] << 16;
+                p += bytes;
+            }
+            (*pixels)[i] = texel;
+        }
+        if (i < count && (usize)(end - p) < bytes)
+            break;
+    }
+    if (i < count)
+    {
+        free(*pixels);
+        return FALSE;
+    }
+
+    // Bottom up unless the descriptor says otherwise, which is what we store
+    if (top_down)
+    {
+        for (u32 y = 0; y < *height / 2; y++)
+        {
+            u32 *a = *pixels + (usize)y * *width;
+            u32 *b = *pixels + (usize)(*height - 1 - y) * *width;
+
+            for (u32 x = 0; x < *width; x++)
+            {
+                u32 t = a[x];
+
+                a[x] = b[x];
+                b[x] = t;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+b32
+texture_decode(const char *path,
+               u32 **pixels,
+               u32 *width,
+               u32 *height)
+{
+    FILE    *file;
+    u8      *data;
+    usize   size;
+    b32     ok;
+
+
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        printf("failed to open texture %s\n", path);
+        return FALSE;
+    }
+    fseek(file, 0, SEEK_END);
+    size = (usize)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = (u8 *)malloc(size + 1);
+    if (fread(data, 1, size, file) != size)
+    {
+        printf("failed to read texture %s\n", path);
+        fclose(file);
+        free(data);
+        return FALSE;
+    }
+    fclose(file);
+
+    if (size > 2 && data[0] == 'P' && data[1] == '6')
+        ok = texture_decode_ppm(data, size, pixels, width, height);
+    else if (size > 18)
+        ok = texture_decode_tga(data, size, pixels, width, height);
+    else
+        ok = FALSE;
+    free(data);
+
+    if (!ok)
+        printf("unsupported texture %s (binary PPM or true colour TGA)\n", path);
+
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LEVELS
+
+usize
+texture_level_offset(u32 level)
+{
+    usize offset = 0;
+
+    for (u32 l = 0; l < level; l++)
+        offset += (usize)(TEXTURE_SIZE >> l) * (TEXTURE_SIZE >> l);
+
+    return offset;
+}
+
+// Bilinear resample of a decoded image onto level 0, in linear space
+internal void
+texture_resample(u32 *pixels,
+                 u32 width,
+                 u32 height,
+                 u32 *level)
+{
+    for (u32 y = 0; y < TEXTURE_SIZE; y++)
+    {
+        f32 sy = (y + 0.5f) * height / TEXTURE_SIZE - 0.5f;
+        f32 fy = floorf(sy);
+        f32 wy = sy - fy;
+        s32 y0 = (s32)fy < 0 ? 0 : (s32)fy;
+        s32 y1 = (s32)fy + 1 > (s32)height - 1 ? (s32)height - 1 : (s32)fy + 1;
+
+        for (u32 x = 0; x < TEXTURE_SIZE; x++)
+        {
+            f32 sx = (x + 0.5f) * width / TEXTURE_SIZE - 0.5f;
+            f32 fx = floorf(sx);
+            f32 wx = sx - fx;
+            s32 x0 = (s32)fx < 0 ? 0 : (s32)fx;
+            s32 x1 = (s32)fx + 1 > (s32)width - 1 ? (s32)width - 1 : (s32)fx + 1;
+            f32 c00[3], c10[3], c01[3], c11[3], c[3];
+
+            texture_unpack(pixels[(usize)y0 * width + x0], c00);
+            texture_unpack(pixels[(usize)y0 * width + x1], c10);
+            texture_unpack(pixels[(usize)y1 * width + x0], c01);
+            texture_unpack(pixels[(usize)y1 * width + x1], c11);
+            for (u32 k = 0; k < 3; k++)
+                c[k] = (c00[k] * (1.0f - wx) + c10[k] * wx) * (1.0f - wy)
+                     + (c01[k] * (1.0f - wx) + c11[k] * wx) * wy;
+            level[(usize)y * TEXTURE_SIZE + x] = texture_pack(c[0], c[1], c[2]);
+        }
+    }
+}
+
+// Stand-in for a missing image, in the spirit of the procedural torus
+internal void
+texture_procedural(u32 layer,
+                   u32 *level)
+{
+    for (u32 y = 0; y < TEXTURE_SIZE; y++)
+    {
+        for (u32 x = 0; x < TEXTURE_SIZE; x++)
+        {
+            f32 u = (x + 0.5f) / TEXTURE_SIZE;
+            f32 v = (y + 0.5f) / TEXTURE_SIZE;
+            u32 texel;
+
+            if (layer % 2 == 0)
+            {
+                // Latitude/longitude grid, 24 x 12 cells
+                f32 cu = u * 24.0f - floorf(u * 24.0f);
+                f32 cv = v * 12.0f - floorf(v * 12.0f);
+                b32 odd = ((u32)(u * 24.0f) + (u32)(v * 12.0f)) & 1;
+
+                if (cu < 0.06f || cv < 0.06f)
+                    texel = texture_pack(0.05f, 0.05f, 0.08f);
+                else
+                    texel = odd ? texture_pack(0.15f, 0.35f, 0.8f) : texture_pack(0.9f, 0.85f, 0.6f);
+            }
+            else
+            {
+                // Running bond bricks, 32 around u and 16 rows along v
+                f32 row = v * 16.0f;
+                f32 col = u * 32.0f + (((u32)row & 1) ? 0.5f : 0.0f);
+                f32 fr = row - floorf(row);
+                f32 fc = col - floorf(col);
+                f32 shade = 0.8f + 0.2f * m_randf((u32)row * 64 + (u32)col);
+
+                if (fr < 0.1f || fc < 0.05f)
+                    texel = texture_pack(0.55f, 0.55f, 0.5f);
+                else
+                    texel = texture_pack(0.6f * shade, 0.22f * shade, 0.12f * shade);
+            }
+            level[(usize)y * TEXTURE_SIZE + x] = texel;
+        }
+    }
+}
+
+// Each level averages 2x2 texels of the one above it
+internal void
+texture_build_mips(u32 *texels)
+{
+    for (u32 l = 1; l < TEXTURE_LEVELS; l++)
+    {
+        u32 *src = texels + texture_level_offset(l - 1);
+        u32 *dst = texels + texture_level_offset(l);
+        u32 size = TEXTURE_SIZE >> l;
+
+        for (u32 y = 0; y < size; y++)
+        {
+            for (u32 x = 0; x < size; x++)
+            {
+                f32 sum[3] = {0.0f, 0.0f, 0.0f};
+
+                for (u32 k = 0; k < 4; k++)
+                {
+                    f32 c[3];
+
+                    texture_unpack(src[(usize)(y * 2 + k / 2) * size * 2 + x * 2 + k % 2], c);
+                    sum[0] += c[0];
+                    sum[1] += c[1];
+                    sum[2] += c[2];
+                }
+                dst[(usize)y * size + x] = texture_pack(sum[0] * 0.25f, sum[1] * 0.25f, sum[2] * 0.25f);
+            }
+        }
+    }
+}
+
+internal void
+texture_load_layer(texture_set_t *set,
+                   u32 layer,
+                   const char *path)
+{
+    u32 *pixels;
+    u32 width,
+        height;
+
+
+    set->texels[layer] = (u32 *)malloc(texture_level_offset(TEXTURE_LEVELS) * sizeof(u32));
+
+    if (path && texture_decode(path, &pixels, &width, &height))
+    {
+        texture_resample(pixels, width, height, set->texels[layer]);
+        free(pixels);
+        printf("texture %u: %s, %ux%u\n", layer, path, width, height);
+    }
+    else
+    {
+        texture_procedural(layer, set->texels[layer]);
+    }
+    texture_build_mips(set->texels[layer]);
+}
+
+internal void
+texture_worker(texture_job_t *job)
+{
+    u32 layer;
+
+    while ((layer = job->next++) < job->num_layers)
+        texture_load_layer(job->set, layer, job->paths[layer]);
+}
+
+// Layers are handed out one at a time, so a big image doesn't hold up the rest
+void
+texture_set_load(texture_set_t *set,
+                 const char **paths,
+                 u32 num_layers,
+                 u32 num_threads)
+{
+    texture_job_t   job;
+    std::thread     threads[TEXTURE_MAX_THREADS];
+    f64             start = texture_now();
+
+
+    memset(set, 0, sizeof(*set));
+    if (num_layers > TEXTURE_MAX_LAYERS)
+        num_layers = TEXTURE_MAX_LAYERS;
+    set->num_layers = num_layers;
+
+    for (u32 i = 0; i < 256; i++)
+    {
+        f32 c = i / 255.0f;
+
+        texture_srgb_table[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    if (!num_threads)
+        num_threads = std::thread::hardware_concurrency();
+    if (!num_threads)
+        num_threads = 1;
+    if (num_threads > TEXTURE_MAX_THREADS)
+        num_threads = TEXTURE_MAX_THREADS;
+    if (num_threads > num_layers)
+        num_threads = num_layers ? num_layers : 1;
+
+    job.set = set;
+    job.paths = paths;
+    job.num_layers = num_layers;
+    job.next = 0;
+
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i] = std::thread(texture_worker, &job);
+    texture_worker(&job);
+    for (u32 i = 1; i < num_threads; i++)
+        threads[i].join();
+
+    printf("textures: %u layers of %u^2 in %.2f s on %u threads\n",
+           num_layers, TEXTURE_SIZE, texture_now() - start, num_threads);
+}
+
+void
+texture_set_free(texture_set_t *set)
+{
+    for (u32 i = 0; i < set->num_layers; i++)
+        free(set->texels[i]);
+    memset(set, 0, sizeof(*set));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// SAMPLING
+
+// Texture space width of the cone's footprint, in level 0 texels
+f32
+texture_lod(f32 cone_width,
+            f32 uv_density,
+            f32 cosine)
+{
+    f32 c = fabsf(cosine);
+    f32 footprint = cone_width * uv_density * TEXTURE_SIZE / (c > TEXTURE_MIN_COSINE ? c : TEXTURE_MIN_COSINE);
+
+    return footprint > 1.0f ? log2f(footprint) : 0.0f;
+}
+
+internal void
+texture_bilinear(u32 *texels,
+                 u32 size,
+                 f32 u,
+                 f32 v,
+                 f32 *c)
+{
+    f32 x = u * size - 0.5f;
+    f32 y = v * size - 0.5f;
+    f32 fx = floorf(x);
+    f32 fy = floorf(y);
+    f32 wx = x - fx;
+    f32 wy = y - fy;
+    u32 x0 = (u32)(s32)fx & (size - 1);
+    u32 y0 = (u32)(s32)fy & (size - 1);
+    u32 x1 = (x0 + 1) & (size - 1);
+    u32 y1 = (y0 + 1) & (size - 1);
+    f32 c00[3], c10[3], c01[3], c11[3];
+
+
+    texture_unpack(texels[(usize)y0 * size + x0], c00);
+    texture_unpack(texels[(usize)y0 * size + x1], c10);
+    texture_unpack(texels[(usize)y1 * size + x0], c01);
+    texture_unpack(texels[(usize)y1 * size + x1], c11);
+    for (u32 k = 0; k < 3; k++)
+        c[k] = (c00[k] * (1.0f - wx) + c10[k] * wx) * (1.0f - wy)
+             + (c01[k] * (1.0f - wx) + c11[k] * wx) * wy;
+}
+
+// Linear colour, like a GL_SRGB8_ALPHA8 array with GL_LINEAR_MIPMAP_LINEAR
+vec3_t
+texture_sample(texture_set_t *set,
+               u32 layer,
+               f32 u,
+               f32 v,
+               f32 lod)
+{
+    u32 *texels = set->texels[layer];
+    u32 level;
+    f32 w;
+    f32 a[3],
+        b[3] = {0.0f, 0.0f, 0.0f};
+    vec3_t color;
+
+
+    u -= floorf(u);
+    v -= floorf(v);
+    lod = (lod < 0.0f) ? 0.0f : (lod > TEXTURE_LEVELS - 1) ? (f32)(TEXTURE_LEVELS - 1) : lod;
+    level = (u32)lod;
+    w = lod - level;
+
+    texture_bilinear(texels + texture_level_offset(level), TEXTURE_SIZE >> level, u, v, a);
+    if (w > 0.0f)
+        texture_bilinear(texels + texture_level_offset(level + 1), TEXTURE_SIZE >> (level + 1), u, v, b);
+
+    color.x = a[0] + (b[0] - a[0]) * w;
+    color.y = a[1] + (b[1] - a[1]) * w;
+    color.z = a[2] + (b[2] - a[2]) * w;
+
+    return color;
+}
+
+#endif // TEXTURE_IMPL
+
+#endif // TEXTURE_H
@@ -0,0 +1,234 @@
+#ifndef TLAS_H
+#define TLAS_H
+
+// Two level acceleration structure. Bottom level structures (BLAS) are
+// meshes with their own BVH in object space; the top level is a BVH over
+// instances, each a transform plus the BLAS it places. Any number of
+// instances share one copy of the geometry.
+//
+// Moving instances only needs tlas_set_transform() and tlas_refit(), which
+// keeps the top level topology and just recomputes its bounds. For the
+// kernels all BLAS are packed into one set of mesh buffers with
+// tlas_pack(); the instances then carry the root node of their BLAS.
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "types.h"
+#include "mmath.h"
+#include "bvh.h"
+#include "mesh.h"
+
+typedef struct _TAG_tlas_instance
+{
+    mat4_t  world_to_object;    // rays go to object space, normals come back with its transpose
+    u32     blas;
+    u32     material;
+    u32     root;               // first node of the BLAS in the packed buffers
+    u32     pad;
+} tlas_instance_t;
+
+typedef struct _TAG_tlas
+{
+    mesh_t              **blas;         // not owned
+    u32                 num_blas;
+
+    tlas_instance_t     *instances;
+    mat4_t              *object_to_world;
+    bvh_aabb_t          *bounds;        // world space box of every instance
+    u32                 num_instances;
+    u32                 capacity;
+
+    bvh_t               bvh;            // over bounds
+} tlas_t;
+
+void        tlas_init(tlas_t *tlas);
+void        tlas_free(tlas_t *tlas);
+u32         tlas_add_blas(tlas_t *tlas, mesh_t *mesh);
+u32         tlas_add_instance(tlas_t *tlas, u32 blas, mat4_t object_to_world, u32 material);
+void        tlas_set_transform(tlas_t *tlas, u32 instance, mat4_t object_to_world);
+void        tlas_build(tlas_t *tlas);
+void        tlas_refit(tlas_t *tlas);
+void        tlas_pack(tlas_t *tlas, mesh_t *packed);
+void        tlas_leaf_order(tlas_t *tlas, tlas_instance_t *out);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== TLAS IMPLEMENTATION ================================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef TLAS_IMPL
+
+void
+tlas_init(tlas_t *tlas)
+{
+    memset(tlas, 0, sizeof(*tlas));
+}
+
+void
+tlas_free(tlas_t *tlas)
+{
+    free(tlas->blas);
+    free(tlas->instances);
+    free(tlas->object_to_world);
+    free(tlas->bounds);
+    bvh_free(&tlas->bvh);
+    tlas_init(tlas);
+}
+
+u32
+tlas_add_blas(tlas_t *tlas,
+              mesh_t *mesh)
+{
+    tlas->blas = (mesh_t **)realloc(tlas->blas, (tlas->num_blas + 1) * sizeof(mesh_t *));
+    tlas->blas[tlas->num_blas] = mesh;
+
+    return tlas->num_blas++;
+}
+
+u32
+tlas_add_instance(tlas_t *tlas,
+                  u32 blas,
+                  mat4_t object_to_world,
+                  u32 material)
+{
+    u32 i = tlas->num_instances;
+
+    if (i == tlas->capacity)
+    {
+        tlas->capacity = tlas->capacity ? tlas->capacity * 2 : 64;
+        tlas->instances = (tlas_instance_t *)realloc(tlas->instances,
+            tlas->capacity * sizeof(tlas_instance_t));
+        tlas->object_to_world = (mat4_t *)realloc(tlas->object_to_world,
+            tlas->capacity * sizeof(mat4_t));
+        tlas->bounds = (bvh_aabb_t *)realloc(tlas->bounds,
+            tlas->capacity * sizeof(bvh_aabb_t));
+    }
+
+    memset(&tlas->instances[i], 0, sizeof(tlas_instance_t));
+    tlas->instances[i].blas = blas;
+    tlas->instances[i].material = material;
+    tlas->num_instances++;
+    tlas_set_transform(tlas, i, object_to_world);
+
+    return i;
+}
+
+void
+tlas_set_transform(tlas_t *tlas,
+                   u32 instance,
+                   mat4_t object_to_world)
+{
+    tlas->object_to_world[instance] = object_to_world;
+    tlas->instances[instance].world_to_object = mat4_inverse(object_to_world);
+}
+
+// World box of an instance: the 8 corners of its BLAS root box, transformed
+internal void
+tlas_instance_bounds(tlas_t *tlas,
+                     u32 instance)
+{
+    bvh_node_t  *root = &tlas->blas[tlas->instances[instance].blas]->bvh.nodes[0];
+    bvh_aabb_t  *box = &tlas->bounds[instance];
+
+
+    bvh_aabb_empty(box);
+    for (u32 c = 0; c < 8; c++)
+    {
+        vec4_t corner = vec4_make((c & 1) ? root->max[0] : root->min[0],
+                                  (c & 2) ? root->max[1] : root->min[1],
+                                  (c & 4) ? root->max[2] : root->min[2],
+                                  1.0f);
+        vec4_t p = mat4_mult_vec4(tlas->object_to_world[instance], corner);
+
+        bvh_aabb_grow(box, &p.x, &p.x);
+    }
+}
+
+void
+tlas_build(tlas_t *tlas)
+{
+    for (u32 i = 0; i < tlas->num_instances; i++)
+        tlas_instance_bounds(tlas, i);
+
+    bvh_free(&tlas->bvh);
+    bvh_build(&tlas->bvh, tlas->bounds, tlas->num_instances, 0);
+}
+
+// After tlas_set_transform(). Much cheaper than a rebuild, but the tree
+// degrades if instances move far; rebuild once in a while for that.
+void
+tlas_refit(tlas_t *tlas)
+{
+    for (u32 i = 0; i < tlas->num_instances; i++)
+        tlas_instance_bounds(tlas, i);
+
+    bvh_refit(&tlas->bvh, tlas->bounds);
+}
+
+// Concatenates every BLAS into one mesh for upload: indices are offset to
+// the packed vertices, and in the compressed BVHs leaf children to the
+// packed triangles and inner children to the packed nodes. BLAS 0 lands at
+// offset 0, so its buffers double as the single mesh ones. Sets the root of
+// every instance.
+void
+tlas_pack(tlas_t *tlas,
+          mesh_t *packed)
+{
+    u32 *roots = (u32 *)malloc((tlas->num_blas + 1) * sizeof(u32));
+    u32 vertex_base = 0,
+        tri_base = 0,
+        node_base = 0;
+
+
+    memset(packed, 0, sizeof(*packed));
+    for (u32 b = 0; b < tlas->num_blas; b++)
+    {
+        packed->num_vertices += tlas->blas[b]->num_vertices;
+        packed->num_triangles += tlas->blas[b]->num_triangles;
+        packed->bvh4.num_nodes += tlas->blas[b]->bvh4.num_nodes;
+    }
+    packed->vertices = (mesh_vertex_t *)malloc(((usize)packed->num_vertices + 1) * sizeof(mesh_vertex_t));
+    packed->indices = (u32 *)malloc(((usize)packed->num_triangles * 3 + 1) * sizeof(u32));
+    packed->bvh4.nodes = (bvh4_node_t *)malloc(((usize)packed->bvh4.num_nodes + 1) * sizeof(bvh4_node_t));
+    packed->bvh4.capacity = packed->bvh4.num_nodes + 1;
+
+    for (u32 b = 0; b < tlas->num_blas; b++)
+    {
+        mesh_t *mesh = tlas->blas[b];
+
+        memcpy(packed->vertices + vertex_base, mesh->vertices, mesh->num_vertices * sizeof(mesh_vertex_t));
+        for (u32 i = 0; i < mesh->num_triangles * 3; i++)
+            packed->indices[tri_base * 3 + i] = mesh->indices[i] + vertex_base;
+        for (u32 i = 0; i < mesh->bvh4.num_nodes; i++)
+        {
+            bvh4_node_t node = mesh->bvh4.nodes[i];
+            for (u32 c = 0; c < node.num_children; c++)
+                node.child[c] += node.count[c] ? tri_base : node_base;
+            packed->bvh4.nodes[node_base + i] = node;
+        }
+
+        roots[b] = node_base;
+        vertex_base += mesh->num_vertices;
+        tri_base += mesh->num_triangles;
+        node_base += mesh->bvh4.num_nodes;
+    }
+
+    for (u32 i = 0; i < tlas->num_instances; i++)
+        tlas->instances[i].root = roots[tlas->instances[i].blas];
+
+    free(roots);
+}
+
+// The instances in BVH leaf order, so the kernels can index them straight
+// from the leaves. Instance indices on the host stay stable.
+void
+tlas_leaf_order(tlas_t *tlas,
+                tlas_instance_t *out)
+{
+    for (u32 i = 0; i < tlas->num_instances; i++)
+        out[i] = tlas->instances[tlas->bvh.prims[i]];
+}
+
+#endif // TLAS_IMPL
+
+#endif // TLAS_H
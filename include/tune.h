@@ -0,0 +1,220 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+// Workgroup shapes of the path tracing kernels. A kernel is compiled for a
+// shape through the defines tune_defines() writes, which
+// src/shaders/lib/group.glsl reads; without them it is 16x16, one group per
+// tile of the image. A shape with `groups` is persistent instead: that many
+// groups are launched and take tiles off the queue at TUNE_QUEUE_BINDING
+// in the shape's `order` (curve.h) until it runs dry. The best shape
+// depends on the device and the scene, so --tune-workgroups times every
+// shape in tune_shapes[] per scene and saves the fastest to a config file,
+// which later launches read with tune_load():
+//
+//     <scene> <width> <height> <morton> <groups> <order> <GL_RENDERER string>
+//
+// one line per scene and device, so one file serves several GPUs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "curve.h"
+
+#define TUNE_NUM_SHAPES     14
+#define TUNE_DEFINES_SIZE   160
+#define TUNE_MAX_GROUPS     65535   // of a one dimensional dispatch
+#define TUNE_QUEUE_BINDING  19      // tiles taken by a persistent dispatch
+#define TUNE_LINE_SIZE      256
+#define TUNE_SAMPLES        2       // per pixel and timed dispatch
+#define TUNE_RUNS           3       // timed dispatches per shape, the fastest counts
+
+typedef struct _TAG_tune_shape
+{
+    u32 width;
+    u32 height;
+    b32 morton;         // invocations walk the group in Morton order
+    u32 groups;         // resident groups of a persistent kernel, 0 for a grid
+    u32 order;          // CURVE_* the persistent groups take their tiles in
+} tune_shape_t;
+
+// Row major first, so ties keep the old 16x16
+internal const tune_shape_t tune_shapes[TUNE_NUM_SHAPES] =
+{
+    { 16, 16, FALSE, 0, CURVE_ROWS }, { 8, 8, FALSE, 0, CURVE_ROWS }, { 16, 8, FALSE, 0, CURVE_ROWS },
+    { 32, 4, FALSE, 0, CURVE_ROWS }, { 64, 1, FALSE, 0, CURVE_ROWS },
+    { 16, 16, TRUE, 0, CURVE_ROWS }, { 8, 8, TRUE, 0, CURVE_ROWS }, { 16, 8, TRUE, 0, CURVE_ROWS },
+    { 16, 16, FALSE, 64, CURVE_ROWS }, { 16, 16, FALSE, 256, CURVE_ROWS }, { 16, 16, FALSE, 256, CURVE_HILBERT },
+    { 8, 8, TRUE, 256, CURVE_ROWS }, { 8, 8, TRUE, 1024, CURVE_ROWS }, { 8, 8, TRUE, 1024, CURVE_HILBERT }
+};
+
+u32         tune_defines(tune_shape_t shape, char *text, u32 capacity);
+void        tune_default(tune_shape_t *shapes, u32 num_scenes);
+u32         tune_load(const char *path, const char *device, tune_shape_t *shapes, u32 num_scenes);
+b32         tune_save(const char *path, const char *device, const tune_shape_t *shapes, u32 num_scenes);
+
+////////////////////////////////////////////////////////////////////////////////
+// ====== TUNE IMPLEMENTATION ================================================/
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef TUNE_IMPL
+
+// GROUP_WIDTH, GROUP_HEIGHT, GROUP_MORTON, GROUP_PERSISTENT and
+// GROUP_ORDER; returns the length of the text, 0 if it didn't fit
+u32
+tune_defines(tune_shape_t shape,
+             char *text,
+             u32 capacity)
+{
+    s32 len = snprintf(text, capacity,
+                       "#define GROUP_WIDTH     %u\n"
+                       "#define GROUP_HEIGHT    %u\n"
+                       "#define GROUP_MORTON    %u\n"
+                       "#define GROUP_PERSISTENT    %u\n"
+                       "#define GROUP_ORDER         %u\n",
+                       shape.width, shape.height, shape.morton ? 1 : 0, shape.groups ? 1 : 0, shape.order);
+
+
+    return (len > 0 && (u32)len < capacity) ? (u32)len : 0;
+}
+
+void
+tune_default(tune_shape_t *shapes,
+             u32 num_scenes)
+{
+    for (u32 i = 0; i < num_scenes; i++)
+        shapes[i] = tune_shapes[0];
+}
+
+internal b32
+tune_valid(tune_shape_t shape)
+{
+    u32 size = shape.width * shape.height;
+
+
+    return shape.width > 0 && shape.height > 0 &&
+           (shape.width & (shape.width - 1)) == 0 &&
+           (shape.height & (shape.height - 1)) == 0 &&
+           size >= 32 && size <= 1024 && shape.groups <= TUNE_MAX_GROUPS &&
+           shape.order < CURVE_COUNT;
+}
+
+// Splits a config line; FALSE for comments and lines that don't parse
+internal b32
+tune_parse(const char *line,
+           u32 *scene,
+           tune_shape_t *shape,
+           const char **device)
+{
+    u32 morton;
+    s32 consumed = 0;
+
+
+    if (sscanf(line, "%u %u %u %u %u %u %n", scene, &shape->width, &shape->height, &morton, &shape->groups,
+               &shape->order, &consumed) != 6 ||
+        consumed == 0)
+        return FALSE;
+    shape->morton = morton != 0;
+    *device = line + consumed;
+
+    return TRUE;
+}
+
+// Overwrites the shapes of the scenes `path` has for `device`, leaving the
+// others alone. Returns how many it found.
+u32
+tune_load(const char *path,
+          const char *device,
+          tune_shape_t *shapes,
+          u32 num_scenes)
+{
+    FILE            *fptr;
+    char            line[TUNE_LINE_SIZE];
+    u32             found = 0;
+
+
+    fptr = fopen(path, "r");
+    if (!fptr)
+        return 0;
+
+    while (fgets(line, sizeof(line), fptr))
+    {
+        u32             scene;
+        tune_shape_t    shape;
+        const char      *line_device;
+
+
+        line[strcspn(line, "\r\n")] = 0;
+        if (!tune_parse(line, &scene, &shape, &line_device) ||
+            strcmp(line_device, device) || scene >= num_scenes || !tune_valid(shape))
+            continue;
+        shapes[scene] = shape;
+        found++;
+    }
+    fclose(fptr);
+
+    return found;
+}
+
+// Replaces `device`'s lines in `path` by `shapes`, keeping other devices'
+b32
+tune_save(const char *path,
+          const char *device,
+          const tune_shape_t *shapes,
+          u32 num_scenes)
+{
+    FILE        *fptr;
+    char        line[TUNE_LINE_SIZE];
+    char        *kept = NULL;
+    u32         kept_len = 0;
+
+
+    fptr = fopen(path, "r");
+    if (fptr)
+    {
+        while (fgets(line, sizeof(line), fptr))
+        {
+            u32             scene;
+            tune_shape_t    shape;
+            const char      *line_device;
+            char            trimmed[TUNE_LINE_SIZE];
+            u32             len;
+
+
+            strcpy(trimmed, line);
+            trimmed[strcspn(trimmed, "\r\n")] = 0;
+            if (tune_parse(trimmed, &scene, &shape, &line_device) && !strcmp(line_device, device))
+                continue;
+
+            len = (u32)strlen(line);
+            kept = (char *)realloc(kept, kept_len + len + 1);
+            memcpy(kept + kept_len, line, len + 1);
+            kept_len += len;
+        }
+        fclose(fptr);
+    }
+
+    fptr = fopen(path, "w");
+    if (!fptr)
+    {
+        printf("couldn't write %s\n", path);
+        free(kept);
+        return FALSE;
+    }
+
+    if (kept_len)
+        fwrite(kept, 1, kept_len, fptr);
+    else
+        fprintf(fptr, "# scene width height morton groups order device, written by --tune-workgroups\n");
+    for (u32 i = 0; i < num_scenes; i++)
+        fprintf(fptr, "%u %u %u %u %u %u %s\n", i, shapes[i].width, shapes[i].height, shapes[i].morton ? 1 : 0,
+                shapes[i].groups, shapes[i].order, device);
+    fclose(fptr);
+    free(kept);
+
+    return TRUE;
+}
+
+#endif // TUNE_IMPL
+
+#endif // TUNE_H
@@ -3,6 +3,8 @@
 #include <glfw3.h>
 #define MMATH_IMPL
 #include <mmath.h>
+#define MMATH_BENCH_IMPL
+#include <mmath_bench.h>
 #include "..\inc\gl_loadshader.hpp"
 #define NK_INCLUDE_FIXED_TYPES
 #define NK_INCLUDE_STANDARD_IO
@@ -16,18 +18,98 @@
 #define NK_KEYSTATE_BASED_INPUT
 #include <nuklear.h>
 #include <nuklear_glfw_gl3.h>
+#define DISTRIB_IMPL
+#include <distrib.h>
+#define SCHED_IMPL
+#include <scheduler.h>
+#define RENDER_QUEUE_IMPL
+#include <render_queue.h>
+#define BVH_IMPL
+#include <bvh.h>
+#define LBVH_IMPL
+#include <lbvh.h>
+#define BVH4_IMPL
+#include <bvh4.h>
+#define MESH_IMPL
+#include <mesh.h>
+#define TLAS_IMPL
+#include <tlas.h>
+#define TEXTURE_IMPL
+#include <texture.h>
+#define ENVMAP_IMPL
+#include <envmap.h>
+#define SCENE_IMPL
+#include <scene.h>
+#define CURVE_IMPL
+#include <curve.h>
+#define CPU_RENDER_IMPL
+#include <cpu_render.h>
+#define CPU_RENDER_BENCH_IMPL
+#include <cpu_render_bench.h>
+#define LBVH_BENCH_IMPL
+#include <lbvh_bench.h>
+#define PACKED_IMPL
+#include <packed.h>
+#define PACKED_BENCH_IMPL
+#include <packed_bench.h>
+#define TUNE_IMPL
+#include <tune.h>
+#define PACING_IMPL
+#include <pacing.h>
+#define INPUT_IMPL
+#include <input.h>
+#define RAY_STATS_IMPL
+#include <ray_stats.h>
+#include <thread>
+#include <chrono>
 
 #define SCR_WIDTH   1600
 #define SCR_HEIGHT  900
 #define MAX_VERTEX_BUFFER 512 * 1024
 #define MAX_ELEMENT_BUFFER 128 * 1024
 #define UNREFERENCED_PARAMETER(__x)	__x
+#define NUM_SCENES  12
+#define GEOMETRY_BUFFERS 11  // mesh nodes, vertices, indices, TLAS nodes, instances,
+                             // cloud spheres, cloud materials, material table,
+                             // environment texels and CDFs, work queue
+#define MATERIAL_TABLE  7
+#define ENVMAP_TEXELS   8
+#define ENVMAP_CDF      9
+#define WORK_QUEUE      10
+#define ALBEDO_TEXTURE_UNIT 1   // unit 0 is the present pass'
+#define SCENE_TEXTURES  2       // ball and mesh of the mesh scene
+#define CLOUD_PER_SIDE 1024
+#define PROGRAM_CACHE_PATH "shaders.cache"     // linked kernels, next to the binary
+#define TUNE_CONFIG_PATH "workgroups.cfg"       // workgroup shape per device and scene
+#define CLOUD_SCENE 11
+#define BENCH_RAYS_SAMPLES 4    // per pixel of a --bench-rays dispatch
+#define IDLE_TIMEOUT 0.1    // seconds between checks on an idle window while a render is in flight
 
 void framebuffer_size_callback(GLFWwindow *window, s32 width, s32 height);
 void mouse_callback(GLFWwindow *window, f64 x_pos, f64 y_pos);
-void process_input(GLFWwindow *window, f32 delta_time);
+void key_callback(GLFWwindow *window, s32 key, s32 scancode, s32 action, s32 mods);
+void refresh_callback(GLFWwindow *window);
+void ui_scroll_callback(GLFWwindow *window, f64 x_offset, f64 y_offset);
+void ui_char_callback(GLFWwindow *window, u32 codepoint);
+void ui_mouse_button_callback(GLFWwindow *window, s32 button, s32 action, s32 mods);
+void pump_events(f64 seconds);
+b32 process_input(GLFWwindow *window);
 /* u32 load_shader(const char *cs_path); */
 void reset_camera(void);
+void dispatch_tile(u32 program, u32 groups, mat4_t view, mat4_t proj, vec2_t resolution,
+                   u32 tile_samples, u32 sample_base, u32 seed,
+                   s32 x, s32 y, s32 w, s32 h);
+s32 run_worker(const char *address, u32 *shaders, tune_shape_t *shapes, u32 texture);
+void upload_geometry(mesh_t *packed, tlas_t *tlas, scene_cloud_t *cloud, envmap_t *environment,
+                     u32 *buffers, u32 *material_bases);
+u32 upload_textures(texture_set_t *set);
+u32 load_scene_kernel(u32 index, tune_shape_t shape, b32 stats);
+void set_kernel_constants(u32 program, u32 material_base, envmap_t *environment);
+b32 persistent_complete(u32 program, tune_shape_t shape, s32 w, s32 h);
+void tune_workgroups(const char *device, u32 *material_bases, envmap_t *environment);
+void bench_rays(tune_shape_t *shapes, u32 *material_bases, envmap_t *environment);
+void bind_geometry(u32 *buffers, u32 lbvh_nodes, u32 albedo_textures);
+void animate_cloud(u32 program, u32 spheres, u32 *motion, u32 num_spheres, f32 time);
 
 struct camera_t
 {
@@ -36,16 +118,187 @@ struct camera_t
     vec3_t up;
 };
 
+// State shared between the UI thread and the render thread. The render
+// thread owns its own (shared) GL context and accumulates into
+// accum_texture; finished frames are copied into one of the mailbox targets
+// for the UI thread to present.
+struct render_shared_t
+{
+    GLFWwindow          *context;
+    u32                 accum_texture;
+    u32                 targets[MAILBOX_SLOTS];
+    GLsync              fences[MAILBOX_SLOTS];      // render -> UI, the copy into the slot is done
+    GLsync              ui_fences[MAILBOX_SLOTS];   // UI -> render, the draw from the slot is done
+    snapshot_queue_t    queue;
+    frame_mailbox_t     mailbox;
+    std::atomic<u32>    running;
+    std::atomic<f32>    budget_ms;
+    std::atomic<f32>    progress;
+    mesh_t              *mesh;
+    tlas_t              *tlas;
+    scene_cloud_t       *cloud;
+    texture_set_t       *textures;
+    envmap_t            *environment;   // NULL without --env
+    u32                 geometry_buffers[GEOMETRY_BUFFERS];
+    u32                 albedo_textures;
+    lbvh_t              *lbvh;
+    u32                 cloud_animate;
+    u32                 cloud_motion[2];
+    u32                 cpu_order;      // CURVE_* of the CPU backend's tiles
+    b32                 ray_stats;      // the kernels count, see ray_stats.h
+    std::atomic<u64>    ray_counts[STAT_COUNT];
+    std::atomic<f64>    rays_per_second;
+};
+
+void render_thread_main(render_shared_t *shared);
+
 camera_t cam;
 vec2_t window_size = {SCR_WIDTH, SCR_HEIGHT};
 u32 samples = 1;
 b32 sample_change = TRUE;
 b32 nuklear_control;
 f32 cam_speed = 5.0f;
+f32 gpu_budget_ms = 8.0f;
+b32 cpu_backend = FALSE;
+b32 animate = FALSE;
+f32 anim_time = 0.0f;
+b32 redraw = TRUE;      // an event came in since the last drawn frame
+input_queue_t key_events;
 
 int
-main()
+main(int argc,
+     char **argv)
 {
+    /////////////////////////////////////////////////////////////////////////
+    // COMMAND LINE
+    //
+    // --coordinator <addr> [--spawn <n>]   render through worker processes
+    // --worker <addr>                      headless worker for a coordinator
+    // --bench-math                         mmath SIMD microbenchmarks
+    // --bench-cpu                          CPU backend ray throughput
+    // --bench-lbvh                         GPU LBVH build time
+    // --bench-packed                       packed ray/hit formats, CPU and GPU
+    // --bench-rays                         every scene's kernel: Mrays/s and
+    //                                      what its rays do
+    // --validate-shaders                   compile every shader from source,
+    //                                      exit 1 on errors (for the build)
+    // --tune-workgroups                    time the kernels' workgroup shapes
+    //                                      and keep the fastest per scene
+    // --persistent <groups>                persistent kernels of that many
+    //                                      workgroups for every scene, 0 for
+    //                                      grid dispatches
+    // --order <rows|morton|hilbert>        order of the CPU backend's tiles
+    //                                      and the persistent kernels'
+    // --ray-stats                          kernels count their rays, tests
+    //                                      and path ends for the overlay
+    // --present <uncapped|vsync|capped|display>
+    //                                      how the window presents, see
+    //                                      pacing.h (default uncapped)
+    // --fps <n>                            frame rate of capped presents,
+    //                                      selects capped without --present
+    // --obj <path>                         mesh for the mesh scene
+    // --texture <path>                     PPM/TGA albedo for the mesh scene,
+    //                                      first the ball's, then the mesh's
+    // --env <path>                         Radiance .hdr sky for the outdoor
+    //                                      scenes, a procedural one if it
+    //                                      can't be read
+    //
+    // <addr> is host:port or unix:/path. Workers need the same --obj,
+    // --texture and --env as their coordinator.
+
+    const char *coordinator_address = NULL;
+    const char *worker_address = NULL;
+    const char *obj_path = NULL;
+    const char *env_path = NULL;
+    const char *texture_paths[TEXTURE_MAX_LAYERS] = {0};
+    u32 num_textures = 0;
+    u32 spawn_count = 0;
+    b32 bench_lbvh = FALSE;
+    b32 bench_packed = FALSE;
+    b32 validate_shaders = FALSE;
+    b32 tune_groups = FALSE;
+    b32 bench_ray_stats = FALSE;
+    b32 ray_stats = FALSE;
+    s32 persistent_groups = -1;     // as tuned
+    u32 order = CURVE_COUNT;        // CPU_DEFAULT_ORDER, kernels as tuned
+    u32 present_mode = PACE_COUNT;  // uncapped, capped with --fps
+    u32 present_fps = 0;
+
+    for (s32 i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--coordinator") && i + 1 < argc)
+            coordinator_address = argv[++i];
+        else if (!strcmp(argv[i], "--worker") && i + 1 < argc)
+            worker_address = argv[++i];
+        else if (!strcmp(argv[i], "--spawn") && i + 1 < argc)
+            spawn_count = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--obj") && i + 1 < argc)
+            obj_path = argv[++i];
+        else if (!strcmp(argv[i], "--persistent") && i + 1 < argc)
+            persistent_groups = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--order") && i + 1 < argc)
+        {
+            i++;
+            for (order = 0; order < CURVE_COUNT && strcmp(argv[i], curve_names[order]); order++)
+                ;
+            if (order == CURVE_COUNT)
+                printf("unknown order %s, keeping the defaults\n", argv[i]);
+        }
+        else if (!strcmp(argv[i], "--present") && i + 1 < argc)
+        {
+            i++;
+            for (present_mode = 0; present_mode < PACE_COUNT && strcmp(argv[i], pace_names[present_mode]);
+                 present_mode++)
+                ;
+            if (present_mode == PACE_COUNT)
+                printf("unknown present mode %s, ignoring it\n", argv[i]);
+        }
+        else if (!strcmp(argv[i], "--fps") && i + 1 < argc)
+            present_fps = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--env") && i + 1 < argc)
+            env_path = argv[++i];
+        else if (!strcmp(argv[i], "--texture") && i + 1 < argc)
+        {
+            if (num_textures < TEXTURE_MAX_LAYERS)
+                texture_paths[num_textures++] = argv[i + 1];
+            i++;
+        }
+        else if (!strcmp(argv[i], "--bench-math"))
+        {
+            mmath_bench();
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--bench-cpu"))
+        {
+            cpu_render_bench();
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--bench-lbvh"))
+        {
+            bench_lbvh = TRUE;
+        }
+        else if (!strcmp(argv[i], "--bench-rays"))
+        {
+            bench_ray_stats = TRUE;
+        }
+        else if (!strcmp(argv[i], "--ray-stats"))
+        {
+            ray_stats = TRUE;
+        }
+        else if (!strcmp(argv[i], "--bench-packed"))
+        {
+            bench_packed = TRUE;
+        }
+        else if (!strcmp(argv[i], "--validate-shaders"))
+        {
+            validate_shaders = TRUE;
+        }
+        else if (!strcmp(argv[i], "--tune-workgroups"))
+        {
+            tune_groups = TRUE;
+        }
+    }
+
     /////////////////////////////////////////////////////////////////////////
     // GLFW SETUP
 
@@ -53,6 +306,7 @@ main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, (worker_address || validate_shaders) ? GLFW_FALSE : GLFW_TRUE);
 
 	GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "test", NULL, NULL);
     if (!window)
@@ -62,9 +316,21 @@ main()
         return -1;
     }
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(0);
+
+    // The display's refresh rate sizes the render thread's slices in display
+    // mode; a hidden window (workers, validation) never presents
+    frame_pacer_t pacer;
+    const GLFWvidmode *video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+
+    if (present_mode == PACE_COUNT)
+        present_mode = present_fps ? PACE_CAPPED : PACE_UNCAPPED;
+    pace_init(&pacer, present_mode, present_fps, video_mode ? video_mode->refreshRate : 0.0);
+    glfwSwapInterval(pace_swap_interval(&pacer));
     glfwSetFramebufferSizeCallback(window, &framebuffer_size_callback);
     glfwSetCursorPosCallback(window, &mouse_callback);
+    input_init(&key_events);
+    glfwSetKeyCallback(window, &key_callback);
+    glfwSetWindowRefreshCallback(window, &refresh_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -74,22 +340,89 @@ main()
         return -1;
     }
 
+    // Needs a context but none of the scenes
+    if (bench_packed)
+    {
+        u32 packed_check = load_shader("..\\src\\shaders\\packed_check.comp");
+
+        free_source_cache();
+        packed_bench(packed_check);
+        glDeleteProgram(packed_check);
+        glfwTerminate();
+        return 0;
+    }
+
     /////////////////////////////////////////////////////////////////////////
     // SHADER SETUP
 
+    // Validation compiles everything, the cache would skip it
+    if (!validate_shaders)
+        load_program_cache(PROGRAM_CACHE_PATH);
+
+    // Workgroup shapes this device was tuned to, 16x16 for the rest
+    const char *device = (const char *)glGetString(GL_RENDERER);
+    tune_shape_t group_shapes[NUM_SCENES];
+    tune_default(group_shapes, NUM_SCENES);
+    tune_load(TUNE_CONFIG_PATH, device, group_shapes, NUM_SCENES);
+    for (u32 i = 0; i < NUM_SCENES; i++)
+    {
+        if (persistent_groups >= 0)
+            group_shapes[i].groups = (u32)persistent_groups < TUNE_MAX_GROUPS ? (u32)persistent_groups : TUNE_MAX_GROUPS;
+        if (order < CURVE_COUNT)
+            group_shapes[i].order = order;
+    }
+
+    // Only the render thread reads the counters, workers don't count
+    if (worker_address || coordinator_address)
+        ray_stats = FALSE;
+
     u32 render_shader = load_shader("..\\src\\shaders\\compute.vert", "..\\src\\shaders\\compute.frag");
-    u32 shaders[] =
-    {
-		load_shader("..\\src\\shaders\\chapter7.comp"),
-		load_shader("..\\src\\shaders\\chapter8.comp"),
-		load_shader("..\\src\\shaders\\chapter9.comp"),
-		load_shader("..\\src\\shaders\\chapter10.comp"),
-		load_shader("..\\src\\shaders\\chapter11.comp"),
-		load_shader("..\\src\\shaders\\hollow glass ball.comp"),
-		load_shader("..\\src\\shaders\\checkered texture.comp"),
-		load_shader("..\\src\\shaders\\lamp.comp"),
-		load_shader("..\\src\\shaders\\plane.comp")
+    u32 shaders[NUM_SCENES] =
+    {
+		load_scene_kernel(0, group_shapes[0], ray_stats),      // chapter7
+		load_scene_kernel(1, group_shapes[1], ray_stats),      // chapter8
+		load_scene_kernel(2, group_shapes[2], ray_stats),      // chapter9
+		load_scene_kernel(3, group_shapes[3], ray_stats),      // chapter10
+		load_scene_kernel(4, group_shapes[4], ray_stats),      // chapter11
+		load_scene_kernel(5, group_shapes[5], ray_stats),      // hollow glass ball
+		load_scene_kernel(6, group_shapes[6], ray_stats),      // checkered texture
+		load_scene_kernel(7, group_shapes[7], ray_stats),      // lamp
+		load_scene_kernel(8, group_shapes[8], ray_stats),      // plane
+		load_scene_kernel(9, group_shapes[9], ray_stats),      // mesh
+		load_scene_kernel(10, group_shapes[10], ray_stats),    // instances
+		load_scene_kernel(11, group_shapes[11], ray_stats)     // cloud
+    };
+    u32 lbvh_programs[LBVH_NUM_PASSES] =
+    {
+        load_shader("..\\src\\shaders\\lbvh_bounds.comp"),
+        load_shader("..\\src\\shaders\\lbvh_morton.comp"),
+        load_shader("..\\src\\shaders\\lbvh_radix_count.comp"),
+        load_shader("..\\src\\shaders\\lbvh_radix_scan.comp"),
+        load_shader("..\\src\\shaders\\lbvh_radix_scatter.comp"),
+        load_shader("..\\src\\shaders\\lbvh_emit.comp"),
+        load_shader("..\\src\\shaders\\lbvh_fit.comp"),
+        load_shader("..\\src\\shaders\\lbvh_sah.comp")
     };
+    u32 cloud_animate = load_shader("..\\src\\shaders\\cloud_animate.comp");
+
+    // Every kernel is compiled, the shared sources aren't needed anymore
+    free_source_cache();
+    save_program_cache();
+
+    if (validate_shaders)
+    {
+        u32 packed_check = load_shader("..\\src\\shaders\\packed_check.comp");
+
+        glDeleteProgram(packed_check);
+
+        // The kernels with their counters compiled in, too
+        for (u32 i = 0; i < NUM_SCENES && !ray_stats; i++)
+            glDeleteProgram(load_scene_kernel(i, group_shapes[i], TRUE));
+        free_source_cache();
+        printf("shaders: %u errors\n", shader_errors);
+        glfwTerminate();
+        return shader_errors ? 1 : 0;
+    }
 
     u32 comp_shader_index = 0;
     u32 comp_shader = shaders[0];
@@ -104,15 +437,182 @@ main()
     u32 texture_data;
     glCreateTextures(GL_TEXTURE_2D, 1, &texture_data);
     glTextureStorage2D(texture_data, 1, GL_RGBA32F, SCR_WIDTH, SCR_HEIGHT);
-    glBindImageTexture(0, texture_data, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(0, texture_data, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+    /////////////////////////////////////////////////////////////////////////
+    // MESHES
+
+    // The mesh scene shows the --obj model, or a torus without one, fitted
+    // to where the other scenes keep their centre sphere. The instance
+    // scene scatters copies of it and of a ball over a big ground sphere,
+    // the cloud scene a million small balls, whose BVH the GPU builds and
+    // refits while they move. The textures decode on their own threads in
+    // the meantime. With --env, the environment map lights these three
+    // scenes.
+    mesh_t mesh;
+    mesh_t ball;
+    mesh_t packed;
+    tlas_t tlas;
+    scene_cloud_t cloud;
+    lbvh_t lbvh;
+    u32 geometry_buffers[GEOMETRY_BUFFERS];
+    u32 material_bases[SCENE_NUM_BUILTIN];
+    u32 cloud_motion[2];    // rest positions, animation channels
+    vec3_t mesh_center = {0.0f, 0.0f, -1.0f};
+    texture_set_t textures;
+    u32 albedo_textures;
+    envmap_t environment;
+    envmap_t *env = NULL;
+    std::thread texture_loader(texture_set_load, &textures, texture_paths,
+                               num_textures > SCENE_TEXTURES ? num_textures : SCENE_TEXTURES, 0);
+
+    if (!obj_path || !mesh_load_obj(&mesh, obj_path, 0))
+        mesh_make_torus(&mesh, 1.0f, 0.35f, 96, 48);
+    mesh_fit(&mesh, mesh_center, 1.0f);
+    mesh_build_bvh(&mesh, 0);
+    mesh_make_sphere(&ball, 0.5f, 24, 48);
+    mesh_build_bvh(&ball, 0);
+    scene_make_instances(&tlas, &mesh, &ball, 64);
+    scene_make_cloud(&cloud, CLOUD_PER_SIDE);
+    scene_cloud_build_bvh(&cloud, 0);
+    if (env_path)
+    {
+        if (!envmap_load_hdr(&environment, env_path))
+            envmap_make_sky(&environment, ENVMAP_SKY_WIDTH, ENVMAP_SKY_HEIGHT);
+        env = &environment;
+    }
+
+    // The mesh is BLAS 0, so the packed buffers serve both scenes
+    tlas_pack(&tlas, &packed);
+    upload_geometry(&packed, &tlas, &cloud, env, geometry_buffers, material_bases);
+    mesh_free(&packed);
+    for (u32 i = 0; i < NUM_SCENES; i++)
+        set_kernel_constants(shaders[i], material_bases[i], env);
+    texture_loader.join();
+    albedo_textures = upload_textures(&textures);
+    glCreateBuffers(2, cloud_motion);
+    glNamedBufferStorage(cloud_motion[0], cloud.num_spheres * 4 * sizeof(f32), cloud.rest, 0);
+    glNamedBufferStorage(cloud_motion[1], cloud.num_spheres * 4 * sizeof(f32), cloud.anim, 0);
+
+    if (!lbvh_init(&lbvh, lbvh_programs, cloud.num_spheres))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    lbvh_build(&lbvh, geometry_buffers[5], cloud.num_spheres);
+    bind_geometry(geometry_buffers, lbvh_nodes(&lbvh), albedo_textures);
+
+    if (bench_lbvh || tune_groups || bench_ray_stats || worker_address)
+    {
+        s32 result = 0;
+
+        if (bench_lbvh)
+            lbvh_bench(&lbvh, geometry_buffers[5], &cloud);
+        else if (tune_groups)
+            tune_workgroups(device, material_bases, env);
+        else if (bench_ray_stats)
+            bench_rays(group_shapes, material_bases, env);
+        else
+            result = run_worker(worker_address, shaders, group_shapes, texture_data);
+        lbvh_free(&lbvh);
+        glDeleteProgram(cloud_animate);
+        glDeleteBuffers(2, cloud_motion);
+        glDeleteBuffers(GEOMETRY_BUFFERS, geometry_buffers);
+        glDeleteTextures(1, &albedo_textures);
+        texture_set_free(&textures);
+        if (env)
+            envmap_free(env);
+        scene_cloud_free(&cloud);
+        tlas_free(&tlas);
+        mesh_free(&ball);
+        mesh_free(&mesh);
+        glfwTerminate();
+        return result;
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+    // DISTRIBUTED RENDERING
+
+    dist_coordinator_t coord;
+    mat4_t dist_view = {0};
+    u32 dist_scene = 0;
+    u32 dist_samples = 0;
+    f32 *dist_pixels = NULL;
+
+    if (coordinator_address)
+    {
+        if (!dist_coordinator_init(&coord, coordinator_address, SCR_WIDTH, SCR_HEIGHT))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        if (spawn_count)
+            dist_spawn_workers(&coord, argv[0], coordinator_address, spawn_count);
+        dist_pixels = (f32 *)calloc(SCR_WIDTH * SCR_HEIGHT * 4, sizeof(f32));
+    }
+
+    /////////////////////////////////////////////////////////////////////////
+    // RENDER THREAD
+
+    // Dispatches are submitted from a dedicated thread with its own context
+    // so UI hitches and long dispatches don't stall each other. The UI thread
+    // only pushes camera/scene snapshots and presents the newest frame.
+    render_shared_t shared;
+    render_snapshot_t last_snap = {0};
+    render_snapshot_t pending_snap;
+    b32 snap_pending = FALSE;
+    std::thread render_thread;
+    u32 present_texture = texture_data;
+
+    if (!coordinator_address)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        shared.context = glfwCreateWindow(1, 1, "render", NULL, window);
+        if (!shared.context)
+        {
+            printf("failed to create render context!\n");
+            glfwTerminate();
+            return -1;
+        }
+
+        shared.accum_texture = texture_data;
+        shared.mesh = &mesh;
+        shared.tlas = &tlas;
+        shared.cloud = &cloud;
+        shared.textures = &textures;
+        shared.environment = env;
+        memcpy(shared.geometry_buffers, geometry_buffers, sizeof(geometry_buffers));
+        shared.albedo_textures = albedo_textures;
+        shared.lbvh = &lbvh;
+        shared.cloud_animate = cloud_animate;
+        memcpy(shared.cloud_motion, cloud_motion, sizeof(cloud_motion));
+        shared.cpu_order = order < CURVE_COUNT ? order : CPU_DEFAULT_ORDER;
+        shared.ray_stats = ray_stats;
+        for (u32 i = 0; i < STAT_COUNT; i++)
+            shared.ray_counts[i].store(0);
+        shared.rays_per_second.store(0.0);
+        glCreateTextures(GL_TEXTURE_2D, MAILBOX_SLOTS, shared.targets);
+        for (u32 i = 0; i < MAILBOX_SLOTS; i++)
+        {
+            glTextureStorage2D(shared.targets[i], 1, GL_RGBA32F, SCR_WIDTH, SCR_HEIGHT);
+            shared.fences[i] = NULL;
+            shared.ui_fences[i] = NULL;
+        }
+        snapshot_queue_init(&shared.queue);
+        frame_mailbox_init(&shared.mailbox);
+        shared.running.store(TRUE);
+        shared.budget_ms.store(pace_budget_ms(&pacer, gpu_budget_ms));
+        shared.progress.store(1.0f);
+
+        // Objects must exist before the other context starts using them
+        glFinish();
+        render_thread = std::thread(render_thread_main, &shared);
+    }
 
     /////////////////////////////////////////////////////////////////////////
     // NUKLEAR + MATRIX + CAMERA SETUP
 
     reset_camera();
-    cam.up.x = 0;
-    cam.up.y = 1;
-    cam.up.z = 0;
 
     mat4_t view;
     mat4_t proj = mat4_perspective(70.0f, (f32)SCR_WIDTH / (f32)SCR_HEIGHT, 0.1f, 100.0f);
@@ -125,7 +625,11 @@ main()
     struct nk_glfw glfw = {0};
     struct nk_font_atlas *atlas;
 
-    ctx = nk_glfw3_init(&glfw, window, NK_GLFW3_INSTALL_CALLBACKS);
+    // Nuklear's callbacks go through ours, which also wake lazy redraw
+    ctx = nk_glfw3_init(&glfw, window, NK_GLFW3_DEFAULT);
+    glfwSetScrollCallback(window, &ui_scroll_callback);
+    glfwSetCharCallback(window, &ui_char_callback);
+    glfwSetMouseButtonCallback(window, &ui_mouse_button_callback);
     nk_glfw3_font_stash_begin(&glfw, &atlas);
     nk_glfw3_font_stash_end(&glfw);
 
@@ -138,38 +642,135 @@ main()
         delta_time = current_frame - last_frame;
         last_frame = current_frame;
 
-        process_input(window, delta_time);
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (process_input(window))
+            redraw = TRUE;
+
+        // The cloud only moves while its scene is shown; every step is a
+        // new frame, so progressive rendering restarts
+        if (animate && comp_shader_index == CLOUD_SCENE && !coordinator_address)
+        {
+            anim_time += delta_time;
+            sample_change = TRUE;
+            redraw = TRUE;
+        }
 
-        glBindVertexArray(vao);
         if (sample_change)
         {
             view = mat4_lookat(cam.lookfrom,
             vec3_add(cam.lookfrom, cam.lookat),
             cam.up);
-            glUseProgram(comp_shader);
-            glUniform1ui(glGetUniformLocation(comp_shader, "samples"),
-                         samples);
-            glUniform2f(glGetUniformLocation(comp_shader, "resolution"),
-                        window_size.x, window_size.y);
-            glUniformMatrix4fv(glGetUniformLocation(comp_shader, "view_matrix"),
-                                1, GL_FALSE, m_cast(view));
-            glUniformMatrix4fv(glGetUniformLocation(comp_shader, "proj_matrix"),
-                                1, GL_FALSE, m_cast(proj));
-            glDispatchCompute(SCR_WIDTH / 16, SCR_HEIGHT / 16, 1);
-            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-            glBindTextureUnit(0, texture_data);
+            if (coordinator_address)
+            {
+                // Only restart the distributed frame when something actually
+                // changed, otherwise keep accumulating what the workers send
+                if (memcmp(&view, &dist_view, sizeof(view)) ||
+                    dist_scene != comp_shader_index ||
+                    dist_samples != samples)
+                {
+                    dist_coordinator_begin_frame(&coord, comp_shader_index,
+                                                 m_cast(view), m_cast(proj), samples);
+                    dist_view = view;
+                    dist_scene = comp_shader_index;
+                    dist_samples = samples;
+                }
+            }
+            else
+            {
+                render_snapshot_t snap;
+
+                memset(&snap, 0, sizeof(snap));
+                snap.view = view;
+                snap.proj = proj;
+                snap.resolution = window_size;
+                snap.program = comp_shader;
+                snap.groups = group_shapes[comp_shader_index].groups;
+                snap.scene = comp_shader_index;
+                snap.backend = cpu_backend ? RENDER_BACKEND_CPU : RENDER_BACKEND_GPU;
+                snap.samples = samples;
+                snap.time = (comp_shader_index == CLOUD_SCENE) ? anim_time : 0.0f;
+                if (memcmp(&snap, &last_snap, sizeof(snap)))
+                {
+                    pending_snap = snap;
+                    snap_pending = TRUE;
+                }
+            }
 
             if (samples > 1)
                 sample_change = FALSE;
         }
-        glBindTexture(GL_TEXTURE_2D, texture_data);
+        if (!coordinator_address)
+        {
+            // A full queue just means the render thread is behind; retry the
+            // newest snapshot next frame
+            if (snap_pending && snapshot_queue_push(&shared.queue, &pending_snap))
+            {
+                last_snap = pending_snap;
+                snap_pending = FALSE;
+            }
+            shared.budget_ms.store(pace_budget_ms(&pacer, gpu_budget_ms));
+
+            if (frame_mailbox_acquire(&shared.mailbox))
+            {
+                u32 slot = shared.mailbox.front;
+
+                glWaitSync(shared.fences[slot], 0, GL_TIMEOUT_IGNORED);
+                glDeleteSync(shared.fences[slot]);
+                shared.fences[slot] = NULL;
+                redraw = TRUE;
+            }
+            present_texture = shared.targets[shared.mailbox.front];
+        }
+        else
+        {
+            dist_coordinator_poll(&coord, glfwGetTime());
+            if (coord.updated)
+            {
+                dist_coordinator_resolve(&coord, dist_pixels);
+                glTextureSubImage2D(texture_data, 0, 0, 0, SCR_WIDTH, SCR_HEIGHT,
+                                    GL_RGBA, GL_FLOAT, dist_pixels);
+                redraw = TRUE;
+            }
+        }
+
+        // Lazy redraw: with no event, no camera motion and no new frame the
+        // window would show the same image again, so skip the draw, the UI
+        // and the present and sleep until something happens. While a render
+        // is in flight its frames wake us (render_thread_publish), the
+        // timeout is for the coordinator's sockets and snapshots still queued.
+        if (!redraw)
+        {
+            if (coordinator_address || snap_pending || shared.progress.load() < 1.0f)
+                glfwWaitEventsTimeout(IDLE_TIMEOUT);
+            else
+                glfwWaitEvents();
+
+            // The time asleep isn't frame time
+            last_frame = (f32)glfwGetTime();
+            continue;
+        }
+        redraw = FALSE;
+
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBindVertexArray(vao);
+        glBindTextureUnit(0, present_texture);
         glUseProgram(render_shader);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
+        // The slot goes back to the render thread with the next acquire, and
+        // its next copy must not overwrite it under this draw
+        if (!coordinator_address)
+        {
+            u32 slot = shared.mailbox.front;
+
+            if (shared.ui_fences[slot])
+                glDeleteSync(shared.ui_fences[slot]);
+            shared.ui_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+
         // NUKLEAR
         nk_glfw3_new_frame(&glfw);
-        if (nk_begin(ctx, "Demo", nk_rect(50, 50, 275, 275),
+        if (nk_begin(ctx, "Demo", nk_rect(50, 50, 275, ray_stats ? 520 : 420),
                      NK_WINDOW_BORDER|NK_WINDOW_MOVABLE|NK_WINDOW_SCALABLE|
                      NK_WINDOW_MINIMIZABLE|NK_WINDOW_TITLE))
         {
@@ -177,6 +778,43 @@ main()
             nk_layout_row_static(ctx, 20, 130, 1);
             nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Frametime: %.3f ms", delta_time * 1000.0f);
             nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "FPS: %f", 1.0f / delta_time);
+            if (coordinator_address)
+                nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Workers: %u", coord.num_workers);
+            else if (shared.progress.load() < 1.0f)
+                nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Render: %.0f%%", shared.progress.load() * 100.0f);
+
+            // What the current render's rays did, a few frames late
+            if (!coordinator_address && shared.ray_stats && !cpu_backend)
+            {
+                u64 counts[STAT_COUNT];
+                u64 rays, paths;
+
+
+                for (u32 i = 0; i < STAT_COUNT; i++)
+                    counts[i] = shared.ray_counts[i].load();
+                rays = ray_stats_rays(counts);
+                paths = counts[STAT_ESCAPED] + counts[STAT_ABSORBED] + counts[STAT_MAX_DEPTH];
+
+                nk_layout_row_static(ctx, 20, 250, 1);
+                nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Mrays/s: %.1f", shared.rays_per_second.load() * 1e-6);
+                if (counts[STAT_RAYS])
+                {
+                    f64 primary = (f64)counts[STAT_RAYS];
+
+                    nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Rays: %.1f M, %.2f per primary", rays * 1e-6, rays / primary);
+                    nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Bounce 1/2/3: %.2f %.2f %.2f, shadow %.2f",
+                              counts[STAT_RAYS + 1] / primary, counts[STAT_RAYS + 2] / primary,
+                              counts[STAT_RAYS + 3] / primary, counts[STAT_SHADOW_RAYS] / primary);
+                    nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Per ray: %.1f nodes, %.1f tests",
+                              (f64)counts[STAT_NODE_VISITS] / rays,
+                              (f64)(counts[STAT_SPHERE_TESTS] + counts[STAT_PLANE_TESTS] +
+                                    counts[STAT_TRIANGLE_TESTS]) / rays);
+                }
+                if (paths)
+                    nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Ends: %.0f%% sky, %.0f%% absorbed, %.0f%% depth",
+                              100.0 * counts[STAT_ESCAPED] / paths, 100.0 * counts[STAT_ABSORBED] / paths,
+                              100.0 * counts[STAT_MAX_DEPTH] / paths);
+            }
 
             // Camera
             nk_layout_row_static(ctx, 20, 250, 1);
@@ -194,6 +832,54 @@ main()
                 nk_layout_row_push(ctx, 150);
                 nk_slider_float(ctx, 0, &cam_speed, 10.0f, 1.0f);
             } nk_layout_row_end(ctx);
+            // Display mode sizes the slices itself
+            if (pacer.mode == PACE_DISPLAY)
+            {
+                nk_layout_row_static(ctx, 20, 200, 1);
+                nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "GPU ms: %.1f (display)", pace_budget_ms(&pacer, gpu_budget_ms));
+            }
+            else
+            {
+                nk_layout_row_begin(ctx, NK_STATIC, 30, 5);
+                {
+                    nk_layout_row_push(ctx, 50);
+                    nk_label(ctx, "GPU ms:", NK_TEXT_LEFT);
+                    nk_layout_row_push(ctx, 150);
+                    nk_slider_float(ctx, 1.0f, &gpu_budget_ms, 33.0f, 1.0f);
+                } nk_layout_row_end(ctx);
+            }
+
+            // Present mode
+            nk_layout_row_begin(ctx, NK_STATIC, 25, 2);
+            {
+                s32 mode;
+
+                nk_layout_row_push(ctx, 60);
+                nk_label(ctx, "Present:", NK_TEXT_LEFT);
+                nk_layout_row_push(ctx, 140);
+                mode = nk_combo(ctx, pace_names, PACE_COUNT, (s32)pacer.mode, 20, nk_vec2(140, 110));
+                if ((u32)mode != pacer.mode)
+                {
+                    pace_set_mode(&pacer, (u32)mode);
+                    glfwSwapInterval(pace_swap_interval(&pacer));
+                }
+            } nk_layout_row_end(ctx);
+            if (pacer.mode == PACE_CAPPED)
+            {
+                s32 fps = (s32)pacer.fps;
+
+                nk_layout_row_static(ctx, 25, 200, 1);
+                nk_property_int(ctx, "FPS cap:", PACE_MIN_FPS, &fps, PACE_MAX_FPS, 5, 1.0f);
+                pacer.fps = (u32)fps;
+            }
+            if (!coordinator_address)
+            {
+                nk_layout_row_static(ctx, 20, 200, 1);
+                if (nk_checkbox_label(ctx, "CPU backend", &cpu_backend))
+                    sample_change = TRUE;
+                nk_layout_row_static(ctx, 20, 200, 1);
+                nk_checkbox_label(ctx, "Animate cloud", &animate);
+            }
 
             // Prev / Next Buttons 
             nk_layout_row_begin(ctx, NK_STATIC, 30, 5);
@@ -202,23 +888,27 @@ main()
                 if (nk_button_label(ctx, "Prev"))
                 {
                     if (comp_shader_index == 0)
-                        comp_shader_index = 8;
+                        comp_shader_index = NUM_SCENES - 1;
                     else
                         comp_shader_index--;
 
                     reset_camera();
                     comp_shader = shaders[comp_shader_index];
+                    samples = 1;
+                    sample_change = TRUE;
                 }
                 nk_layout_row_push(ctx, 100);
                 if (nk_button_label(ctx, "Next"))
                 {
-                    if (comp_shader_index == 8)
+                    if (comp_shader_index == NUM_SCENES - 1)
                         comp_shader_index = 0;
                     else
                         comp_shader_index++;
 
                     reset_camera();
                     comp_shader = shaders[comp_shader_index];
+                    samples = 1;
+                    sample_change = TRUE;
                 }
             } nk_layout_row_end(ctx);
             nk_layout_row_static(ctx, 20, 80, 1);
@@ -236,13 +926,690 @@ main()
         nk_glfw3_render(&glfw, NK_ANTI_ALIASING_ON, MAX_VERTEX_BUFFER, MAX_ELEMENT_BUFFER);
 
         glfwSwapBuffers(window);
+        pace_wait(&pacer, &pump_events);
         glfwPollEvents();
     }
+
+    if (coordinator_address)
+    {
+        dist_coordinator_shutdown(&coord);
+        free(dist_pixels);
+    }
+    else
+    {
+        shared.running.store(FALSE);
+        render_thread.join();
+        glfwDestroyWindow(shared.context);
+    }
+
+    lbvh_free(&lbvh);
+    glDeleteProgram(cloud_animate);
+    glDeleteBuffers(2, cloud_motion);
+    glDeleteBuffers(GEOMETRY_BUFFERS, geometry_buffers);
+    glDeleteTextures(1, &albedo_textures);
+    texture_set_free(&textures);
+    if (env)
+        envmap_free(env);
+    scene_cloud_free(&cloud);
+    tlas_free(&tlas);
+    mesh_free(&ball);
+    mesh_free(&mesh);
     
     glfwTerminate();
     return 0;
 }
 
+// A grid dispatch runs one workgroup per tile of the area; a persistent
+// kernel (`groups` not 0) runs at most `groups`, which take the tiles off
+// the work queue
+void
+dispatch_tile(u32 program,
+              u32 groups,
+              mat4_t view,
+              mat4_t proj,
+              vec2_t resolution,
+              u32 tile_samples,
+              u32 sample_base,
+              u32 seed,
+              s32 x,
+              s32 y,
+              s32 w,
+              s32 h)
+{
+    glUseProgram(program);
+    glUniform1ui(glGetUniformLocation(program, "samples"),
+                 tile_samples);
+    glUniform1ui(glGetUniformLocation(program, "sample_base"),
+                 sample_base);
+    glUniform1ui(glGetUniformLocation(program, "seed"),
+                 seed);
+    glUniform2i(glGetUniformLocation(program, "tile_origin"),
+                x, y);
+    glUniform2f(glGetUniformLocation(program, "resolution"),
+                resolution.x, resolution.y);
+    glUniformMatrix4fv(glGetUniformLocation(program, "view_matrix"),
+                        1, GL_FALSE, m_cast(view));
+    glUniformMatrix4fv(glGetUniformLocation(program, "proj_matrix"),
+                        1, GL_FALSE, m_cast(proj));
+
+    // Workgroup shapes differ per kernel (tune.h)
+    s32 group_size[3];
+    glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, group_size);
+    u32 tiles_x = (w + group_size[0] - 1) / group_size[0];
+    u32 tiles_y = (h + group_size[1] - 1) / group_size[1];
+
+    if (groups)
+    {
+        s32 queue;
+
+        glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, TUNE_QUEUE_BINDING, &queue);
+        glClearNamedBufferData(queue, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        glUniform2ui(glGetUniformLocation(program, "group_tiles"), tiles_x, tiles_y);
+        glDispatchCompute(tiles_x * tiles_y < groups ? tiles_x * tiles_y : groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+    else
+    {
+        glDispatchCompute(tiles_x, tiles_y, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+}
+
+// Whether the last persistent dispatch of `program` over a w x h area got
+// through all its tiles: each group stops after taking one past the last
+// slot, and the curves have a slot for every tile of their square. Drivers
+// that cut long loops short (llvmpipe caps their iterations) leave some
+// behind.
+b32
+persistent_complete(u32 program,
+                    tune_shape_t shape,
+                    s32 w,
+                    s32 h)
+{
+    s32 group_size[3];
+    s32 queue;
+    u32 tiles_x;
+    u32 tiles_y;
+    u32 slots;
+    u32 taken;
+
+
+    glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, group_size);
+    tiles_x = (w + group_size[0] - 1) / group_size[0];
+    tiles_y = (h + group_size[1] - 1) / group_size[1];
+    slots = (shape.order == CURVE_ROWS) ? tiles_x * tiles_y : curve_side(tiles_x, tiles_y) * curve_side(tiles_x, tiles_y);
+    glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, TUNE_QUEUE_BINDING, &queue);
+    glGetNamedBufferSubData(queue, 0, sizeof(taken), &taken);
+
+    return taken == slots + (tiles_x * tiles_y < shape.groups ? tiles_x * tiles_y : shape.groups);
+}
+
+// Per kernel uniforms that stay put: where the scene's materials start in
+// the table, and the environment map's size
+void
+set_kernel_constants(u32 program,
+                     u32 material_base,
+                     envmap_t *environment)
+{
+    glProgramUniform1ui(program, glGetUniformLocation(program, "material_base"), material_base);
+    if (environment)
+        glProgramUniform2ui(program, glGetUniformLocation(program, "env_size"),
+                            environment->width, environment->height);
+}
+
+// Times every shape of tune_shapes[] on every scene's kernel at the window's
+// resolution from the default camera, and saves the fastest per scene for
+// `device`. Needs the geometry bound and the image at unit 0.
+void
+tune_workgroups(const char *device,
+                u32 *material_bases,
+                envmap_t *environment)
+{
+    tune_shape_t    best[NUM_SCENES];
+    vec2_t          resolution = {SCR_WIDTH, SCR_HEIGHT};
+    mat4_t          proj = mat4_perspective(70.0f, (f32)SCR_WIDTH / (f32)SCR_HEIGHT, 0.1f, 100.0f);
+    mat4_t          view;
+    u32             query;
+
+
+    reset_camera();
+    view = mat4_lookat(cam.lookfrom, vec3_add(cam.lookfrom, cam.lookat), cam.up);
+    glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+    printf("tuning workgroups on %s, %ux%u, %u samples\n", device, SCR_WIDTH, SCR_HEIGHT, TUNE_SAMPLES);
+
+    for (u32 scene = 0; scene < NUM_SCENES; scene++)
+    {
+        f64 best_ms = -1.0;
+
+
+        best[scene] = tune_shapes[0];
+        for (u32 s = 0; s < TUNE_NUM_SHAPES; s++)
+        {
+            u32 program = load_scene_kernel(scene, tune_shapes[s], FALSE);
+            f64 ms = 0.0;
+
+            if (!program)
+                continue;
+            set_kernel_constants(program, material_bases[scene], environment);
+
+            // The first dispatch warms up, the fastest of the others counts
+            dispatch_tile(program, tune_shapes[s].groups, view, proj, resolution, TUNE_SAMPLES, 0, 1, 0, 0, SCR_WIDTH, SCR_HEIGHT);
+            for (u32 run = 0; run < TUNE_RUNS; run++)
+            {
+                u64 ns;
+
+                glBeginQuery(GL_TIME_ELAPSED, query);
+                dispatch_tile(program, tune_shapes[s].groups, view, proj, resolution, TUNE_SAMPLES, 0, 1, 0, 0, SCR_WIDTH, SCR_HEIGHT);
+                glEndQuery(GL_TIME_ELAPSED);
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+                ms = (run == 0 || ns * 1e-6 < ms) ? ns * 1e-6 : ms;
+            }
+
+            printf("scene %2u  %2ux%-2u %-9s %4u groups %-7s %8.2f ms", scene, tune_shapes[s].width,
+                   tune_shapes[s].height, tune_shapes[s].morton ? "morton" : "row major", tune_shapes[s].groups,
+                   tune_shapes[s].groups ? curve_names[tune_shapes[s].order] : "", ms);
+            if (tune_shapes[s].groups && !persistent_complete(program, tune_shapes[s], SCR_WIDTH, SCR_HEIGHT))
+            {
+                printf("  left tiles behind, skipped\n");
+                glDeleteProgram(program);
+                continue;
+            }
+            printf("\n");
+            glDeleteProgram(program);
+
+            if (best_ms < 0.0 || ms < best_ms)
+            {
+                best[scene] = tune_shapes[s];
+                best_ms = ms;
+            }
+        }
+    }
+
+    glDeleteQueries(1, &query);
+    if (tune_save(TUNE_CONFIG_PATH, device, best, NUM_SCENES))
+        printf("saved to %s\n", TUNE_CONFIG_PATH);
+}
+
+// Every scene's kernel from the default camera at the window's resolution:
+// the GPU time of a dispatch without the counters, then what the same
+// dispatch counts with them, for the Mrays/s of the kernel as it normally
+// runs. Needs the geometry bound and the image at unit 0.
+void
+bench_rays(tune_shape_t *shapes,
+           u32 *material_bases,
+           envmap_t *environment)
+{
+    vec2_t          resolution = {SCR_WIDTH, SCR_HEIGHT};
+    mat4_t          proj = mat4_perspective(70.0f, (f32)SCR_WIDTH / (f32)SCR_HEIGHT, 0.1f, 100.0f);
+    mat4_t          view;
+    ray_stats_t     stats;
+    u32             query;
+
+
+    reset_camera();
+    view = mat4_lookat(cam.lookfrom, vec3_add(cam.lookfrom, cam.lookat), cam.up);
+    glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+    ray_stats_init(&stats);
+    printf("rays of every scene, %ux%u, %u samples\n", SCR_WIDTH, SCR_HEIGHT, BENCH_RAYS_SAMPLES);
+
+    for (u32 scene = 0; scene < NUM_SCENES; scene++)
+    {
+        u32 program = load_scene_kernel(scene, shapes[scene], FALSE);
+        u32 counting = load_scene_kernel(scene, shapes[scene], TRUE);
+        u64 counts[STAT_COUNT];
+        u64 ns;
+        f64 ms;
+
+        if (!program || !counting)
+        {
+            printf("scene %2u: no kernel\n", scene);
+            glDeleteProgram(program);
+            glDeleteProgram(counting);
+            continue;
+        }
+        set_kernel_constants(program, material_bases[scene], environment);
+        set_kernel_constants(counting, material_bases[scene], environment);
+
+        // The first dispatch warms up
+        dispatch_tile(program, shapes[scene].groups, view, proj, resolution, BENCH_RAYS_SAMPLES, 0, 1,
+                      0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        dispatch_tile(program, shapes[scene].groups, view, proj, resolution, BENCH_RAYS_SAMPLES, 0, 1,
+                      0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glEndQuery(GL_TIME_ELAPSED);
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        ms = ns * 1e-6;
+
+        ray_stats_reset(&stats);
+        dispatch_tile(counting, shapes[scene].groups, view, proj, resolution, BENCH_RAYS_SAMPLES, 0, 1,
+                      0, 0, SCR_WIDTH, SCR_HEIGHT);
+        ray_stats_read(&stats, counts);
+
+        printf("scene %2u: %8.2f ms, %8.1f Mrays/s\n", scene, ms,
+               ms > 0.0 ? ray_stats_rays(counts) / (ms * 1e3) : 0.0);
+        ray_stats_print(counts);
+        glDeleteProgram(program);
+        glDeleteProgram(counting);
+    }
+
+    ray_stats_free(&stats);
+    glDeleteQueries(1, &query);
+}
+
+// Also uploads the material table of all scenes, each kernel's slice
+// starting at its entry of material_bases, and the environment map if
+// there is one
+void
+upload_geometry(mesh_t *packed,
+                tlas_t *tlas,
+                scene_cloud_t *cloud,
+                envmap_t *environment,
+                u32 *buffers,
+                u32 *material_bases)
+{
+    tlas_instance_t         *instances = (tlas_instance_t *)malloc(tlas->num_instances * sizeof(tlas_instance_t));
+    scene_gpu_material_t    *materials;
+    u32                     num_materials;
+
+
+    glCreateBuffers(GEOMETRY_BUFFERS, buffers);
+    glNamedBufferStorage(buffers[0], packed->bvh4.num_nodes * sizeof(bvh4_node_t),
+                         packed->bvh4.nodes, 0);
+    glNamedBufferStorage(buffers[1], packed->num_vertices * sizeof(mesh_vertex_t),
+                         packed->vertices, 0);
+    glNamedBufferStorage(buffers[2], packed->num_triangles * 3 * sizeof(u32),
+                         packed->indices, 0);
+
+    // The top level can be refit and re-uploaded when instances move
+    tlas_leaf_order(tlas, instances);
+    glNamedBufferStorage(buffers[3], tlas->bvh.num_nodes * sizeof(bvh_node_t),
+                         tlas->bvh.nodes, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferStorage(buffers[4], tlas->num_instances * sizeof(tlas_instance_t),
+                         instances, GL_DYNAMIC_STORAGE_BIT);
+    free(instances);
+
+    glNamedBufferStorage(buffers[5], cloud->num_spheres * 4 * sizeof(f32),
+                         cloud->spheres, 0);
+    glNamedBufferStorage(buffers[6], cloud->num_spheres * sizeof(u32),
+                         cloud->materials, 0);
+
+    num_materials = scene_material_table(&materials, material_bases);
+    glNamedBufferStorage(buffers[MATERIAL_TABLE], num_materials * sizeof(scene_gpu_material_t),
+                         materials, 0);
+    free(materials);
+
+    // The kernels don't read these while env_size is zero
+    if (environment)
+    {
+        glNamedBufferStorage(buffers[ENVMAP_TEXELS], (usize)environment->width * environment->height * 4 * sizeof(f32),
+                             environment->texels, 0);
+        glNamedBufferStorage(buffers[ENVMAP_CDF], envmap_cdf_size(environment) * sizeof(f32),
+                             environment->cdf, 0);
+    }
+    else
+    {
+        glNamedBufferStorage(buffers[ENVMAP_TEXELS], 4 * sizeof(f32), NULL, 0);
+        glNamedBufferStorage(buffers[ENVMAP_CDF], 4 * sizeof(f32), NULL, 0);
+    }
+
+    // Tiles taken by a persistent dispatch, cleared before each
+    glNamedBufferStorage(buffers[WORK_QUEUE], sizeof(u32), NULL, 0);
+}
+
+// One array layer per texture, with the mip chains texture.h built on the
+// CPU. The sampler state matches texture_sample().
+u32
+upload_textures(texture_set_t *set)
+{
+    u32 texture;
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, TEXTURE_LEVELS, GL_SRGB8_ALPHA8, TEXTURE_SIZE, TEXTURE_SIZE, set->num_layers);
+    for (u32 layer = 0; layer < set->num_layers; layer++)
+    {
+        for (u32 level = 0; level < TEXTURE_LEVELS; level++)
+        {
+            u32 size = TEXTURE_SIZE >> level;
+
+            glTextureSubImage3D(texture, level, 0, 0, layer, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                set->texels[layer] + texture_level_offset(level));
+        }
+    }
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    return texture;
+}
+
+// Kernel of builtin scene `index` for a workgroup shape. The sphere scenes
+// share one kernel, specialised per scene; the others have their own.
+u32
+load_scene_kernel(u32 index,
+                  tune_shape_t shape,
+                  b32 stats)
+{
+    static const char *kernels[NUM_SCENES - SCENE_NUM_SPECIALIZED] =
+    {
+        "..\\src\\shaders\\mesh.comp",
+        "..\\src\\shaders\\instances.comp",
+        "..\\src\\shaders\\cloud.comp"
+    };
+    scene_t scene;
+    char    defines[sizeof(RAY_STATS_DEFINE) + TUNE_DEFINES_SIZE + SCENE_SPECIALIZE_SIZE];
+    u32     length = 0;
+    u32     program = 0;
+
+
+    if (stats)
+    {
+        strcpy(defines, RAY_STATS_DEFINE);
+        length = (u32)strlen(RAY_STATS_DEFINE);
+    }
+    length += tune_defines(shape, defines + length, TUNE_DEFINES_SIZE);
+    if (index >= SCENE_NUM_SPECIALIZED)
+        return load_compute_shader(kernels[index - SCENE_NUM_SPECIALIZED], defines);
+
+    scene_init(&scene);
+    scene_load_builtin(&scene, index, NULL, NULL, NULL, NULL, NULL);
+    if (scene_specialize(&scene, defines + length, sizeof(defines) - length))
+        program = load_compute_shader("..\\src\\shaders\\spheres.comp", defines);
+    else
+        printf("scene %u doesn't fit its kernel's defines\n", index);
+    scene_free(&scene);
+
+    return program;
+}
+
+// Buffer and texture unit bindings are per context, so every context that
+// dispatches the kernels binds them. The cloud spheres land on
+// LBVH_BINDING_SPHERES.
+void
+bind_geometry(u32 *buffers,
+              u32 lbvh_nodes,
+              u32 albedo_textures)
+{
+    for (u32 i = 0; i < MATERIAL_TABLE; i++)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_MATERIAL_BINDING, buffers[MATERIAL_TABLE]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ENVMAP_BINDING_TEXELS, buffers[ENVMAP_TEXELS]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ENVMAP_BINDING_CDF, buffers[ENVMAP_CDF]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LBVH_BINDING_NODES, lbvh_nodes);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TUNE_QUEUE_BINDING, buffers[WORK_QUEUE]);
+    glBindTextureUnit(ALBEDO_TEXTURE_UNIT, albedo_textures);
+}
+
+// Moves the cloud spheres in `spheres` to where they are at `time`, from
+// the rest positions and animation channels in `motion`
+void
+animate_cloud(u32 program,
+              u32 spheres,
+              u32 *motion,
+              u32 num_spheres,
+              f32 time)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LBVH_BINDING_SPHERES, spheres);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, motion[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, motion[1]);
+    glUseProgram(program);
+    glUniform1ui(glGetUniformLocation(program, "num_spheres"), num_spheres);
+    glUniform1f(glGetUniformLocation(program, "time"), time);
+    glDispatchCompute((num_spheres + LBVH_GROUP_SIZE - 1) / LBVH_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+internal void
+render_thread_publish(render_shared_t *shared)
+{
+    u32 slot = shared->mailbox.back;
+
+    // A frame the UI never picked up still has its fence
+    if (shared->fences[slot])
+        glDeleteSync(shared->fences[slot]);
+
+    // The UI thread may still be drawing from the slot it handed back
+    if (shared->ui_fences[slot])
+    {
+        glWaitSync(shared->ui_fences[slot], 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(shared->ui_fences[slot]);
+        shared->ui_fences[slot] = NULL;
+    }
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glCopyImageSubData(shared->accum_texture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                       shared->targets[slot], GL_TEXTURE_2D, 0, 0, 0, 0,
+                       SCR_WIDTH, SCR_HEIGHT, 1);
+    shared->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    frame_mailbox_publish(&shared->mailbox);
+
+    // Wakes the UI thread if it is idle in glfwWaitEvents
+    glfwPostEmptyEvent();
+}
+
+void
+render_thread_main(render_shared_t *shared)
+{
+    render_snapshot_t   snap = {0},
+                        next;
+    sched_t             sched;
+    sched_work_t        work;
+    GLsync              slice_fence = NULL;
+    b32                 fresh;
+    b32                 have_snap = FALSE;
+    cpu_renderer_t      cpu;
+    scene_t             cpu_scene;
+    u32                 cpu_scene_index = U32_MAX;
+    u32                 cpu_samples_done = 0;
+    f32                 gpu_cloud_time = 0.0f,  // pose of the cloud in each backend
+                        cpu_cloud_time = 0.0f;
+    ray_stats_t         stats;
+
+
+    glfwMakeContextCurrent(shared->context);
+    glBindImageTexture(0, shared->accum_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    bind_geometry(shared->geometry_buffers, lbvh_nodes(shared->lbvh), shared->albedo_textures);
+
+    // Progressive (R) renders are handed out a few tiles per frame within a
+    // GPU time budget instead of as one full-screen dispatch
+    sched_init(&sched, SCR_WIDTH, SCR_HEIGHT, shared->budget_ms.load());
+
+    // The CPU backend renders whole frames, one sample per pixel per pass
+    // for progressive renders, and uploads them into the accumulation image
+    cpu_renderer_init(&cpu, SCR_WIDTH, SCR_HEIGHT, 0);
+    cpu_renderer_set_order(&cpu, shared->cpu_order);
+    scene_init(&cpu_scene);
+
+    // The counters are read back a few frames late, the totals are those of
+    // the current snapshot
+    if (shared->ray_stats)
+        ray_stats_init(&stats);
+
+    while (shared->running.load())
+    {
+        // Only the newest snapshot matters, older ones are already stale
+        fresh = FALSE;
+        while (snapshot_queue_pop(&shared->queue, &next))
+        {
+            snap = next;
+            fresh = TRUE;
+            have_snap = TRUE;
+        }
+
+        // Nothing to render until the UI thread pushes its first snapshot
+        if (!have_snap)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        if (shared->ray_stats)
+        {
+            if (fresh)
+                ray_stats_reset(&stats);
+            if (ray_stats_poll(&stats) || fresh)
+            {
+                for (u32 i = 0; i < STAT_COUNT; i++)
+                    shared->ray_counts[i].store(stats.totals[i]);
+            }
+            shared->rays_per_second.store(stats.rays_per_second);
+        }
+
+        if (snap.backend == RENDER_BACKEND_CPU)
+        {
+            if (fresh)
+            {
+                sched_reset(&sched);
+                cpu_samples_done = 0;
+                if (snap.scene != cpu_scene_index)
+                {
+                    scene_load_builtin(&cpu_scene, snap.scene, shared->mesh, shared->tlas, shared->cloud,
+                                       shared->textures, shared->environment);
+                    cpu_scene_index = snap.scene;
+                }
+                if (snap.scene == CLOUD_SCENE && snap.time != cpu_cloud_time)
+                {
+                    scene_cloud_update(shared->cloud, snap.time);
+                    cpu_cloud_time = snap.time;
+                }
+            }
+
+            if (cpu_samples_done < snap.samples)
+            {
+                cpu_render_pass(&cpu, &cpu_scene, snap.view, snap.proj, snap.resolution,
+                                cpu_samples_done, 1);
+                cpu_samples_done++;
+
+                glTextureSubImage2D(shared->accum_texture, 0, 0, 0, SCR_WIDTH, SCR_HEIGHT,
+                                    GL_RGBA, GL_FLOAT, cpu.pixels);
+                render_thread_publish(shared);
+                shared->progress.store((f32)cpu_samples_done / snap.samples);
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            continue;
+        }
+
+        if (fresh && snap.scene == CLOUD_SCENE && snap.time != gpu_cloud_time)
+        {
+            animate_cloud(shared->cloud_animate, shared->geometry_buffers[5], shared->cloud_motion,
+                          shared->cloud->num_spheres, snap.time);
+            lbvh_update(shared->lbvh, shared->geometry_buffers[5]);
+            gpu_cloud_time = snap.time;
+        }
+
+        if (fresh && snap.samples > 1)
+        {
+            sched_begin(&sched, snap.samples);
+        }
+        else if (fresh)
+        {
+            sched_reset(&sched);
+            dispatch_tile(snap.program, snap.groups, snap.view, snap.proj, snap.resolution,
+                          snap.samples, 0, 0, 0, 0, SCR_WIDTH, SCR_HEIGHT);
+            render_thread_publish(shared);
+            if (shared->ray_stats)
+                ray_stats_collect(&stats);
+        }
+
+        if (!sched_done(&sched))
+        {
+            // Keep at most one slice queued on the GPU, otherwise the budget
+            // means nothing and the UI context's presents queue up behind us
+            if (slice_fence)
+            {
+                glClientWaitSync(slice_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                glDeleteSync(slice_fence);
+            }
+
+            sched.budget_ms = shared->budget_ms.load();
+            sched_frame_begin(&sched);
+            while (sched_next(&sched, &work))
+            {
+                dispatch_tile(snap.program, snap.groups, snap.view, snap.proj, snap.resolution,
+                              work.samples, work.sample_base, work.sample_base,
+                              work.x, work.y, work.w, work.h);
+            }
+            sched_frame_end(&sched);
+            render_thread_publish(shared);
+            if (shared->ray_stats)
+                ray_stats_collect(&stats);
+            slice_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            shared->progress.store(sched_progress(&sched));
+        }
+        else
+        {
+            shared->progress.store(1.0f);
+            if (!fresh)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    if (slice_fence)
+        glDeleteSync(slice_fence);
+    if (shared->ray_stats)
+        ray_stats_free(&stats);
+    sched_free(&sched);
+    cpu_renderer_free(&cpu);
+    scene_free(&cpu_scene);
+    glfwMakeContextCurrent(NULL);
+}
+
+s32
+run_worker(const char *address,
+           u32 *shaders,
+           tune_shape_t *shapes,
+           u32 texture)
+{
+    dist_socket_t   sock;
+    dist_job_t      job;
+    f32             *rgb;
+    mat4_t          view,
+                    proj;
+
+
+    sock = dist_worker_connect(address);
+    if (sock == DIST_BAD_SOCKET)
+        return -1;
+
+    rgb = (f32 *)malloc(DIST_TILE_SIZE * DIST_TILE_SIZE * 3 * sizeof(f32));
+    while (dist_worker_recv_job(sock, &job))
+    {
+        if (job.scene >= NUM_SCENES || job.width != SCR_WIDTH || job.height != SCR_HEIGHT)
+        {
+            printf("worker: rejecting job for scene %u at %dx%d\n", job.scene, job.width, job.height);
+            break;
+        }
+
+        vec2_t resolution = {(f32)job.width, (f32)job.height};
+        memcpy(&view, job.view, sizeof(view));
+        memcpy(&proj, job.proj, sizeof(proj));
+
+        dispatch_tile(shaders[job.scene], shapes[job.scene].groups, view, proj, resolution,
+                      job.samples, 0, job.seed, job.x, job.y, job.w, job.h);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+        glGetTextureSubImage(texture, 0, job.x, job.y, 0, job.w, job.h, 1,
+                             GL_RGB, GL_FLOAT, job.w * job.h * 3 * sizeof(f32), rgb);
+
+        // The kernels store gamma corrected colour; undo it so the
+        // coordinator can merge tiles linearly by sample count
+        for (s32 i = 0; i < job.w * job.h * 3; i++)
+            rgb[i] *= rgb[i];
+
+        if (!dist_worker_send_result(sock, &job, rgb))
+            break;
+    }
+
+    free(rgb);
+    dist_closesocket(sock);
+
+    return 0;
+}
+
 void
 framebuffer_size_callback(GLFWwindow *window,
                           s32 width,
@@ -252,37 +1619,97 @@ framebuffer_size_callback(GLFWwindow *window,
     glViewport(0, 0, width, height);
     window_size.x = (f32)width;
     window_size.y = (f32)height;
+    redraw = TRUE;
 }
 
+// Movement keys go into the event queue with the time they came in; the
+// other keys are polled in process_input() and by Nuklear
 void
-process_input(GLFWwindow *window,
-             f32 delta_time)
+key_callback(GLFWwindow *,
+             s32 key,
+             s32,
+             s32 action,
+             s32)
 {
+    redraw = TRUE;
+    if (action == GLFW_REPEAT)
+        return;
+
+    switch (key)
+    {
+        case GLFW_KEY_W: input_push(&key_events, INPUT_FORWARD, action == GLFW_PRESS, glfwGetTime()); break;
+        case GLFW_KEY_S: input_push(&key_events, INPUT_BACK, action == GLFW_PRESS, glfwGetTime()); break;
+        case GLFW_KEY_A: input_push(&key_events, INPUT_LEFT, action == GLFW_PRESS, glfwGetTime()); break;
+        case GLFW_KEY_D: input_push(&key_events, INPUT_RIGHT, action == GLFW_PRESS, glfwGetTime()); break;
+        default: break;
+    }
+}
+
+// Sleep of the frame pacer: events that come in while it waits get their
+// own time stamps instead of all the frame's end
+void
+pump_events(f64 seconds)
+{
+    glfwWaitEventsTimeout(seconds);
+}
+
+// The window was uncovered or resized and its contents are gone
+void
+refresh_callback(GLFWwindow *)
+{
+    redraw = TRUE;
+}
+
+void
+ui_scroll_callback(GLFWwindow *window,
+                   f64 x_offset,
+                   f64 y_offset)
+{
+    nk_gflw3_scroll_callback(window, x_offset, y_offset);
+    redraw = TRUE;
+}
+
+void
+ui_char_callback(GLFWwindow *window,
+                 u32 codepoint)
+{
+    nk_glfw3_char_callback(window, codepoint);
+    redraw = TRUE;
+}
+
+void
+ui_mouse_button_callback(GLFWwindow *window,
+                         s32 button,
+                         s32 action,
+                         s32 mods)
+{
+    nk_glfw3_mouse_button_callback(window, button, action, mods);
+    redraw = TRUE;
+}
+
+// Returns TRUE if a held key changed anything, which keeps lazy redraw
+// drawing while the camera moves
+b32
+process_input(GLFWwindow *window)
+{
+    f64 held[INPUT_KEY_COUNT];
+    b32 changed = FALSE;
+
+
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (sample_change)
+    // The camera moves by the time each key was held since the last frame,
+    // from the key events' time stamps, not by the frame time
+    if (input_held(&key_events, glfwGetTime(), held) && sample_change)
     {
-        f32 speed = cam_speed * delta_time;
+        vec3_t side = vec3_normalize(vec3_cross(cam.lookat, cam.up));
+        f32 forward = cam_speed * (f32)(held[INPUT_FORWARD] - held[INPUT_BACK]);
+        f32 right = cam_speed * (f32)(held[INPUT_RIGHT] - held[INPUT_LEFT]);
 
-        if (glfwGetKey(window, GLFW_KEY_W))
-            cam.lookfrom = vec3_add(cam.lookfrom, vec3_scal(cam.lookat, speed));
-        if (glfwGetKey(window, GLFW_KEY_S))
-            cam.lookfrom = vec3_sub(cam.lookfrom, vec3_scal(cam.lookat, speed));
-        if (glfwGetKey(window, GLFW_KEY_A))
-        {
-            vec3_t temp = vec3_cross(cam.lookat, cam.up);
-            temp = vec3_normalize(temp);
-            temp = vec3_scal(temp, speed);
-            cam.lookfrom = vec3_sub(cam.lookfrom, temp);
-        }
-        if (glfwGetKey(window, GLFW_KEY_D))
-        {
-            vec3_t temp = vec3_cross(cam.lookat, cam.up);
-            temp = vec3_normalize(temp);
-            temp = vec3_scal(temp, speed);
-            cam.lookfrom = vec3_add(cam.lookfrom, temp);
-        }
+        cam.lookfrom = vec3_add(cam.lookfrom, vec3_scal(cam.lookat, forward));
+        cam.lookfrom = vec3_add(cam.lookfrom, vec3_scal(side, right));
+        changed = TRUE;
     }
 
     if (glfwGetKey(window, GLFW_KEY_Q))
@@ -299,6 +1726,8 @@ process_input(GLFWwindow *window,
     {
         samples = 600;
     }
+
+    return changed;
 }
 
 void
@@ -312,6 +1741,8 @@ mouse_callback(GLFWwindow *window,
     static f64 last_x = SCR_WIDTH / 2;
     static f64 last_y = SCR_HEIGHT / 2;
 
+    // Nuklear's hover state follows the cursor too
+    redraw = TRUE;
     if (!nuklear_control)
     {
         if (first_mouse)
@@ -363,4 +1794,8 @@ reset_camera(void)
     cam.lookat.x = 0;
     cam.lookat.y = 0;
     cam.lookat.z = -1;
+
+    cam.up.x = 0;
+    cam.up.y = 1;
+    cam.up.z = 0;
 }
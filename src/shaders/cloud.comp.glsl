@@ -0,0 +1,231 @@
+#version 450 core
+
+#define BVH_STACK_SIZE  64
+
+#include "lib/common.glsl"
+#include "lib/geometry.glsl"
+
+struct scene_t
+{
+    int num_spheres;
+    sphere_t spheres[1];
+};
+
+// The sphere cloud with the LBVH built over it on the GPU (lbvh.h). Leaves
+// hold one sphere and index it directly; materials index the palette.
+layout (std430, binding = 5) readonly buffer cloud_spheres
+{
+    vec4 cloud[];       // center, radius
+};
+
+layout (std430, binding = 6) readonly buffer cloud_materials
+{
+    uint cloud_material[];
+};
+
+layout (std430, binding = 7) readonly buffer lbvh_nodes
+{
+    bvh_node_t nodes[];
+};
+
+void        render_pixel(void);
+bool        cloud_hit(ray_t r, float t_min, float t_max, inout hit_record_t rec);
+bool        scene_hit(ray_t r, scene_t s, float t_min, float t_max, inout hit_record_t rec);
+vec3        ray_trace(ray_t r, scene_t world, uint max_depth);
+
+#include "lib/materials.glsl"
+#include "lib/envmap.glsl"
+
+void
+main(void)
+{
+    memoryBarrier();
+
+#if GROUP_PERSISTENT
+    // The pixel and its random state are the ones a grid dispatch gives it
+    ivec2 origin;
+
+    while (group_next(origin))
+    {
+        pixel = origin + group_offset() + tile_origin;
+        state = uint(pixel.x * 1973 + pixel.y * 9277) + seed * 26699;
+        render_pixel();
+    }
+#else
+    render_pixel();
+#endif
+
+    STATS_FLUSH();
+    memoryBarrier();
+}
+
+void
+render_pixel(void)
+{
+    scene_t scene;
+    scene.num_spheres = 1;
+
+    // Ground
+    scene.spheres[0].center = vec3(0, -1000.5, 0);
+    scene.spheres[0].radius = 1000;
+    scene.spheres[0].material_id = 0;
+
+    ray_t ray;
+
+    vec3 pixel_data = vec3(0.0);
+
+    for (uint i = 0; i < samples; i++)
+    {
+        float u = ((pixel.x + f_randf(state)) / resolution.x);
+        float v = ((pixel.y + f_randf(state)) / resolution.y);
+        ray = get_ray(u, v);
+        pixel_data += ray_trace(ray, scene, 50);
+    }
+
+    write_color(pixel_data, samples);
+}
+
+bool
+cloud_hit(ray_t r, float t_min, float t_max, inout hit_record_t rec)
+{
+    uint stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+    vec3 inv_dir = 1.0 / r.direction;
+    sphere_t s;
+
+    if (aabb_hit(nodes[0].min, nodes[0].max, r.origin, inv_dir, t_min, t_max) < 0.0)
+        return false;
+
+    uint node = 0;
+    for (;;)
+    {
+        STATS_ADD(STAT_NODE_VISITS, 1);
+        if (nodes[node].count > 0)
+        {
+            uint first = nodes[node].left_first;
+
+            STATS_ADD(STAT_SPHERE_TESTS, nodes[node].count);
+            for (uint i = 0; i < nodes[node].count; i++)
+            {
+                s.center = cloud[first + i].xyz;
+                s.radius = cloud[first + i].w;
+                s.material_id = int(cloud_material[first + i]);
+                if (sphere_hit(r, s, t_min, t_max, rec))
+                {
+                    found = true;
+                    t_max = rec.t;
+                }
+            }
+        }
+        else
+        {
+            uint left = nodes[node].left_first;
+            float t_left = aabb_hit(nodes[left].min, nodes[left].max, r.origin, inv_dir, t_min, t_max);
+            float t_right = aabb_hit(nodes[left + 1].min, nodes[left + 1].max, r.origin, inv_dir, t_min, t_max);
+
+            if (t_left >= 0.0 && t_right >= 0.0)
+            {
+                bool left_first = t_left <= t_right;
+                node = left_first ? left : left + 1;
+                if (stack_size < BVH_STACK_SIZE)
+                    stack[stack_size++] = left_first ? left + 1 : left;
+                continue;
+            }
+            if (t_left >= 0.0 || t_right >= 0.0)
+            {
+                node = (t_left >= 0.0) ? left : left + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        node = stack[--stack_size];
+    }
+
+    return found;
+}
+
+bool
+scene_hit(ray_t r, scene_t s, float t_min, float t_max, inout hit_record_t rec)
+{
+    hit_record_t temp_rec;
+    bool hit_anything = false;
+    float closest_so_far = t_max;
+
+    STATS_ADD(STAT_SPHERE_TESTS, s.num_spheres);
+    for (int i = 0; i < s.num_spheres; i++)
+    {
+        if (sphere_hit(r, s.spheres[i], t_min, closest_so_far, temp_rec))
+        {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+
+    if (cloud_hit(r, t_min, closest_so_far, temp_rec))
+    {
+        hit_anything = true;
+        rec = temp_rec;
+    }
+
+    return hit_anything;
+}
+
+vec3
+ray_trace(ray_t r, scene_t world, uint max_depth)
+{
+    ray_t cur_ray = r;
+    vec3 atten = vec3(0.0);
+    vec3 color = vec3(1.0);
+    vec3 radiance = vec3(0.0);
+    float bsdf_pdf = 0.0;   // of the last bounce, if the environment was sampled there too
+    hit_record_t rec;
+
+    int i;
+    for (i = 0; i < max_depth; i++)
+    {
+        ray_t scattered_ray;
+
+        STATS_RAY(i);
+        if (scene_hit(cur_ray, world, 0.001, 100000000000.0, rec))
+        {
+            if (scatter(cur_ray, rec, atten, scattered_ray))
+            {
+                uint type = materials[material_base + uint(rec.material_id)].type;
+
+                bsdf_pdf = 0.0;
+                if (env_size.x != 0u && (type == MAT_LAMBERTIAN || type == MAT_CHECKERED))
+                {
+                    radiance += color * atten * env_light(world, rec);
+                    bsdf_pdf = max(dot(rec.normal, scattered_ray.direction), 0.0) /
+                               (length(scattered_ray.direction) * PI);
+                }
+                color *= atten;
+                cur_ray = scattered_ray;
+            }
+            else
+            {
+                STATS_ADD(STAT_ABSORBED, 1);
+                color *= vec3(0.0);
+                break;
+            }
+        }
+        else
+        {
+            STATS_ADD(STAT_ESCAPED, 1);
+            radiance += color * sky(cur_ray.direction, bsdf_pdf);
+            break;
+        }
+    }
+
+    if (i == max_depth)
+        STATS_ADD(STAT_MAX_DEPTH, 1);
+
+    if (i < 50)
+        return radiance;
+    else
+        return vec3(0.0);   // exceeded iteration
+}
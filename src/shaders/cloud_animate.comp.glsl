@@ -0,0 +1,43 @@
+#version 450 core
+
+// Poses the sphere cloud at `time` from its rest positions and animation
+// channels, like scene_cloud_animate() on the CPU.
+
+#define GROUP_SIZE  256
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+uniform float time;
+
+layout (std430, binding = 5) writeonly buffer cloud_spheres
+{
+    vec4 spheres[];
+};
+
+layout (std430, binding = 8) readonly buffer cloud_rest
+{
+    vec4 rest[];
+};
+
+layout (std430, binding = 9) readonly buffer cloud_anim
+{
+    vec4 anim[];        // bounce height, speed, orbit radius, phase
+};
+
+void
+main(void)
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= num_spheres)
+        return;
+
+    vec4 a = anim[i];
+    float orbit = 0.5 * a.y * time + a.w;
+    vec4 s = rest[i];
+
+    s.x += a.z * (cos(orbit) - cos(a.w));
+    s.y += a.x * abs(sin(a.y * time));
+    s.z += a.z * (sin(orbit) - sin(a.w));
+    spheres[i] = s;
+}
@@ -0,0 +1,264 @@
+#version 450 core
+
+#define BVH_STACK_SIZE  64
+
+#include "lib/common.glsl"
+#include "lib/geometry.glsl"
+
+struct scene_t
+{
+    int num_spheres;
+    sphere_t spheres[1];
+};
+
+// All BLAS packed into the mesh buffers by tlas_pack(): node indices,
+// triangle indices and vertex indices are global. The TLAS nodes index the
+// instances, which are uploaded in leaf order.
+#include "lib/bvh4.glsl"
+
+struct instance_t
+{
+    mat4 world_to_object;
+    uint blas;
+    uint material_id;
+    uint root;
+    uint pad;
+};
+
+layout (std430, binding = 3) readonly buffer tlas_nodes
+{
+    bvh_node_t top_nodes[];
+};
+
+layout (std430, binding = 4) readonly buffer tlas_instances
+{
+    instance_t instances[];
+};
+
+void        render_pixel(void);
+vec3        triangle_normal(uint tri, vec3 bary);
+bool        tlas_hit(ray_t r, float t_min, float t_max, inout hit_record_t rec);
+bool        scene_hit(ray_t r, scene_t s, float t_min, float t_max, inout hit_record_t rec);
+vec3        ray_trace(ray_t r, scene_t world, uint max_depth);
+
+#include "lib/materials.glsl"
+#include "lib/envmap.glsl"
+
+void
+main(void)
+{
+    memoryBarrier();
+
+#if GROUP_PERSISTENT
+    // The pixel and its random state are the ones a grid dispatch gives it
+    ivec2 origin;
+
+    while (group_next(origin))
+    {
+        pixel = origin + group_offset() + tile_origin;
+        state = uint(pixel.x * 1973 + pixel.y * 9277) + seed * 26699;
+        render_pixel();
+    }
+#else
+    render_pixel();
+#endif
+
+    STATS_FLUSH();
+    memoryBarrier();
+}
+
+void
+render_pixel(void)
+{
+    scene_t scene;
+    scene.num_spheres = 1;
+
+    // Ground
+    scene.spheres[0].center = vec3(0, -1000.5, 0);
+    scene.spheres[0].radius = 1000;
+    scene.spheres[0].material_id = 0;
+
+    ray_t ray;
+
+    vec3 pixel_data = vec3(0.0);
+
+    for (uint i = 0; i < samples; i++)
+    {
+        float u = ((pixel.x + f_randf(state)) / resolution.x);
+        float v = ((pixel.y + f_randf(state)) / resolution.y);
+        ray = get_ray(u, v);
+        pixel_data += ray_trace(ray, scene, 50);
+    }
+
+    write_color(pixel_data, samples);
+}
+
+// Object space normal, not normalised
+vec3
+triangle_normal(uint tri, vec3 bary)
+{
+    mesh_vertex_t v0 = vertices[indices[tri * 3 + 0]];
+    mesh_vertex_t v1 = vertices[indices[tri * 3 + 1]];
+    mesh_vertex_t v2 = vertices[indices[tri * 3 + 2]];
+    vec3 normal = bary.x * v0.normal_v.xyz + bary.y * v1.normal_v.xyz + bary.z * v2.normal_v.xyz;
+
+    // Files without normals get the geometric one
+    if (dot(normal, normal) == 0.0)
+        normal = cross(v1.pos_u.xyz - v0.pos_u.xyz, v2.pos_u.xyz - v0.pos_u.xyz);
+
+    return normal;
+}
+
+bool
+tlas_hit(ray_t r, float t_min, float t_max, inout hit_record_t rec)
+{
+    uint stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    uint hit_instance = 0xffffffffu;
+    uint hit_tri = 0;
+    vec3 hit_bary = vec3(0.0);
+    vec3 inv_dir = 1.0 / r.direction;
+
+    if (aabb_hit(top_nodes[0].min, top_nodes[0].max, r.origin, inv_dir, t_min, t_max) < 0.0)
+        return false;
+
+    uint node = 0;
+    for (;;)
+    {
+        STATS_ADD(STAT_NODE_VISITS, 1);
+        if (top_nodes[node].count > 0)
+        {
+            uint first = top_nodes[node].left_first;
+            for (uint i = 0; i < top_nodes[node].count; i++)
+            {
+                ray_t local;
+                mat4 m = instances[first + i].world_to_object;
+
+                local.origin = (m * vec4(r.origin, 1.0)).xyz;
+                local.direction = (m * vec4(r.direction, 0.0)).xyz;
+                if (blas_hit(local, instances[first + i].root, t_min, t_max, hit_tri, hit_bary))
+                    hit_instance = first + i;
+            }
+        }
+        else
+        {
+            uint left = top_nodes[node].left_first;
+            float t_left = aabb_hit(top_nodes[left].min, top_nodes[left].max, r.origin, inv_dir, t_min, t_max);
+            float t_right = aabb_hit(top_nodes[left + 1].min, top_nodes[left + 1].max, r.origin, inv_dir, t_min, t_max);
+
+            if (t_left >= 0.0 && t_right >= 0.0)
+            {
+                bool left_first = t_left <= t_right;
+                node = left_first ? left : left + 1;
+                if (stack_size < BVH_STACK_SIZE)
+                    stack[stack_size++] = left_first ? left + 1 : left;
+                continue;
+            }
+            if (t_left >= 0.0 || t_right >= 0.0)
+            {
+                node = (t_left >= 0.0) ? left : left + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        node = stack[--stack_size];
+    }
+
+    if (hit_instance == 0xffffffffu)
+        return false;
+
+    // Back to world space with the transposed inverse
+    vec3 normal = transpose(mat3(instances[hit_instance].world_to_object)) * triangle_normal(hit_tri, hit_bary);
+
+    rec.t = t_max;
+    rec.p = ray_at(r, rec.t);
+    set_face_normal(r, normalize(normal), rec);
+    rec.material_id = int(instances[hit_instance].material_id);
+
+    return true;
+}
+
+bool
+scene_hit(ray_t r, scene_t s, float t_min, float t_max, inout hit_record_t rec)
+{
+    hit_record_t temp_rec;
+    bool hit_anything = false;
+    float closest_so_far = t_max;
+
+    STATS_ADD(STAT_SPHERE_TESTS, s.num_spheres);
+    for (int i = 0; i < s.num_spheres; i++)
+    {
+        if (sphere_hit(r, s.spheres[i], t_min, closest_so_far, temp_rec))
+        {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+
+    if (tlas_hit(r, t_min, closest_so_far, temp_rec))
+    {
+        hit_anything = true;
+        rec = temp_rec;
+    }
+
+    return hit_anything;
+}
+
+vec3
+ray_trace(ray_t r, scene_t world, uint max_depth)
+{
+    ray_t cur_ray = r;
+    vec3 atten = vec3(0.0);
+    vec3 color = vec3(1.0);
+    vec3 radiance = vec3(0.0);
+    float bsdf_pdf = 0.0;   // of the last bounce, if the environment was sampled there too
+    hit_record_t rec;
+
+    int i;
+    for (i = 0; i < max_depth; i++)
+    {
+        ray_t scattered_ray;
+
+        STATS_RAY(i);
+        if (scene_hit(cur_ray, world, 0.001, 100000000000.0, rec))
+        {
+            if (scatter(cur_ray, rec, atten, scattered_ray))
+            {
+                uint type = materials[material_base + uint(rec.material_id)].type;
+
+                bsdf_pdf = 0.0;
+                if (env_size.x != 0u && (type == MAT_LAMBERTIAN || type == MAT_CHECKERED))
+                {
+                    radiance += color * atten * env_light(world, rec);
+                    bsdf_pdf = max(dot(rec.normal, scattered_ray.direction), 0.0) /
+                               (length(scattered_ray.direction) * PI);
+                }
+                color *= atten;
+                cur_ray = scattered_ray;
+            }
+            else
+            {
+                STATS_ADD(STAT_ABSORBED, 1);
+                color *= vec3(0.0);
+                break;
+            }
+        }
+        else
+        {
+            STATS_ADD(STAT_ESCAPED, 1);
+            radiance += color * sky(cur_ray.direction, bsdf_pdf);
+            break;
+        }
+    }
+
+    if (i == max_depth)
+        STATS_ADD(STAT_MAX_DEPTH, 1);
+
+    if (i < 50)
+        return radiance;
+    else
+        return vec3(0.0);   // exceeded iteration
+}
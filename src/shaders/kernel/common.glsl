@@ -0,0 +1,20 @@
+// Declarations of the sphere kernel's scene, on top of ../lib/common.glsl:
+// the spheres and planes as constants
+
+struct plane_t
+{
+    vec3 pos;
+    vec3 normal;
+    int material_id;
+};
+
+const sphere_t spheres[SCENE_NUM_SPHERES] = sphere_t[](SCENE_SPHERES);
+#if SCENE_NUM_PLANES > 0
+const plane_t planes[SCENE_NUM_PLANES] = plane_t[](SCENE_PLANES);
+#endif
+
+void        render_pixel(void);
+bool        plane_hit(ray_t r, plane_t p, float t_min, float t_max, inout hit_record_t rec);
+bool        scene_hit(ray_t r, float t_min, float t_max, inout hit_record_t rec);
+vec3        sky(vec3 direction);
+vec3        ray_trace(ray_t r);
@@ -0,0 +1,59 @@
+// Intersection against the scene's constant spheres and planes
+
+// Two sided
+bool
+plane_hit(ray_t r, plane_t p, float t_min, float t_max, inout hit_record_t rec)
+{
+    float denom = dot(p.normal, r.direction);
+    vec3 normal = (denom > 0.0) ? p.normal : -p.normal;
+    float t;
+
+    denom = abs(denom);
+    if (denom <= 1e-6)
+        return false;
+
+    t = dot(p.pos - r.origin, normal) / denom;
+    if (t < t_min || t > t_max)
+        return false;
+
+    rec.t = t;
+    rec.p = ray_at(r, rec.t);
+    set_face_normal(r, normal, rec);
+    rec.material_id = p.material_id;
+
+    return true;
+}
+
+bool
+scene_hit(ray_t r, float t_min, float t_max, inout hit_record_t rec)
+{
+    hit_record_t temp_rec;
+    bool hit_anything = false;
+    float closest_so_far = t_max;
+
+    STATS_ADD(STAT_SPHERE_TESTS, SCENE_NUM_SPHERES);
+    for (int i = 0; i < SCENE_NUM_SPHERES; i++)
+    {
+        if (sphere_hit(r, spheres[i], t_min, closest_so_far, temp_rec))
+        {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+
+#if SCENE_NUM_PLANES > 0
+    STATS_ADD(STAT_PLANE_TESTS, SCENE_NUM_PLANES);
+    for (int i = 0; i < SCENE_NUM_PLANES; i++)
+    {
+        if (plane_hit(r, planes[i], t_min, closest_so_far, temp_rec))
+        {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+#endif
+
+    return hit_anything;
+}
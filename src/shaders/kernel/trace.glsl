@@ -0,0 +1,257 @@
+// Path tracing and the entry point, which traces its pixel or, in a
+// persistent kernel, the pixels of the tiles its group takes. Chapter 7
+// colours primary hits by their normal; scenes with SCENE_BIN_MATERIALS
+// shade their hits binned by material type, the others right where they
+// are found.
+
+void
+main(void)
+{
+    memoryBarrier();
+
+#if GROUP_PERSISTENT
+    // The pixel and its random state are the ones a grid dispatch gives it
+    ivec2 origin;
+
+    while (group_next(origin))
+    {
+        pixel = origin + group_offset() + tile_origin;
+        state = uint(pixel.x * 1973 + pixel.y * 9277) + seed * 26699;
+        render_pixel();
+    }
+#else
+    render_pixel();
+#endif
+
+    STATS_FLUSH();
+    memoryBarrier();
+}
+
+void
+render_pixel(void)
+{
+#if SCENE_SHADE_NORMALS
+    // One centred sample, stored as is
+    ray_t ray = get_ray(pixel.x / resolution.x, pixel.y / resolution.y);
+
+    imageStore(image_data, pixel, vec4(ray_trace(ray), 1.0));
+#else
+    vec3 pixel_data = vec3(0.0);
+
+    for (uint i = 0; i < samples; i++)
+    {
+        float u = ((pixel.x + f_randf(state)) / resolution.x);
+        float v = ((pixel.y + f_randf(state)) / resolution.y);
+        pixel_data += ray_trace(get_ray(u, v));
+    }
+
+    write_color(pixel_data, samples);
+#endif
+}
+
+vec3
+sky(vec3 direction)
+{
+    float t = 0.5 * (normalize(direction).y + 1.0);
+
+    return (1.0 - t) * SCENE_SKY_HORIZON + t * SCENE_SKY_ZENITH;
+}
+
+#if SCENE_SHADE_NORMALS
+
+vec3
+ray_trace(ray_t r)
+{
+    hit_record_t rec;
+
+    STATS_RAY(0);
+    if (scene_hit(r, 0, 10000000.0, rec))
+        return 0.5 * (rec.normal + vec3(1, 1, 1));
+
+    STATS_ADD(STAT_ESCAPED, 1);
+    return sky(r.direction);
+}
+
+#elif SCENE_BIN_MATERIALS
+
+#include "../lib/packed.glsl"
+
+#define HIT_FRONT_FACE  0x80000000u
+#define HIT_SCATTERED   0x40000000u
+
+// Hits of the workgroup, binned by material type for shading. Every bounce
+// the hits are stored grouped by type, so consecutive invocations shade the
+// same kind of material; the results go back to the paths that own them.
+// Directions are stored octahedral and attenuations as halves (packed.h),
+// 32 bytes per hit instead of 52.
+shared uint bin_count[NUM_MAT_TYPES];
+shared vec3 bin_p[GROUP_SIZE];
+shared uint bin_normal[GROUP_SIZE];     // octahedral
+shared uint bin_dir[GROUP_SIZE];        // incoming, then scattered direction
+shared uvec2 bin_atten[GROUP_SIZE];     // rgb halves
+shared uint bin_info[GROUP_SIZE];       // material id and HIT_* flags
+
+// All invocations of the workgroup come through here in step, finished
+// paths included, since the binning needs barriers
+vec3
+ray_trace(ray_t r)
+{
+    ray_t cur_ray = r;
+    vec3 color = vec3(SCENE_EXPOSURE);
+    bool alive = true;
+    uint lane = gl_LocalInvocationIndex;
+    hit_record_t rec;
+
+    if (lane < NUM_MAT_TYPES)
+        bin_count[lane] = 0;
+    barrier();
+
+    for (uint i = 0; i < SCENE_MAX_DEPTH; i++)
+    {
+        bool hit = false;
+        uint type = 0;
+        uint slot = 0;
+        uint num_hits = 0;
+
+        if (alive)
+        {
+            STATS_RAY(i);
+            hit = scene_hit(cur_ray, 0.001, 100000000000.0, rec);
+            if (!hit)
+            {
+                STATS_ADD(STAT_ESCAPED, 1);
+                color *= sky(cur_ray.direction);
+                alive = false;
+            }
+        }
+
+        // Count the hits per material type; every invocation then finds
+        // where the bins start and files its hit
+        if (hit)
+        {
+            type = min(materials[material_base + uint(rec.material_id)].type, NUM_MAT_TYPES - 1);
+            slot = atomicAdd(bin_count[type], 1);
+        }
+        barrier();
+        for (uint b = 0; b < NUM_MAT_TYPES; b++)
+        {
+            slot += (b < type) ? bin_count[b] : 0;
+            num_hits += bin_count[b];
+        }
+        if (hit)
+        {
+            bin_p[slot] = rec.p;
+            bin_normal[slot] = oct_encode(rec.normal);
+            bin_dir[slot] = oct_encode(cur_ray.direction);
+            bin_info[slot] = uint(rec.material_id) | (rec.front_face ? HIT_FRONT_FACE : 0u);
+        }
+        barrier();
+        if (lane < NUM_MAT_TYPES)
+            bin_count[lane] = 0;    // read by everyone, ready for the next bounce
+        if (num_hits == 0)
+            break;
+
+        // One hit per invocation, in bin order
+        if (lane < num_hits)
+        {
+            hit_record_t shade_rec;
+            ray_t in_ray;
+            ray_t scattered_ray;
+            vec3 atten;
+
+            shade_rec.p = bin_p[lane];
+            shade_rec.normal = oct_decode(bin_normal[lane]);
+            shade_rec.front_face = (bin_info[lane] & HIT_FRONT_FACE) != 0;
+            shade_rec.material_id = int(bin_info[lane] & 0xffffu);
+            in_ray.origin = shade_rec.p;
+            in_ray.direction = oct_decode(bin_dir[lane]);
+
+            if (scatter(in_ray, shade_rec, atten, scattered_ray))
+            {
+                bin_dir[lane] = oct_encode(scattered_ray.direction);
+                bin_atten[lane] = uvec2(packHalf2x16(atten.xy), packHalf2x16(vec2(atten.z, 0.0)));
+                bin_info[lane] |= HIT_SCATTERED;
+            }
+        }
+        barrier();
+
+        if (hit)
+        {
+            if ((bin_info[slot] & HIT_SCATTERED) != 0)
+            {
+                uvec2 atten = bin_atten[slot];
+
+                color *= vec3(unpackHalf2x16(atten.x), unpackHalf2x16(atten.y).x);
+                cur_ray.origin = rec.p;
+                cur_ray.direction = oct_decode(bin_dir[slot]);
+            }
+            else
+            {
+#if !SCENE_ABSORB_KEEPS
+                color *= vec3(0.0);
+#endif
+                STATS_ADD(STAT_ABSORBED, 1);
+                alive = false;
+            }
+        }
+    }
+
+    if (alive)
+        STATS_ADD(STAT_MAX_DEPTH, 1);
+
+    // Paths that run out keep their colour in scenes with a short max
+    // depth, like on the CPU
+    if (alive && SCENE_MAX_DEPTH >= 50)
+        return vec3(0.0);
+
+    return color;
+}
+
+#else
+
+vec3
+ray_trace(ray_t r)
+{
+    ray_t cur_ray = r;
+    vec3 atten = vec3(0.0);
+    vec3 color = vec3(SCENE_EXPOSURE);
+    hit_record_t rec;
+
+    uint i;
+    for (i = 0; i < SCENE_MAX_DEPTH; i++)
+    {
+        ray_t scattered_ray;
+
+        STATS_RAY(i);
+        if (!scene_hit(cur_ray, 0.001, 100000000000.0, rec))
+        {
+            STATS_ADD(STAT_ESCAPED, 1);
+            color *= sky(cur_ray.direction);
+            break;
+        }
+
+        if (!scatter(cur_ray, rec, atten, scattered_ray))
+        {
+#if !SCENE_ABSORB_KEEPS
+            color *= vec3(0.0);
+#endif
+            STATS_ADD(STAT_ABSORBED, 1);
+            break;
+        }
+
+        color *= atten;
+        cur_ray = scattered_ray;
+    }
+
+    if (i == SCENE_MAX_DEPTH)
+        STATS_ADD(STAT_MAX_DEPTH, 1);
+
+    // Paths that run out keep their colour in scenes with a short max
+    // depth, like on the CPU
+    if (i == SCENE_MAX_DEPTH && SCENE_MAX_DEPTH >= 50)
+        return vec3(0.0);
+
+    return color;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#version 450 core
+
+// LBVH pass 1: bounds of the sphere centres, which the Morton codes are
+// quantised to. Every workgroup reduces its spheres in shared memory and
+// merges the result with integer atomics on floats mapped to uints that
+// sort like the floats do.
+
+#define GROUP_SIZE  256
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+
+layout (std430, binding = 5) readonly buffer cloud_spheres
+{
+    vec4 spheres[];     // center, radius
+};
+
+layout (std430, binding = 15) buffer lbvh_bounds
+{
+    uint bounds[6];     // min xyz, max xyz, as ordered uints
+};
+
+shared vec3 group_min[GROUP_SIZE];
+shared vec3 group_max[GROUP_SIZE];
+
+uint
+float_to_ordered(float f)
+{
+    uint u = floatBitsToUint(f);
+
+    return ((u & 0x80000000u) != 0u) ? ~u : (u | 0x80000000u);
+}
+
+void
+main(void)
+{
+    uint i = gl_GlobalInvocationID.x;
+    uint t = gl_LocalInvocationIndex;
+
+    // Threads past the end repeat sphere 0, which is in the bounds anyway
+    vec3 c = spheres[(i < num_spheres) ? i : 0].xyz;
+    group_min[t] = c;
+    group_max[t] = c;
+    barrier();
+
+    for (uint s = GROUP_SIZE / 2; s > 0; s >>= 1)
+    {
+        if (t < s)
+        {
+            group_min[t] = min(group_min[t], group_min[t + s]);
+            group_max[t] = max(group_max[t], group_max[t + s]);
+        }
+        barrier();
+    }
+
+    if (t == 0)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            atomicMin(bounds[a], float_to_ordered(group_min[0][a]));
+            atomicMax(bounds[3 + a], float_to_ordered(group_max[0][a]));
+        }
+    }
+}
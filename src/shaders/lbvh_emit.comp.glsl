@@ -0,0 +1,137 @@
+#version 450 core
+
+// LBVH pass 4: the hierarchy from the sorted Morton codes, one internal
+// node per thread, after Karras, "Maximizing Parallelism in the
+// Construction of BVHs, Octrees, and k-d Trees" (HPG 2012).
+//
+// Karras' internal node i covers a range of leaves and has one split in it.
+// To keep the bvh_node_t layout the traversal kernels already use, where
+// both children are adjacent, the children of internal node i are stored
+// in slots 2i + 1 and 2i + 2 and the root in slot 0. slots[] records where
+// every internal node (0 .. n - 2) and leaf (n - 1 ..) ended up, which the
+// bottom-up fit needs. Leaves hold one sphere and index it directly.
+
+#define GROUP_SIZE  256
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+
+struct bvh_node_t
+{
+    vec3 min;
+    uint left_first;
+    vec3 max;
+    uint count;
+};
+
+layout (std430, binding = 7) writeonly buffer lbvh_nodes
+{
+    bvh_node_t nodes[];
+};
+
+layout (std430, binding = 8) readonly buffer lbvh_keys
+{
+    uint keys[];
+};
+
+layout (std430, binding = 9) readonly buffer lbvh_values
+{
+    uint values[];
+};
+
+layout (std430, binding = 13) writeonly buffer lbvh_slots
+{
+    uint slots[];
+};
+
+// Length of the common prefix of the codes of leaves i and j; equal codes
+// fall back to the indices so every key is unique
+int
+delta(int i, int j)
+{
+    if (j < 0 || j >= int(num_spheres))
+        return -1;
+
+    uint a = keys[i];
+    uint b = keys[j];
+    if (a == b)
+        return 32 + 31 - findMSB(uint(i ^ j));
+
+    return 31 - findMSB(a ^ b);
+}
+
+void
+set_child(uint slot, int index, bool leaf)
+{
+    if (leaf)
+    {
+        nodes[slot].left_first = values[index];
+        nodes[slot].count = 1;
+        slots[num_spheres - 1 + uint(index)] = slot;
+    }
+    else
+    {
+        nodes[slot].left_first = 2 * uint(index) + 1;
+        nodes[slot].count = 0;
+        slots[index] = slot;
+    }
+}
+
+void
+main(void)
+{
+    int i = int(gl_GlobalInvocationID.x);
+
+    if (num_spheres == 1)
+    {
+        if (i == 0)
+        {
+            nodes[0].left_first = values[0];
+            nodes[0].count = 1;
+            slots[0] = 0;
+        }
+        return;
+    }
+    if (i >= int(num_spheres) - 1)
+        return;
+
+    // Direction of the range and its other end
+    int d = (delta(i, i + 1) - delta(i, i - 1)) >= 0 ? 1 : -1;
+    int delta_min = delta(i, i - d);
+    int l_max = 2;
+
+    while (delta(i, i + l_max * d) > delta_min)
+        l_max *= 2;
+
+    int l = 0;
+    for (int t = l_max / 2; t >= 1; t /= 2)
+    {
+        if (delta(i, i + (l + t) * d) > delta_min)
+            l += t;
+    }
+    int j = i + l * d;
+
+    // Split position: the last leaf sharing more than delta_node bits with i
+    int delta_node = delta(i, j);
+    int s = 0;
+    for (int div = 2; ; div *= 2)
+    {
+        int t = (l + div - 1) / div;
+
+        if (delta(i, i + (s + t) * d) > delta_node)
+            s += t;
+        if (t == 1)
+            break;
+    }
+    int gamma = i + s * d + min(d, 0);
+
+    set_child(2 * uint(i) + 1, gamma, min(i, j) == gamma);
+    set_child(2 * uint(i) + 2, gamma + 1, max(i, j) == gamma + 1);
+
+    if (i == 0)
+    {
+        nodes[0].left_first = 1;
+        nodes[0].count = 0;
+        slots[0] = 0;
+    }
+}
@@ -0,0 +1,74 @@
+#version 450 core
+
+// LBVH pass 5: bounds, bottom-up. Every leaf thread writes its sphere's box
+// and walks up; at each internal node the first thread to arrive stops and
+// the second, which knows both children are done, writes the union. The
+// arrival counters have to be cleared before every run.
+//
+// Only boxes are written, so the same pass refits the tree after spheres
+// moved.
+
+#define GROUP_SIZE  256
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+
+struct bvh_node_t
+{
+    vec3 min;
+    uint left_first;
+    vec3 max;
+    uint count;
+};
+
+layout (std430, binding = 5) readonly buffer cloud_spheres
+{
+    vec4 spheres[];
+};
+
+layout (std430, binding = 7) coherent buffer lbvh_nodes
+{
+    bvh_node_t nodes[];
+};
+
+layout (std430, binding = 13) readonly buffer lbvh_slots
+{
+    uint slots[];
+};
+
+layout (std430, binding = 14) coherent buffer lbvh_arrivals
+{
+    uint arrivals[];
+};
+
+void
+main(void)
+{
+    uint k = gl_GlobalInvocationID.x;
+
+    if (k >= num_spheres)
+        return;
+
+    uint slot = slots[num_spheres - 1 + k];
+    vec4 sphere = spheres[nodes[slot].left_first];
+
+    nodes[slot].min = sphere.xyz - sphere.w;
+    nodes[slot].max = sphere.xyz + sphere.w;
+
+    while (slot != 0)
+    {
+        uint parent = (slot - 1) / 2;
+        uint left = 2 * parent + 1;
+
+        memoryBarrierBuffer();
+        if (atomicAdd(arrivals[parent], 1) == 0)
+            return;
+
+        vec3 bmin = min(nodes[left].min, nodes[left + 1].min);
+        vec3 bmax = max(nodes[left].max, nodes[left + 1].max);
+
+        slot = slots[parent];
+        nodes[slot].min = bmin;
+        nodes[slot].max = bmax;
+    }
+}
@@ -0,0 +1,65 @@
+#version 450 core
+
+// LBVH pass 2: 30 bit Morton code of every sphere centre, 10 bits per axis
+// within the bounds from the first pass. The sphere index rides along as
+// the sort value.
+
+#define GROUP_SIZE  256
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+
+layout (std430, binding = 5) readonly buffer cloud_spheres
+{
+    vec4 spheres[];
+};
+
+layout (std430, binding = 8) writeonly buffer lbvh_keys
+{
+    uint keys[];
+};
+
+layout (std430, binding = 9) writeonly buffer lbvh_values
+{
+    uint values[];
+};
+
+layout (std430, binding = 15) readonly buffer lbvh_bounds
+{
+    uint bounds[6];
+};
+
+float
+ordered_to_float(uint u)
+{
+    return uintBitsToFloat(((u & 0x80000000u) != 0u) ? (u & 0x7fffffffu) : ~u);
+}
+
+// Spreads the low 10 bits of v out to every third bit
+uint
+expand_bits(uint v)
+{
+    v = (v * 0x00010001u) & 0xff0000ffu;
+    v = (v * 0x00000101u) & 0x0f00f00fu;
+    v = (v * 0x00000011u) & 0xc30c30c3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+
+    return v;
+}
+
+void
+main(void)
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= num_spheres)
+        return;
+
+    vec3 bmin = vec3(ordered_to_float(bounds[0]), ordered_to_float(bounds[1]), ordered_to_float(bounds[2]));
+    vec3 bmax = vec3(ordered_to_float(bounds[3]), ordered_to_float(bounds[4]), ordered_to_float(bounds[5]));
+    vec3 p = (spheres[i].xyz - bmin) / max(bmax - bmin, vec3(1e-20));
+    uvec3 q = uvec3(clamp(p * 1024.0, vec3(0.0), vec3(1023.0)));
+
+    keys[i] = expand_bits(q.x) * 4u + expand_bits(q.y) * 2u + expand_bits(q.z);
+    values[i] = i;
+}
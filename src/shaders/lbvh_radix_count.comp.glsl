@@ -0,0 +1,50 @@
+#version 450 core
+
+// LBVH radix sort, step 1 of every digit: how many keys of each block have
+// each digit value. Counts are stored digit major, so one exclusive scan
+// over them gives every block its output offset per digit.
+
+#define GROUP_SIZE  256
+#define ITEMS       16      // keys per thread
+#define BLOCK_SIZE  (GROUP_SIZE * ITEMS)
+#define RADIX       16      // 4 bit digits
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+uniform uint num_blocks;
+uniform uint shift;
+
+layout (std430, binding = 8) readonly buffer lbvh_keys_in
+{
+    uint keys_in[];
+};
+
+layout (std430, binding = 12) writeonly buffer lbvh_block_counts
+{
+    uint block_counts[];
+};
+
+shared uint histogram[RADIX];
+
+void
+main(void)
+{
+    uint t = gl_LocalInvocationIndex;
+    uint block = gl_WorkGroupID.x;
+
+    if (t < RADIX)
+        histogram[t] = 0;
+    barrier();
+
+    // Order doesn't matter here, so read coalesced
+    for (uint k = 0; k < ITEMS; k++)
+    {
+        uint i = block * BLOCK_SIZE + k * GROUP_SIZE + t;
+        if (i < num_spheres)
+            atomicAdd(histogram[(keys_in[i] >> shift) & (RADIX - 1)], 1);
+    }
+    barrier();
+
+    if (t < RADIX)
+        block_counts[t * num_blocks + block] = histogram[t];
+}
@@ -0,0 +1,50 @@
+#version 450 core
+
+// LBVH radix sort, step 2: exclusive prefix sum over all block counts, in
+// place, by a single workgroup. Each thread sums a run of entries, the run
+// totals are scanned in shared memory and then the runs are written back.
+
+#define GROUP_SIZE  1024
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_entries;
+
+layout (std430, binding = 12) buffer lbvh_block_counts
+{
+    uint block_counts[];
+};
+
+shared uint partial[GROUP_SIZE];
+
+void
+main(void)
+{
+    uint t = gl_LocalInvocationIndex;
+    uint per_thread = (num_entries + GROUP_SIZE - 1) / GROUP_SIZE;
+    uint first = min(t * per_thread, num_entries);
+    uint last = min(first + per_thread, num_entries);
+    uint sum = 0;
+
+    for (uint i = first; i < last; i++)
+        sum += block_counts[i];
+
+    partial[t] = sum;
+    barrier();
+
+    // Hillis-Steele inclusive scan of the run totals
+    for (uint offset = 1; offset < GROUP_SIZE; offset <<= 1)
+    {
+        uint add = (t >= offset) ? partial[t - offset] : 0;
+        barrier();
+        partial[t] += add;
+        barrier();
+    }
+
+    uint running = partial[t] - sum;
+    for (uint i = first; i < last; i++)
+    {
+        uint c = block_counts[i];
+        block_counts[i] = running;
+        running += c;
+    }
+}
@@ -0,0 +1,87 @@
+#version 450 core
+
+// LBVH radix sort, step 3: stable scatter of every key/value pair to its
+// place for this digit. Each thread owns ITEMS consecutive keys; a scan of
+// the per thread digit counts over the workgroup ranks them within the
+// block, the scanned block counts place the block.
+
+#define GROUP_SIZE  256
+#define ITEMS       16
+#define BLOCK_SIZE  (GROUP_SIZE * ITEMS)
+#define RADIX       16
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+uniform uint num_blocks;
+uniform uint shift;
+
+layout (std430, binding = 8) readonly buffer lbvh_keys_in
+{
+    uint keys_in[];
+};
+
+layout (std430, binding = 9) readonly buffer lbvh_values_in
+{
+    uint values_in[];
+};
+
+layout (std430, binding = 10) writeonly buffer lbvh_keys_out
+{
+    uint keys_out[];
+};
+
+layout (std430, binding = 11) writeonly buffer lbvh_values_out
+{
+    uint values_out[];
+};
+
+layout (std430, binding = 12) readonly buffer lbvh_block_offsets
+{
+    uint block_offsets[];
+};
+
+shared uint ranks[RADIX * GROUP_SIZE];
+
+void
+main(void)
+{
+    uint t = gl_LocalInvocationIndex;
+    uint block = gl_WorkGroupID.x;
+    uint first = block * BLOCK_SIZE + t * ITEMS;
+    uint last = min(first + ITEMS, num_spheres);
+    uint cursor[RADIX];
+
+    for (uint d = 0; d < RADIX; d++)
+        cursor[d] = 0;
+    for (uint i = first; i < last; i++)
+        cursor[(keys_in[i] >> shift) & (RADIX - 1)]++;
+
+    for (uint d = 0; d < RADIX; d++)
+        ranks[d * GROUP_SIZE + t] = cursor[d];
+    barrier();
+
+    // Inclusive scan along the threads, all digits at once
+    for (uint offset = 1; offset < GROUP_SIZE; offset <<= 1)
+    {
+        uint add[RADIX];
+
+        for (uint d = 0; d < RADIX; d++)
+            add[d] = (t >= offset) ? ranks[d * GROUP_SIZE + t - offset] : 0;
+        barrier();
+        for (uint d = 0; d < RADIX; d++)
+            ranks[d * GROUP_SIZE + t] += add[d];
+        barrier();
+    }
+
+    for (uint d = 0; d < RADIX; d++)
+        cursor[d] = block_offsets[d * num_blocks + block] + ranks[d * GROUP_SIZE + t] - cursor[d];
+
+    for (uint i = first; i < last; i++)
+    {
+        uint key = keys_in[i];
+        uint dst = cursor[(key >> shift) & (RADIX - 1)]++;
+
+        keys_out[dst] = key;
+        values_out[dst] = values_in[i];
+    }
+}
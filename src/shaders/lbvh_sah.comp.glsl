@@ -0,0 +1,66 @@
+#version 450 core
+
+// SAH cost of the LBVH, like bvh_sah_cost(): node areas relative to the
+// root, summed per workgroup in shared memory and then added up in 16.16
+// fixed point with an integer atomic.
+
+#define GROUP_SIZE          256
+#define COST_TRAVERSAL      1.0
+#define COST_INTERSECT      1.0
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint num_spheres;
+
+struct bvh_node_t
+{
+    vec3 min;
+    uint left_first;
+    vec3 max;
+    uint count;
+};
+
+layout (std430, binding = 7) readonly buffer lbvh_nodes
+{
+    bvh_node_t nodes[];
+};
+
+layout (std430, binding = 15) buffer lbvh_cost
+{
+    uint cost;          // 16.16
+};
+
+shared float group_cost[GROUP_SIZE];
+
+float
+area(vec3 bmin, vec3 bmax)
+{
+    vec3 e = bmax - bmin;
+
+    return 2.0 * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+void
+main(void)
+{
+    uint i = gl_GlobalInvocationID.x;
+    uint t = gl_LocalInvocationIndex;
+    float c = 0.0;
+
+    if (i < 2 * num_spheres - 1)
+    {
+        c = area(nodes[i].min, nodes[i].max) / area(nodes[0].min, nodes[0].max);
+        c *= (nodes[i].count > 0) ? COST_INTERSECT * float(nodes[i].count) : COST_TRAVERSAL;
+    }
+    group_cost[t] = c;
+    barrier();
+
+    for (uint s = GROUP_SIZE / 2; s > 0; s >>= 1)
+    {
+        if (t < s)
+            group_cost[t] += group_cost[t + s];
+        barrier();
+    }
+
+    if (t == 0)
+        atomicAdd(cost, uint(group_cost[0] * 65536.0 + 0.5));
+}
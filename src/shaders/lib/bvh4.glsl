@@ -0,0 +1,209 @@
+// Triangle meshes under compressed 4 wide BVHs (bvh4.h), with the watertight
+// triangle test. Needs ray_t, BVH_STACK_SIZE and stats.glsl.
+
+// Mesh buffers, laid out by bvh4.h / mesh.h. Triangles are stored in BVH
+// leaf order, so a leaf covers indices[3 * first .. 3 * (first + count)).
+// The nodes are compressed and 4 wide: child boxes are bytes on a power of
+// two grid from the node's origin, one uint per axis holding all four
+// children; a child with a count is a leaf of that many triangles.
+struct bvh4_node_t
+{
+    vec3 origin;
+    uint exponents;     // biased like a float's; byte 3 is the number of children
+    uint qmin[3];
+    uint qmax[3];
+    uint child[4];      // node, or first triangle of a leaf
+    uint counts;        // one byte per child
+    uint pad;
+};
+
+struct mesh_vertex_t
+{
+    vec4 pos_u;
+    vec4 normal_v;
+};
+
+layout (std430, binding = 0) readonly buffer mesh_nodes
+{
+    bvh4_node_t nodes[];
+};
+
+layout (std430, binding = 1) readonly buffer mesh_vertices
+{
+    mesh_vertex_t vertices[];
+};
+
+layout (std430, binding = 2) readonly buffer mesh_indices
+{
+    uint indices[];
+};
+
+// Per ray constants of the watertight test
+struct tri_ray_t
+{
+    ivec3 k;
+    vec3 shear;
+};
+
+
+// Woop, Benthin & Wald, "Watertight Ray/Triangle Intersection" (JCGT 2013).
+// The ray is sheared so it points down +z, which makes the edge tests
+// exact for shared edges: a ray can't slip between two triangles.
+tri_ray_t
+tri_ray_setup(ray_t r)
+{
+    tri_ray_t tr;
+    vec3 a = abs(r.direction);
+
+    tr.k.z = (a.x > a.y) ? ((a.x > a.z) ? 0 : 2) : ((a.y > a.z) ? 1 : 2);
+    tr.k.x = (tr.k.z + 1) % 3;
+    tr.k.y = (tr.k.x + 1) % 3;
+    if (r.direction[tr.k.z] < 0.0)
+        tr.k.xy = tr.k.yx;     // keep the winding
+
+    tr.shear.x = r.direction[tr.k.x] / r.direction[tr.k.z];
+    tr.shear.y = r.direction[tr.k.y] / r.direction[tr.k.z];
+    tr.shear.z = 1.0 / r.direction[tr.k.z];
+
+    return tr;
+}
+
+bool
+triangle_hit(ray_t r, tri_ray_t tr, uint tri, float t_min, inout float t_max, out vec3 bary)
+{
+    vec3 A = vertices[indices[tri * 3 + 0]].pos_u.xyz - r.origin;
+    vec3 B = vertices[indices[tri * 3 + 1]].pos_u.xyz - r.origin;
+    vec3 C = vertices[indices[tri * 3 + 2]].pos_u.xyz - r.origin;
+
+    float Ax = A[tr.k.x] - tr.shear.x * A[tr.k.z];
+    float Ay = A[tr.k.y] - tr.shear.y * A[tr.k.z];
+    float Bx = B[tr.k.x] - tr.shear.x * B[tr.k.z];
+    float By = B[tr.k.y] - tr.shear.y * B[tr.k.z];
+    float Cx = C[tr.k.x] - tr.shear.x * C[tr.k.z];
+    float Cy = C[tr.k.y] - tr.shear.y * C[tr.k.z];
+
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+
+    // Exactly on an edge: redo the edge functions in double precision
+    if (U == 0.0 || V == 0.0 || W == 0.0)
+    {
+        U = float(double(Cx) * double(By) - double(Cy) * double(Bx));
+        V = float(double(Ax) * double(Cy) - double(Ay) * double(Cx));
+        W = float(double(Bx) * double(Ay) - double(By) * double(Ax));
+    }
+
+    if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0))
+        return false;
+
+    float det = U + V + W;
+    if (det == 0.0)
+        return false;
+
+    float T = U * tr.shear.z * A[tr.k.z] + V * tr.shear.z * B[tr.k.z] + W * tr.shear.z * C[tr.k.z];
+    float t = T / det;
+    if (t < t_min || t > t_max)
+        return false;
+
+    t_max = t;
+    bary = vec3(U, V, W) / det;
+
+    return true;
+}
+
+// Children of a wide node hit by the ray, nearest first. Each key is the
+// entry distance with the child slot in its two low bits (rounding the
+// distance down a little); misses and unused slots sort last as 0xffffffff.
+uvec4
+bvh4_children_hit(bvh4_node_t node, vec3 origin, vec3 inv_dir, float t_min, float t_max)
+{
+    uvec4 shifts = uvec4(0, 8, 16, 24);
+    vec4 enter = vec4(t_min);
+    vec4 leave = vec4(t_max);
+
+    for (int a = 0; a < 3; a++)
+    {
+        // (origin + q * step - o) / d, the division folded into the constants
+        float scale = uintBitsToFloat(((node.exponents >> shifts[a]) & 0xffu) << 23) * inv_dir[a];
+        float base = (node.origin[a] - origin[a]) * inv_dir[a];
+        vec4 t0 = base + vec4((uvec4(node.qmin[a]) >> shifts) & 0xffu) * scale;
+        vec4 t1 = base + vec4((uvec4(node.qmax[a]) >> shifts) & 0xffu) * scale;
+
+        enter = max(enter, min(t0, t1));
+        leave = min(leave, max(t0, t1));
+    }
+
+    // Distances are positive, so their bits sort like the floats
+    bvec4 hit = bvec4(uvec4(lessThanEqual(enter, leave)) &
+                      uvec4(lessThan(uvec4(0, 1, 2, 3), uvec4(node.exponents >> 24))));
+    uvec4 keys = mix(uvec4(0xffffffffu), (floatBitsToUint(enter) & ~3u) | uvec4(0, 1, 2, 3), hit);
+
+    // Sorting network, (0 1)(2 3), (0 2)(1 3), (1 2)
+    uvec2 lo = min(keys.xz, keys.yw);
+    uvec2 hi = max(keys.xz, keys.yw);
+    keys = uvec4(lo.x, hi.x, lo.y, hi.y);
+    lo = min(keys.xy, keys.zw);
+    hi = max(keys.xy, keys.zw);
+
+    return uvec4(lo.x, min(lo.y, hi.x), max(lo.y, hi.x), hi.y);
+}
+
+// Closest triangle of the mesh BVH below node `root`. The leaf children
+// of a node are tested with it and its inner children visited later, both
+// nearest first.
+bool
+blas_hit(ray_t r, uint root, float t_min, inout float t_max, inout uint hit_tri, inout vec3 hit_bary)
+{
+    uint stack[BVH_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+    vec3 inv_dir = 1.0 / r.direction;
+    tri_ray_t tr = tri_ray_setup(r);
+
+    uint node = root;
+    for (;;)
+    {
+        STATS_ADD(STAT_NODE_VISITS, 1);
+        uvec4 keys = bvh4_children_hit(nodes[node], r.origin, inv_dir, t_min, t_max);
+        uint counts = nodes[node].counts;
+
+        for (int k = 0; k < 4 && keys[k] != 0xffffffffu; k++)
+        {
+            uint c = keys[k] & 3u;
+            uint count = (counts >> (8 * c)) & 0xffu;
+
+            if (count == 0 || uintBitsToFloat(keys[k] & ~3u) > t_max)
+                continue;
+            STATS_ADD(STAT_TRIANGLE_TESTS, count);
+            for (uint i = 0; i < count; i++)
+            {
+                vec3 bary;
+                if (triangle_hit(r, tr, nodes[node].child[c] + i, t_min, t_max, bary))
+                {
+                    found = true;
+                    hit_tri = nodes[node].child[c] + i;
+                    hit_bary = bary;
+                }
+            }
+        }
+
+        // Inner children farthest first, so the nearest comes off next
+        for (int k = 3; k >= 0; k--)
+        {
+            uint c = keys[k] & 3u;
+
+            if (keys[k] == 0xffffffffu || ((counts >> (8 * c)) & 0xffu) != 0 ||
+                uintBitsToFloat(keys[k] & ~3u) > t_max)
+                continue;
+            if (stack_size < BVH_STACK_SIZE)
+                stack[stack_size++] = nodes[node].child[c];
+        }
+
+        if (stack_size == 0)
+            break;
+        node = stack[--stack_size];
+    }
+
+    return found;
+}
@@ -0,0 +1,140 @@
+// Declarations and helpers shared by the path tracing kernels: the
+// uniforms the host sets on every kernel, the ray, hit and material types,
+// the material table and the camera. Included first, after the kernel's
+// own defines. A kernel that samples textures defines HIT_UV, which gives
+// its hits surface coordinates and a ray cone.
+
+#define MAT_LAMBERTIAN  0
+#define MAT_METAL       1
+#define MAT_DIELECTRIC  2
+#define MAT_CHECKERED   3
+
+#define NUM_MAT_TYPES   4
+
+#define PI              3.1415926
+
+// The sphere kernel compiles in only its scene's material types, the
+// others take them all
+#ifndef SCENE_MATERIAL_TYPES
+#define SCENE_MATERIAL_TYPES ((1 << NUM_MAT_TYPES) - 1)
+#endif
+#define HAS_MATERIAL(t)     ((SCENE_MATERIAL_TYPES & (1 << (t))) != 0)
+#define ONLY_MATERIAL(t)    (SCENE_MATERIAL_TYPES == (1 << (t)))
+
+#ifndef HIT_UV
+#define HIT_UV          0
+#endif
+
+#include "group.glsl"
+#include "stats.glsl"
+
+layout (rgba32f) uniform image2D image_data;
+uniform vec2 resolution;
+uniform mat4 view_matrix;
+uniform mat4 proj_matrix;
+uniform ivec2 tile_origin;
+uniform uint seed;
+uniform uint sample_base;
+uniform uint material_base;
+uniform uint samples;
+
+mat4 inv_viewmat = inverse(view_matrix);
+mat4 inv_projmat = inverse(proj_matrix);
+
+struct ray_t
+{
+    vec3 origin;
+    vec3 direction;
+};
+
+struct sphere_t
+{
+    vec3 center;
+    float radius;
+    int material_id;
+};
+
+struct hit_record_t
+{
+    vec3 p;
+    vec3 normal;
+    float t;
+    bool front_face;
+    int material_id;
+#if HIT_UV
+    vec2 uv;
+    float uv_density;   // texture units per world unit
+    float cone_width;   // of the path's ray cone, set by ray_trace
+#endif
+};
+
+// Entry of the material table shared by all scenes (scene_gpu_material_t);
+// this scene's materials start at material_base
+struct material_t
+{
+    vec3 albedo;
+    uint type;
+    vec3 checker_even;
+    float fuzz;
+    vec3 checker_odd;
+    float idx_ref;
+    uint texture;       // albedo layer, only the mesh kernel samples it
+};
+
+layout (std430, binding = 16) readonly buffer material_table
+{
+    material_t materials[];
+};
+
+vec3        ray_at(ray_t r, float t);
+ray_t       get_ray(float u, float v);
+void        write_color(vec3 color, float samples_per_pixel);
+
+ivec2 pixel = group_pixel() + tile_origin;
+uint state = uint(pixel.x * 1973 + pixel.y * 9277) + seed * 26699;
+
+#include "random.glsl"
+
+vec3
+ray_at(ray_t r, float t)
+{
+    return r.origin + t * r.direction;
+}
+
+ray_t
+get_ray(float u, float v)
+{
+    u = u * 2.0 - 1.0;
+    v = v * 2.0 - 1.0;
+
+    vec4 clip_pos = vec4(u, v, -1.0, 1.0);
+    vec4 view_pos = inv_projmat * clip_pos;
+
+    vec3 dir = normalize(vec3(inv_viewmat * vec4(view_pos.x, view_pos.y, -1.0, 0.0)));
+
+    vec4 origin = inv_viewmat * vec4(0.0, 0.0, 0.0, 1.0);
+    origin.xyz /= origin.w;
+
+    ray_t r;
+
+    r.origin = origin.xyz;
+    r.direction = dir;
+
+    return r;
+}
+
+void
+write_color(vec3 color, float samples_per_pixel)
+{
+    // Fold in the samples already accumulated for this pixel (stored gamma
+    // corrected, so square to get back to linear)
+    if (sample_base > 0)
+    {
+        vec3 prev = imageLoad(image_data, pixel).rgb;
+        color += prev * prev * float(sample_base);
+        samples_per_pixel += float(sample_base);
+    }
+
+    // Gamma correction
+    imageStore(image_data, pixel, vec4(sqrt(color / samples_per_pixel), 1.0));
+}
@@ -0,0 +1,55 @@
+// The GLSL side of curve.h: points of a Morton or Hilbert curve over a power
+// of two square, the same ones curve_point() gives
+
+#define CURVE_ROWS      0
+#define CURVE_MORTON    1
+#define CURVE_HILBERT   2
+
+uint
+curve_side(uvec2 grid)
+{
+    uint side = 1u;
+
+    while (side < grid.x || side < grid.y)
+        side <<= 1;
+
+    return side;
+}
+
+uvec2
+curve_point(uint curve, uint side, uint d)
+{
+    uvec2 p = uvec2(0u);
+
+    if (curve == CURVE_MORTON)
+    {
+        for (uint bit = 0u; (1u << bit) < side; bit++)
+        {
+            p.x |= ((d >> (2u * bit)) & 1u) << bit;
+            p.y |= ((d >> (2u * bit + 1u)) & 1u) << bit;
+        }
+    }
+    else if (curve == CURVE_HILBERT)
+    {
+        for (uint s = 1u; s < side; s <<= 1)
+        {
+            uint rx = 1u & (d >> 1);
+            uint ry = 1u & (d ^ rx);
+
+            if (ry == 0u)
+            {
+                if (rx == 1u)
+                    p = uvec2(s - 1u) - p;
+                p = p.yx;
+            }
+            p += s * uvec2(rx, ry);
+            d >>= 2;
+        }
+    }
+    else
+    {
+        p = uvec2(d % side, d / side);
+    }
+
+    return p;
+}
@@ -0,0 +1,135 @@
+// Environment map lighting of the mesh, instance and cloud kernels. Included
+// after the kernel's declarations: env_light() traces its scene_t with its
+// scene_hit().
+
+uniform uvec2 env_size;        // zero for the sky gradient
+
+// Environment map, laid out by envmap.h: radiance and pdf over the uv square
+// per texel; the marginal CDF, then one conditional CDF per row
+layout (std430, binding = 17) readonly buffer env_texels
+{
+    vec4 env[];
+};
+
+layout (std430, binding = 18) readonly buffer env_cdfs
+{
+    float env_cdf[];
+};
+
+vec3        sky(vec3 dir, float bsdf_pdf);
+float       power_heuristic(float pdf, float other_pdf);
+vec3        env_lookup(vec3 dir, out float pdf);
+uint        env_find(uint first, uint count, float u);
+vec3        env_sample(out vec3 dir, out float pdf);
+vec3        env_light(scene_t world, hit_record_t rec);
+
+// Sky along `dir`. An environment hit that next event estimation could
+// have sampled too (bsdf_pdf > 0) only gets its MIS share.
+vec3
+sky(vec3 dir, float bsdf_pdf)
+{
+    vec3 unit_dir = normalize(dir);
+
+    if (env_size.x == 0u)
+    {
+        float t = 0.5 * (unit_dir.y + 1.0);
+        return (1.0 - t) * vec3(1.0, 1.0, 1.0) + t * vec3(0.5, 0.7, 1.0);
+    }
+
+    float light_pdf;
+    vec3 radiance = env_lookup(unit_dir, light_pdf);
+
+    return (bsdf_pdf > 0.0) ? radiance * power_heuristic(bsdf_pdf, light_pdf) : radiance;
+}
+
+float
+power_heuristic(float pdf, float other_pdf)
+{
+    return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+}
+
+// Radiance towards a unit direction, and its pdf per solid angle
+vec3
+env_lookup(vec3 dir, out float pdf)
+{
+    float u = (atan(-dir.z, dir.x) + PI) / (2.0 * PI);
+    float v = acos(clamp(dir.y, -1.0, 1.0)) / PI;
+    uint x = min(uint(u * float(env_size.x)), env_size.x - 1u);
+    uint y = min(uint(v * float(env_size.y)), env_size.y - 1u);
+    float sin_theta = sqrt(max(0.0, 1.0 - dir.y * dir.y));
+    vec4 texel = env[y * env_size.x + x];
+
+    pdf = (sin_theta > 0.0) ? texel.w / (2.0 * PI * PI * sin_theta) : 0.0;
+
+    return texel.rgb;
+}
+
+// Last entry of env_cdf[first .. first + count] not above u
+uint
+env_find(uint first, uint count, float u)
+{
+    uint lo = 0u;
+    uint hi = count;
+
+    while (lo + 1u < hi)
+    {
+        uint mid = (lo + hi) / 2u;
+
+        if (env_cdf[first + mid] <= u)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// Direction picked in proportion to the radiance, its pdf per solid angle
+// and the radiance that way
+vec3
+env_sample(out vec3 dir, out float pdf)
+{
+    float u1 = f_randf(state);
+    float u2 = f_randf(state);
+    uint y = env_find(0u, env_size.y, u2);
+    uint row = env_size.y + 1u + y * (env_size.x + 1u);
+    uint x = env_find(row, env_size.x, u1);
+    float dv = (u2 - env_cdf[y]) / (env_cdf[y + 1u] - env_cdf[y]);
+    float du = (u1 - env_cdf[row + x]) / (env_cdf[row + x + 1u] - env_cdf[row + x]);
+    float theta = (float(y) + dv) / float(env_size.y) * PI;
+    float phi = (float(x) + du) / float(env_size.x) * 2.0 * PI;
+    vec4 texel = env[y * env_size.x + x];
+
+    dir = vec3(-sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+    float sin_theta = sqrt(max(0.0, 1.0 - dir.y * dir.y));
+    pdf = (sin_theta > 0.0) ? texel.w / (2.0 * PI * PI * sin_theta) : 0.0;
+
+    return texel.rgb;
+}
+
+// Next event estimation towards the environment from a diffuse hit: f cos
+// over pdf without the albedo, MIS weighted against the diffuse bounce
+vec3
+env_light(scene_t world, hit_record_t rec)
+{
+    vec3 dir;
+    float light_pdf;
+    vec3 radiance = env_sample(dir, light_pdf);
+    float cosine = dot(rec.normal, dir);
+
+    if (cosine <= 0.0 || light_pdf <= 0.0)
+        return vec3(0.0);
+
+    ray_t shadow;
+    hit_record_t blocker;
+
+    shadow.origin = rec.p;
+    shadow.direction = dir;
+    STATS_ADD(STAT_SHADOW_RAYS, 1);
+    if (scene_hit(shadow, world, 0.001, 100000000000.0, blocker))
+        return vec3(0.0);
+
+    float bsdf_pdf = cosine / PI;
+
+    return radiance * (bsdf_pdf / light_pdf * power_heuristic(light_pdf, bsdf_pdf));
+}
@@ -0,0 +1,75 @@
+// Intersection tests shared by the path tracing kernels, and the node of
+// the binary BVHs (bvh.h) the TLAS and the LBVH are stored in. Needs
+// common.glsl.
+
+struct bvh_node_t
+{
+    vec3 min;
+    uint left_first;
+    vec3 max;
+    uint count;
+};
+
+bool        sphere_hit(ray_t r, sphere_t s, float t_min, float t_max, inout hit_record_t rec);
+void        set_face_normal(ray_t r, vec3 outward_normal, inout hit_record_t rec);
+float       aabb_hit(vec3 bmin, vec3 bmax, vec3 origin, vec3 inv_dir, float t_min, float t_max);
+
+bool
+sphere_hit(ray_t r, sphere_t s, float t_min, float t_max, inout hit_record_t rec)
+{
+    vec3 oc = r.origin - s.center;
+    float a = dot(r.direction, r.direction);
+    float half_b = dot(oc, r.direction);
+    float c = dot(oc, oc) - s.radius * s.radius;
+    float disc = half_b * half_b - a * c;
+
+    if (disc < 0)
+        return false;
+    else
+    {
+        float sqrtd = sqrt(disc);
+        float root = (-half_b - sqrtd) / a;
+        if (root < t_min || root > t_max)
+        {
+            root = (-half_b + sqrtd) / a;
+            if (root < t_min || root > t_max)
+                return false;
+        }
+
+        rec.t = root;
+        rec.p = ray_at(r, rec.t);
+        vec3 outward_normal = (rec.p - s.center) / s.radius;
+        set_face_normal(r, outward_normal, rec);
+        rec.material_id = s.material_id;
+
+#if HIT_UV
+        // Latitude/longitude, seam at -x; a unit of uv covers the whole sphere
+        rec.uv = vec2((atan(-outward_normal.z, outward_normal.x) + PI) / (2.0 * PI),
+                      acos(clamp(-outward_normal.y, -1.0, 1.0)) / PI);
+        rec.uv_density = 1.0 / (2.0 * sqrt(PI) * s.radius);
+#endif
+
+        return true;
+    }
+}
+
+void
+set_face_normal(ray_t r, vec3 outward_normal, inout hit_record_t rec)
+{
+    rec.front_face = dot(r.direction, outward_normal) < 0;
+    rec.normal = rec.front_face ? outward_normal : -outward_normal;
+}
+
+// Entry distance of the ray into a box, or a negative value on a miss
+float
+aabb_hit(vec3 bmin, vec3 bmax, vec3 origin, vec3 inv_dir, float t_min, float t_max)
+{
+    vec3 t0 = (bmin - origin) * inv_dir;
+    vec3 t1 = (bmax - origin) * inv_dir;
+    vec3 tnear = min(t0, t1);
+    vec3 tfar = max(t0, t1);
+    float enter = max(max(tnear.x, tnear.y), max(tnear.z, t_min));
+    float leave = min(min(tfar.x, tfar.y), min(tfar.z, t_max));
+
+    return (enter <= leave) ? enter : -1.0;
+}
@@ -0,0 +1,115 @@
+// Workgroup shape of the path tracing kernels and the pixel each invocation
+// traces. The host picks the shape per scene and device (tune.h) and passes
+// it as defines; both sides must be powers of two. With GROUP_MORTON the
+// invocations walk their group's pixels in Morton order, so consecutive
+// invocations cover a squarer patch than a row.
+//
+// With GROUP_PERSISTENT the host launches only as many workgroups as keep
+// the device busy, and each takes group sized tiles of the dispatch's area
+// off a queue until none are left, so groups stuck on glass don't hold up
+// the ones that only saw sky. GROUP_ORDER is the order the tiles are taken
+// in, one of the CURVE_* orders (curve.h), so the groups in flight work on
+// neighbouring tiles.
+
+#ifndef GROUP_WIDTH
+#define GROUP_WIDTH     16
+#define GROUP_HEIGHT    16
+#define GROUP_MORTON    0
+#endif
+#ifndef GROUP_PERSISTENT
+#define GROUP_PERSISTENT    0
+#define GROUP_ORDER         0
+#endif
+
+#define GROUP_SIZE      (GROUP_WIDTH * GROUP_HEIGHT)
+
+layout (local_size_x = GROUP_WIDTH, local_size_y = GROUP_HEIGHT) in;
+
+// Position of the invocation in its group's tile
+ivec2
+group_offset(void)
+{
+#if GROUP_MORTON
+    // The index's bits alternate between x and y while both sides have
+    // room, then the longer side takes the rest
+    uint index = gl_LocalInvocationIndex;
+    uvec2 local_pos = uvec2(0u);
+    uint x_bits = 0u;
+    uint y_bits = 0u;
+
+    for (uint bit = 0u; (1u << bit) < uint(GROUP_SIZE); bit++)
+    {
+        uint b = (index >> bit) & 1u;
+
+        if ((1u << x_bits) < uint(GROUP_WIDTH) &&
+            (x_bits <= y_bits || (1u << y_bits) >= uint(GROUP_HEIGHT)))
+            local_pos.x |= b << x_bits++;
+        else
+            local_pos.y |= b << y_bits++;
+    }
+
+    return ivec2(local_pos);
+#else
+    return ivec2(gl_LocalInvocationID.xy);
+#endif
+}
+
+// Pixel of a grid dispatch, one group per tile
+ivec2
+group_pixel(void)
+{
+    return ivec2(gl_WorkGroupID.xy * uvec2(GROUP_WIDTH, GROUP_HEIGHT)) + group_offset();
+}
+
+#if GROUP_PERSISTENT
+
+#include "curve.glsl"
+
+// Tiles taken so far, cleared by the host before every dispatch
+layout (std430, binding = 19) coherent buffer work_queue
+{
+    uint next_tile;
+};
+
+uniform uvec2 group_tiles;      // across and down the dispatch's area
+
+shared uvec2 group_tile;
+shared bool group_done;
+
+// Origin of the group's next tile, false once they are all taken. Every
+// invocation of the group gets the same answer, so the kernels' barriers
+// stay in uniform control flow. The curves run over curve_side() squared
+// slots; the first invocation passes over the ones off the area.
+bool
+group_next(out ivec2 origin)
+{
+    barrier();      // everyone has read the last tile
+    if (gl_LocalInvocationIndex == 0u)
+    {
+#if GROUP_ORDER == CURVE_ROWS
+        uint slots = group_tiles.x * group_tiles.y;
+        uint side = group_tiles.x;
+#else
+        uint side = curve_side(group_tiles);
+        uint slots = side * side;
+#endif
+        uint slot;
+        uvec2 tile;
+
+        do
+        {
+            slot = atomicAdd(next_tile, 1u);
+            tile = curve_point(GROUP_ORDER, side, slot);
+        } while (slot < slots && (tile.x >= group_tiles.x || tile.y >= group_tiles.y));
+
+        group_tile = tile;
+        group_done = slot >= slots;
+    }
+    barrier();
+
+    origin = ivec2(group_tile) * ivec2(GROUP_WIDTH, GROUP_HEIGHT);
+
+    return !group_done;
+}
+
+#endif
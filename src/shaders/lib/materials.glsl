@@ -0,0 +1,118 @@
+// Scattering for the material types in SCENE_MATERIAL_TYPES; the others
+// aren't compiled, and a kernel with a single type skips the dispatch.
+// Needs common.glsl. The albedo a hit scatters with is MATERIAL_ALBEDO(),
+// which a kernel that samples textures defines before including this.
+
+#ifndef MATERIAL_ALBEDO
+#define MATERIAL_ALBEDO(r_in, rec, mat)     (mat).albedo
+#endif
+
+bool        scatter(ray_t r_in, inout hit_record_t rec, out vec3 atten, out ray_t r_scattered);
+bool        scatter_lambertian(ray_t r_in, inout hit_record_t rec, material_t mat, out vec3 atten, out ray_t r_scattered);
+bool        scatter_metal(ray_t r_in, inout hit_record_t rec, material_t mat, out vec3 atten, out ray_t r_scattered);
+bool        scatter_dielectric(ray_t r_in, inout hit_record_t rec, material_t mat, out vec3 atten, out ray_t r_scattered);
+bool        scatter_checkered(ray_t r_in, inout hit_record_t rec, material_t mat, out vec3 atten, out ray_t r_scattered);
+float       f_schlick(float cosine, float ref_idx);
+
+// Shades a hit with its entry of the material table
+bool
+scatter(ray_t r_in, inout hit_record_t rec, out vec3 atten, out ray_t r_scattered)
+{
+    material_t mat = materials[material_base + uint(rec.material_id)];
+
+#if HAS_MATERIAL(MAT_METAL)
+    if (ONLY_MATERIAL(MAT_METAL) || mat.type == MAT_METAL)
+        return scatter_metal(r_in, rec, mat, atten, r_scattered);
+#endif
+#if HAS_MATERIAL(MAT_DIELECTRIC)
+    if (ONLY_MATERIAL(MAT_DIELECTRIC) || mat.type == MAT_DIELECTRIC)
+        return scatter_dielectric(r_in, rec, mat, atten, r_scattered);
+#endif
+#if HAS_MATERIAL(MAT_CHECKERED)
+    if (ONLY_MATERIAL(MAT_CHECKERED) || mat.type == MAT_CHECKERED)
+        return scatter_checkered(r_in, rec, mat, atten, r_scattered);
+#endif
+#if HAS_MATERIAL(MAT_LAMBERTIAN)
+    return scatter_lambertian(r_in, rec, mat, atten, r_scattered);
+#else
+    return false;
+#endif
+}
+
+#if HAS_MATERIAL(MAT_LAMBERTIAN)
+bool
+scatter_lambertian(ray_t r_in, inout hit_record_t rec,
+                   material_t mat, out vec3 atten, out ray_t r_scattered)
+{
+    r_scattered.origin = rec.p;
+    r_scattered.direction = rec.normal + random_unit_vector(state);
+    atten = MATERIAL_ALBEDO(r_in, rec, mat);
+
+    return true;
+}
+#endif
+
+#if HAS_MATERIAL(MAT_METAL)
+bool
+scatter_metal(ray_t r_in, inout hit_record_t rec,
+              material_t mat, out vec3 atten, out ray_t r_scattered)
+{
+    vec3 reflected = reflect(normalize(r_in.direction), rec.normal);
+    r_scattered.origin = rec.p;
+    r_scattered.direction = reflected + mat.fuzz * random_in_unit_sphere(state);
+    atten = MATERIAL_ALBEDO(r_in, rec, mat);
+
+    return (dot(r_scattered.direction, rec.normal) > 0);
+}
+#endif
+
+#if HAS_MATERIAL(MAT_DIELECTRIC)
+bool
+scatter_dielectric(ray_t r_in, inout hit_record_t rec,
+                   material_t mat, out vec3 atten, out ray_t r_scattered)
+{
+    atten = vec3(1.0);
+    float refraction_ratio = rec.front_face ? (1 / mat.idx_ref) : mat.idx_ref;
+
+    vec3 unit_dir = normalize(r_in.direction);
+    float cos_theta = min(dot(-unit_dir, rec.normal), 1.0);
+    float sin_theta = sqrt(1 - cos_theta * cos_theta);
+
+    bool cannot_refract = (refraction_ratio * sin_theta) > 1.0;
+    vec3 dir;
+
+    if (cannot_refract || f_schlick(cos_theta, refraction_ratio) > f_randf(state))
+        dir = reflect(unit_dir, rec.normal);
+    else
+        dir = refract(unit_dir, rec.normal, refraction_ratio);
+
+    r_scattered.origin = rec.p;
+    r_scattered.direction = dir;
+
+    return true;
+}
+
+float
+f_schlick(float cosine, float ref_idx)
+{
+    float r0 = (1 - ref_idx) / (1 + ref_idx);
+    r0 = r0 * r0;
+
+    return r0 + (1 - r0) * pow((1 - cosine), 5);
+}
+#endif
+
+#if HAS_MATERIAL(MAT_CHECKERED)
+bool
+scatter_checkered(ray_t r_in, inout hit_record_t rec,
+                  material_t mat, out vec3 atten, out ray_t r_scattered)
+{
+    float sines = sin(10 * rec.p.x) * sin(10 * rec.p.y) * sin(10 * rec.p.z);
+
+    r_scattered.origin = rec.p;
+    r_scattered.direction = rec.normal + random_unit_vector(state);
+    atten = (sines < 0) ? mat.checker_even : mat.checker_odd;
+
+    return true;
+}
+#endif
@@ -0,0 +1,33 @@
+// The GLSL side of packed.h; packed_check.comp holds it to the CPU bit for
+// bit. Halves are the builtin packHalf2x16().
+
+// Unit vector on the octahedron |x| + |y| + |z| = 1, lower half folded over
+// the upper one, as two snorm16s; the same bits as packed_oct_encode()
+uint
+oct_encode(vec3 v)
+{
+    float l1 = abs(v.x) + abs(v.y) + abs(v.z);
+    vec2 e;
+
+    if (l1 == 0.0)
+        return 0u;
+
+    e = v.xy / l1;
+    if (v.z < 0.0)
+        e = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+
+    return packSnorm2x16(e);
+}
+
+vec3
+oct_decode(uint bits)
+{
+    vec2 e = unpackSnorm2x16(bits);
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = max(-v.z, 0.0);
+
+    v.x += (v.x >= 0.0) ? -fold : fold;
+    v.y += (v.y >= 0.0) ? -fold : fold;
+
+    return normalize(v);
+}
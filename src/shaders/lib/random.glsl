@@ -0,0 +1,47 @@
+// Xorshift random numbers, one stream per invocation in the kernel's
+// `state`
+
+uint
+f_randi(inout uint index)
+{
+    uint x = index;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 15;
+    index = x;
+
+    return x;
+}
+
+float
+f_randf(inout uint index)
+{
+    return (f_randi(index) & 0xffffff) / 16777216.0f;
+}
+
+vec3
+random_unit_vector(inout uint index)
+{
+    float z = f_randf(index) * 2.0 - 1.0;
+    float t = f_randf(index) * 2.0 * 3.1415926;
+    float r = sqrt(1.0 - z * z);
+    float x = r * cos(t);
+    float y = r * sin(t);
+
+    return vec3(x, y, z);
+}
+
+vec3
+random_in_unit_sphere(inout uint index)
+{
+    float z = f_randf(index) * 2.0 - 1.0;
+    float t = f_randf(index) * 2.0 * 3.1415926;
+    float r = sqrt(max(0.0, 1.0 - z * z));
+    float x = r * cos(t);
+    float y = r * sin(t);
+    vec3 res = vec3(x, y, z);
+    res *= pow(f_randf(index), 1.0 / 3.0);
+
+    return res;
+}
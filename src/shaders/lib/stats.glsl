@@ -0,0 +1,59 @@
+// Ray statistics of the path tracing kernels, the GLSL side of ray_stats.h.
+// Compiled in only with RAY_STATS (--ray-stats); without it STATS_ADD() and
+// STATS_FLUSH() are empty. An invocation counts in its own registers and
+// adds the totals to the counters once, from STATS_FLUSH() at the end of
+// main(). Counters are 64 bit, low word first, so the host reads them as
+// u64s.
+
+#ifndef RAY_STATS
+#define RAY_STATS       0
+#endif
+
+#define STAT_RAYS           0   // by depth, STATS_DEPTHS of them; depth 0 is the primary rays
+#define STATS_DEPTHS        8   // the last one counts every deeper ray too
+#define STAT_SHADOW_RAYS    8
+#define STAT_SPHERE_TESTS   9
+#define STAT_PLANE_TESTS    10
+#define STAT_TRIANGLE_TESTS 11
+#define STAT_NODE_VISITS    12
+#define STAT_ESCAPED        13
+#define STAT_ABSORBED       14
+#define STAT_MAX_DEPTH      15
+#define STAT_COUNT          16
+
+#if RAY_STATS
+
+layout (std430, binding = 20) coherent buffer ray_stats
+{
+    uint stat_counters[];   // STAT_COUNT pairs of words
+};
+
+uint stat_local[STAT_COUNT] = uint[STAT_COUNT](0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u,
+                                               0u, 0u, 0u, 0u, 0u, 0u, 0u, 0u);
+
+void
+stats_flush(void)
+{
+    for (uint i = 0u; i < uint(STAT_COUNT); i++)
+    {
+        if (stat_local[i] == 0u)
+            continue;
+
+        // Carry into the high word when the low one wraps
+        uint old = atomicAdd(stat_counters[2u * i], stat_local[i]);
+        if (old + stat_local[i] < old)
+            atomicAdd(stat_counters[2u * i + 1u], 1u);
+    }
+}
+
+#define STATS_ADD(counter, n)   stat_local[counter] += uint(n)
+#define STATS_RAY(depth)        stat_local[STAT_RAYS + min(uint(depth), uint(STATS_DEPTHS - 1))]++
+#define STATS_FLUSH()           stats_flush()
+
+#else
+
+#define STATS_ADD(counter, n)
+#define STATS_RAY(depth)
+#define STATS_FLUSH()
+
+#endif
@@ -0,0 +1,230 @@
+#version 450 core
+
+#define BVH_STACK_SIZE  64
+#define TEXTURE_NONE    0xffffffffu
+#define TEXTURE_MIN_COSINE 0.05
+#define HIT_UV          1
+#define MATERIAL_ALBEDO(r_in, rec, mat)     material_albedo(r_in, rec, mat)
+
+#include "lib/common.glsl"
+#include "lib/geometry.glsl"
+
+layout (binding = 1) uniform sampler2DArray albedo_textures;
+
+struct scene_t
+{
+    int num_spheres;
+    int mesh_material_id;
+    sphere_t spheres[2];
+};
+
+#include "lib/bvh4.glsl"
+
+void        render_pixel(void);
+bool        mesh_hit(ray_t r, int material_id, float t_min, float t_max, inout hit_record_t rec);
+bool        scene_hit(ray_t r, scene_t s, float t_min, float t_max, inout hit_record_t rec);
+vec3        ray_trace(ray_t r, scene_t world, uint max_depth);
+vec3        material_albedo(ray_t r_in, hit_record_t rec, material_t mat);
+
+#include "lib/materials.glsl"
+#include "lib/envmap.glsl"
+
+void
+main(void)
+{
+    memoryBarrier();
+
+#if GROUP_PERSISTENT
+    // The pixel and its random state are the ones a grid dispatch gives it
+    ivec2 origin;
+
+    while (group_next(origin))
+    {
+        pixel = origin + group_offset() + tile_origin;
+        state = uint(pixel.x * 1973 + pixel.y * 9277) + seed * 26699;
+        render_pixel();
+    }
+#else
+    render_pixel();
+#endif
+
+    STATS_FLUSH();
+    memoryBarrier();
+}
+
+void
+render_pixel(void)
+{
+    scene_t scene;
+    scene.num_spheres = 2;
+
+    // Ground
+    scene.spheres[0].center = vec3(0, -100.5, -1);
+    scene.spheres[0].radius = 100;
+    scene.spheres[0].material_id = 0;
+
+    // Textured ball
+    scene.spheres[1].center = vec3(-1.2, -0.15, -1.5);
+    scene.spheres[1].radius = 0.35;
+    scene.spheres[1].material_id = 2;
+
+    // Mesh, fitted by the host into the unit box around (0, 0, -1)
+    scene.mesh_material_id = 1;
+
+    ray_t ray;
+
+    vec3 pixel_data = vec3(0.0);
+
+    for (uint i = 0; i < samples; i++)
+    {
+        float u = ((pixel.x + f_randf(state)) / resolution.x);
+        float v = ((pixel.y + f_randf(state)) / resolution.y);
+        ray = get_ray(u, v);
+        pixel_data += ray_trace(ray, scene, 50);
+    }
+
+    write_color(pixel_data, samples);
+}
+
+bool
+mesh_hit(ray_t r, int material_id, float t_min, float t_max, inout hit_record_t rec)
+{
+    uint hit_tri = 0;
+    vec3 hit_bary = vec3(0.0);
+
+    if (!blas_hit(r, 0, t_min, t_max, hit_tri, hit_bary))
+        return false;
+
+    mesh_vertex_t v0 = vertices[indices[hit_tri * 3 + 0]];
+    mesh_vertex_t v1 = vertices[indices[hit_tri * 3 + 1]];
+    mesh_vertex_t v2 = vertices[indices[hit_tri * 3 + 2]];
+    vec3 normal = hit_bary.x * v0.normal_v.xyz + hit_bary.y * v1.normal_v.xyz + hit_bary.z * v2.normal_v.xyz;
+
+    vec3 geometric = cross(v1.pos_u.xyz - v0.pos_u.xyz, v2.pos_u.xyz - v0.pos_u.xyz);
+    vec2 uv0 = vec2(v0.pos_u.w, v0.normal_v.w);
+    vec2 uv1 = vec2(v1.pos_u.w, v1.normal_v.w);
+    vec2 uv2 = vec2(v2.pos_u.w, v2.normal_v.w);
+    vec2 e1 = uv1 - uv0;
+    vec2 e2 = uv2 - uv0;
+    float world_area = length(geometric);
+
+    // Files without normals get the geometric one
+    if (dot(normal, normal) == 0.0)
+        normal = geometric;
+
+    rec.t = t_max;
+    rec.p = ray_at(r, rec.t);
+    set_face_normal(r, normalize(normal), rec);
+    rec.material_id = material_id;
+    rec.uv = hit_bary.x * uv0 + hit_bary.y * uv1 + hit_bary.z * uv2;
+    rec.uv_density = (world_area > 0.0) ? sqrt(abs(e1.x * e2.y - e2.x * e1.y) / world_area) : 0.0;
+
+    return true;
+}
+
+bool
+scene_hit(ray_t r, scene_t s, float t_min, float t_max, inout hit_record_t rec)
+{
+    hit_record_t temp_rec;
+    bool hit_anything = false;
+    float closest_so_far = t_max;
+
+    STATS_ADD(STAT_SPHERE_TESTS, s.num_spheres);
+    for (int i = 0; i < s.num_spheres; i++)
+    {
+        if (sphere_hit(r, s.spheres[i], t_min, closest_so_far, temp_rec))
+        {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+
+    if (mesh_hit(r, s.mesh_material_id, t_min, closest_so_far, temp_rec))
+    {
+        hit_anything = true;
+        rec = temp_rec;
+    }
+
+    return hit_anything;
+}
+
+vec3
+ray_trace(ray_t r, scene_t world, uint max_depth)
+{
+    ray_t cur_ray = r;
+    vec3 atten = vec3(0.0);
+    vec3 color = vec3(1.0);
+    vec3 radiance = vec3(0.0);
+    float bsdf_pdf = 0.0;   // of the last bounce, if the environment was sampled there too
+    hit_record_t rec;
+
+    // Ray cone: starts at a point and widens by one pixel's angle per unit
+    // of distance, along the whole path
+    float spread = 2.0 / (proj_matrix[1][1] * resolution.y);
+    float cone_width = 0.0;
+
+    int i;
+    for (i = 0; i < max_depth; i++)
+    {
+        ray_t scattered_ray;
+
+        STATS_RAY(i);
+        if (scene_hit(cur_ray, world, 0.001, 100000000000.0, rec))
+        {
+            // Directions of scattered rays aren't unit length
+            cone_width += spread * rec.t * length(cur_ray.direction);
+            rec.cone_width = cone_width;
+
+            if (scatter(cur_ray, rec, atten, scattered_ray))
+            {
+                uint type = materials[material_base + uint(rec.material_id)].type;
+
+                bsdf_pdf = 0.0;
+                if (env_size.x != 0u && (type == MAT_LAMBERTIAN || type == MAT_CHECKERED))
+                {
+                    radiance += color * atten * env_light(world, rec);
+                    bsdf_pdf = max(dot(rec.normal, scattered_ray.direction), 0.0) /
+                               (length(scattered_ray.direction) * PI);
+                }
+                color *= atten;
+                cur_ray = scattered_ray;
+            }
+            else
+            {
+                STATS_ADD(STAT_ABSORBED, 1);
+                color *= vec3(0.0);
+                break;
+            }
+        }
+        else
+        {
+            STATS_ADD(STAT_ESCAPED, 1);
+            radiance += color * sky(cur_ray.direction, bsdf_pdf);
+            break;
+        }
+    }
+
+    if (i == max_depth)
+        STATS_ADD(STAT_MAX_DEPTH, 1);
+
+    if (i < 50)
+        return radiance;
+    else
+        return vec3(0.0);   // exceeded iteration
+}
+
+// Albedo through the material's texture layer, at the ray cone's level
+// (texture_lod() in texture.h)
+vec3
+material_albedo(ray_t r_in, hit_record_t rec, material_t mat)
+{
+    if (mat.texture == TEXTURE_NONE)
+        return mat.albedo;
+
+    float cosine = max(abs(dot(normalize(r_in.direction), rec.normal)), TEXTURE_MIN_COSINE);
+    float footprint = rec.cone_width * rec.uv_density * float(textureSize(albedo_textures, 0).x) / cosine;
+    float lod = log2(max(footprint, 1.0));
+
+    return mat.albedo * textureLod(albedo_textures, vec3(rec.uv, float(mat.texture)), lod).rgb;
+}
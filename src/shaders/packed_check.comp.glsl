@@ -0,0 +1,44 @@
+#version 450 core
+
+// Encodes test vectors with the kernels' packing functions so that
+// packed_bench() can hold them against packed.h bit for bit, and decodes
+// them again for the round trip.
+
+#define GROUP_SIZE  256
+
+layout (local_size_x = GROUP_SIZE) in;
+uniform uint count;
+
+layout (std430, binding = 8) readonly buffer packed_input
+{
+    vec4 values[];      // xyz unit vector, w a colour channel
+};
+
+struct packed_result_t
+{
+    uvec4 bits;         // oct(xyz), halves of xy, halves of zw, unused
+    vec4 decoded;       // oct decoded again
+};
+
+layout (std430, binding = 9) writeonly buffer packed_output
+{
+    packed_result_t results[];
+};
+
+#include "lib/packed.glsl"
+
+void
+main(void)
+{
+    uint i = gl_GlobalInvocationID.x;
+    vec4 value;
+    uint oct;
+
+    if (i >= count)
+        return;
+
+    value = values[i];
+    oct = oct_encode(value.xyz);
+    results[i].bits = uvec4(oct, packHalf2x16(value.xy), packHalf2x16(value.zw), 0u);
+    results[i].decoded = vec4(oct_decode(oct), 0.0);
+}
@@ -0,0 +1,14 @@
+#version 450 core
+
+// The kernel of the sphere scenes (chapter7 .. plane), compiled behind the
+// scene's specialisation, which scene_specialize() writes and the loader
+// puts after the #version line: the spheres and planes as constants, a mask
+// of the material types present and the per scene quirks. Everything a
+// scene doesn't use is left out at compile time.
+
+#include "lib/common.glsl"
+#include "kernel/common.glsl"
+#include "lib/geometry.glsl"
+#include "kernel/geometry.glsl"
+#include "lib/materials.glsl"
+#include "kernel/trace.glsl"